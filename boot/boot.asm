@@ -44,6 +44,15 @@ header_start:
     dd 8                           ; Size
 header_end:
 
+; Store the TSC into boot_tsc[%1]. Indices are BOOT_TSC_* in boottrace.h.
+; Clobbers eax and edx; works in both 32-bit and 64-bit mode since the
+; image is linked below 4GB.
+%macro BOOT_TSC 1
+    rdtsc
+    mov [boot_tsc + %1 * 8], eax
+    mov [boot_tsc + %1 * 8 + 4], edx
+%endmacro
+
 section .bss
 align 16
 stack_bottom:
@@ -61,9 +70,10 @@ kernel_stack_top:
 section .text
 global _start
 _start:
-    ; Immediate debug to screen
-    mov edi, 0xb8000
-    mov word [edi], 0x4F53      ; 'S' in white on red (Start)
+    ; Timestamp entry before anything else; eax holds the loader magic
+    mov esi, eax
+    BOOT_TSC 0                  ; BOOT_TSC_ENTRY
+    mov eax, esi
     
     ; Disable interrupts and setup stack
     cli
@@ -73,8 +83,7 @@ _start:
     cmp eax, 0x36d76289
     jne .no_multiboot
     
-    ; Write multiboot OK marker
-    mov word [edi + 2], 0x4F4D  ; 'M'
+    BOOT_TSC 1                  ; BOOT_TSC_MULTIBOOT
     
     ; Save multiboot info pointer for later
     mov [multiboot_info], ebx
@@ -83,21 +92,18 @@ _start:
     call check_cpuid
     call check_long_mode
     
-    ; Write CPU OK marker
-    mov word [edi + 4], 0x4F43  ; 'C'
+    BOOT_TSC 2                  ; BOOT_TSC_CPUID
     
     ; Setup paging for long mode transition
     call setup_page_tables
     call enable_paging
     
-    ; Write paging OK marker
-    mov word [edi + 6], 0x4F50  ; 'P'
+    BOOT_TSC 3                  ; BOOT_TSC_PAGING
     
     ; Load GDT and transition to long mode
     lgdt [gdt64.pointer]
     
-    ; Write GDT loaded marker
-    mov word [edi + 8], 0x4F47  ; 'G'
+    BOOT_TSC 4                  ; BOOT_TSC_GDT
     
     jmp gdt64.code:long_mode_start
 
@@ -146,11 +152,12 @@ check_long_mode:
 
 ; Page Table Setup for Long Mode (32-bit mode)
 setup_page_tables:
-    ; Clear page tables
+    ; Clear the three tables used below (P4, P3, P2); everything past the
+    ; first 1GB is mapped later by vmem_init, only as far as RAM extends
     mov edi, 0x1000
     mov cr3, edi
     xor eax, eax
-    mov ecx, 4096
+    mov ecx, 3 * 1024
     rep stosd
     mov edi, cr3
     
@@ -184,9 +191,9 @@ enable_paging:
     or eax, 1 << 8
     wrmsr
     
-    ; Enable paging
+    ; Enable paging, with supervisor writes honouring read-only pages
     mov eax, cr0
-    or eax, 1 << 31
+    or eax, (1 << 31) | (1 << 16)
     mov cr0, eax
     ret
 
@@ -217,30 +224,21 @@ long_mode_start:
     ; Setup kernel stack
     mov rsp, kernel_stack_top
     
-    ; Write long mode OK marker
-    mov rdi, 0xb8000
-    mov word [rdi + 10], 0x4F4C    ; "L"
-    mov word [rdi + 12], 0x4F4F    ; "O"
-    mov word [rdi + 14], 0x4F4E    ; "N"
-    mov word [rdi + 16], 0x4F47    ; "G"
+    BOOT_TSC 5                     ; BOOT_TSC_LONG_MODE
     
     ; Get multiboot info from saved location
     mov edi, [multiboot_info]      ; Get saved multiboot info
     and rdi, 0xFFFFFFFF            ; Clear upper 32 bits
     
-    ; Write stage2 call marker
-    mov rsi, 0xb8000
-    mov word [rsi + 18], 0x4F32    ; "2" - Calling stage2
-    
     ; Call stage2_main with multiboot info
     extern stage2_main
     call stage2_main
     
     ; Should never return
     mov rsi, 0xb8000
-    mov word [rsi + 20], 0x4F52    ; "R" - Stage2 returned (error)
-    mov word [rsi + 22], 0x4F45    ; "E"
-    mov word [rsi + 24], 0x4F54    ; "T"
+    mov word [rsi], 0x4F52         ; "R" - Stage2 returned (error)
+    mov word [rsi + 2], 0x4F45     ; "E"
+    mov word [rsi + 4], 0x4F54     ; "T"
     
 .hang:
     cli
@@ -269,6 +267,11 @@ no_long_mode_msg: db "ERROR: Long mode not supported", 0
 ; Data section for multiboot info storage
 align 4
 multiboot_info: dd 0               ; Storage for multiboot info pointer
+
+; Early stage timestamps, read by boot_trace_report
+global boot_tsc
+align 8
+boot_tsc: times 6 dq 0             ; BOOT_TSC_STAGES
 _data_end:
 
 section .bss
@@ -0,0 +1,45 @@
+/*
+ * Power1 OS - Alternatives
+ * Point each function pointer at the best version this CPU supports
+ *
+ * Runs once from cpu_early_init, after feature detection and before any
+ * other CPU or task exists, so the pointers are simply stored.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/cpu.h"
+#include "../include/alternative.h"
+#include "../include/init.h"
+
+/**
+ * alternative_outranked - Whether a supported version ranks above @alt
+ */
+static bool __init alternative_outranked(const struct alternative *alt)
+{
+    for (const struct alternative *other = __alternatives_start;
+         other < __alternatives_end; other++) {
+        if (other->slot == alt->slot && other->rank > alt->rank &&
+            cpu_has_feature(other->feature)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * alternatives_apply - Select a version for every registered pointer
+ *
+ * Pointers with no supported alternative keep their generic version.
+ */
+void __init alternatives_apply(void)
+{
+    for (const struct alternative *alt = __alternatives_start;
+         alt < __alternatives_end; alt++) {
+        if (cpu_has_feature(alt->feature) && !alternative_outranked(alt)) {
+            *alt->slot = alt->impl;
+        }
+    }
+}
@@ -0,0 +1,201 @@
+/*
+ * Power1 OS - Boot Trace
+ * Time-to-ready measurement over the whole boot path
+ *
+ * Every stage from the first bootloader instruction to the start of init
+ * leaves a timestamp here: the assembly entry path fills boot_tsc[] and C
+ * code records marks and timed *_init calls. Recording is a TSC read and
+ * an array store, so it costs nothing measurable and needs no allocator
+ * or console. Once the kernel is up the events are sorted and printed
+ * as a timeline over serial, together with the time the firmware and
+ * loader spent before _start.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/cpu.h"
+#include "../include/serial.h"
+#include "../include/boottrace.h"
+
+static const char *const boot_tsc_names[BOOT_TSC_STAGES] = {
+    [BOOT_TSC_ENTRY]        = "entry",
+    [BOOT_TSC_MULTIBOOT]    = "multiboot",
+    [BOOT_TSC_CPUID]        = "cpuid",
+    [BOOT_TSC_PAGING]       = "paging",
+    [BOOT_TSC_GDT]          = "gdt",
+    [BOOT_TSC_LONG_MODE]    = "long_mode",
+};
+
+static struct boot_trace_entry boot_trace[BOOT_TRACE_MAX];
+static unsigned int boot_trace_count = 0;
+static unsigned int boot_trace_dropped = 0;
+
+/**
+ * boot_trace_add - Append one event, counting overflow instead of failing
+ */
+static struct boot_trace_entry *boot_trace_add(const char *name, uint64_t start)
+{
+    struct boot_trace_entry *entry;
+
+    if (boot_trace_count >= BOOT_TRACE_MAX) {
+        boot_trace_dropped++;
+        return NULL;
+    }
+
+    entry = &boot_trace[boot_trace_count++];
+    entry->name = name;
+    entry->start = start;
+    entry->end = 0;
+    return entry;
+}
+
+/**
+ * boot_trace_mark - Record that the boot reached a named point
+ */
+void boot_trace_mark(const char *name)
+{
+    boot_trace_add(name, cpu_read_tsc());
+}
+
+/**
+ * boot_trace_call - Run an initialisation function and record its duration
+ * @name: Timeline label, normally the function name
+ * @fn: Function returning KERNEL_SUCCESS or a negative error
+ *
+ * Returns whatever @fn returns.
+ */
+int boot_trace_call(const char *name, int (*fn)(void))
+{
+    struct boot_trace_entry *entry = boot_trace_add(name, cpu_read_tsc());
+    int ret = fn();
+
+    if (entry) {
+        entry->end = cpu_read_tsc();
+    }
+    return ret;
+}
+
+/**
+ * boot_trace_tsc_mhz - TSC frequency from CPUID, or 0 when not reported
+ */
+static uint64_t boot_trace_tsc_mhz(void)
+{
+    uint32_t max_leaf, eax, ebx, ecx, edx;
+
+    cpu_cpuid(0, 0, &max_leaf, &ebx, &ecx, &edx);
+
+    /* Leaf 0x15: TSC = crystal * ebx / eax */
+    if (max_leaf >= 0x15) {
+        cpu_cpuid(0x15, 0, &eax, &ebx, &ecx, &edx);
+        if (eax && ebx && ecx) {
+            return ((uint64_t)ecx * ebx / eax) / 1000000;
+        }
+    }
+
+    /* Leaf 0x16: base frequency in MHz, which the TSC runs at */
+    if (max_leaf >= 0x16) {
+        cpu_cpuid(0x16, 0, &eax, &ebx, &ecx, &edx);
+        if (eax & 0xFFFF) {
+            return eax & 0xFFFF;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * boot_trace_sort - Order events by start time
+ *
+ * Insertion sort: the table is small and already almost in order, since
+ * only the assembly stages are collected out of sequence.
+ */
+static void boot_trace_sort(struct boot_trace_entry *entries, unsigned int count)
+{
+    for (unsigned int i = 1; i < count; i++) {
+        struct boot_trace_entry key = entries[i];
+        unsigned int j = i;
+
+        while (j > 0 && entries[j - 1].start > key.start) {
+            entries[j] = entries[j - 1];
+            j--;
+        }
+        entries[j] = key;
+    }
+}
+
+/**
+ * boot_trace_report - Print the sorted boot timeline over serial
+ *
+ * Offsets are relative to _start. A point mark lasts until the next event;
+ * a timed call lasts until its function returned. Times are in
+ * microseconds when CPUID reports the TSC frequency, otherwise in cycles.
+ */
+void boot_trace_report(void)
+{
+    static struct boot_trace_entry timeline[BOOT_TSC_STAGES + BOOT_TRACE_MAX];
+    unsigned int count = 0;
+    uint64_t mhz, base, now;
+
+    now = cpu_read_tsc();
+    if (serial_init() != KERNEL_SUCCESS) {
+        return;
+    }
+
+    for (unsigned int i = 0; i < BOOT_TSC_STAGES; i++) {
+        if (boot_tsc[i]) {
+            timeline[count].name = boot_tsc_names[i];
+            timeline[count].start = boot_tsc[i];
+            timeline[count].end = 0;
+            count++;
+        }
+    }
+    for (unsigned int i = 0; i < boot_trace_count; i++) {
+        timeline[count++] = boot_trace[i];
+    }
+    if (!count) {
+        return;
+    }
+
+    boot_trace_sort(timeline, count);
+    base = timeline[0].start;
+    mhz = boot_trace_tsc_mhz();
+
+    serial_write("\nBoot timeline (");
+    serial_write(mhz ? "us" : "TSC cycles");
+    serial_write(")\n     offset   duration  stage\n");
+
+    for (unsigned int i = 0; i < count; i++) {
+        uint64_t end = timeline[i].end;
+        uint64_t offset = timeline[i].start - base;
+        uint64_t duration;
+
+        if (!end) {
+            end = (i + 1 < count) ? timeline[i + 1].start : now;
+        }
+        duration = end - timeline[i].start;
+        if (mhz) {
+            offset /= mhz;
+            duration /= mhz;
+        }
+
+        serial_write_u64(offset, 11);
+        serial_write_u64(duration, 11);
+        serial_write("  ");
+        serial_write(timeline[i].name);
+        serial_putc('\n');
+    }
+
+    serial_write("Firmware and loader: ");
+    serial_write_u64(mhz ? boot_tsc[BOOT_TSC_ENTRY] / mhz : boot_tsc[BOOT_TSC_ENTRY], 0);
+    serial_write("\nTime to ready:       ");
+    serial_write_u64(mhz ? (now - base) / mhz : now - base, 0);
+    serial_putc('\n');
+
+    if (boot_trace_dropped) {
+        serial_write("Events dropped:      ");
+        serial_write_u64(boot_trace_dropped, 0);
+        serial_putc('\n');
+    }
+}
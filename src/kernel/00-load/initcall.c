@@ -0,0 +1,283 @@
+/*
+ * Power1 OS - Initcalls
+ * Dependency-ordered subsystem initialisation
+ *
+ * Subsystems register in the .initcall section instead of being listed in
+ * kernel_main, so adding one no longer means editing a fixed serial chain.
+ * The table is resolved once into index lists; after that each pass starts
+ * every entry whose dependencies have finished, in link order. Entries
+ * marked INITCALL_ASYNC run in kernel threads once the process manager is
+ * up, so independent device probes sleep on their I/O at the same time
+ * instead of one after another. Threads run on the boot CPU; nothing here
+ * depends on which CPU an initcall runs on.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/string.h"
+#include "../include/process.h"
+#include "../include/boottrace.h"
+#include "../include/cpuidle.h"
+#include "../include/init.h"
+
+enum initcall_state {
+    INITCALL_PENDING,
+    INITCALL_RUNNING,
+    INITCALL_DONE,
+};
+
+struct initcall_slot {
+    const struct initcall *call;
+    enum initcall_state state;
+    int result;
+    int64_t pid;                /* Thread running it, while RUNNING */
+    uint8_t nr_deps;
+    uint8_t deps[INITCALL_MAX_DEPS];
+};
+
+static struct initcall_slot initcall_slots[INITCALL_MAX] __initdata;
+static unsigned int initcall_count __initdata;
+static char initcall_failure[64] __initdata;
+
+/**
+ * initcall_find - Table index of the initcall named by @name[0..len)
+ */
+static int __init initcall_find(const char *name, size_t len)
+{
+    for (unsigned int i = 0; i < initcall_count; i++) {
+        const char *candidate = initcall_slots[i].call->name;
+        if (strlen(candidate) == len && !memcmp(candidate, name, len)) {
+            return (int)i;
+        }
+    }
+    return KERNEL_ERROR_NOTFOUND;
+}
+
+/**
+ * initcall_resolve - Turn each dependency string into table indices
+ */
+static int __init initcall_resolve(void)
+{
+    const struct initcall *call;
+
+    initcall_count = 0;
+    for (call = __initcall_start; call < __initcall_end; call++) {
+        if (initcall_count >= INITCALL_MAX) {
+            return KERNEL_ERROR_NOSPC;
+        }
+        initcall_slots[initcall_count].call = call;
+        initcall_slots[initcall_count].state = INITCALL_PENDING;
+        initcall_slots[initcall_count].nr_deps = 0;
+        initcall_count++;
+    }
+
+    for (unsigned int i = 0; i < initcall_count; i++) {
+        struct initcall_slot *slot = &initcall_slots[i];
+        const char *p = slot->call->deps;
+
+        while (*p) {
+            while (*p == ',' || *p == ' ') {
+                p++;
+            }
+            const char *start = p;
+            while (*p && *p != ',' && *p != ' ') {
+                p++;
+            }
+            if (p == start) {
+                break;
+            }
+
+            int dep = initcall_find(start, (size_t)(p - start));
+            if (dep < 0 || slot->nr_deps >= INITCALL_MAX_DEPS) {
+                return KERNEL_ERROR_INVALID;
+            }
+            slot->deps[slot->nr_deps++] = (uint8_t)dep;
+        }
+    }
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * initcall_ready - Whether every dependency of @slot has finished
+ */
+static bool __init initcall_ready(const struct initcall_slot *slot)
+{
+    for (unsigned int d = 0; d < slot->nr_deps; d++) {
+        if (initcall_slots[slot->deps[d]].state != INITCALL_DONE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * initcall_thread - Kernel thread body for an asynchronous initcall
+ *
+ * The return value becomes the thread's exit code, which initcalls_run
+ * collects when it reaps the thread.
+ */
+static int __init initcall_thread(void *arg)
+{
+    const struct initcall *call = arg;
+    return boot_trace_call(call->name, call->fn);
+}
+
+/**
+ * initcall_finish - Record a result, failing the boot unless it is optional
+ */
+static int __init initcall_finish(struct initcall_slot *slot, int result)
+{
+    slot->state = INITCALL_DONE;
+    slot->result = result;
+
+    if (result != KERNEL_SUCCESS && !(slot->call->flags & INITCALL_OPTIONAL)) {
+        size_t len = MIN(strlen(slot->call->name), sizeof(initcall_failure) - 8);
+        memcpy(initcall_failure, slot->call->name, len);
+        strcpy(initcall_failure + len, " failed");
+        return result;
+    }
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * initcall_reap - Collect asynchronous initcalls that have finished
+ *
+ * Returns the number collected, or a negative error from a required one.
+ */
+static int __init initcall_reap(void)
+{
+    int reaped = 0;
+
+    for (unsigned int i = 0; i < initcall_count; i++) {
+        struct initcall_slot *slot = &initcall_slots[i];
+        int status;
+
+        if (slot->state != INITCALL_RUNNING ||
+            process_wait(slot->pid, &status, WNOHANG) <= 0) {
+            continue;
+        }
+
+        int ret = initcall_finish(slot, status);
+        if (ret != KERNEL_SUCCESS) {
+            return ret;
+        }
+        reaped++;
+    }
+    return reaped;
+}
+
+/**
+ * initcall_start - Run @slot inline, or start its thread when allowed
+ *
+ * Threads need the process manager; until it is up, asynchronous
+ * initcalls run inline like the others.
+ */
+static int __init initcall_start(struct initcall_slot *slot)
+{
+    if ((slot->call->flags & INITCALL_ASYNC) && current_task) {
+        struct task *task = kthread_create(slot->call->name, initcall_thread,
+                                           (void *)slot->call);
+        if (task) {
+            slot->state = INITCALL_RUNNING;
+            slot->pid = task->pid;
+            return KERNEL_SUCCESS;
+        }
+    }
+
+    slot->state = INITCALL_RUNNING;
+    return initcall_finish(slot, boot_trace_call(slot->call->name, slot->call->fn));
+}
+
+/**
+ * initcalls_run - Run every registered initcall in dependency order
+ *
+ * Returns KERNEL_SUCCESS, or the error of the first required initcall to
+ * fail; kernel_panic is then given initcall_failure. A dependency cycle or
+ * an unknown dependency name is reported as KERNEL_ERROR_INVALID.
+ */
+int __init initcalls_run(void)
+{
+    unsigned int finished = 0;
+    int ret;
+
+    ret = initcall_resolve();
+    if (ret != KERNEL_SUCCESS) {
+        strcpy(initcall_failure, "initcall table invalid");
+        return ret;
+    }
+
+    while (finished < initcall_count) {
+        bool started = false;
+        bool spawned = false;
+
+        /* Start everything that is ready, in link order */
+        for (unsigned int i = 0; i < initcall_count; i++) {
+            struct initcall_slot *slot = &initcall_slots[i];
+
+            if (slot->state != INITCALL_PENDING || !initcall_ready(slot)) {
+                continue;
+            }
+
+            ret = initcall_start(slot);
+            if (ret != KERNEL_SUCCESS) {
+                return ret;
+            }
+            started = true;
+            if (slot->state == INITCALL_DONE) {
+                finished++;
+            } else {
+                spawned = true;
+            }
+        }
+
+        /* Let new threads reach their first wait before going on */
+        if (spawned) {
+            schedule();
+        }
+
+        ret = initcall_reap();
+        if (ret < 0) {
+            return ret;
+        }
+        finished += (unsigned int)ret;
+
+        if (started || ret > 0) {
+            continue;
+        }
+
+        bool running = false;
+        for (unsigned int i = 0; i < initcall_count; i++) {
+            if (initcall_slots[i].state == INITCALL_RUNNING) {
+                running = true;
+                break;
+            }
+        }
+        if (!running) {
+            strcpy(initcall_failure, "initcall dependency cycle");
+            return KERNEL_ERROR_INVALID;
+        }
+
+        /* Nothing can start until a thread finishes; idle like the scheduler */
+        schedule();
+        ret = initcall_reap();
+        if (ret < 0) {
+            return ret;
+        }
+        finished += (unsigned int)ret;
+        if (ret == 0) {
+            cpu_idle();
+        }
+    }
+
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * initcall_failure_message - What initcalls_run failed on, for kernel_panic
+ */
+const char *initcall_failure_message(void)
+{
+    return initcall_failure;
+}
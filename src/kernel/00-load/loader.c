@@ -8,7 +8,11 @@
 #include "../include/stddef.h"
 #include "../include/stdbool.h"
 #include "../include/kernel.h"
+#include "../include/cpu.h"
+#include "../include/fpu.h"
+#include "../include/alternative.h"
 #include "../include/multiboot2.h"
+#include "../include/boottrace.h"
 
 /* Early kernel stack */
 extern uint8_t kernel_stack_top[];
@@ -19,6 +23,9 @@ static struct multiboot_info *mb_info = NULL;
 /* Kernel early state */
 struct kernel_early_state kernel_state = {0};
 
+/* Memory map - no allocator exists yet, so it is a static array */
+static struct memory_region memory_map[MEMORY_MAP_MAX];
+
 /* Early VGA console implementation */
 static volatile uint16_t *vga_buffer = (volatile uint16_t *)VGA_BUFFER_ADDR;
 static size_t terminal_row = 0;
@@ -38,7 +45,6 @@ static struct console_ops early_console = {
 struct console_ops *current_console = &early_console;
 
 /* Forward declarations */
-static int parse_multiboot_info(struct multiboot_info *info);
 static void parse_memory_map_tag(struct multiboot_tag *tag);
 
 /**
@@ -100,66 +106,125 @@ static void early_console_set_color(uint8_t fg, uint8_t bg)
 void early_memory_init(void *mb_info_ptr)
 {
     struct multiboot_info *info = (struct multiboot_info *)mb_info_ptr;
-    struct multiboot_tag *tag;
     
     kernel_state.mb_info = info;
+    kernel_state.memory_map = memory_map;
+    kernel_state.memory_map_count = 0;
     kernel_state.total_memory = 0;
     kernel_state.available_memory = 0;
     
-    /* Parse multiboot tags for memory information */
-    for (tag = (struct multiboot_tag *)(info + 1);
-         tag->type != MULTIBOOT_TAG_TYPE_END;
-         tag = (struct multiboot_tag *)((uint8_t *)tag + ((tag->size + 7) & ~7))) {
-        
-        if (tag->type == MULTIBOOT_TAG_TYPE_MEMORY) {
-            parse_memory_map_tag(tag);
-        }
+    /* The one walk of the tag list; everything later uses the index */
+    if (multiboot2_parse_info(info) != KERNEL_SUCCESS) {
+        return;
     }
+    parse_memory_map_tag(multiboot2_find_tag(info, MULTIBOOT_TAG_TYPE_MMAP));
     
     kernel_state.memory_initialized = true;
 }
 
 /**
- * cpu_early_init - Initialize early CPU features
+ * cpu_early_init - Detect CPU features and select code for them
+ *
+ * Runs before anything else so every later subsystem can ask
+ * cpu_has_feature and already calls the selected alternatives. CR0.WP
+ * makes kernel stores honour read-only user PTEs, so a copy into a
+ * copy-on-write page faults and gets its own frame instead of writing
+ * through to the shared one.
  */
 void cpu_early_init(void)
 {
-    /* Enable SSE if available */
-    uint32_t eax, ebx, ecx, edx;
-    __asm__ volatile ("cpuid"
-                      : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
-                      : "a" (1));
-    
-    if (edx & (1 << 25)) { /* SSE support */
-        uint64_t cr0, cr4;
-        __asm__ volatile ("mov %%cr0, %0" : "=r" (cr0));
-        __asm__ volatile ("mov %%cr4, %0" : "=r" (cr4));
-        
-        cr0 &= ~(1UL << 2);  /* Clear EM */
-        cr0 |= (1UL << 1);   /* Set MP */
-        cr4 |= (1UL << 9);   /* Set OSFXSR */
-        cr4 |= (1UL << 10);  /* Set OSXMMEXCPT */
-        
-        __asm__ volatile ("mov %0, %%cr0" :: "r" (cr0) : "memory");
-        __asm__ volatile ("mov %0, %%cr4" :: "r" (cr4) : "memory");
+    cpu_write_cr0(cpu_read_cr0() | CR0_WP);
+    cpu_detect_features();
+    cpu_enable_sse();
+    fpu_xstate_init();
+    alternatives_apply();
+}
+
+/**
+ * memory_map_insert - Add a region, keeping the map sorted by base address
+ */
+static void memory_map_insert(uint64_t base, uint64_t length, uint32_t type)
+{
+    size_t i = kernel_state.memory_map_count;
+
+    if (!length || i >= MEMORY_MAP_MAX) {
+        return;
+    }
+
+    /* Firmware maps are nearly sorted, so this rarely moves anything */
+    while (i > 0 && memory_map[i - 1].base_addr > base) {
+        memory_map[i] = memory_map[i - 1];
+        i--;
+    }
+    memory_map[i].base_addr = base;
+    memory_map[i].length = length;
+    memory_map[i].type = type;
+    kernel_state.memory_map_count++;
+}
+
+/**
+ * memory_map_coalesce - Merge touching regions and resolve overlaps
+ *
+ * Adjacent or overlapping regions of one type become a single region.
+ * Where types disagree the reserved type wins, so memory is never handed
+ * out because firmware listed it twice.
+ */
+static void memory_map_coalesce(void)
+{
+    size_t out = 0;
+
+    for (size_t i = 0; i < kernel_state.memory_map_count; i++) {
+        struct memory_region region = memory_map[i];
+        uint64_t end = region.base_addr + region.length;
+
+        if (out > 0) {
+            struct memory_region *prev = &memory_map[out - 1];
+            uint64_t prev_end = prev->base_addr + prev->length;
+
+            if (region.base_addr <= prev_end && region.type == prev->type) {
+                prev->length = MAX(prev_end, end) - prev->base_addr;
+                continue;
+            }
+            if (region.base_addr < prev_end) {
+                if (region.type == MULTIBOOT_MEMORY_AVAILABLE) {
+                    /* Keep only what lies past the reserved region */
+                    if (end <= prev_end) {
+                        continue;
+                    }
+                    region.base_addr = prev_end;
+                    region.length = end - prev_end;
+                } else if (prev->type == MULTIBOOT_MEMORY_AVAILABLE) {
+                    /* Any available tail past the reserved region is dropped */
+                    prev->length = region.base_addr - prev->base_addr;
+                    if (!prev->length) {
+                        out--;
+                    }
+                }
+            }
+        }
+        memory_map[out++] = region;
     }
+
+    kernel_state.memory_map_count = out;
 }
 
 /**
- * parse_memory_map_tag - Parse multiboot memory map
+ * parse_memory_map_tag - Build the sorted memory map from the mmap tag
  */
 static void parse_memory_map_tag(struct multiboot_tag *tag)
 {
-    if (!tag || tag->size < 16) {
+    if (!tag || tag->size < sizeof(struct multiboot_tag_mmap)) {
         return;
     }
     
-    /* Simple memory map parsing - avoid complex structures */
     struct multiboot_tag_mmap *mmap_tag = (struct multiboot_tag_mmap *)tag;
-    
     uint8_t *entry_ptr = (uint8_t *)(mmap_tag + 1);
     uint8_t *tag_end = (uint8_t *)tag + tag->size;
     
+    if (mmap_tag->entry_size < sizeof(struct multiboot_mmap_entry)) {
+        return;
+    }
+    
     while (entry_ptr + mmap_tag->entry_size <= tag_end) {
         struct multiboot_mmap_entry *entry = (struct multiboot_mmap_entry *)entry_ptr;
         
@@ -167,9 +232,12 @@ static void parse_memory_map_tag(struct multiboot_tag *tag)
         if (entry->type == MULTIBOOT_MEMORY_AVAILABLE) {
             kernel_state.available_memory += entry->len;
         }
+        memory_map_insert(entry->addr, entry->len, entry->type);
         
         entry_ptr += mmap_tag->entry_size;
     }
+    
+    memory_map_coalesce();
 }
 
 /**
@@ -178,38 +246,21 @@ static void parse_memory_map_tag(struct multiboot_tag *tag)
  */
 void stage2_main(uint64_t mb_info_addr)
 {
-    /* Write immediate debug markers to VGA */
-    volatile uint16_t *vga = (volatile uint16_t *)0xB8000;
+    boot_trace_mark("stage2");
     
-    /* Clear screen completely first */
-    for (int i = 0; i < 80*25; i++) {
-        vga[i] = 0x0F20; /* Space in white on black */
-    }
-    
-    /* Write debug progression */
-    vga[0] = 0x4F53; /* 'S' in white on red - Stage2 start */
-    vga[1] = 0x4F54; /* 'T' */
-    vga[2] = 0x4F41; /* 'A' */
-    vga[3] = 0x4F47; /* 'G' */
-    vga[4] = 0x4F45; /* 'E' */
-    vga[5] = 0x4F32; /* '2' */
+    /* Features first: alternatives decide which code everything else runs */
+    cpu_early_init();
     
     /* Save multiboot info */
     mb_info = (struct multiboot_info *)mb_info_addr;
     
-    /* Write calling kernel marker */
-    vga[80] = 0x2F43; /* 'C' in green - Calling kernel */
-    vga[81] = 0x2F41; /* 'A' */
-    vga[82] = 0x2F4C; /* 'L' */
-    vga[83] = 0x2F4C; /* 'L' */
+    /* Record the memory map for memory_manager_init */
+    early_memory_init(mb_info);
     
     /* Jump directly to main kernel without complex initialization */
     kernel_main();
     
     /* Should never reach here */
-    vga[160] = 0x4F45; /* 'E' in white on red - Error */
-    vga[161] = 0x4F52; /* 'R' */
-    vga[162] = 0x4F52; /* 'R' */
     kernel_panic("Kernel main returned");
 }
 
@@ -219,42 +270,8 @@ void stage2_main(uint64_t mb_info_addr)
 void kernel_entry(void)
 {
     /* Direct kernel entry without multiboot */
+    cpu_early_init();
     early_console_init();
     kernel_main();
     kernel_panic("Kernel main returned");
 }
-
-/**
- * parse_multiboot_info - Parse multiboot2 information structure
- */
-static int parse_multiboot_info(struct multiboot_info *info)
-{
-    struct multiboot_tag *tag;
-    
-    if (info->total_size < 8) {
-        return -1;
-    }
-    
-    /* Iterate through multiboot tags */
-    for (tag = (struct multiboot_tag *)(info + 1);
-         tag->type != MULTIBOOT_TAG_TYPE_END;
-         tag = (struct multiboot_tag *)((uint8_t *)tag + ((tag->size + 7) & ~7))) {
-        
-        switch (tag->type) {
-        case MULTIBOOT_TAG_TYPE_MEMORY:
-            /* Handle memory map */
-            break;
-        case MULTIBOOT_TAG_TYPE_BOOTDEV:
-            /* Handle boot device info */
-            break;
-        case MULTIBOOT_TAG_TYPE_CMDLINE:
-            /* Handle command line */
-            break;
-        case MULTIBOOT_TAG_TYPE_MODULE:
-            /* Handle loaded modules */
-            break;
-        }
-    }
-    
-    return 0;
-}
@@ -0,0 +1,103 @@
+/*
+ * Power1 OS - Multiboot2 Tag Index
+ * One walk of the boot information, shared by every consumer
+ *
+ * The loader, the physical allocator, ACPI and the boot module file
+ * system all need tags from the same list. Rather than each walking it,
+ * multiboot2_parse_info records every tag once and groups them by type,
+ * so a lookup is an index into a small array.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/multiboot2.h"
+
+static struct multiboot_tag_index tag_index;
+
+/**
+ * multiboot2_parse_info - Index every tag of @info by type
+ *
+ * Tags keep their list order within a type. Returns KERNEL_ERROR_INVALID
+ * for a malformed list; tags beyond MULTIBOOT_TAG_INDEX_MAX or of unknown
+ * type are skipped.
+ */
+int multiboot2_parse_info(struct multiboot_info *info)
+{
+    struct multiboot_tag *found[MULTIBOOT_TAG_INDEX_MAX];
+    struct multiboot_tag *tag;
+    uint8_t *end;
+    size_t total = 0;
+
+    tag_index.info = NULL;
+    for (uint32_t type = 0; type < MULTIBOOT_TAG_TYPE_COUNT; type++) {
+        tag_index.first[type] = 0;
+        tag_index.count[type] = 0;
+    }
+
+    if (!info || info->total_size < sizeof(*info) + sizeof(*tag)) {
+        return KERNEL_ERROR_INVALID;
+    }
+    end = (uint8_t *)info + info->total_size;
+
+    for (tag = (struct multiboot_tag *)(info + 1);
+         (uint8_t *)(tag + 1) <= end && tag->type != MULTIBOOT_TAG_TYPE_END;
+         tag = (struct multiboot_tag *)((uint8_t *)tag + ((tag->size + 7) & ~7))) {
+
+        if (tag->size < sizeof(*tag)) {
+            return KERNEL_ERROR_INVALID;
+        }
+        if (tag->type < MULTIBOOT_TAG_TYPE_COUNT && total < MULTIBOOT_TAG_INDEX_MAX) {
+            found[total++] = tag;
+            tag_index.count[tag->type]++;
+        }
+    }
+
+    /* Counting sort by type; stable, so list order survives within a type */
+    uint8_t next[MULTIBOOT_TAG_TYPE_COUNT];
+    uint8_t offset = 0;
+    for (uint32_t type = 0; type < MULTIBOOT_TAG_TYPE_COUNT; type++) {
+        tag_index.first[type] = offset;
+        next[type] = offset;
+        offset += tag_index.count[type];
+    }
+    for (size_t i = 0; i < total; i++) {
+        tag_index.tags[next[found[i]->type]++] = found[i];
+    }
+
+    tag_index.info = info;
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * multiboot2_find_tags - Every indexed tag of @type, in list order
+ * @count: Receives the number of tags
+ */
+struct multiboot_tag *const *multiboot2_find_tags(uint32_t type, size_t *count)
+{
+    if (!tag_index.info || type >= MULTIBOOT_TAG_TYPE_COUNT) {
+        *count = 0;
+        return NULL;
+    }
+
+    *count = tag_index.count[type];
+    return &tag_index.tags[tag_index.first[type]];
+}
+
+/**
+ * multiboot2_find_tag - First tag of @type in @info, or NULL
+ *
+ * @info is indexed on first use, so this works before early_memory_init.
+ */
+struct multiboot_tag *multiboot2_find_tag(struct multiboot_info *info, uint32_t type)
+{
+    size_t count;
+
+    if (info != tag_index.info && multiboot2_parse_info(info) != KERNEL_SUCCESS) {
+        return NULL;
+    }
+
+    struct multiboot_tag *const *tags = multiboot2_find_tags(type, &count);
+    return count ? tags[0] : NULL;
+}
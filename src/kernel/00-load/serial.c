@@ -0,0 +1,111 @@
+/*
+ * Power1 OS - Serial Port
+ * Polled 16550 output on COM1
+ *
+ * Output is polled so it works before interrupts are set up. A port that
+ * fails the loopback check is treated as absent and writes are dropped,
+ * since spinning on a line status register that never changes would hang
+ * the boot on machines without a UART.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/io.h"
+#include "../include/serial.h"
+
+/* Bound on transmit-ready polling so a stuck UART cannot stall the kernel */
+#define SERIAL_TX_SPINS         100000
+
+static bool serial_ready = false;
+
+/**
+ * serial_init - Program COM1 for 115200 8N1 and verify it responds
+ */
+int serial_init(void)
+{
+    uint16_t port = SERIAL_COM1;
+
+    if (serial_ready) {
+        return KERNEL_SUCCESS;
+    }
+
+    outb(port + SERIAL_IER, 0x00);
+    outb(port + SERIAL_LCR, SERIAL_LCR_DLAB);
+    outb(port + SERIAL_DATA, SERIAL_BAUD_DIVISOR & 0xFF);
+    outb(port + SERIAL_IER, (SERIAL_BAUD_DIVISOR >> 8) & 0xFF);
+    outb(port + SERIAL_LCR, SERIAL_LCR_8N1);
+    outb(port + SERIAL_FCR, SERIAL_FCR_ENABLE);
+
+    /* Echo a byte through loopback to confirm the UART exists */
+    outb(port + SERIAL_MCR, SERIAL_MCR_LOOPBACK);
+    outb(port + SERIAL_DATA, 0xAE);
+    if (inb(port + SERIAL_DATA) != 0xAE) {
+        return KERNEL_ERROR_NOTFOUND;
+    }
+
+    outb(port + SERIAL_MCR, SERIAL_MCR_NORMAL);
+    serial_ready = true;
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * serial_present - Whether serial_init found a working UART
+ */
+bool serial_present(void)
+{
+    return serial_ready;
+}
+
+/**
+ * serial_putc - Transmit one character, expanding \n to \r\n
+ */
+void serial_putc(char c)
+{
+    if (!serial_ready) {
+        return;
+    }
+
+    if (c == '\n') {
+        serial_putc('\r');
+    }
+
+    for (int spins = 0; spins < SERIAL_TX_SPINS; spins++) {
+        if (inb(SERIAL_COM1 + SERIAL_LSR) & SERIAL_LSR_THRE) {
+            break;
+        }
+    }
+    outb(SERIAL_COM1 + SERIAL_DATA, (uint8_t)c);
+}
+
+/**
+ * serial_write - Transmit a NUL-terminated string
+ */
+void serial_write(const char *str)
+{
+    while (*str) {
+        serial_putc(*str++);
+    }
+}
+
+/**
+ * serial_write_u64 - Transmit a decimal number right-aligned in @width columns
+ */
+void serial_write_u64(uint64_t value, int width)
+{
+    char buffer[24];
+    int len = 0;
+
+    do {
+        buffer[len++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+
+    while (width-- > len) {
+        serial_putc(' ');
+    }
+    while (len) {
+        serial_putc(buffer[--len]);
+    }
+}
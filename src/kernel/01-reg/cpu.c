@@ -0,0 +1,153 @@
+/*
+ * Power1 OS - CPU Register Management
+ * Model specific register access, feature detection and FPU enabling
+ *
+ * CPUID is read once, early, into boot_cpu_info; everything after that
+ * asks cpu_has_feature instead of executing CPUID again. Features the
+ * kernel cannot use, such as AVX without XSAVE enabled, are cleared once
+ * the FPU is set up, so a set bit always means usable.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/string.h"
+#include "../include/cpu.h"
+
+/**
+ * cpu_read_msr - Read a model specific register
+ */
+uint64_t cpu_read_msr(uint32_t msr)
+{
+    uint32_t low, high;
+    __asm__ volatile ("rdmsr" : "=a" (low), "=d" (high) : "c" (msr));
+    return ((uint64_t)high << 32) | low;
+}
+
+/**
+ * cpu_write_msr - Write a model specific register
+ */
+void cpu_write_msr(uint32_t msr, uint64_t value)
+{
+    __asm__ volatile ("wrmsr" :: "c" (msr),
+                      "a" ((uint32_t)value), "d" ((uint32_t)(value >> 32)));
+}
+
+static struct cpu_info boot_cpu_info;
+
+/**
+ * cpu_detect_features - Read vendor, model and feature leaves into boot_cpu_info
+ *
+ * Covers leaves 1, 7 and 0x80000001, the XSAVE variants of leaf 0xD and
+ * the brand string.
+ */
+void cpu_detect_features(void)
+{
+    struct cpu_info *info = &boot_cpu_info;
+    uint32_t *features = info->features;
+    uint32_t eax, ebx, ecx, edx;
+
+    memset(info, 0, sizeof(*info));
+
+    cpu_cpuid(0, 0, &info->max_leaf, &info->vendor_id[0], &info->vendor_id[2], &info->vendor_id[1]);
+
+    cpu_cpuid(1, 0, &eax, &ebx, &features[CPUID_1_ECX], &features[CPUID_1_EDX]);
+    info->family = (eax >> 8) & 0xF;
+    info->model = (eax >> 4) & 0xF;
+    info->stepping = eax & 0xF;
+    if (info->family == 0xF) {
+        info->family += (eax >> 20) & 0xFF;
+    }
+    if (info->family == 0x6 || info->family >= 0xF) {
+        info->model |= ((eax >> 16) & 0xF) << 4;
+    }
+
+    if (info->max_leaf >= 7) {
+        cpu_cpuid(7, 0, &eax, &features[CPUID_7_EBX], &features[CPUID_7_ECX], &features[CPUID_7_EDX]);
+    }
+    if (info->max_leaf >= 0xD) {
+        cpu_cpuid(0xD, 1, &features[CPUID_D_1_EAX], &ebx, &ecx, &edx);
+    }
+
+    cpu_cpuid(0x80000000, 0, &info->max_ext_leaf, &ebx, &ecx, &edx);
+    if (info->max_ext_leaf >= 0x80000001) {
+        cpu_cpuid(0x80000001, 0, &eax, &ebx,
+                  &features[CPUID_80000001_ECX], &features[CPUID_80000001_EDX]);
+    }
+    if (info->max_ext_leaf >= 0x80000004) {
+        for (uint32_t i = 0; i < 3; i++) {
+            uint32_t *regs = &info->brand_string[i * 4];
+            cpu_cpuid(0x80000002 + i, 0, &regs[0], &regs[1], &regs[2], &regs[3]);
+        }
+    }
+}
+
+/**
+ * cpu_has_feature - Whether X86_FEATURE_* @feature is present and usable
+ */
+bool cpu_has_feature(uint32_t feature)
+{
+    if (feature >= CPU_FEATURE_WORDS * 32) {
+        return false;
+    }
+    return (boot_cpu_info.features[feature / 32] >> (feature % 32)) & 1;
+}
+
+/**
+ * cpu_clear_feature - Mark @feature unusable
+ */
+void cpu_clear_feature(uint32_t feature)
+{
+    if (feature < CPU_FEATURE_WORDS * 32) {
+        boot_cpu_info.features[feature / 32] &= ~(1U << (feature % 32));
+    }
+}
+
+/**
+ * cpu_get_info - Copy out what cpu_detect_features found
+ */
+void cpu_get_info(struct cpu_info *info)
+{
+    *info = boot_cpu_info;
+}
+
+/**
+ * cpu_enable_sse - Let SSE and, with XSAVE, AVX instructions execute
+ *
+ * XCR0 enables x87, SSE and, where present, AVX state. Features whose
+ * state stays disabled are cleared.
+ */
+void cpu_enable_sse(void)
+{
+    uint64_t xcr0 = 0;
+
+    cpu_write_cr0((cpu_read_cr0() & ~CR0_EM) | CR0_MP);
+    uint64_t cr4 = cpu_read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT;
+
+    if (cpu_has_feature(X86_FEATURE_XSAVE)) {
+        cpu_write_cr4(cr4 | CR4_OSXSAVE);
+        xcr0 = XFEATURE_X87 | XFEATURE_SSE;
+        if (cpu_has_feature(X86_FEATURE_AVX)) {
+            xcr0 |= XFEATURE_YMM;
+        }
+        cpu_xsetbv(0, xcr0);
+        boot_cpu_info.features[CPUID_1_ECX] |= 1U << (X86_FEATURE_OSXSAVE % 32);
+    } else {
+        cpu_write_cr4(cr4);
+        cpu_clear_feature(X86_FEATURE_XSAVEOPT);
+        cpu_clear_feature(X86_FEATURE_XSAVEC);
+    }
+
+    if (!(xcr0 & XFEATURE_YMM)) {
+        cpu_clear_feature(X86_FEATURE_AVX);
+        cpu_clear_feature(X86_FEATURE_AVX2);
+        cpu_clear_feature(X86_FEATURE_VPCLMULQDQ);
+    }
+
+    /* Opmask and ZMM state are not enabled */
+    cpu_clear_feature(X86_FEATURE_AVX512F);
+
+    /* Supervisor state components are not managed */
+    cpu_clear_feature(X86_FEATURE_XSAVES);
+}
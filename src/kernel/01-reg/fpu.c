@@ -0,0 +1,257 @@
+/*
+ * Power1 OS - FPU and Extended State
+ * Lazy FPU switching, kernel FPU regions and the XSAVE variants
+ *
+ * XSAVEOPT skips components the CPU knows are unchanged since the last
+ * XRSTOR from the same area, and XSAVEC also leaves out components in
+ * their initial state, which makes the area smaller. XRSTOR reads either
+ * format, so one restore serves every XSAVE variant.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/cpu.h"
+#include "../include/memory.h"
+#include "../include/string.h"
+#include "../include/interrupts.h"
+#include "../include/process.h"
+#include "../include/alternative.h"
+#include "../include/fpu.h"
+#include "../include/init.h"
+
+#define CPUID_XSTATE_LEAF       0xD
+#define FXSAVE_MXCSR_OFFSET     24
+
+struct fpu_cpu {
+    struct task *owner;         /* Task whose user state is in the registers */
+    bool ts;                    /* CR0.TS as last written */
+} __attribute__((aligned(64)));
+
+static struct fpu_cpu fpu_cpus[CPU_MAX];
+static const uint32_t fpu_mxcsr_default = FPU_MXCSR_DEFAULT;
+
+uint32_t fpu_xstate_size = FPU_FXSAVE_SIZE;
+
+static void fpu_save_fxsave(void *area)
+{
+    __asm__ volatile ("fxsave64 (%0)" :: "r" (area) : "memory");
+}
+
+static void fpu_save_xsave(void *area)
+{
+    __asm__ volatile ("xsave64 (%0)" :: "r" (area), "a" (-1), "d" (-1) : "memory");
+}
+
+static void fpu_save_xsaveopt(void *area)
+{
+    __asm__ volatile ("xsaveopt64 (%0)" :: "r" (area), "a" (-1), "d" (-1) : "memory");
+}
+
+static void fpu_save_xsavec(void *area)
+{
+    __asm__ volatile ("xsavec64 (%0)" :: "r" (area), "a" (-1), "d" (-1) : "memory");
+}
+
+static void fpu_restore_fxrstor(const void *area)
+{
+    __asm__ volatile ("fxrstor64 (%0)" :: "r" (area) : "memory");
+}
+
+static void fpu_restore_xrstor(const void *area)
+{
+    __asm__ volatile ("xrstor64 (%0)" :: "r" (area), "a" (-1), "d" (-1) : "memory");
+}
+
+void (*fpu_save_impl)(void *area) = fpu_save_fxsave;
+void (*fpu_restore_impl)(const void *area) = fpu_restore_fxrstor;
+
+alternative(fpu_save_impl, fpu_save_xsave, X86_FEATURE_OSXSAVE, 1);
+alternative(fpu_save_impl, fpu_save_xsaveopt, X86_FEATURE_XSAVEOPT, 2);
+alternative(fpu_save_impl, fpu_save_xsavec, X86_FEATURE_XSAVEC, 3);
+alternative(fpu_restore_impl, fpu_restore_xrstor, X86_FEATURE_OSXSAVE, 1);
+
+/**
+ * fpu_xstate_init - Size save areas for the state XCR0 enables
+ *
+ * Called after cpu_enable_sse has set XCR0.
+ */
+void fpu_xstate_init(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+
+    if (!cpu_has_feature(X86_FEATURE_OSXSAVE)) {
+        fpu_xstate_size = FPU_FXSAVE_SIZE;
+        return;
+    }
+
+    /* Compacted size for XSAVEC, otherwise the standard layout */
+    cpu_cpuid(CPUID_XSTATE_LEAF, cpu_has_feature(X86_FEATURE_XSAVEC) ? 1 : 0,
+              &eax, &ebx, &ecx, &edx);
+    fpu_xstate_size = ALIGN_UP(ebx, FPU_AREA_ALIGN);
+}
+
+static inline struct fpu_cpu *fpu_this_cpu(void)
+{
+    return &fpu_cpus[cpu_current_id()];
+}
+
+static void fpu_clts(struct fpu_cpu *fc)
+{
+    if (fc->ts) {
+        cpu_clts();
+        fc->ts = false;
+    }
+}
+
+static void fpu_stts(struct fpu_cpu *fc)
+{
+    if (!fc->ts) {
+        cpu_write_cr0(cpu_read_cr0() | CR0_TS);
+        fc->ts = true;
+    }
+}
+
+/**
+ * fpu_area_alloc - Save area holding the initial state
+ *
+ * Only the legacy control words need values; a zero XSAVE header makes
+ * XRSTOR load every other component in its initial state. kmalloc size
+ * classes are powers of two, so the area is aligned to its size.
+ */
+static void *fpu_area_alloc(void)
+{
+    uint8_t *area = kzalloc(fpu_xstate_size);
+    if (!area) {
+        return NULL;
+    }
+
+    *(uint16_t *)area = FPU_FCW_DEFAULT;
+    *(uint32_t *)(area + FXSAVE_MXCSR_OFFSET) = FPU_MXCSR_DEFAULT;
+    return area;
+}
+
+/**
+ * fpu_switch - Scheduler hook: @next is about to run
+ *
+ * Leaves the registers alone; only the owner may use them without a trap.
+ */
+void fpu_switch(struct task *next)
+{
+    struct fpu_cpu *fc = fpu_this_cpu();
+
+    if (fc->owner == next) {
+        fpu_clts(fc);
+    } else {
+        fpu_stts(fc);
+    }
+}
+
+/**
+ * fpu_device_na - #NM: the current task uses the FPU while it is not the owner
+ */
+static void fpu_device_na(struct interrupt_frame *frame)
+{
+    struct fpu_cpu *fc = fpu_this_cpu();
+    struct task *task = current_task;
+
+    if (!interrupt_from_user(frame)) {
+        kernel_panic("FPU used outside kernel_fpu_begin");
+    }
+
+    fpu_clts(fc);
+    if (fc->owner == task) {
+        return;
+    }
+    if (fc->owner) {
+        fpu_save(fc->owner->fpu_area);
+        fc->owner = NULL;
+    }
+
+    if (!task->fpu_area && !(task->fpu_area = fpu_area_alloc())) {
+        task_exit(TASK_WSTATUS_SEGV);
+    }
+    fpu_restore(task->fpu_area);
+    fc->owner = task;
+}
+
+/**
+ * fpu_fork - Give @child a copy of @parent's FPU state
+ */
+int fpu_fork(struct task *child, struct task *parent)
+{
+    struct fpu_cpu *fc = fpu_this_cpu();
+
+    if (!parent->fpu_area) {
+        return KERNEL_SUCCESS;
+    }
+
+    child->fpu_area = kmalloc(fpu_xstate_size);
+    if (!child->fpu_area) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    /* The live registers are newer than the area */
+    if (fc->owner == parent) {
+        fpu_clts(fc);
+        fpu_save(parent->fpu_area);
+    }
+    memcpy(child->fpu_area, parent->fpu_area, fpu_xstate_size);
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * fpu_release - Drop @task's FPU state; its next use starts from the initial state
+ */
+void fpu_release(struct task *task)
+{
+    struct fpu_cpu *fc = fpu_this_cpu();
+
+    /* Trap the next use, which would otherwise see the old registers */
+    if (fc->owner == task) {
+        fc->owner = NULL;
+        fpu_stts(fc);
+    }
+    kfree(task->fpu_area);
+    task->fpu_area = NULL;
+}
+
+/**
+ * kernel_fpu_begin - Allow vector instructions until kernel_fpu_end
+ *
+ * The owner's state is saved only when it is live in the registers. The
+ * SSE control word is reset, so kernel code does not run with the
+ * rounding or exception masks a user task left behind.
+ */
+void kernel_fpu_begin(void)
+{
+    struct fpu_cpu *fc = fpu_this_cpu();
+
+    fpu_clts(fc);
+    if (fc->owner) {
+        fpu_save(fc->owner->fpu_area);
+        fc->owner = NULL;
+    }
+    __asm__ volatile ("ldmxcsr %0" :: "m" (fpu_mxcsr_default));
+}
+
+/**
+ * kernel_fpu_end - End a kernel FPU region
+ *
+ * The task whose state was saved by kernel_fpu_begin reloads it through
+ * #NM when it next uses the FPU.
+ */
+void kernel_fpu_end(void)
+{
+    fpu_stts(fpu_this_cpu());
+}
+
+/**
+ * fpu_init - Take over #NM for lazy switching
+ */
+int __init fpu_init(void)
+{
+    return interrupt_register_handler(EXCEPTION_DEVICE_NA, fpu_device_na);
+}
+initcall(fpu_init, 0, interrupt_system_init);
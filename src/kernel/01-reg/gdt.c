@@ -0,0 +1,131 @@
+/*
+ * Power1 OS - Segmentation and Privilege Setup
+ * 64-bit GDT with user segments, TSS and SYSCALL/SYSRET configuration
+ *
+ * boot.asm only provides kernel code/data descriptors. Running user tasks
+ * needs ring 3 segments, a TSS whose rsp0 points at the current task's
+ * kernel stack, and the SYSCALL MSRs. The selector order is fixed by
+ * SYSRET: user data must sit 8 bytes below user code.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/cpu.h"
+#include "../include/init.h"
+
+#define GDT_ENTRIES             7
+
+/* Descriptor templates */
+#define GDT_DESC_KERNEL_CODE    0x00209A0000000000UL    /* L, P, DPL0, exec/read */
+#define GDT_DESC_KERNEL_DATA    0x0000920000000000UL    /* P, DPL0, read/write */
+#define GDT_DESC_USER_DATA      0x0000F20000000000UL    /* P, DPL3, read/write */
+#define GDT_DESC_USER_CODE      0x0020FA0000000000UL    /* L, P, DPL3, exec/read */
+#define GDT_TSS_TYPE_AVAILABLE  0x89UL
+
+/* 64-bit task state segment */
+struct tss {
+    uint32_t reserved0;
+    uint64_t rsp0;
+    uint64_t rsp1;
+    uint64_t rsp2;
+    uint64_t reserved1;
+    uint64_t ist[7];
+    uint64_t reserved2;
+    uint16_t reserved3;
+    uint16_t iomap_base;
+} __packed;
+
+struct gdt_pointer {
+    uint16_t limit;
+    uint64_t base;
+} __packed;
+
+static uint64_t gdt[GDT_ENTRIES] __aligned(16);
+static struct tss tss __aligned(16);
+
+/* Stack pointers used by the SYSCALL entry stub (entry.asm) */
+uint64_t syscall_kernel_rsp = 0;
+uint64_t syscall_user_rsp = 0;
+
+extern void syscall_entry(void);
+
+/**
+ * gdt_set_tss - Encode the 16-byte system descriptor for the TSS
+ */
+static void gdt_set_tss(int index, uint64_t base, uint32_t limit)
+{
+    gdt[index] = (limit & 0xFFFFUL) |
+                 ((base & 0xFFFFFFUL) << 16) |
+                 (GDT_TSS_TYPE_AVAILABLE << 40) |
+                 (((uint64_t)limit >> 16 & 0xF) << 48) |
+                 (((base >> 24) & 0xFF) << 56);
+    gdt[index + 1] = base >> 32;
+}
+
+/**
+ * gdt_load - Install the GDT and reload every segment register
+ */
+static void gdt_load(void)
+{
+    struct gdt_pointer gdtr = {
+        .limit = sizeof(gdt) - 1,
+        .base = (uint64_t)gdt
+    };
+
+    __asm__ volatile ("lgdt %0" :: "m" (gdtr));
+
+    /* Far return to reload CS */
+    __asm__ volatile ("pushq %0\n\t"
+                      "leaq 1f(%%rip), %%rax\n\t"
+                      "pushq %%rax\n\t"
+                      "lretq\n"
+                      "1:"
+                      :: "i" ((uint64_t)GDT_KERNEL_CODE) : "rax", "memory");
+
+    __asm__ volatile ("mov %0, %%ds\n\t"
+                      "mov %0, %%es\n\t"
+                      "mov %0, %%ss\n\t"
+                      "mov %1, %%fs\n\t"
+                      "mov %1, %%gs"
+                      :: "r" ((uint16_t)GDT_KERNEL_DATA), "r" ((uint16_t)0));
+
+    __asm__ volatile ("ltr %0" :: "r" ((uint16_t)GDT_TSS));
+}
+
+/**
+ * cpu_set_kernel_stack - Stack used on entry from ring 3
+ */
+void cpu_set_kernel_stack(uint64_t stack_top)
+{
+    tss.rsp0 = stack_top;
+    syscall_kernel_rsp = stack_top;
+}
+
+/**
+ * cpu_registers_init - Load GDT/TSS and enable the SYSCALL instruction
+ */
+int __init cpu_registers_init(void)
+{
+    gdt[0] = 0;
+    gdt[GDT_KERNEL_CODE >> 3] = GDT_DESC_KERNEL_CODE;
+    gdt[GDT_KERNEL_DATA >> 3] = GDT_DESC_KERNEL_DATA;
+    gdt[GDT_USER_DATA >> 3] = GDT_DESC_USER_DATA;
+    gdt[GDT_USER_CODE >> 3] = GDT_DESC_USER_CODE;
+
+    tss.iomap_base = sizeof(tss);
+    gdt_set_tss(GDT_TSS >> 3, (uint64_t)&tss, sizeof(tss) - 1);
+
+    gdt_load();
+
+    /* SYSRET loads CS = base + 16 and SS = base + 8 from STAR[63:48] */
+    cpu_write_msr(MSR_EFER, cpu_read_msr(MSR_EFER) | EFER_SCE);
+    cpu_write_msr(MSR_STAR, ((uint64_t)(GDT_KERNEL_DATA | GDT_RPL_USER) << 48) |
+                            ((uint64_t)GDT_KERNEL_CODE << 32));
+    cpu_write_msr(MSR_LSTAR, (uint64_t)syscall_entry);
+    cpu_write_msr(MSR_FMASK, RFLAGS_TF | RFLAGS_IF | RFLAGS_DF);
+
+    return KERNEL_SUCCESS;
+}
+initcall(cpu_registers_init, 0);
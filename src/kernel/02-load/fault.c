@@ -0,0 +1,224 @@
+/*
+ * Power1 OS - Page Fault Handling
+ * Demand paging for anonymous and file-backed areas
+ *
+ * Anonymous pages are allocated zeroed on first touch. File pages are
+ * mapped straight from the page cache; a read fault also maps the cached
+ * neighbours inside a small aligned window (fault-around) so sequential
+ * access through a mapping takes one fault per window instead of per page.
+ * Neighbours are always mapped read-only, so the first write to one of them
+ * still goes through fault_write_protect for dirty tracking or copying.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/fs.h"
+#include "../include/cpu.h"
+#include "../include/interrupts.h"
+#include "../include/string.h"
+#include "../include/process.h"
+
+/**
+ * vma_page_index - File page index backing @vaddr
+ */
+static inline uint64_t vma_page_index(struct vm_area *vma, uint64_t vaddr)
+{
+    return vma->pgoff + ((vaddr - vma->start) >> 12);
+}
+
+/**
+ * fault_copy_page - Give the faulting space a private copy of @source
+ */
+static int fault_copy_page(struct vm_space *space, struct vm_area *vma,
+                           uint64_t vaddr, struct page *source)
+{
+    struct page *copy = page_alloc(0, 0);
+    if (!copy) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    memcpy(page_address(copy), page_address(source), PAGE_SIZE);
+    copy->flags |= PG_ANON;
+    return vm_map_user_page(space, vaddr, copy, vma->flags, true);
+}
+
+/**
+ * fault_around - Map already-cached file pages around a read fault
+ */
+static void fault_around(struct vm_space *space, struct vm_area *vma, uint64_t vaddr)
+{
+    uint64_t window = FAULT_AROUND_PAGES * PAGE_SIZE;
+    uint64_t start = MAX(ALIGN_DOWN(vaddr, window), vma->start);
+    uint64_t end = MIN(ALIGN_DOWN(vaddr, window) + window, vma->end);
+
+    for (uint64_t addr = start; addr < end; addr += PAGE_SIZE) {
+        if (addr == vaddr) {
+            continue;
+        }
+
+        /* The window never crosses a page table, so no allocation here */
+        uint64_t *pte = vm_lookup_pte(space, addr, false);
+        if (!pte || (*pte & PAGE_PRESENT)) {
+            continue;
+        }
+
+        struct page *page = page_cache_find(vma->inode, vma_page_index(vma, addr));
+        if (!page) {
+            continue;
+        }
+        if (!(page->flags & PG_UPTODATE)) {
+            page_put(page);
+            continue;
+        }
+
+        *pte = page_to_phys(page) | vm_protection_bits(vma->flags, false);
+        space->resident_pages++;
+    }
+}
+
+/**
+ * fault_anonymous - First touch of an anonymous page
+ */
+static int fault_anonymous(struct vm_space *space, struct vm_area *vma, uint64_t vaddr)
+{
+    struct page *page = page_alloc(0, ALLOC_ZERO);
+    if (!page) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    page->flags |= PG_ANON;
+    int ret = vm_map_user_page(space, vaddr, page, vma->flags, vma->flags & VMA_WRITE);
+    if (ret != KERNEL_SUCCESS) {
+        page_put(page);
+    }
+    return ret;
+}
+
+/**
+ * fault_file - First touch of a file-backed page
+ */
+static int fault_file(struct vm_space *space, struct vm_area *vma,
+                      uint64_t vaddr, bool write)
+{
+    struct page *page = page_cache_get(vma->inode, vma_page_index(vma, vaddr));
+    if (!page) {
+        return KERNEL_ERROR_FAULT;
+    }
+
+    int ret;
+    if (write && !(vma->flags & VMA_SHARED)) {
+        /* Private write: the cached frame must stay pristine */
+        ret = fault_copy_page(space, vma, vaddr, page);
+        page_put(page);
+        return ret;
+    }
+
+    if (write) {
+        page_cache_set_dirty(page);
+    }
+
+    ret = vm_map_user_page(space, vaddr, page, vma->flags, write);
+    if (ret != KERNEL_SUCCESS) {
+        page_put(page);
+        return ret;
+    }
+
+    if (!write) {
+        fault_around(space, vma, vaddr);
+    }
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * fault_write_protect - Write to a present, read-only page of a writable area
+ */
+static int fault_write_protect(struct vm_space *space, struct vm_area *vma,
+                               uint64_t vaddr, uint64_t *pte)
+{
+    struct page *page = phys_to_page(*pte & PAGE_ADDR_MASK);
+
+    /* Shared mappings write through to the frame; just record the dirt */
+    if (vma->flags & VMA_SHARED) {
+        page_cache_set_dirty(page);
+        *pte |= PAGE_WRITABLE;
+        vm_flush_page(space, vaddr);
+        return KERNEL_SUCCESS;
+    }
+
+    /* Sole owner of a private anonymous frame: reuse it in place */
+    if ((page->flags & PG_ANON) && atomic_read(&page->refcount) == 1) {
+        *pte |= PAGE_WRITABLE;
+        vm_flush_page(space, vaddr);
+        return KERNEL_SUCCESS;
+    }
+
+    int ret = fault_copy_page(space, vma, vaddr, page);
+    if (ret == KERNEL_SUCCESS) {
+        page_put(page);
+    }
+    return ret;
+}
+
+/**
+ * vm_handle_fault - Resolve a fault at @addr in @space
+ * @error: Page fault error code (PF_* bits)
+ *
+ * Returns KERNEL_SUCCESS when the access can be retried.
+ */
+int vm_handle_fault(struct vm_space *space, uint64_t addr, uint32_t error)
+{
+    struct vm_area *vma = vma_find(space, addr);
+    bool write = error & PF_WRITE;
+
+    if (!vma || addr < vma->start) {
+        return KERNEL_ERROR_FAULT;
+    }
+    if (write && !(vma->flags & VMA_WRITE)) {
+        return KERNEL_ERROR_FAULT;
+    }
+    if ((error & PF_INSTR) && !(vma->flags & VMA_EXEC)) {
+        return KERNEL_ERROR_FAULT;
+    }
+    if (!(vma->flags & (VMA_READ | VMA_WRITE | VMA_EXEC))) {
+        return KERNEL_ERROR_FAULT;
+    }
+
+    uint64_t vaddr = page_align_down(addr);
+    uint64_t *pte = vm_lookup_pte(space, vaddr, true);
+    if (!pte) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    if (*pte & PAGE_PRESENT) {
+        if (!write || (*pte & PAGE_WRITABLE)) {
+            return KERNEL_SUCCESS;  /* Already resolved */
+        }
+        return fault_write_protect(space, vma, vaddr, pte);
+    }
+
+    if (vma->flags & VMA_ANON) {
+        return fault_anonymous(space, vma, vaddr);
+    }
+    return fault_file(space, vma, vaddr, write);
+}
+
+/**
+ * page_fault_handler - Exception 14 entry from interrupt_dispatch
+ */
+void page_fault_handler(struct interrupt_frame *frame)
+{
+    uint64_t addr = cpu_read_cr2();
+
+    if (current_vm_space && addr >= USER_SPACE_START && addr <= USER_SPACE_END &&
+        vm_handle_fault(current_vm_space, addr, (uint32_t)frame->error_code) == KERNEL_SUCCESS) {
+        return;
+    }
+
+    if (interrupt_from_user(frame)) {
+        task_exit(TASK_WSTATUS_SEGV);
+    }
+    kernel_panic("Unhandled kernel page fault");
+}
@@ -0,0 +1,149 @@
+/*
+ * Power1 OS - Kernel Heap
+ * Size-class slab allocator behind kmalloc/kfree
+ *
+ * Requests up to 2KB are served from per-class free lists carved out of
+ * whole pages; the owning struct page records the class, so kfree needs no
+ * header in front of each object. Larger requests go straight to the buddy
+ * allocator.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/string.h"
+
+/* Free objects of each class, linked through their first word */
+static void *kmalloc_free_list[KMALLOC_CLASSES];
+
+/**
+ * kmalloc_class - Size class index for @size bytes
+ */
+static uint32_t kmalloc_class(size_t size)
+{
+    uint32_t shift = KMALLOC_MIN_SHIFT;
+    while ((1UL << shift) < size) {
+        shift++;
+    }
+    return shift - KMALLOC_MIN_SHIFT;
+}
+
+/**
+ * kmalloc_refill - Carve a fresh page into objects of class @cls
+ */
+static bool kmalloc_refill(uint32_t cls)
+{
+    struct page *page = page_alloc(0, 0);
+    if (!page) {
+        return false;
+    }
+
+    page->flags |= PG_SLAB;
+    page->order = cls;
+
+    size_t object_size = 1UL << (cls + KMALLOC_MIN_SHIFT);
+    uint8_t *base = page_address(page);
+    for (size_t offset = 0; offset < PAGE_SIZE; offset += object_size) {
+        void **object = (void **)(base + offset);
+        *object = kmalloc_free_list[cls];
+        kmalloc_free_list[cls] = object;
+    }
+    return true;
+}
+
+/**
+ * kmalloc_size - Usable size of an allocation
+ */
+static size_t kmalloc_size(void *ptr)
+{
+    struct page *page = virt_to_page(ptr);
+
+    if (page->flags & PG_SLAB) {
+        return 1UL << (page->order + KMALLOC_MIN_SHIFT);
+    }
+    return PAGE_SIZE << page->order;
+}
+
+/**
+ * kmalloc - Allocate kernel memory
+ */
+void *kmalloc(size_t size)
+{
+    if (size == 0) {
+        return NULL;
+    }
+
+    if (size > (1UL << KMALLOC_MAX_SHIFT)) {
+        struct page *page = page_alloc(pmem_order_for(DIV_ROUND_UP(size, PAGE_SIZE)), 0);
+        return page ? page_address(page) : NULL;
+    }
+
+    uint32_t cls = kmalloc_class(size);
+    if (!kmalloc_free_list[cls] && !kmalloc_refill(cls)) {
+        return NULL;
+    }
+
+    void **object = kmalloc_free_list[cls];
+    kmalloc_free_list[cls] = *object;
+    return object;
+}
+
+/**
+ * kzalloc - Allocate zeroed kernel memory
+ */
+void *kzalloc(size_t size)
+{
+    void *ptr = kmalloc(size);
+    if (ptr) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+/**
+ * krealloc - Resize an allocation, moving it when the class changes
+ */
+void *krealloc(void *ptr, size_t size)
+{
+    if (!ptr) {
+        return kmalloc(size);
+    }
+    if (size == 0) {
+        kfree(ptr);
+        return NULL;
+    }
+
+    size_t old_size = kmalloc_size(ptr);
+    if (size <= old_size) {
+        return ptr;
+    }
+
+    void *new_ptr = kmalloc(size);
+    if (new_ptr) {
+        memcpy(new_ptr, ptr, old_size);
+        kfree(ptr);
+    }
+    return new_ptr;
+}
+
+/**
+ * kfree - Release memory from kmalloc
+ */
+void kfree(void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+
+    struct page *page = virt_to_page(ptr);
+    if (page->flags & PG_SLAB) {
+        void **object = ptr;
+        *object = kmalloc_free_list[page->order];
+        kmalloc_free_list[page->order] = object;
+        return;
+    }
+
+    page_free(page, page->order);
+}
@@ -0,0 +1,255 @@
+/*
+ * Power1 OS - Memory Mappings
+ * Virtual memory areas, mmap and munmap
+ *
+ * mmap only records a vm_area; page frames are attached lazily by
+ * vm_handle_fault when the process first touches each page.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/fs.h"
+
+/**
+ * vma_find - First area ending above @addr
+ *
+ * The returned area may start above @addr; callers check containment.
+ */
+struct vm_area *vma_find(struct vm_space *space, uint64_t addr)
+{
+    struct vm_area *vma = space->area_cache;
+
+    if (vma && vma->start <= addr && addr < vma->end) {
+        return vma;
+    }
+
+    for (vma = space->areas; vma; vma = vma->next) {
+        if (addr < vma->end) {
+            if (vma->start <= addr) {
+                space->area_cache = vma;
+            }
+            return vma;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * vma_free - Release an unlinked area and its file reference
+ */
+void vma_free(struct vm_area *vma)
+{
+    if (vma->inode) {
+        inode_put(vma->inode);
+    }
+    kfree(vma);
+}
+
+/**
+ * vma_insert - Link an area into the sorted list
+ */
+void vma_insert(struct vm_space *space, struct vm_area *vma)
+{
+    struct vm_area **link = &space->areas;
+
+    while (*link && (*link)->start < vma->start) {
+        link = &(*link)->next;
+    }
+    vma->next = *link;
+    *link = vma;
+    vma->space = space;
+}
+
+/**
+ * vm_range_user - [addr, addr + length) lies in user space, without overflow
+ */
+static inline bool vm_range_user(uint64_t addr, uint64_t length)
+{
+    return addr >= USER_SPACE_START && addr <= USER_SPACE_END &&
+           length <= USER_SPACE_END + 1 - addr;
+}
+
+/**
+ * vm_range_free - True if no area intersects [addr, addr + length)
+ */
+static bool vm_range_free(struct vm_space *space, uint64_t addr, uint64_t length)
+{
+    struct vm_area *vma = vma_find(space, addr);
+    return !vma || vma->start >= addr + length;
+}
+
+/**
+ * vm_find_free - Choose an unmapped range of @length bytes
+ * @hint: Preferred address, used when page aligned and free
+ */
+static uint64_t vm_find_free(struct vm_space *space, uint64_t length, uint64_t hint)
+{
+    if (hint && !(hint & PAGE_MASK) && vm_range_user(hint, length) &&
+        vm_range_free(space, hint, length)) {
+        return hint;
+    }
+
+    uint64_t candidate = USER_MMAP_BASE;
+    for (struct vm_area *vma = space->areas; vma; vma = vma->next) {
+        if (vma->end <= candidate) {
+            continue;
+        }
+        if (candidate + length <= vma->start) {
+            break;
+        }
+        candidate = vma->end;
+    }
+
+    return candidate + length <= USER_SPACE_END + 1 ? candidate : 0;
+}
+
+/**
+ * vm_munmap - Remove mappings in [addr, addr + length)
+ */
+int vm_munmap(struct vm_space *space, uint64_t addr, uint64_t length)
+{
+    if ((addr & PAGE_MASK) || length == 0 || !vm_range_user(addr, length)) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    /* The user half ends on a page boundary, so rounding up stays inside */
+    uint64_t end = page_align_up(addr + length);
+    if (end > USER_SPACE_END + 1) {
+        return KERNEL_ERROR_INVALID;
+    }
+    struct vm_area **link = &space->areas;
+
+    while (*link) {
+        struct vm_area *vma = *link;
+
+        if (vma->end <= addr) {
+            link = &vma->next;
+            continue;
+        }
+        if (vma->start >= end) {
+            break;
+        }
+
+        if (vma->start < addr && vma->end > end) {
+            /* Hole in the middle: split off the tail */
+            struct vm_area *tail = kmalloc(sizeof(*tail));
+            if (!tail) {
+                return KERNEL_ERROR_NOMEM;
+            }
+            *tail = *vma;
+            if (tail->inode) {
+                inode_get(tail->inode);
+            }
+            tail->start = end;
+            tail->pgoff = vma->pgoff + ((end - vma->start) >> 12);
+            vma->end = addr;
+            tail->next = vma->next;
+            vma->next = tail;
+            break;
+        } else if (vma->start < addr) {
+            vma->end = addr;
+            link = &vma->next;
+        } else if (vma->end > end) {
+            vma->pgoff += (end - vma->start) >> 12;
+            vma->start = end;
+            break;
+        } else {
+            *link = vma->next;
+            vma_free(vma);
+        }
+    }
+
+    space->area_cache = NULL;
+    vm_unmap_range(space, addr, end);
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * vm_mmap - Create a mapping of anonymous memory or of @inode
+ *
+ * Returns the mapped address, or a negative KERNEL_ERROR_* code.
+ */
+int64_t vm_mmap(struct vm_space *space, uint64_t addr, uint64_t length,
+                int prot, int flags, struct inode *inode, uint64_t offset)
+{
+    if (length == 0 || (offset & PAGE_MASK)) {
+        return KERNEL_ERROR_INVALID;
+    }
+    if (!(flags & (MAP_SHARED | MAP_PRIVATE))) {
+        return KERNEL_ERROR_INVALID;
+    }
+    if (!(flags & MAP_ANONYMOUS) && !inode) {
+        return KERNEL_ERROR_BADF;
+    }
+
+    /* Bounded first, so rounding up cannot wrap to zero */
+    if (length > USER_SPACE_END + 1 - USER_SPACE_START) {
+        return KERNEL_ERROR_NOMEM;
+    }
+    length = page_align_up(length);
+
+    if (flags & MAP_FIXED) {
+        if ((addr & PAGE_MASK) || !vm_range_user(addr, length)) {
+            return KERNEL_ERROR_INVALID;
+        }
+        int ret = vm_munmap(space, addr, length);
+        if (ret != KERNEL_SUCCESS) {
+            return ret;
+        }
+    } else {
+        addr = vm_find_free(space, length, addr);
+        if (!addr) {
+            return KERNEL_ERROR_NOMEM;
+        }
+    }
+
+    struct vm_area *vma = kzalloc(sizeof(*vma));
+    if (!vma) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    vma->start = addr;
+    vma->end = addr + length;
+    if (prot & PROT_READ) {
+        vma->flags |= VMA_READ;
+    }
+    if (prot & PROT_WRITE) {
+        vma->flags |= VMA_WRITE;
+    }
+    if (prot & PROT_EXEC) {
+        vma->flags |= VMA_EXEC;
+    }
+    if (flags & MAP_SHARED) {
+        vma->flags |= VMA_SHARED;
+    }
+    if ((flags & MAP_ANONYMOUS) && (flags & MAP_SHARED)) {
+        /* Shared anonymous memory needs one identity across fork */
+        vma->inode = shmem_inode_create(length);
+        if (!vma->inode) {
+            kfree(vma);
+            return KERNEL_ERROR_NOMEM;
+        }
+    } else if (flags & MAP_ANONYMOUS) {
+        vma->flags |= VMA_ANON;
+    } else {
+        inode_get(inode);
+        vma->inode = inode;
+        vma->pgoff = offset >> 12;
+    }
+    vma_insert(space, vma);
+
+    /* Opt-in prefault; the default is to pay only for touched pages */
+    if (flags & MAP_POPULATE) {
+        uint32_t error = ((vma->flags & VMA_ANON) && (vma->flags & VMA_WRITE)) ? PF_WRITE : 0;
+        for (uint64_t page = vma->start; page < vma->end; page += PAGE_SIZE) {
+            if (vm_handle_fault(space, page, error) != KERNEL_SUCCESS) {
+                break;
+            }
+        }
+    }
+
+    return (int64_t)addr;
+}
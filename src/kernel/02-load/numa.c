@@ -0,0 +1,392 @@
+/*
+ * Power1 OS - NUMA Topology
+ * Node discovery from the ACPI SRAT and SLIT, and memory policies
+ *
+ * Proximity domains from the SRAT are renumbered into dense node ids. The
+ * physical allocator keeps separate free lists per node and asks this file
+ * which node a frame belongs to, which node a CPU sits on and, for each
+ * node, the other nodes ordered by SLIT distance. Without an SRAT (or when
+ * it is not reachable through the direct map at memory_manager_init time)
+ * everything is node 0 and the policies collapse to the plain allocator.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/interrupts.h"
+#include "../include/acpi.h"
+#include "../include/numa.h"
+#include "../include/serial.h"
+#include "../include/init.h"
+
+struct numa_range {
+    uint64_t start;
+    uint64_t end;
+    uint32_t node;
+};
+
+/* Proximity domain of each node id */
+static uint32_t node_pxm[NUMA_MAX_NODES];
+unsigned int numa_node_count = 1;
+
+static struct numa_range numa_ranges[NUMA_MAX_RANGES];
+static unsigned int numa_range_count = 0;
+
+/* APIC ID to node, from the SRAT processor entries */
+static struct {
+    uint32_t apic_id;
+    uint32_t node;
+} numa_cpus[CPU_MAX];
+static unsigned int numa_cpu_entries = 0;
+
+static uint8_t numa_distances[NUMA_MAX_NODES][NUMA_MAX_NODES];
+static uint8_t numa_fallback[NUMA_MAX_NODES][NUMA_MAX_NODES];
+
+/**
+ * numa_node_for_pxm - Dense node id of proximity domain @pxm, allocating one
+ *
+ * Returns NUMA_MAX_NODES when there are more domains than nodes.
+ */
+static uint32_t __init numa_node_for_pxm(uint32_t pxm)
+{
+    for (uint32_t node = 0; node < numa_node_count; node++) {
+        if (node_pxm[node] == pxm) {
+            return node;
+        }
+    }
+    if (numa_node_count >= NUMA_MAX_NODES) {
+        return NUMA_MAX_NODES;
+    }
+    node_pxm[numa_node_count] = pxm;
+    return numa_node_count++;
+}
+
+/**
+ * numa_add_range - Record an SRAT memory range, keeping the list sorted
+ */
+static void __init numa_add_range(uint64_t start, uint64_t end, uint32_t node)
+{
+    unsigned int i = numa_range_count;
+
+    if (start >= end || numa_range_count >= NUMA_MAX_RANGES) {
+        return;
+    }
+    while (i > 0 && numa_ranges[i - 1].start > start) {
+        numa_ranges[i] = numa_ranges[i - 1];
+        i--;
+    }
+    numa_ranges[i].start = start;
+    numa_ranges[i].end = end;
+    numa_ranges[i].node = node;
+    numa_range_count++;
+}
+
+/**
+ * numa_add_cpu - Record the node of the processor with @apic_id
+ */
+static void __init numa_add_cpu(uint32_t apic_id, uint32_t pxm)
+{
+    uint32_t node = numa_node_for_pxm(pxm);
+
+    if (node < NUMA_MAX_NODES && numa_cpu_entries < CPU_MAX) {
+        numa_cpus[numa_cpu_entries].apic_id = apic_id;
+        numa_cpus[numa_cpu_entries].node = node;
+        numa_cpu_entries++;
+    }
+}
+
+/**
+ * numa_parse_srat - Read processor and memory affinity entries
+ */
+static bool __init numa_parse_srat(void)
+{
+    struct acpi_srat *srat = acpi_find_table("SRAT");
+    if (!srat) {
+        return false;
+    }
+
+    /* Renumber from scratch; node 0 is only a placeholder until now */
+    numa_node_count = 0;
+
+    const uint8_t *entry = srat->entries;
+    const uint8_t *end = (const uint8_t *)srat + srat->header.length;
+
+    while (entry + sizeof(struct acpi_madt_entry) <= end) {
+        const struct acpi_madt_entry *header = (const struct acpi_madt_entry *)entry;
+        if (header->length < sizeof(*header) || entry + header->length > end) {
+            break;
+        }
+
+        if (header->type == ACPI_SRAT_CPU_AFFINITY) {
+            const struct acpi_srat_cpu_affinity *cpu = (const void *)entry;
+            if (cpu->flags & ACPI_SRAT_ENABLED) {
+                uint32_t pxm = cpu->proximity_low;
+                if (srat->table_revision >= 2) {
+                    pxm |= (uint32_t)cpu->proximity_high[0] << 8 |
+                           (uint32_t)cpu->proximity_high[1] << 16 |
+                           (uint32_t)cpu->proximity_high[2] << 24;
+                }
+                numa_add_cpu(cpu->apic_id, pxm);
+            }
+        } else if (header->type == ACPI_SRAT_X2APIC_AFFINITY) {
+            const struct acpi_srat_x2apic_affinity *cpu = (const void *)entry;
+            if (cpu->flags & ACPI_SRAT_ENABLED) {
+                numa_add_cpu(cpu->x2apic_id, cpu->proximity_domain);
+            }
+        } else if (header->type == ACPI_SRAT_MEMORY_AFFINITY) {
+            const struct acpi_srat_memory_affinity *memory = (const void *)entry;
+            if (memory->flags & ACPI_SRAT_ENABLED) {
+                uint32_t node = numa_node_for_pxm(memory->proximity_domain);
+                if (node < NUMA_MAX_NODES) {
+                    numa_add_range(memory->base_address,
+                                   memory->base_address + memory->length, node);
+                }
+            }
+        }
+        entry += header->length;
+    }
+
+    if (!numa_node_count) {
+        numa_node_count = 1;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * numa_parse_slit - Fill the distance matrix, or assume local/remote
+ */
+static void __init numa_parse_slit(void)
+{
+    struct acpi_slit *slit = acpi_find_table("SLIT");
+
+    for (uint32_t from = 0; from < numa_node_count; from++) {
+        for (uint32_t to = 0; to < numa_node_count; to++) {
+            uint8_t distance = from == to ? NUMA_LOCAL_DISTANCE : NUMA_REMOTE_DISTANCE;
+
+            /* The SLIT is indexed by proximity domain */
+            uint64_t count = slit ? slit->locality_count : 0;
+            if (node_pxm[from] < count && node_pxm[to] < count &&
+                sizeof(*slit) + count * count <= slit->header.length) {
+                distance = slit->entries[node_pxm[from] * count + node_pxm[to]];
+            }
+            numa_distances[from][to] = distance;
+        }
+    }
+}
+
+/**
+ * numa_build_fallback - Order every node's candidates by distance
+ *
+ * Each node lists itself first, then the others nearest first; ties keep
+ * node id order so allocation spreads predictably.
+ */
+static void __init numa_build_fallback(void)
+{
+    for (uint32_t node = 0; node < numa_node_count; node++) {
+        uint8_t *order = numa_fallback[node];
+
+        for (uint32_t i = 0; i < numa_node_count; i++) {
+            order[i] = (uint8_t)i;
+        }
+        for (uint32_t i = 1; i < numa_node_count; i++) {
+            uint8_t key = order[i];
+            uint32_t j = i;
+            while (j > 0 && numa_distances[node][order[j - 1]] > numa_distances[node][key]) {
+                order[j] = order[j - 1];
+                j--;
+            }
+            order[j] = key;
+        }
+    }
+}
+
+/**
+ * numa_init - Discover the node layout
+ *
+ * Called by memory_manager_init once the direct map covers RAM and before
+ * any frame is initialised, so every frame gets its node from the start.
+ */
+int __init numa_init(void)
+{
+    numa_node_count = 1;
+    node_pxm[0] = 0;
+
+    if (acpi_init() != KERNEL_SUCCESS || !numa_parse_srat()) {
+        numa_range_count = 0;
+        numa_cpu_entries = 0;
+    }
+
+    numa_parse_slit();
+    numa_build_fallback();
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * numa_node_of_phys - Node owning physical address @paddr
+ *
+ * Addresses outside every SRAT range go to node 0. Callers walk memory in
+ * ascending order, so the last hit is tried first.
+ */
+uint32_t numa_node_of_phys(uint64_t paddr)
+{
+    static unsigned int last = 0;
+
+    if (last < numa_range_count &&
+        paddr >= numa_ranges[last].start && paddr < numa_ranges[last].end) {
+        return numa_ranges[last].node;
+    }
+
+    for (unsigned int i = 0; i < numa_range_count; i++) {
+        if (paddr >= numa_ranges[i].start && paddr < numa_ranges[i].end) {
+            last = i;
+            return numa_ranges[i].node;
+        }
+    }
+    return 0;
+}
+
+/**
+ * numa_cpu_node - Node of logical CPU @cpu
+ */
+uint32_t numa_cpu_node(unsigned int cpu)
+{
+    uint32_t apic_id;
+
+    if (numa_node_count == 1) {
+        return 0;
+    }
+
+    apic_id = lapic_cpu_apic_id(cpu);
+    for (unsigned int i = 0; i < numa_cpu_entries; i++) {
+        if (numa_cpus[i].apic_id == apic_id) {
+            return numa_cpus[i].node;
+        }
+    }
+    return 0;
+}
+
+/**
+ * numa_distance - SLIT distance between two nodes
+ */
+uint8_t numa_distance(uint32_t from, uint32_t to)
+{
+    if (from >= numa_node_count || to >= numa_node_count) {
+        return 0xFF;
+    }
+    return numa_distances[from][to];
+}
+
+/**
+ * numa_fallback_order - numa_node_count nodes, nearest to @node first
+ */
+const uint8_t *numa_fallback_order(uint32_t node)
+{
+    return numa_fallback[node < numa_node_count ? node : 0];
+}
+
+/**
+ * mempolicy_set - Validate and install a policy
+ * @nodes: Node mask; ignored for MPOL_DEFAULT
+ */
+int mempolicy_set(struct mempolicy *policy, uint32_t mode, uint32_t nodes)
+{
+    uint32_t online = (numa_node_count >= 32) ? ~0u : (1u << numa_node_count) - 1;
+
+    if (mode > MPOL_INTERLEAVE) {
+        return KERNEL_ERROR_INVALID;
+    }
+    if (mode != MPOL_DEFAULT) {
+        nodes &= online;
+        if (!nodes) {
+            return KERNEL_ERROR_INVALID;
+        }
+    } else {
+        nodes = 0;
+    }
+
+    policy->mode = mode;
+    policy->nodes = nodes;
+    policy->interleave_next = 0;
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * mempolicy_first_node - Node an allocation should try first
+ * @local: Node of the allocating CPU
+ *
+ * Interleave advances the task's cursor, so consecutive allocations land
+ * on consecutive nodes of the mask.
+ */
+uint32_t mempolicy_first_node(struct mempolicy *policy, uint32_t local)
+{
+    if (!policy || numa_node_count == 1) {
+        return local;
+    }
+
+    switch (policy->mode) {
+    case MPOL_PREFERRED:
+        for (uint32_t node = 0; node < numa_node_count; node++) {
+            if (policy->nodes & (1u << node)) {
+                return node;
+            }
+        }
+        return local;
+    case MPOL_BIND:
+        /* The nearest allowed node, which is the local one if allowed */
+        for (uint32_t i = 0; i < numa_node_count; i++) {
+            uint32_t node = numa_fallback_order(local)[i];
+            if (policy->nodes & (1u << node)) {
+                return node;
+            }
+        }
+        return local;
+    case MPOL_INTERLEAVE:
+        for (uint32_t i = 1; i <= numa_node_count; i++) {
+            uint32_t node = (policy->interleave_next + i) % numa_node_count;
+            if (policy->nodes & (1u << node)) {
+                policy->interleave_next = node;
+                return node;
+            }
+        }
+        return local;
+    default:
+        return local;
+    }
+}
+
+/**
+ * numa_report - Print nodes, distances and allocation counters over serial
+ *
+ * Lets a QEMU -numa configuration be checked from the serial log.
+ */
+void numa_report(void)
+{
+    struct numa_node_info info;
+
+    serial_write("\nNUMA nodes: ");
+    serial_write_u64(numa_node_count, 0);
+    serial_write("\nnode  pxm   total MB    free MB      local     remote interleave       miss  distances\n");
+
+    for (uint32_t node = 0; node < numa_node_count; node++) {
+        if (numa_node_info(node, &info) != KERNEL_SUCCESS) {
+            continue;
+        }
+
+        serial_write_u64(node, 4);
+        serial_write_u64(node_pxm[node], 5);
+        serial_write_u64(info.total_pages >> 8, 11);
+        serial_write_u64(info.free_pages >> 8, 11);
+        serial_write_u64(info.stats.local, 11);
+        serial_write_u64(info.stats.remote, 11);
+        serial_write_u64(info.stats.interleave, 11);
+        serial_write_u64(info.stats.miss, 11);
+        serial_write(" ");
+        for (uint32_t to = 0; to < numa_node_count; to++) {
+            serial_write_u64(numa_distances[node][to], 4);
+        }
+        serial_write("\n");
+    }
+}
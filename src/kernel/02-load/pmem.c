@@ -0,0 +1,731 @@
+/*
+ * Power1 OS - Physical Memory Manager
+ * Page frame database and buddy allocator
+ *
+ * Every physical page below max_pfn owns a struct page in mem_map. Free
+ * frames are kept in power-of-two blocks (buddy system) so that multi-page
+ * requests such as DMA rings are contiguous, and freeing coalesces blocks
+ * back in O(log n) without any per-page bitmap scan.
+ *
+ * Boot only initialises the frames of the first PMEM_EAGER_LIMIT bytes.
+ * The rest of mem_map is filled in PMEM_DEFERRED_CHUNK pieces by a
+ * background thread after the scheduler starts, each piece joining the
+ * free lists as soon as it is ready, so time to the first task does not
+ * grow with RAM size. Chunks are aligned to the largest buddy block, so
+ * merging never looks at a frame whose struct page is not set up yet.
+ *
+ * Each node also keeps a small pool of its own pages zeroed ahead of time
+ * by the idle task of a CPU on that node. Single-page ALLOC_ZERO requests,
+ * which is every anonymous fault and page table, take from the pool of
+ * the node their memory policy picks and skip the memset.
+ *
+ * On NUMA machines every node has its own set of free lists. A block never
+ * spans two nodes, and allocations start from the node the task's memory
+ * policy picks (normally the CPU's own) before falling back to the others
+ * in SLIT distance order.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/multiboot2.h"
+#include "../include/string.h"
+#include "../include/init.h"
+#include "../include/process.h"
+#include "../include/cpu.h"
+#include "../include/numa.h"
+#include "../include/clear_page.h"
+
+/* Linker provided image bounds */
+extern uint8_t kernel_start[];
+extern uint8_t kernel_end[];
+
+/* Page frame database */
+struct page *mem_map = NULL;
+uint64_t max_pfn = 0;
+
+/* Physical ranges that must never reach the allocator */
+#define PMEM_RESERVED_MAX       32
+static struct {
+    uint64_t start;
+    uint64_t end;
+} reserved_ranges[PMEM_RESERVED_MAX];
+static size_t reserved_count = 0;
+
+/* Early allocations must stay inside what the page tables already map */
+static uint64_t early_alloc_limit = 0x40000000UL;  /* boot.asm maps 1GB */
+
+/* Buddy free lists and counters of one NUMA node */
+struct pmem_node {
+    struct list_head free_area[PMEM_MAX_ORDER];
+    uint64_t free_pages;
+    uint64_t total_pages;
+    struct numa_node_stats stats;
+};
+
+static struct pmem_node pmem_nodes[NUMA_MAX_NODES];
+
+/* Sums over all nodes */
+static uint64_t free_pages = 0;
+static uint64_t total_pages = 0;
+
+/* Pre-zeroed pages of one node, linked through page->list */
+struct zero_pool {
+    struct list_head pages;
+    unsigned int count;
+} __attribute__((aligned(64)));
+
+static struct zero_pool zero_pools[NUMA_MAX_NODES];
+static uint64_t zero_pool_total = 0;
+
+/* Frames in [deferred_next_pfn, deferred_end_pfn) still need initialising */
+static uint64_t deferred_next_pfn = 0;
+static uint64_t deferred_end_pfn = 0;
+
+/**
+ * pmem_reserve_range - Exclude a physical range from allocation
+ */
+static void pmem_reserve_range(uint64_t start, uint64_t end)
+{
+    if (reserved_count >= PMEM_RESERVED_MAX || start >= end) {
+        return;
+    }
+
+    reserved_ranges[reserved_count].start = page_align_down(start);
+    reserved_ranges[reserved_count].end = page_align_up(end);
+    reserved_count++;
+}
+
+/**
+ * pmem_reserved_overlap - Find a reserved range intersecting [start, end)
+ */
+static int pmem_reserved_overlap(uint64_t start, uint64_t end)
+{
+    for (size_t i = 0; i < reserved_count; i++) {
+        if (start < reserved_ranges[i].end && reserved_ranges[i].start < end) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * pmem_reserve_boot_ranges - Protect firmware, kernel image and boot data
+ */
+static void pmem_reserve_boot_ranges(void)
+{
+    struct multiboot_info *info = kernel_state.mb_info;
+
+    /* Real-mode area, BIOS data and the boot page tables at 0x1000-0x3FFF */
+    pmem_reserve_range(0, 0x100000);
+    pmem_reserve_range((uint64_t)kernel_start, (uint64_t)kernel_end);
+
+    if (!info) {
+        return;
+    }
+
+    pmem_reserve_range((uint64_t)info, (uint64_t)info + info->total_size);
+
+    /* Boot modules stay in place until their consumers copy or map them */
+    size_t count;
+    struct multiboot_tag *const *tags = multiboot2_find_tags(MULTIBOOT_TAG_TYPE_MODULE, &count);
+    for (size_t i = 0; i < count; i++) {
+        struct multiboot_tag_module *module = (struct multiboot_tag_module *)tags[i];
+        pmem_reserve_range(module->mod_start, module->mod_end);
+    }
+}
+
+/**
+ * pmem_early_alloc - Carve physically contiguous memory before mem_map exists
+ * @size: Bytes required, rounded up to whole pages
+ *
+ * Returns the physical address of the block, or 0 if no region fits.
+ * The block is recorded as reserved so the buddy allocator skips it.
+ */
+uint64_t pmem_early_alloc(size_t size)
+{
+    size = page_align_up(size);
+
+    for (size_t i = 0; i < kernel_state.memory_map_count; i++) {
+        struct memory_region *region = &kernel_state.memory_map[i];
+
+        if (region->type != MEMORY_TYPE_AVAILABLE) {
+            continue;
+        }
+
+        uint64_t candidate = page_align_up(region->base_addr);
+        uint64_t limit = MIN(region->base_addr + region->length, early_alloc_limit);
+
+        while (candidate + size <= limit) {
+            int hit = pmem_reserved_overlap(candidate, candidate + size);
+            if (hit < 0) {
+                pmem_reserve_range(candidate, candidate + size);
+                return candidate;
+            }
+            candidate = reserved_ranges[hit].end;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * pmem_set_early_limit - Raise the ceiling once more memory is mapped
+ */
+void pmem_set_early_limit(uint64_t limit)
+{
+    early_alloc_limit = limit;
+}
+
+/**
+ * pmem_order_for - Smallest buddy order holding @count pages
+ */
+uint32_t pmem_order_for(size_t count)
+{
+    uint32_t order = 0;
+    while ((1UL << order) < count) {
+        order++;
+    }
+    return order;
+}
+
+/**
+ * buddy_free_block - Return a block to its node's free lists, merging buddies
+ */
+static void buddy_free_block(uint64_t pfn, uint32_t order)
+{
+    uint32_t node = mem_map[pfn].node;
+
+    while (order < PMEM_MAX_ORDER - 1) {
+        uint64_t buddy_pfn = pfn ^ (1UL << order);
+        if (buddy_pfn >= max_pfn) {
+            break;
+        }
+
+        struct page *buddy = &mem_map[buddy_pfn];
+        if (!(buddy->flags & PG_BUDDY) || buddy->order != order || buddy->node != node) {
+            break;
+        }
+
+        list_del(&buddy->list);
+        buddy->flags &= ~PG_BUDDY;
+        pfn &= ~(1UL << order);
+        order++;
+    }
+
+    struct page *head = &mem_map[pfn];
+    head->flags |= PG_BUDDY;
+    head->order = order;
+    list_add(&head->list, &pmem_nodes[node].free_area[order]);
+}
+
+/**
+ * pmem_free_range - Hand [start_pfn, end_pfn) to the buddy allocator
+ */
+static void pmem_free_range(uint64_t start_pfn, uint64_t end_pfn)
+{
+    for (uint64_t pfn = start_pfn; pfn < end_pfn; pfn++) {
+        struct pmem_node *node = &pmem_nodes[mem_map[pfn].node];
+        mem_map[pfn].flags &= ~PG_RESERVED;
+        node->total_pages++;
+        node->free_pages++;
+    }
+
+    total_pages += end_pfn - start_pfn;
+    free_pages += end_pfn - start_pfn;
+
+    /* Release the largest naturally aligned single-node blocks that fit */
+    while (start_pfn < end_pfn) {
+        uint32_t order = 0;
+        while (order + 1 < PMEM_MAX_ORDER &&
+               !(start_pfn & ((1UL << (order + 1)) - 1)) &&
+               start_pfn + (1UL << (order + 1)) <= end_pfn &&
+               mem_map[start_pfn + (1UL << (order + 1)) - 1].node == mem_map[start_pfn].node) {
+            order++;
+        }
+        buddy_free_block(start_pfn, order);
+        start_pfn += 1UL << order;
+    }
+}
+
+/**
+ * pmem_release_region - Free the unreserved parts of an available region
+ */
+static void pmem_release_region(uint64_t start, uint64_t end)
+{
+    start = page_align_up(start);
+    end = MIN(page_align_down(end), max_pfn << 12);
+
+    while (start < end) {
+        /* Lowest reserved range intersecting what is left */
+        int hit = -1;
+        for (size_t i = 0; i < reserved_count; i++) {
+            if (reserved_ranges[i].start < end && reserved_ranges[i].end > start &&
+                (hit < 0 || reserved_ranges[i].start < reserved_ranges[hit].start)) {
+                hit = (int)i;
+            }
+        }
+
+        if (hit < 0) {
+            pmem_free_range(start >> 12, end >> 12);
+            return;
+        }
+
+        if (reserved_ranges[hit].start > start) {
+            pmem_free_range(start >> 12, reserved_ranges[hit].start >> 12);
+        }
+        start = reserved_ranges[hit].end;
+    }
+}
+
+/**
+ * pmem_init_frames - Set up mem_map for [start_pfn, end_pfn) and free its RAM
+ */
+static void pmem_init_frames(uint64_t start_pfn, uint64_t end_pfn)
+{
+    memset(&mem_map[start_pfn], 0, (end_pfn - start_pfn) * sizeof(struct page));
+    for (uint64_t pfn = start_pfn; pfn < end_pfn; pfn++) {
+        mem_map[pfn].flags = PG_RESERVED;
+        mem_map[pfn].node = numa_node_of_phys(pfn << 12);
+        list_init(&mem_map[pfn].list);
+    }
+
+    /* The map is sorted, so stop at the first region past the range */
+    for (size_t i = 0; i < kernel_state.memory_map_count; i++) {
+        struct memory_region *region = &kernel_state.memory_map[i];
+        uint64_t start = MAX(region->base_addr, start_pfn << 12);
+        uint64_t end = MIN(region->base_addr + region->length, end_pfn << 12);
+
+        if (region->base_addr >= end_pfn << 12) {
+            break;
+        }
+        if (region->type == MEMORY_TYPE_AVAILABLE && start < end) {
+            pmem_release_region(start, end);
+        }
+    }
+}
+
+/**
+ * pmem_deferred_grow - Initialise the next deferred chunk
+ *
+ * Returns false once all of RAM has been initialised.
+ */
+static bool pmem_deferred_grow(void)
+{
+    uint64_t start = deferred_next_pfn;
+
+    if (start >= deferred_end_pfn) {
+        return false;
+    }
+
+    /* Claim before working so a page_alloc falling back here takes the next chunk */
+    deferred_next_pfn = MIN(start + PMEM_DEFERRED_CHUNK, deferred_end_pfn);
+    pmem_init_frames(start, deferred_next_pfn);
+    return true;
+}
+
+/**
+ * pmem_deferred_worker - Background thread body for deferred frame init
+ *
+ * Yields after every chunk; the scheduler is cooperative, and the point
+ * is to keep this off the path to the first task.
+ */
+static int pmem_deferred_worker(void *arg)
+{
+    (void)arg;
+
+    while (pmem_deferred_grow()) {
+        schedule();
+    }
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * pmem_deferred_init - Start the deferred init worker
+ *
+ * Only the boot CPU runs tasks, so one worker is all that can make
+ * progress; more would just take turns on the same CPU.
+ */
+int __init pmem_deferred_init(void)
+{
+    /* Without it page_alloc still grows the free lists on demand */
+    if (deferred_next_pfn < deferred_end_pfn) {
+        kthread_create("pmem_deferred", pmem_deferred_worker, NULL);
+    }
+    return KERNEL_SUCCESS;
+}
+initcall(pmem_deferred_init, 0, memory_manager_init, process_manager_init);
+
+/**
+ * pmem_node_take - Remove a 2^order block from one node's free lists
+ *
+ * Returns NULL if the node has no block of at least that order.
+ */
+static struct page *pmem_node_take(struct pmem_node *node, uint32_t order)
+{
+    uint32_t current;
+
+    for (current = order; current < PMEM_MAX_ORDER; current++) {
+        if (!list_empty(&node->free_area[current])) {
+            break;
+        }
+    }
+    if (current >= PMEM_MAX_ORDER) {
+        return NULL;
+    }
+
+    struct page *page = list_first_entry(&node->free_area[current], struct page, list);
+    list_del(&page->list);
+    page->flags &= ~PG_BUDDY;
+
+    /* Split the block, returning upper halves to smaller lists */
+    while (current > order) {
+        current--;
+        struct page *half = page + (1UL << current);
+        half->flags |= PG_BUDDY;
+        half->order = current;
+        list_add(&half->list, &node->free_area[current]);
+    }
+
+    node->free_pages -= 1UL << order;
+    free_pages -= 1UL << order;
+    return page;
+}
+
+/**
+ * pmem_account - Update the statistics of the node that served a request
+ * @wanted: Node the policy asked for
+ * @local: Node of the allocating CPU
+ */
+static void pmem_account(struct page *page, uint32_t wanted, uint32_t local,
+                         const struct mempolicy *policy)
+{
+    struct numa_node_stats *stats = &pmem_nodes[page->node].stats;
+
+    if (page->node != wanted) {
+        stats->miss++;
+    } else if (policy && policy->mode == MPOL_INTERLEAVE) {
+        stats->interleave++;
+    } else if (page->node == local) {
+        stats->local++;
+    } else {
+        stats->remote++;
+    }
+}
+
+/**
+ * page_prepare - Reset the frame fields of a block leaving the free lists
+ */
+static void page_prepare(struct page *page, uint32_t order)
+{
+    page->flags = 0;
+    page->order = order;
+    page->mapping = NULL;
+    page->index = 0;
+    page->hash_next = NULL;
+    atomic_set(&page->refcount, 1);
+}
+
+/**
+ * zero_pool_get - Take a pre-zeroed page of @node, or NULL
+ */
+static struct page *zero_pool_get(uint32_t node)
+{
+    struct zero_pool *pool = &zero_pools[node];
+
+    if (!pool->count) {
+        return NULL;
+    }
+
+    struct page *page = list_first_entry(&pool->pages, struct page, list);
+    list_del(&page->list);
+    pool->count--;
+    zero_pool_total--;
+    return page;
+}
+
+/**
+ * zero_pool_refill - Zero up to ZERO_POOL_BATCH pages into the local node's pool
+ *
+ * Called from the idle loop. The pages come straight from the node's own
+ * free lists, never from a fallback node, and the last ZERO_POOL_RESERVE
+ * free pages of the node are left alone so the pool cannot starve other
+ * allocations. Returns true if it did any work, in which case the caller
+ * should check for runnable tasks and call again rather than halt.
+ */
+bool zero_pool_refill(void)
+{
+    uint32_t node = numa_cpu_node(cpu_current_id());
+    struct zero_pool *pool = &zero_pools[node];
+    struct page *batch[ZERO_POOL_BATCH];
+    void *addrs[ZERO_POOL_BATCH];
+    unsigned int done = 0;
+
+    while (done < ZERO_POOL_BATCH && pool->count + done < ZERO_POOL_TARGET &&
+           pmem_nodes[node].free_pages > ZERO_POOL_RESERVE) {
+        struct page *page = pmem_node_take(&pmem_nodes[node], 0);
+        if (!page) {
+            break;
+        }
+
+        page_prepare(page, 0);
+        batch[done] = page;
+        addrs[done] = page_address(page);
+        done++;
+    }
+
+    if (!done) {
+        return false;
+    }
+
+    /* One call for the batch, so a vector clear pays for one FPU region */
+    clear_pages_nt(addrs, done);
+    __asm__ volatile ("sfence" ::: "memory");
+
+    for (unsigned int i = 0; i < done; i++) {
+        list_add(&batch[i]->list, &pool->pages);
+    }
+    pool->count += done;
+    zero_pool_total += done;
+    return true;
+}
+
+/**
+ * page_alloc - Allocate 2^order contiguous page frames
+ * @order: Block order
+ * @flags: ALLOC_* flags
+ *
+ * The current task's memory policy picks the first node; the others are
+ * tried nearest first, except that MPOL_BIND never leaves its node mask.
+ */
+struct page *page_alloc(uint32_t order, uint32_t flags)
+{
+    struct mempolicy *policy = current_task ? &current_task->mempolicy : NULL;
+    struct page *page = NULL;
+
+    if (order >= PMEM_MAX_ORDER) {
+        return NULL;
+    }
+
+    uint32_t local = numa_cpu_node(cpu_current_id());
+    uint32_t wanted = mempolicy_first_node(policy, local);
+    uint32_t allowed = (policy && policy->mode == MPOL_BIND) ? policy->nodes : ~0u;
+
+    /* Zeroed ahead of time on the wanted node, so the memset below is skipped */
+    if (order == 0 && (flags & ALLOC_ZERO) && (allowed & (1u << wanted))) {
+        page = zero_pool_get(wanted);
+        if (page) {
+            pmem_account(page, wanted, local, policy);
+            return page;
+        }
+    }
+
+    const uint8_t *fallback = numa_fallback_order(wanted);
+    for (;;) {
+        for (unsigned int i = 0; i < numa_node_count && !page; i++) {
+            if (allowed & (1u << fallback[i])) {
+                page = pmem_node_take(&pmem_nodes[fallback[i]], order);
+            }
+        }
+        if (page) {
+            break;
+        }
+
+        /* Do not fail while deferred memory could satisfy the request */
+        if (!pmem_deferred_grow()) {
+            break;
+        }
+    }
+
+    if (!page) {
+        /* Last resort: pages zeroed for later faults, same node order */
+        for (unsigned int i = 0; i < numa_node_count && order == 0 && !page; i++) {
+            if (allowed & (1u << fallback[i])) {
+                page = zero_pool_get(fallback[i]);
+            }
+        }
+        if (page) {
+            pmem_account(page, wanted, local, policy);
+        }
+        return page;
+    }
+
+    pmem_account(page, wanted, local, policy);
+    page_prepare(page, order);
+
+    if (flags & ALLOC_ZERO) {
+        memset(page_address(page), 0, PAGE_SIZE << order);
+    }
+
+    return page;
+}
+
+/**
+ * page_free - Release a block obtained from page_alloc
+ */
+void page_free(struct page *page, uint32_t order)
+{
+    if (!page) {
+        return;
+    }
+
+    page->flags = 0;
+    page->mapping = NULL;
+    free_pages += 1UL << order;
+    pmem_nodes[page->node].free_pages += 1UL << order;
+    buddy_free_block((uint64_t)(page - mem_map), order);
+}
+
+/**
+ * page_put - Drop a reference, freeing the frame with the last one
+ */
+void page_put(struct page *page)
+{
+    if (page && atomic_dec_and_test(&page->refcount)) {
+        page_free(page, page->order);
+    }
+}
+
+/**
+ * pmem_alloc_page - Allocate one page, returned as a direct-map pointer
+ */
+void *pmem_alloc_page(void)
+{
+    struct page *page = page_alloc(0, 0);
+    return page ? page_address(page) : NULL;
+}
+
+/**
+ * pmem_alloc_pages - Allocate contiguous pages (rounded to a power of two)
+ */
+void *pmem_alloc_pages(size_t count)
+{
+    struct page *page = page_alloc(pmem_order_for(count), 0);
+    return page ? page_address(page) : NULL;
+}
+
+/**
+ * pmem_free_page - Free a page from pmem_alloc_page
+ */
+void pmem_free_page(void *page)
+{
+    if (page) {
+        page_free(virt_to_page(page), 0);
+    }
+}
+
+/**
+ * pmem_free_pages - Free pages from pmem_alloc_pages
+ */
+void pmem_free_pages(void *pages, size_t count)
+{
+    if (pages) {
+        page_free(virt_to_page(pages), pmem_order_for(count));
+    }
+}
+
+/**
+ * pmem_free_init_memory - Give the .init sections back once boot is over
+ *
+ * The pages are filled with int3 first, so a stale call into init code
+ * traps instead of running whatever reuses the page.
+ */
+void pmem_free_init_memory(void)
+{
+    uint64_t start = page_align_up((uint64_t)__init_begin);
+    uint64_t end = page_align_down((uint64_t)__init_end);
+
+    if (start >= end) {
+        return;
+    }
+
+    memset(phys_to_direct(start), 0xCC, end - start);
+    pmem_free_range(start >> 12, end >> 12);
+}
+
+uint64_t pmem_get_total_memory(void)
+{
+    return total_pages * PAGE_SIZE;
+}
+
+uint64_t pmem_get_available_memory(void)
+{
+    return (free_pages + zero_pool_total) * PAGE_SIZE;
+}
+
+/**
+ * numa_node_info - Size, free memory and allocation counters of @node
+ */
+int numa_node_info(uint32_t node, struct numa_node_info *info)
+{
+    if (node >= numa_node_count || !info) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    info->total_pages = pmem_nodes[node].total_pages;
+    info->free_pages = pmem_nodes[node].free_pages;
+    info->stats = pmem_nodes[node].stats;
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * memory_manager_init - Build the frame database and kernel address space
+ */
+int __init memory_manager_init(void)
+{
+    if (!kernel_state.memory_map_count) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    for (uint32_t node = 0; node < NUMA_MAX_NODES; node++) {
+        for (uint32_t order = 0; order < PMEM_MAX_ORDER; order++) {
+            list_init(&pmem_nodes[node].free_area[order]);
+        }
+    }
+    for (uint32_t node = 0; node < NUMA_MAX_NODES; node++) {
+        list_init(&zero_pools[node].pages);
+    }
+
+    pmem_reserve_boot_ranges();
+
+    /* Highest usable frame, bounded by the direct map window */
+    for (size_t i = 0; i < kernel_state.memory_map_count; i++) {
+        struct memory_region *region = &kernel_state.memory_map[i];
+        if (region->type == MEMORY_TYPE_AVAILABLE) {
+            uint64_t end = MIN(region->base_addr + region->length, DIRECT_MAP_LIMIT);
+            max_pfn = MAX(max_pfn, end >> 12);
+        }
+    }
+
+    /* Map all of RAM before placing anything above the boot mapping */
+    int ret = vmem_init(max_pfn << 12);
+    if (ret != KERNEL_SUCCESS) {
+        return ret;
+    }
+
+    /* The SRAT is reached through the direct map, so this waits for vmem */
+    numa_init();
+
+    uint64_t map_size = max_pfn * sizeof(struct page);
+    uint64_t map_phys = pmem_early_alloc(map_size);
+    if (!map_phys) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    mem_map = phys_to_direct(map_phys);
+
+    /* Frames past the eager limit are left for pmem_deferred_init */
+    uint64_t eager_pfn = MIN(ALIGN_UP(PMEM_EAGER_LIMIT >> 12, PMEM_DEFERRED_CHUNK), max_pfn);
+    pmem_init_frames(0, eager_pfn);
+    deferred_next_pfn = eager_pfn;
+    deferred_end_pfn = max_pfn;
+
+    /* Too little early memory: take deferred chunks until something is free */
+    while (!free_pages && pmem_deferred_grow()) {
+    }
+
+    return free_pages ? KERNEL_SUCCESS : KERNEL_ERROR_NOMEM;
+}
+initcall(memory_manager_init, 0, cpu_registers_init);
@@ -0,0 +1,148 @@
+/*
+ * Power1 OS - User Memory Access
+ * Checked copies between kernel buffers and user address spaces
+ *
+ * The kernel dereferences user pointers directly through the live page
+ * tables. Ranges are validated against the areas of the current space
+ * first, so any fault taken during the copy is one vm_handle_fault can
+ * resolve and a bad pointer becomes an error instead of a kernel fault.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/string.h"
+
+/**
+ * user_range_ok - Check that [addr, addr + length) is mapped with access
+ */
+bool user_range_ok(uint64_t addr, size_t length, bool write)
+{
+    struct vm_space *space = current_vm_space;
+    uint64_t end = addr + length;
+
+    if (!space || addr < USER_SPACE_START || end < addr || end > USER_SPACE_END + 1) {
+        return false;
+    }
+
+    while (addr < end) {
+        struct vm_area *vma = vma_find(space, addr);
+        if (!vma || vma->start > addr) {
+            return false;
+        }
+        if (write ? !(vma->flags & VMA_WRITE) : !(vma->flags & VMA_READ)) {
+            return false;
+        }
+        addr = vma->end;
+    }
+    return true;
+}
+
+/**
+ * copy_from_user - Copy @length bytes from user memory
+ */
+int copy_from_user(void *dest, const void *user_src, size_t length)
+{
+    if (!user_range_ok((uint64_t)user_src, length, false)) {
+        return KERNEL_ERROR_FAULT;
+    }
+    memcpy(dest, user_src, length);
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * copy_to_user - Copy @length bytes into user memory
+ */
+int copy_to_user(void *user_dest, const void *src, size_t length)
+{
+    if (!user_range_ok((uint64_t)user_dest, length, true)) {
+        return KERNEL_ERROR_FAULT;
+    }
+    memcpy(user_dest, src, length);
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * strncpy_from_user - Copy a NUL-terminated user string
+ *
+ * Returns the string length, or an error if it is unmapped or does not
+ * fit in @max bytes including the terminator.
+ */
+int64_t strncpy_from_user(char *dest, const char *user_src, size_t max)
+{
+    uint64_t addr = (uint64_t)user_src;
+
+    for (size_t i = 0; i < max; i++, addr++) {
+        if ((i == 0 || !(addr & PAGE_MASK)) && !user_range_ok(addr, 1, false)) {
+            return KERNEL_ERROR_FAULT;
+        }
+        dest[i] = *(const char *)addr;
+        if (!dest[i]) {
+            return (int64_t)i;
+        }
+    }
+    return KERNEL_ERROR_INVALID;
+}
+
+/**
+ * vm_space_frame - Fault in the page holding @uaddr and return its alias
+ *
+ * The page is faulted in as if written by the owner, so a new image can be
+ * populated through the direct map without switching CR3.
+ */
+static uint8_t *vm_space_frame(struct vm_space *space, uint64_t uaddr, int *error)
+{
+    *error = vm_handle_fault(space, uaddr, PF_WRITE | PF_USER);
+    if (*error != KERNEL_SUCCESS) {
+        return NULL;
+    }
+
+    uint64_t *pte = vm_lookup_pte(space, page_align_down(uaddr), false);
+    return (uint8_t *)phys_to_direct(*pte & PAGE_ADDR_MASK) + (uaddr & PAGE_MASK);
+}
+
+/**
+ * vm_copy_to_space - Write into a space that need not be the active one
+ */
+int vm_copy_to_space(struct vm_space *space, uint64_t uaddr, const void *src, size_t length)
+{
+    const uint8_t *in = src;
+    int ret = KERNEL_SUCCESS;
+
+    while (length) {
+        size_t chunk = MIN(length, PAGE_SIZE - (uaddr & PAGE_MASK));
+        uint8_t *frame = vm_space_frame(space, uaddr, &ret);
+        if (!frame) {
+            break;
+        }
+
+        memcpy(frame, in, chunk);
+        in += chunk;
+        uaddr += chunk;
+        length -= chunk;
+    }
+    return ret;
+}
+
+/**
+ * vm_clear_space - Zero a range of a space that need not be the active one
+ */
+int vm_clear_space(struct vm_space *space, uint64_t uaddr, size_t length)
+{
+    int ret = KERNEL_SUCCESS;
+
+    while (length) {
+        size_t chunk = MIN(length, PAGE_SIZE - (uaddr & PAGE_MASK));
+        uint8_t *frame = vm_space_frame(space, uaddr, &ret);
+        if (!frame) {
+            break;
+        }
+
+        memset(frame, 0, chunk);
+        uaddr += chunk;
+        length -= chunk;
+    }
+    return ret;
+}
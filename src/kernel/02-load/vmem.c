@@ -0,0 +1,441 @@
+/*
+ * Power1 OS - Virtual Memory Manager
+ * Page table management, physical direct map and user address spaces
+ *
+ * PML4 slot 0 is the supervisor-only direct map of physical memory that the
+ * kernel runs from. Every address space shares it by copying the slot, so
+ * switching spaces never touches kernel mappings and user page tables are
+ * only ever allocated below USER_SPACE_END.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/cpu.h"
+#include "../include/string.h"
+
+#define PT_ENTRIES              512
+#define PML4_USER_FIRST         1
+#define PML4_USER_LAST          255
+
+/* Kernel page table root (boot.asm's PML4) */
+static uint64_t kernel_pml4 = 0;
+
+/* PAGE_NO_EXECUTE when EFER.NXE could be enabled, otherwise 0 */
+static uint64_t nx_mask = 0;
+
+/* Address space the page fault handler resolves against */
+struct vm_space *current_vm_space = NULL;
+
+/* End of RAM covered by the direct map */
+static uint64_t direct_map_limit = 0;
+
+/* Next free address in the MMIO window */
+static uint64_t mmio_next = MMIO_BASE;
+
+/**
+ * vmem_enable_nx - Enable no-execute pages when the CPU supports them
+ */
+static void vmem_enable_nx(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+
+    cpu_cpuid(0x80000001, 0, &eax, &ebx, &ecx, &edx);
+    if (edx & CPU_FEATURE_EXT_NX) {
+        cpu_write_msr(MSR_EFER, cpu_read_msr(MSR_EFER) | EFER_NXE);
+        nx_mask = PAGE_NO_EXECUTE;
+    }
+}
+
+/**
+ * vmem_extend_direct_map - Map physical memory beyond boot.asm's first 1GB
+ * @phys_limit: End of physical memory to cover
+ *
+ * Uses 2MB pages; all page directories come from one early allocation.
+ */
+static int vmem_extend_direct_map(uint64_t phys_limit)
+{
+    uint64_t *pml4 = phys_to_direct(kernel_pml4);
+    uint64_t *pdpt = phys_to_direct(pml4[0] & PAGE_ADDR_MASK);
+    uint64_t gigabytes = DIV_ROUND_UP(phys_limit, 1UL << 30);
+
+    if (gigabytes <= 1) {
+        return KERNEL_SUCCESS;
+    }
+
+    uint64_t directories = pmem_early_alloc((gigabytes - 1) * PAGE_SIZE);
+    if (!directories) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    for (uint64_t gb = 1; gb < gigabytes; gb++) {
+        uint64_t pd_phys = directories + (gb - 1) * PAGE_SIZE;
+        uint64_t *pd = phys_to_direct(pd_phys);
+
+        for (uint64_t i = 0; i < PT_ENTRIES; i++) {
+            pd[i] = ((gb << 30) + (i << 21)) | PAGE_PRESENT | PAGE_WRITABLE | PAGE_HUGE;
+        }
+        pdpt[gb] = pd_phys | PAGE_PRESENT | PAGE_WRITABLE;
+    }
+
+    cpu_write_cr3(cpu_read_cr3());
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * vmem_init - Take over the boot page tables
+ * @phys_limit: End of the RAM that must be reachable through the direct map
+ */
+int vmem_init(uint64_t phys_limit)
+{
+    kernel_pml4 = cpu_read_cr3() & PAGE_ADDR_MASK;
+    vmem_enable_nx();
+
+    int ret = vmem_extend_direct_map(phys_limit);
+    if (ret != KERNEL_SUCCESS) {
+        return ret;
+    }
+    direct_map_limit = MAX(phys_limit, 1UL << 30);
+
+    /*
+     * Address spaces copy the kernel's upper PML4 slots when created, so
+     * the MMIO window's PDPT must exist before the first one is.
+     */
+    uint64_t pdpt = pmem_early_alloc(PAGE_SIZE);
+    if (!pdpt) {
+        return KERNEL_ERROR_NOMEM;
+    }
+    memset(phys_to_direct(pdpt), 0, PAGE_SIZE);
+    uint64_t *pml4 = phys_to_direct(kernel_pml4);
+    pml4[(MMIO_BASE >> 39) & 0x1FF] = pdpt | PAGE_PRESENT | PAGE_WRITABLE;
+
+    pmem_set_early_limit(phys_limit);
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * vmem_direct_mapped - True if [paddr, paddr + size) is inside the direct map
+ */
+bool vmem_direct_mapped(uint64_t paddr, uint64_t size)
+{
+    return paddr + size >= paddr && paddr + size <= direct_map_limit;
+}
+
+/**
+ * table_next - Descend one page table level, optionally allocating it
+ */
+static uint64_t *table_next(uint64_t *entry, bool create, bool user)
+{
+    if (!(*entry & PAGE_PRESENT)) {
+        if (!create) {
+            return NULL;
+        }
+
+        struct page *table = page_alloc(0, ALLOC_ZERO);
+        if (!table) {
+            return NULL;
+        }
+        *entry = page_to_phys(table) | PAGE_PRESENT | PAGE_WRITABLE |
+                 (user ? PAGE_USER : 0);
+    }
+
+    if (*entry & PAGE_HUGE) {
+        return NULL;
+    }
+    return phys_to_direct(*entry & PAGE_ADDR_MASK);
+}
+
+/**
+ * pte_walk - Find the last-level entry for @vaddr under @pml4
+ */
+static uint64_t *pte_walk(uint64_t pml4, uint64_t vaddr, bool create)
+{
+    bool user = vaddr >= USER_SPACE_START && vaddr <= USER_SPACE_END;
+    uint64_t *table = phys_to_direct(pml4);
+
+    for (int level = 3; level > 0; level--) {
+        uint64_t *entry = &table[(vaddr >> (12 + 9 * level)) & 0x1FF];
+        table = table_next(entry, create, user);
+        if (!table) {
+            return NULL;
+        }
+    }
+
+    return &table[(vaddr >> 12) & 0x1FF];
+}
+
+/**
+ * vmem_map_page - Map a kernel page
+ */
+void *vmem_map_page(uint64_t vaddr, uint64_t paddr, uint64_t flags)
+{
+    uint64_t *pte = pte_walk(kernel_pml4, vaddr, true);
+    if (!pte) {
+        return NULL;
+    }
+
+    *pte = (paddr & PAGE_ADDR_MASK) | flags | PAGE_PRESENT;
+    cpu_invlpg(vaddr);
+    return (void *)vaddr;
+}
+
+/**
+ * vmem_unmap_page - Remove a kernel page mapping
+ */
+void vmem_unmap_page(uint64_t vaddr)
+{
+    uint64_t *pte = pte_walk(kernel_pml4, vaddr, false);
+    if (pte) {
+        *pte = 0;
+        cpu_invlpg(vaddr);
+    }
+}
+
+/**
+ * vmem_translate - Walk the kernel tables, honouring 1GB and 2MB pages
+ */
+static bool vmem_translate(uint64_t vaddr, uint64_t *paddr)
+{
+    uint64_t *table = phys_to_direct(kernel_pml4);
+
+    for (int level = 3; level >= 0; level--) {
+        uint64_t entry = table[(vaddr >> (12 + 9 * level)) & 0x1FF];
+        if (!(entry & PAGE_PRESENT)) {
+            return false;
+        }
+
+        uint64_t span = 1UL << (12 + 9 * level);
+        if (level == 0 || (entry & PAGE_HUGE)) {
+            *paddr = (entry & PAGE_ADDR_MASK & ~(span - 1)) | (vaddr & (span - 1));
+            return true;
+        }
+        table = phys_to_direct(entry & PAGE_ADDR_MASK);
+    }
+
+    return false;
+}
+
+/**
+ * vmem_get_physical_addr - Translate a kernel virtual address
+ *
+ * Returns 0 when the address is not mapped.
+ */
+uint64_t vmem_get_physical_addr(uint64_t vaddr)
+{
+    uint64_t paddr;
+    return vmem_translate(vaddr, &paddr) ? paddr : 0;
+}
+
+bool vmem_is_mapped(uint64_t vaddr)
+{
+    uint64_t paddr;
+    return vmem_translate(vaddr, &paddr);
+}
+
+/**
+ * vmem_map_phys - Map a physical range into the MMIO window
+ * @flags: Extra page flags (caching attributes)
+ *
+ * Window space is never reused; mappings are meant to live as long as the
+ * device or table they expose. Each mapping is followed by a guard page.
+ */
+void *vmem_map_phys(uint64_t paddr, uint64_t size, uint64_t flags)
+{
+    uint64_t offset = paddr & PAGE_MASK;
+    uint64_t length = page_align_up(size + offset);
+
+    if (!size || mmio_next + length + PAGE_SIZE > MMIO_BASE + MMIO_SIZE) {
+        return NULL;
+    }
+
+    uint64_t vaddr = mmio_next;
+    mmio_next += length + PAGE_SIZE;
+
+    for (uint64_t i = 0; i < length; i += PAGE_SIZE) {
+        if (!vmem_map_page(vaddr + i, paddr - offset + i,
+                           flags | PAGE_WRITABLE | PAGE_GLOBAL | nx_mask)) {
+            return NULL;
+        }
+    }
+    return (void *)(vaddr + offset);
+}
+
+/**
+ * ioremap - Map device registers uncached
+ */
+void *ioremap(uint64_t paddr, uint64_t size)
+{
+    return vmem_map_phys(paddr, size, PAGE_CACHE_DISABLE | PAGE_WRITE_THROUGH);
+}
+
+/**
+ * vm_protection_bits - Page table flags for a user page of an area
+ */
+uint64_t vm_protection_bits(uint32_t vma_flags, bool writable)
+{
+    uint64_t bits = PAGE_PRESENT | PAGE_USER;
+
+    if (writable) {
+        bits |= PAGE_WRITABLE;
+    }
+    if (!(vma_flags & VMA_EXEC)) {
+        bits |= nx_mask;
+    }
+    return bits;
+}
+
+/**
+ * vm_lookup_pte - Locate the page table entry of a user address
+ */
+uint64_t *vm_lookup_pte(struct vm_space *space, uint64_t vaddr, bool create)
+{
+    return pte_walk(space->pml4, vaddr, create);
+}
+
+/**
+ * vm_flush_page - Invalidate a stale translation if the space is live
+ */
+void vm_flush_page(struct vm_space *space, uint64_t vaddr)
+{
+    if (space == current_vm_space) {
+        cpu_invlpg(vaddr);
+    }
+}
+
+/**
+ * vm_map_user_page - Install @page at @vaddr
+ *
+ * The caller's reference on @page is transferred to the page table.
+ */
+int vm_map_user_page(struct vm_space *space, uint64_t vaddr, struct page *page,
+                     uint32_t vma_flags, bool writable)
+{
+    uint64_t *pte = vm_lookup_pte(space, vaddr, true);
+    if (!pte) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    bool replaced = *pte & PAGE_PRESENT;
+    *pte = page_to_phys(page) | vm_protection_bits(vma_flags, writable);
+
+    if (replaced) {
+        vm_flush_page(space, vaddr);
+    } else {
+        space->resident_pages++;
+    }
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * vm_unmap_range - Drop every mapping in [start, end)
+ */
+void vm_unmap_range(struct vm_space *space, uint64_t start, uint64_t end)
+{
+    uint64_t vaddr = start;
+
+    while (vaddr < end) {
+        uint64_t *pte = vm_lookup_pte(space, vaddr, false);
+        if (!pte) {
+            /* No page table here: skip to the next 2MB boundary */
+            vaddr = ALIGN_DOWN(vaddr, LARGE_PAGE_SIZE) + LARGE_PAGE_SIZE;
+            continue;
+        }
+
+        if (*pte & PAGE_PRESENT) {
+            struct page *page = phys_to_page(*pte & PAGE_ADDR_MASK);
+            *pte = 0;
+            vm_flush_page(space, vaddr);
+            space->resident_pages--;
+            page_put(page);
+        }
+        vaddr += PAGE_SIZE;
+    }
+}
+
+/**
+ * vm_space_create - Allocate an empty user address space
+ */
+struct vm_space *vm_space_create(void)
+{
+    struct vm_space *space = kzalloc(sizeof(*space));
+    if (!space) {
+        return NULL;
+    }
+
+    struct page *root = page_alloc(0, ALLOC_ZERO);
+    if (!root) {
+        kfree(space);
+        return NULL;
+    }
+
+    /* Share the direct map and any upper-half kernel mappings */
+    uint64_t *pml4 = page_address(root);
+    uint64_t *kernel = phys_to_direct(kernel_pml4);
+    pml4[0] = kernel[0];
+    for (int i = PML4_USER_LAST + 1; i < PT_ENTRIES; i++) {
+        pml4[i] = kernel[i];
+    }
+
+    space->pml4 = page_to_phys(root);
+    atomic_set(&space->users, 1);
+    return space;
+}
+
+/**
+ * vm_free_tables - Release user page table pages below @table
+ */
+static void vm_free_tables(uint64_t table_phys, int level)
+{
+    uint64_t *table = phys_to_direct(table_phys);
+
+    if (level > 1) {
+        for (int i = 0; i < PT_ENTRIES; i++) {
+            if ((table[i] & PAGE_PRESENT) && !(table[i] & PAGE_HUGE)) {
+                vm_free_tables(table[i] & PAGE_ADDR_MASK, level - 1);
+            }
+        }
+    }
+    page_free(phys_to_page(table_phys), 0);
+}
+
+/**
+ * vm_space_destroy - Drop a reference, tearing the space down with the last
+ */
+void vm_space_destroy(struct vm_space *space)
+{
+    if (!space || !atomic_dec_and_test(&space->users)) {
+        return;
+    }
+
+    while (space->areas) {
+        struct vm_area *vma = space->areas;
+        space->areas = vma->next;
+        vm_unmap_range(space, vma->start, vma->end);
+        vma_free(vma);
+    }
+
+    /* Never free tables the CPU may still be walking */
+    if (current_vm_space == space) {
+        vm_space_activate(NULL);
+    }
+
+    uint64_t *pml4 = phys_to_direct(space->pml4);
+    for (int i = PML4_USER_FIRST; i <= PML4_USER_LAST; i++) {
+        if (pml4[i] & PAGE_PRESENT) {
+            vm_free_tables(pml4[i] & PAGE_ADDR_MASK, 3);
+        }
+    }
+    page_free(phys_to_page(space->pml4), 0);
+    kfree(space);
+}
+
+/**
+ * vm_space_activate - Switch to @space, or to the bare kernel tables
+ */
+void vm_space_activate(struct vm_space *space)
+{
+    current_vm_space = space;
+    cpu_write_cr3(space ? space->pml4 : kernel_pml4);
+}
@@ -0,0 +1,199 @@
+/*
+ * Power1 OS - Local APIC
+ * Interrupt acknowledgement and the processor-to-APIC-ID map
+ *
+ * Device interrupts arrive as MSI/MSI-X messages addressed to a local
+ * APIC ID, so drivers steer a vector to a CPU by looking its APIC ID up
+ * here. The map is filled from the ACPI MADT; without one only the boot
+ * CPU is known.
+ *
+ * The local APIC timer drives the timer subsystem as a one-shot clock
+ * event. With TSC-deadline mode the deadline is written as a TSC value;
+ * otherwise the countdown rate is measured against the TSC once and each
+ * deadline is converted into a count.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/cpu.h"
+#include "../include/io.h"
+#include "../include/atomic.h"
+#include "../include/interrupts.h"
+#include "../include/init.h"
+
+#define MSR_APIC_BASE           0x1B
+#define APIC_BASE_ENABLE        (1UL << 11)
+#define APIC_BASE_ADDR_MASK     0x000FFFFFFFFFF000UL
+
+/* Register offsets */
+#define LAPIC_ID                0x020
+#define LAPIC_TPR               0x080
+#define LAPIC_EOI               0x0B0
+#define LAPIC_SVR               0x0F0
+#define LAPIC_SVR_ENABLE        (1 << 8)
+#define LAPIC_LVT_TIMER         0x320
+#define LAPIC_TIMER_INITIAL     0x380
+#define LAPIC_TIMER_CURRENT     0x390
+#define LAPIC_TIMER_DIVIDE      0x3E0
+
+#define LAPIC_LVT_MASKED        (1 << 16)
+#define LAPIC_TIMER_ONESHOT     (0 << 17)
+#define LAPIC_TIMER_TSC_DEADLINE (2 << 17)
+#define LAPIC_TIMER_DIVIDE_16   0x3
+
+#define LAPIC_CALIBRATE_US      10000   /* Countdown measured over 10ms */
+
+static volatile uint8_t *lapic_base = NULL;
+static uint32_t cpu_apic_ids[CPU_MAX];
+static unsigned int cpu_count = 0;
+
+/* Timer: TSC-deadline mode, or countdown ticks per 2^32 TSC cycles */
+static bool lapic_tsc_deadline = false;
+static uint64_t lapic_ticks_per_tsc = 0;
+
+/**
+ * lapic_eoi - Signal end of interrupt
+ */
+void lapic_eoi(void)
+{
+    if (lapic_base) {
+        mmio_write32(lapic_base + LAPIC_EOI, 0);
+    }
+}
+
+/**
+ * lapic_id - APIC ID of the executing CPU
+ */
+uint32_t lapic_id(void)
+{
+    return lapic_base ? mmio_read32(lapic_base + LAPIC_ID) >> 24 : 0;
+}
+
+/**
+ * lapic_add_cpu - Record an enabled processor's APIC ID
+ */
+void lapic_add_cpu(uint32_t apic_id)
+{
+    if (cpu_count < CPU_MAX) {
+        cpu_apic_ids[cpu_count++] = apic_id;
+    }
+}
+
+/**
+ * lapic_cpu_count - Processors interrupts can be steered to
+ */
+unsigned int lapic_cpu_count(void)
+{
+    return cpu_count ? cpu_count : 1;
+}
+
+/**
+ * lapic_online_count - Processors running the kernel
+ *
+ * Application processors are never started, so this is the boot CPU alone
+ * however many the MADT lists.
+ */
+unsigned int lapic_online_count(void)
+{
+    return 1;
+}
+
+/**
+ * lapic_cpu_apic_id - Destination APIC ID for logical CPU @cpu
+ */
+uint32_t lapic_cpu_apic_id(unsigned int cpu)
+{
+    if (!cpu_count) {
+        return lapic_id();
+    }
+    return cpu_apic_ids[cpu % cpu_count];
+}
+
+/**
+ * lapic_init - Map and software-enable the boot CPU's local APIC
+ */
+int __init lapic_init(void)
+{
+    if (!cpu_has_feature(X86_FEATURE_APIC)) {
+        return KERNEL_ERROR_NOTFOUND;
+    }
+
+    uint64_t base = cpu_read_msr(MSR_APIC_BASE);
+    cpu_write_msr(MSR_APIC_BASE, base | APIC_BASE_ENABLE);
+
+    lapic_base = ioremap(base & APIC_BASE_ADDR_MASK, PAGE_SIZE);
+    if (!lapic_base) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    mmio_write32(lapic_base + LAPIC_TPR, 0);
+    mmio_write32(lapic_base + LAPIC_SVR, LAPIC_SVR_ENABLE | SPURIOUS_VECTOR);
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * lapic_timer_init - Set up the timer as a one-shot clock event on @vector
+ * @tsc_khz: TSC rate, for measuring the countdown rate
+ */
+int lapic_timer_init(uint8_t vector, uint64_t tsc_khz)
+{
+    if (!lapic_base || !tsc_khz) {
+        return KERNEL_ERROR_NOTFOUND;
+    }
+
+    if (cpu_has_feature(X86_FEATURE_TSC_DEADLINE)) {
+        lapic_tsc_deadline = true;
+        mmio_write32(lapic_base + LAPIC_LVT_TIMER, LAPIC_TIMER_TSC_DEADLINE | vector);
+        return KERNEL_SUCCESS;
+    }
+
+    /* Count down from the maximum for a known number of TSC cycles */
+    mmio_write32(lapic_base + LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+    mmio_write32(lapic_base + LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | LAPIC_TIMER_ONESHOT | vector);
+
+    uint64_t cycles = tsc_khz * LAPIC_CALIBRATE_US / 1000;
+    uint64_t start = cpu_read_tsc();
+    mmio_write32(lapic_base + LAPIC_TIMER_INITIAL, 0xFFFFFFFF);
+    while (cpu_read_tsc() - start < cycles) {
+        cpu_relax();
+    }
+    uint32_t elapsed = 0xFFFFFFFF - mmio_read32(lapic_base + LAPIC_TIMER_CURRENT);
+    mmio_write32(lapic_base + LAPIC_TIMER_INITIAL, 0);
+
+    if (!elapsed) {
+        return KERNEL_ERROR_NOTFOUND;
+    }
+
+    lapic_ticks_per_tsc = ((uint64_t)elapsed << 32) / cycles;
+    mmio_write32(lapic_base + LAPIC_LVT_TIMER, LAPIC_TIMER_ONESHOT | vector);
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * lapic_timer_arm - Raise the timer vector at TSC value @tsc_deadline
+ *
+ * Zero disarms. A deadline already passed fires as soon as possible.
+ */
+void lapic_timer_arm(uint64_t tsc_deadline)
+{
+    if (lapic_tsc_deadline) {
+        cpu_write_msr(MSR_TSC_DEADLINE, tsc_deadline);
+        return;
+    }
+    if (!lapic_ticks_per_tsc) {
+        return;
+    }
+
+    uint64_t now = cpu_read_tsc();
+    uint64_t count = 0;
+
+    if (tsc_deadline) {
+        uint64_t delta = tsc_deadline > now ? tsc_deadline - now : 0;
+        count = (uint64_t)(((unsigned __int128)delta * lapic_ticks_per_tsc) >> 32);
+        count = count ? MIN(count, 0xFFFFFFFFUL) : 1;
+    }
+    mmio_write32(lapic_base + LAPIC_TIMER_INITIAL, (uint32_t)count);
+}
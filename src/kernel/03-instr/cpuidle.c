@@ -0,0 +1,249 @@
+/*
+ * Power1 OS - CPU Idle
+ * MONITOR/MWAIT and HLT idle states with a predictive governor
+ *
+ * State 0 polls the wake word with interrupts enabled and is for idle
+ * periods too short for any sleeping state. The states after it are
+ * ordered by depth: the MWAIT C-states CPUID leaf 5 reports sub-states
+ * for, or HLT alone when MWAIT cannot be used. Exit latencies are not
+ * reported by the processor, so each C-state takes a conservative
+ * default.
+ *
+ * Each CPU's wake word sits on its own cache line, which is the line
+ * MONITOR arms. cpuidle_wake sets the word once per idle period, so a CPU
+ * polling or in MWAIT resumes on the coherence traffic alone. The word is
+ * only cleared by its CPU on the way out of cpu_idle, so a wake that
+ * lands before the CPU has armed the monitor is seen by the check
+ * between MONITOR and MWAIT.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/cpu.h"
+#include "../include/atomic.h"
+#include "../include/interrupts.h"
+#include "../include/timer.h"
+#include "../include/cpuidle.h"
+#include "../include/init.h"
+
+#define CPUID_MWAIT_LEAF        5
+#define MWAIT_ECX_EXTENSIONS    (1 << 0)    /* EDX enumerates sub-states */
+#define MWAIT_CSTATE_MAX        7
+#define MWAIT_SUBSTATE_MASK     0xF
+#define MWAIT_HINT_CSTATE_SHIFT 4
+
+#define CPUIDLE_AVG_SHIFT       3           /* Average weighs the last 8 periods */
+#define CPUIDLE_AVG_INIT        NSEC_PER_MSEC
+
+struct cpuidle_cpu {
+    /* The monitored line: written by wakers, read by its CPU */
+    uint32_t wake;
+    uint32_t polling;           /* In a state a store to @wake ends */
+
+    /* Governor state, only touched by its CPU */
+    uint64_t avg_idle __attribute__((aligned(64)));
+    uint64_t usage[CPUIDLE_STATE_MAX];
+    uint64_t time[CPUIDLE_STATE_MAX];       /* ns spent in each state */
+} __attribute__((aligned(64)));
+
+/* Exit latency and target residency of MWAIT C1..C7, in ns */
+static const struct {
+    const char *name;
+    uint64_t exit_latency;
+    uint64_t target_residency;
+} mwait_cstates[MWAIT_CSTATE_MAX] = {
+    { "C1", 1000, 2000 },
+    { "C2", 20000, 60000 },
+    { "C3", 80000, 200000 },
+    { "C4", 120000, 400000 },
+    { "C5", 160000, 600000 },
+    { "C6", 200000, 800000 },
+    { "C7", 300000, 1200000 },
+};
+
+static struct cpuidle_cpu cpuidle_cpus[CPU_MAX];
+static struct cpuidle_state cpuidle_states[CPUIDLE_STATE_MAX];
+static unsigned int cpuidle_nr_states = 0;
+static uint64_t cpuidle_latency_limit = UINT64_MAX;
+
+/**
+ * cpuidle_set_latency_limit - Skip states slower than @ns to leave
+ *
+ * Zero restricts idle to polling.
+ */
+void cpuidle_set_latency_limit(uint64_t ns)
+{
+    __atomic_store_n(&cpuidle_latency_limit, ns, __ATOMIC_RELAXED);
+}
+
+/**
+ * cpuidle_wake - End @cpu's current or next idle period
+ *
+ * Returns false if @cpu is halted, where only an interrupt wakes it.
+ */
+bool cpuidle_wake(unsigned int cpu)
+{
+    struct cpuidle_cpu *ci = &cpuidle_cpus[cpu % CPU_MAX];
+
+    /* Only the first wake of a period moves the line */
+    if (!__atomic_load_n(&ci->wake, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&ci->wake, 1, __ATOMIC_SEQ_CST);
+    }
+    return __atomic_load_n(&ci->polling, __ATOMIC_SEQ_CST) != 0;
+}
+
+/**
+ * cpuidle_select - Deepest state worth entering for the predicted idle time
+ */
+static unsigned int cpuidle_select(struct cpuidle_cpu *ci, uint64_t now)
+{
+    uint64_t limit = __atomic_load_n(&cpuidle_latency_limit, __ATOMIC_RELAXED);
+    uint64_t predicted = ci->avg_idle;
+    uint64_t next = timer_next_expiry();
+    unsigned int index = 0;
+
+    /* Without a clock nothing can be predicted or timed; stay shallow */
+    if (!clock_tsc_khz()) {
+        return cpuidle_nr_states > 1 && limit >= cpuidle_states[1].exit_latency ? 1 : 0;
+    }
+
+    if (next) {
+        predicted = MIN(predicted, next > now ? next - now : 0);
+    }
+    for (unsigned int i = 1; i < cpuidle_nr_states; i++) {
+        const struct cpuidle_state *state = &cpuidle_states[i];
+
+        if (state->target_residency > predicted || state->exit_latency > limit) {
+            break;
+        }
+        index = i;
+    }
+    return index;
+}
+
+/**
+ * cpuidle_poll - Spin until woken, interrupted or @until passes
+ *
+ * Interrupts are taken while spinning; one that wakes a task sets the
+ * wake word through the scheduler.
+ */
+static void cpuidle_poll(struct cpuidle_cpu *ci, uint64_t until)
+{
+    cpu_enable_interrupts();
+    while (!__atomic_load_n(&ci->wake, __ATOMIC_ACQUIRE) && clock_ns() < until) {
+        cpu_relax();
+    }
+    cpu_disable_interrupts();
+}
+
+/**
+ * cpuidle_mwait - Wait for a store to the wake word or an interrupt
+ *
+ * STI holds interrupts off for one more instruction, so one arriving
+ * after the wake check still ends the MWAIT instead of being missed.
+ */
+static void cpuidle_mwait(struct cpuidle_cpu *ci, uint32_t hint)
+{
+    __asm__ volatile ("monitor" :: "a" (&ci->wake), "c" (0), "d" (0) : "memory");
+    if (!__atomic_load_n(&ci->wake, __ATOMIC_ACQUIRE)) {
+        __asm__ volatile ("sti; mwait; cli" :: "a" (hint), "c" (0) : "memory");
+    }
+}
+
+/**
+ * cpu_idle - Idle this CPU until an interrupt or a wake
+ */
+void cpu_idle(void)
+{
+    struct cpuidle_cpu *ci = &cpuidle_cpus[cpu_current_id()];
+
+    if (!cpuidle_nr_states) {
+        __asm__ volatile ("sti; hlt; cli" ::: "memory");
+        return;
+    }
+
+    uint64_t start = clock_ns();
+    unsigned int index = cpuidle_select(ci, start);
+    const struct cpuidle_state *state = &cpuidle_states[index];
+
+    if (state->flags & CPUIDLE_FLAG_HLT) {
+        __asm__ volatile ("sti; hlt; cli" ::: "memory");
+    } else {
+        __atomic_store_n(&ci->polling, 1, __ATOMIC_SEQ_CST);
+        if (state->flags & CPUIDLE_FLAG_POLL) {
+            /* Long enough for the next state to have paid off */
+            uint64_t span = index + 1 < cpuidle_nr_states ?
+                            cpuidle_states[index + 1].target_residency : CPUIDLE_AVG_INIT;
+            cpuidle_poll(ci, start + span);
+        } else {
+            cpuidle_mwait(ci, state->mwait_hint);
+        }
+        __atomic_store_n(&ci->polling, 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&ci->wake, 0, __ATOMIC_RELAXED);
+
+    uint64_t idle = clock_ns() - start;
+    ci->avg_idle += (idle >> CPUIDLE_AVG_SHIFT) - (ci->avg_idle >> CPUIDLE_AVG_SHIFT);
+    ci->usage[index]++;
+    ci->time[index] += idle;
+}
+
+/**
+ * cpuidle_add_state - Fill slot *@nr with a state deeper than the ones before it
+ */
+static void __init cpuidle_add_state(unsigned int *nr, const char *name, uint32_t flags,
+                                     uint32_t hint, uint64_t exit_latency,
+                                     uint64_t target_residency)
+{
+    struct cpuidle_state *state = &cpuidle_states[(*nr)++];
+
+    state->name = name;
+    state->flags = flags;
+    state->mwait_hint = hint;
+    state->exit_latency = exit_latency;
+    state->target_residency = target_residency;
+}
+
+/**
+ * cpuidle_init - Build the state table from CPUID
+ */
+int __init cpuidle_init(void)
+{
+    struct cpu_info info;
+    uint32_t eax, ebx, ecx, edx;
+    uint32_t substates = 0;
+
+    cpu_get_info(&info);
+    if (cpu_has_feature(X86_FEATURE_MONITOR) && info.max_leaf >= CPUID_MWAIT_LEAF) {
+        cpu_cpuid(CPUID_MWAIT_LEAF, 0, &eax, &ebx, &ecx, &edx);
+
+        /* Without the enumeration only C1 is known to exist */
+        substates = (ecx & MWAIT_ECX_EXTENSIONS) ? edx : 1U << MWAIT_HINT_CSTATE_SHIFT;
+    }
+
+    for (unsigned int i = 0; i < CPU_MAX; i++) {
+        cpuidle_cpus[i].avg_idle = CPUIDLE_AVG_INIT;
+    }
+
+    unsigned int nr = 0;
+    cpuidle_add_state(&nr, "POLL", CPUIDLE_FLAG_POLL, 0, 0, 0);
+    for (unsigned int c = 1; c <= MWAIT_CSTATE_MAX; c++) {
+        if ((substates >> (c * MWAIT_HINT_CSTATE_SHIFT)) & MWAIT_SUBSTATE_MASK) {
+            cpuidle_add_state(&nr, mwait_cstates[c - 1].name, CPUIDLE_FLAG_MWAIT,
+                              (c - 1) << MWAIT_HINT_CSTATE_SHIFT,
+                              mwait_cstates[c - 1].exit_latency,
+                              mwait_cstates[c - 1].target_residency);
+        }
+    }
+    if (nr == 1) {
+        cpuidle_add_state(&nr, "HLT", CPUIDLE_FLAG_HLT, 0,
+                          mwait_cstates[0].exit_latency, mwait_cstates[0].target_residency);
+    }
+
+    /* Published last: cpu_idle halts until the table is complete */
+    __atomic_store_n(&cpuidle_nr_states, nr, __ATOMIC_RELEASE);
+    return KERNEL_SUCCESS;
+}
+initcall(cpuidle_init, 0, timer_subsystem_init);
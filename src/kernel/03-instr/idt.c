@@ -0,0 +1,201 @@
+/*
+ * Power1 OS - Interrupt Descriptor Table
+ * Exception and interrupt vector setup with a C-level dispatch table
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/interrupts.h"
+#include "../include/io.h"
+#include "../include/softirq.h"
+#include "../include/init.h"
+
+/* Legacy 8259 PIC ports */
+#define PIC1_COMMAND            0x20
+#define PIC1_DATA               0x21
+#define PIC2_COMMAND            0xA0
+#define PIC2_DATA               0xA1
+#define PIC_ICW1_INIT           0x11
+#define PIC_ICW4_8086           0x01
+
+/* IDT gate descriptor */
+struct idt_entry {
+    uint16_t offset_low;
+    uint16_t selector;
+    uint8_t ist;
+    uint8_t type_attr;
+    uint16_t offset_mid;
+    uint32_t offset_high;
+    uint32_t zero;
+} __packed;
+
+struct idt_pointer {
+    uint16_t limit;
+    uint64_t base;
+} __packed;
+
+/* Entry stubs from isr.asm */
+extern uint64_t isr_stub_table[IDT_ENTRIES];
+
+static struct idt_entry idt[IDT_ENTRIES] __aligned(16);
+static interrupt_handler_t interrupt_handlers[IDT_ENTRIES];
+
+/* Device vectors handed out by interrupt_alloc_vector */
+static struct {
+    irq_handler_t handler;
+    void *data;
+} irq_actions[IDT_ENTRIES];
+
+static const char *exception_names[EXCEPTION_COUNT] = {
+    "Divide error", "Debug", "Non-maskable interrupt", "Breakpoint",
+    "Overflow", "Bound range exceeded", "Invalid opcode", "Device not available",
+    "Double fault", "Coprocessor segment overrun", "Invalid TSS", "Segment not present",
+    "Stack-segment fault", "General protection fault", "Page fault", "Reserved",
+    "x87 floating-point exception", "Alignment check", "Machine check", "SIMD floating-point exception",
+    "Virtualization exception", "Control protection exception", "Reserved", "Reserved",
+    "Reserved", "Reserved", "Reserved", "Reserved",
+    "Hypervisor injection exception", "VMM communication exception", "Security exception", "Reserved"
+};
+
+/**
+ * idt_set_gate - Fill one IDT descriptor
+ */
+static void idt_set_gate(uint8_t vector, uint64_t handler, uint8_t type_attr)
+{
+    struct idt_entry *entry = &idt[vector];
+
+    entry->offset_low = handler & 0xFFFF;
+    entry->selector = KERNEL_CODE_SELECTOR;
+    entry->ist = 0;
+    entry->type_attr = type_attr;
+    entry->offset_mid = (handler >> 16) & 0xFFFF;
+    entry->offset_high = (handler >> 32) & 0xFFFFFFFF;
+    entry->zero = 0;
+}
+
+/**
+ * pic_disable - Remap the legacy PIC away from exception vectors and mask it
+ */
+static void pic_disable(void)
+{
+    outb(PIC1_COMMAND, PIC_ICW1_INIT);
+    io_wait();
+    outb(PIC2_COMMAND, PIC_ICW1_INIT);
+    io_wait();
+    outb(PIC1_DATA, IRQ_BASE_VECTOR);
+    io_wait();
+    outb(PIC2_DATA, IRQ_BASE_VECTOR + 8);
+    io_wait();
+    outb(PIC1_DATA, 4);
+    io_wait();
+    outb(PIC2_DATA, 2);
+    io_wait();
+    outb(PIC1_DATA, PIC_ICW4_8086);
+    io_wait();
+    outb(PIC2_DATA, PIC_ICW4_8086);
+    io_wait();
+
+    outb(PIC1_DATA, 0xFF);
+    outb(PIC2_DATA, 0xFF);
+}
+
+/**
+ * interrupt_register_handler - Attach a C handler to a vector
+ */
+int interrupt_register_handler(uint8_t vector, interrupt_handler_t handler)
+{
+    if (interrupt_handlers[vector] && handler) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    interrupt_handlers[vector] = handler;
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * interrupt_alloc_vector - Claim a free device vector for @handler
+ *
+ * Returns the vector number, or KERNEL_ERROR_NOSPC when all are in use.
+ */
+int interrupt_alloc_vector(irq_handler_t handler, void *data)
+{
+    if (!handler) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    for (int vector = IRQ_DYNAMIC_FIRST; vector <= IRQ_DYNAMIC_LAST; vector++) {
+        if (!irq_actions[vector].handler && !interrupt_handlers[vector]) {
+            irq_actions[vector].data = data;
+            irq_actions[vector].handler = handler;
+            return vector;
+        }
+    }
+    return KERNEL_ERROR_NOSPC;
+}
+
+/**
+ * interrupt_free_vector - Return a vector from interrupt_alloc_vector
+ */
+void interrupt_free_vector(int vector)
+{
+    if (vector >= IRQ_DYNAMIC_FIRST && vector <= IRQ_DYNAMIC_LAST) {
+        irq_actions[vector].handler = NULL;
+        irq_actions[vector].data = NULL;
+    }
+}
+
+/**
+ * interrupt_dispatch - Common C entry point called from isr.asm
+ */
+void interrupt_dispatch(struct interrupt_frame *frame)
+{
+    uint8_t vector = frame->vector & 0xFF;
+    interrupt_handler_t handler = interrupt_handlers[vector];
+    bool device = vector >= IRQ_BASE_VECTOR && vector != SPURIOUS_VECTOR;
+
+    if (device) {
+        irq_enter();
+    }
+
+    if (handler) {
+        handler(frame);
+    } else if (irq_actions[vector].handler) {
+        irq_actions[vector].handler(irq_actions[vector].data);
+    } else if (vector < EXCEPTION_COUNT) {
+        kernel_panic(exception_names[vector]);
+    }
+
+    /* Unclaimed device vectors are ignored, but still acknowledged */
+    if (device) {
+        lapic_eoi();
+        irq_exit();
+    }
+}
+
+/**
+ * interrupt_system_init - Install the IDT and core exception handlers
+ */
+int __init interrupt_system_init(void)
+{
+    struct idt_pointer idtr;
+
+    pic_disable();
+
+    for (int vector = 0; vector < IDT_ENTRIES; vector++) {
+        idt_set_gate((uint8_t)vector, isr_stub_table[vector], IDT_GATE_INTERRUPT);
+    }
+
+    interrupt_register_handler(EXCEPTION_PAGE_FAULT, page_fault_handler);
+
+    /* Without a local APIC there are no MSI vectors, but exceptions work */
+    lapic_init();
+
+    idtr.limit = sizeof(idt) - 1;
+    idtr.base = (uint64_t)idt;
+    __asm__ volatile ("lidt %0" :: "m" (idtr));
+
+    return KERNEL_SUCCESS;
+}
+initcall(interrupt_system_init, 0, memory_manager_init);
@@ -0,0 +1,74 @@
+; Power1 OS - Interrupt Entry Stubs
+; Per-vector entry points that build a struct interrupt_frame and call
+; interrupt_dispatch. Vectors without a CPU error code push a zero so the
+; frame layout is identical for every vector.
+
+[bits 64]
+section .text
+
+extern interrupt_dispatch
+
+; Common path: save general purpose registers, dispatch, restore, return
+isr_common:
+    push rax
+    push rbx
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push rbp
+    push r8
+    push r9
+    push r10
+    push r11
+    push r12
+    push r13
+    push r14
+    push r15
+
+    mov rdi, rsp                    ; struct interrupt_frame *
+    cld
+    call interrupt_dispatch
+
+global interrupt_return
+interrupt_return:
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rbp
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rbx
+    pop rax
+    add rsp, 16                     ; Drop vector and error code
+    iretq
+
+; Exceptions 8, 10-14, 17, 21, 29 and 30 push an error code
+%assign vector 0
+%rep 256
+isr_stub_%+vector:
+%if !(vector == 8 || (vector >= 10 && vector <= 14) || vector == 17 || vector == 21 || vector == 29 || vector == 30)
+    push qword 0                    ; Dummy error code
+%endif
+    push qword vector               ; Vector number
+    jmp isr_common
+%assign vector vector + 1
+%endrep
+
+; Table of stub addresses consumed by idt.c
+section .rodata
+align 8
+global isr_stub_table
+isr_stub_table:
+%assign vector 0
+%rep 256
+    dq isr_stub_%+vector
+%assign vector vector + 1
+%endrep
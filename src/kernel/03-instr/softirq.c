@@ -0,0 +1,279 @@
+/*
+ * Power1 OS - Softirqs and Tasklets
+ * Deferred interrupt work, run at interrupt exit or by ksoftirqd
+ *
+ * Each CPU has its own pending mask and tasklet lists, so raising and
+ * running softirqs never touches another CPU's cache lines. Pending bits
+ * are set with interrupts off and consumed in one exchange, which gathers
+ * every completion since the last round into a single pass per handler.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/cpu.h"
+#include "../include/interrupts.h"
+#include "../include/process.h"
+#include "../include/softirq.h"
+#include "../include/init.h"
+
+struct tasklet_list {
+    struct tasklet *head;
+    struct tasklet **tail;
+};
+
+struct softirq_cpu {
+    uint32_t pending;           /* Raised softirq bits */
+    uint32_t irq_depth;         /* Nested device interrupt handlers */
+    bool in_softirq;
+    struct task *ksoftirqd;
+    struct wait_queue wait;     /* ksoftirqd sleeps here */
+    struct tasklet_list tasklets;
+    struct tasklet_list hi_tasklets;
+} __attribute__((aligned(64)));
+
+static struct softirq_cpu softirq_cpus[CPU_MAX];
+static softirq_action_t softirq_actions[NR_SOFTIRQS];
+
+static inline struct softirq_cpu *softirq_this_cpu(void)
+{
+    return &softirq_cpus[cpu_current_id()];
+}
+
+/**
+ * open_softirq - Install the handler for softirq @nr
+ */
+void open_softirq(unsigned int nr, softirq_action_t action)
+{
+    if (nr < NR_SOFTIRQS) {
+        softirq_actions[nr] = action;
+    }
+}
+
+/**
+ * wakeup_softirqd - Hand pending softirqs to this CPU's thread
+ */
+static void wakeup_softirqd(struct softirq_cpu *sc)
+{
+    if (sc->ksoftirqd) {
+        wait_queue_wake_one(&sc->wait);
+    }
+}
+
+/**
+ * raise_softirq - Mark softirq @nr pending on this CPU
+ *
+ * From an interrupt handler it runs at interrupt exit; anywhere else
+ * ksoftirqd is woken to run it.
+ */
+void raise_softirq(unsigned int nr)
+{
+    struct softirq_cpu *sc = softirq_this_cpu();
+    uint64_t flags = cpu_irq_save();
+
+    sc->pending |= 1U << nr;
+    if (!sc->irq_depth && !sc->in_softirq) {
+        wakeup_softirqd(sc);
+    }
+    cpu_irq_restore(flags);
+}
+
+bool in_hardirq(void)
+{
+    return softirq_this_cpu()->irq_depth != 0;
+}
+
+bool in_softirq(void)
+{
+    return softirq_this_cpu()->in_softirq;
+}
+
+/**
+ * do_softirq - Run pending softirq handlers for up to @rounds passes
+ *
+ * Returns true if softirqs were still pending when the rounds ran out.
+ */
+static bool do_softirq(struct softirq_cpu *sc, unsigned int rounds)
+{
+    sc->in_softirq = true;
+
+    while (rounds--) {
+        uint64_t flags = cpu_irq_save();
+        uint32_t pending = sc->pending;
+        sc->pending = 0;
+        cpu_irq_restore(flags);
+
+        if (!pending) {
+            break;
+        }
+        for (unsigned int nr = 0; nr < NR_SOFTIRQS; nr++) {
+            if ((pending & (1U << nr)) && softirq_actions[nr]) {
+                softirq_actions[nr]();
+            }
+        }
+    }
+
+    sc->in_softirq = false;
+    return sc->pending != 0;
+}
+
+/**
+ * irq_enter - A device interrupt handler starts
+ */
+void irq_enter(void)
+{
+    softirq_this_cpu()->irq_depth++;
+}
+
+/**
+ * irq_exit - A device interrupt handler finished; run what it raised
+ */
+void irq_exit(void)
+{
+    struct softirq_cpu *sc = softirq_this_cpu();
+
+    if (--sc->irq_depth || sc->in_softirq || !sc->pending) {
+        return;
+    }
+    if (do_softirq(sc, SOFTIRQ_MAX_RESTART)) {
+        wakeup_softirqd(sc);
+    }
+}
+
+/**
+ * ksoftirqd - Per-CPU thread for softirqs deferred from interrupt exit
+ *
+ * Yields after every round, so a softirq storm shares the CPU with tasks.
+ */
+static int ksoftirqd(void *arg)
+{
+    struct softirq_cpu *sc = arg;
+
+    for (;;) {
+        while (!sc->pending) {
+            wait_queue_sleep(&sc->wait);
+        }
+        do_softirq(sc, 1);
+        schedule();
+    }
+    return KERNEL_SUCCESS;
+}
+
+static void tasklet_enqueue(struct tasklet_list *list, struct tasklet *t, unsigned int nr)
+{
+    uint64_t flags = cpu_irq_save();
+
+    t->next = NULL;
+    *list->tail = t;
+    list->tail = &t->next;
+    cpu_irq_restore(flags);
+    raise_softirq(nr);
+}
+
+/**
+ * tasklet_init - Prepare @t to run @func(@data)
+ */
+void tasklet_init(struct tasklet *t, void (*func)(void *data), void *data)
+{
+    t->next = NULL;
+    t->state = 0;
+    t->func = func;
+    t->data = data;
+}
+
+/**
+ * tasklet_schedule - Run @t soon on this CPU, unless already scheduled
+ */
+void tasklet_schedule(struct tasklet *t)
+{
+    if (!(__atomic_fetch_or(&t->state, TASKLET_STATE_SCHED, __ATOMIC_ACQ_REL) & TASKLET_STATE_SCHED)) {
+        tasklet_enqueue(&softirq_this_cpu()->tasklets, t, TASKLET_SOFTIRQ);
+    }
+}
+
+/**
+ * tasklet_hi_schedule - tasklet_schedule, ahead of every other softirq
+ */
+void tasklet_hi_schedule(struct tasklet *t)
+{
+    if (!(__atomic_fetch_or(&t->state, TASKLET_STATE_SCHED, __ATOMIC_ACQ_REL) & TASKLET_STATE_SCHED)) {
+        tasklet_enqueue(&softirq_this_cpu()->hi_tasklets, t, HI_SOFTIRQ);
+    }
+}
+
+/**
+ * tasklet_run_list - Run every tasklet queued on @list
+ *
+ * A tasklet still running on another CPU is requeued for the next round.
+ */
+static void tasklet_run_list(struct tasklet_list *list, unsigned int nr)
+{
+    uint64_t flags = cpu_irq_save();
+    struct tasklet *t = list->head;
+    list->head = NULL;
+    list->tail = &list->head;
+    cpu_irq_restore(flags);
+
+    while (t) {
+        struct tasklet *next = t->next;
+
+        if (__atomic_fetch_or(&t->state, TASKLET_STATE_RUN, __ATOMIC_ACQUIRE) & TASKLET_STATE_RUN) {
+            tasklet_enqueue(list, t, nr);
+        } else {
+            __atomic_and_fetch(&t->state, ~TASKLET_STATE_SCHED, __ATOMIC_ACQ_REL);
+            t->func(t->data);
+            __atomic_and_fetch(&t->state, ~TASKLET_STATE_RUN, __ATOMIC_RELEASE);
+        }
+        t = next;
+    }
+}
+
+static void tasklet_action(void)
+{
+    tasklet_run_list(&softirq_this_cpu()->tasklets, TASKLET_SOFTIRQ);
+}
+
+static void tasklet_hi_action(void)
+{
+    tasklet_run_list(&softirq_this_cpu()->hi_tasklets, HI_SOFTIRQ);
+}
+
+/**
+ * tasklet_kill - Wait until @t is neither scheduled nor running
+ *
+ * The caller must keep @t from being scheduled again. Process context
+ * only.
+ */
+void tasklet_kill(struct tasklet *t)
+{
+    while (__atomic_load_n(&t->state, __ATOMIC_ACQUIRE) & (TASKLET_STATE_SCHED | TASKLET_STATE_RUN)) {
+        schedule();
+    }
+}
+
+/**
+ * softirq_init - Set up per-CPU state and start a ksoftirqd per online CPU
+ */
+int __init softirq_init(void)
+{
+    for (unsigned int cpu = 0; cpu < CPU_MAX; cpu++) {
+        struct softirq_cpu *sc = &softirq_cpus[cpu];
+        wait_queue_init(&sc->wait);
+        sc->tasklets.tail = &sc->tasklets.head;
+        sc->hi_tasklets.tail = &sc->hi_tasklets.head;
+    }
+
+    open_softirq(TASKLET_SOFTIRQ, tasklet_action);
+    open_softirq(HI_SOFTIRQ, tasklet_hi_action);
+
+    unsigned int cpus = MIN(lapic_online_count(), CPU_MAX);
+    for (unsigned int cpu = 0; cpu < cpus; cpu++) {
+        softirq_cpus[cpu].ksoftirqd = kthread_create("ksoftirqd", ksoftirqd, &softirq_cpus[cpu]);
+        if (!softirq_cpus[cpu].ksoftirqd) {
+            return KERNEL_ERROR_NOMEM;
+        }
+    }
+    return KERNEL_SUCCESS;
+}
+initcall(softirq_init, 0, interrupt_system_init, process_manager_init);
@@ -0,0 +1,256 @@
+/*
+ * Power1 OS - Timers
+ * TSC clock and per-CPU one-shot timers on the local APIC
+ *
+ * Time is the TSC scaled to nanoseconds since timer_subsystem_init. Each
+ * CPU keeps its pending timers in a list sorted by expiry, and the local
+ * APIC timer is armed for the head only, so an idle CPU takes no
+ * interrupts until something is actually due. Timers run on the CPU that
+ * added them.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/cpu.h"
+#include "../include/io.h"
+#include "../include/interrupts.h"
+#include "../include/spinlock.h"
+#include "../include/timer.h"
+#include "../include/init.h"
+
+#define PIT_CALIBRATE_MS        10
+#define PIT_CALIBRATE_SPINS     100000000UL  /* Give up if the PIT never counts out */
+
+struct timer_base {
+    spinlock_t lock;
+    struct list_head pending;
+    uint64_t armed;             /* Expiry the hardware is set for, 0 if none */
+} __attribute__((aligned(64)));
+
+static struct timer_base timer_bases[CPU_MAX];
+
+static uint64_t tsc_khz = 0;
+static uint64_t tsc_base = 0;
+static uint64_t ns_per_tsc = 0;     /* 32.32 fixed point */
+static uint64_t tsc_per_ns = 0;     /* 32.32 fixed point */
+
+/**
+ * tsc_khz_from_cpuid - TSC frequency reported by CPUID, or 0
+ */
+static uint64_t __init tsc_khz_from_cpuid(void)
+{
+    uint32_t max_leaf, eax, ebx, ecx, edx;
+
+    cpu_cpuid(0, 0, &max_leaf, &ebx, &ecx, &edx);
+
+    /* Leaf 0x15: TSC = crystal * ebx / eax */
+    if (max_leaf >= 0x15) {
+        cpu_cpuid(0x15, 0, &eax, &ebx, &ecx, &edx);
+        if (eax && ebx && ecx) {
+            return (uint64_t)ecx * ebx / eax / 1000;
+        }
+    }
+
+    /* Leaf 0x16: base frequency in MHz */
+    if (max_leaf >= 0x16) {
+        cpu_cpuid(0x16, 0, &eax, &ebx, &ecx, &edx);
+        if (eax & 0xFFFF) {
+            return (uint64_t)(eax & 0xFFFF) * 1000;
+        }
+    }
+    return 0;
+}
+
+/**
+ * tsc_khz_from_pit - Count TSC cycles over a PIT channel 2 countdown
+ */
+static uint64_t __init tsc_khz_from_pit(void)
+{
+    uint16_t count = PIT_FREQUENCY * PIT_CALIBRATE_MS / 1000;
+
+    /* Gate on, speaker off; mode 0 (interrupt on terminal count) */
+    outb(PIT_GATE_PORT, (inb(PIT_GATE_PORT) & ~0x02) | 0x01);
+    outb(PIT_COMMAND, 0xB0);
+    outb(PIT_CHANNEL2, count & 0xFF);
+    outb(PIT_CHANNEL2, count >> 8);
+
+    uint64_t start = cpu_read_tsc();
+    for (uint64_t spins = 0; !(inb(PIT_GATE_PORT) & 0x20); spins++) {
+        if (spins == PIT_CALIBRATE_SPINS) {
+            return 0;
+        }
+    }
+    return (cpu_read_tsc() - start) / PIT_CALIBRATE_MS;
+}
+
+/**
+ * clock_ns - Nanoseconds since the timer subsystem started
+ */
+uint64_t clock_ns(void)
+{
+    if (!ns_per_tsc) {
+        return 0;
+    }
+    return (uint64_t)(((unsigned __int128)(cpu_read_tsc() - tsc_base) * ns_per_tsc) >> 32);
+}
+
+/**
+ * clock_tsc_khz - Measured TSC frequency, 0 before timer_subsystem_init
+ */
+uint64_t clock_tsc_khz(void)
+{
+    return tsc_khz;
+}
+
+/**
+ * clock_to_tsc - TSC value at clock_ns() time @ns
+ */
+static uint64_t clock_to_tsc(uint64_t ns)
+{
+    return tsc_base + (uint64_t)(((unsigned __int128)ns * tsc_per_ns) >> 32);
+}
+
+/**
+ * timer_program - Point the hardware at the earliest pending timer
+ *
+ * Called with the base locked.
+ */
+static void timer_program(struct timer_base *base)
+{
+    uint64_t expires = 0;
+
+    if (!list_empty(&base->pending)) {
+        expires = list_first_entry(&base->pending, struct timer, entry)->expires;
+    }
+    if (expires != base->armed) {
+        base->armed = expires;
+        lapic_timer_arm(expires ? clock_to_tsc(expires) : 0);
+    }
+}
+
+/**
+ * timer_init - Prepare a timer that is not pending
+ */
+void timer_init(struct timer *timer, timer_fn_t fn, void *data)
+{
+    list_init(&timer->entry);
+    timer->expires = 0;
+    timer->fn = fn;
+    timer->data = data;
+    timer->cpu = 0;
+}
+
+/**
+ * timer_add - Run @timer once clock_ns() reaches @expires
+ *
+ * A pending timer is moved to the new expiry.
+ */
+void timer_add(struct timer *timer, uint64_t expires)
+{
+    timer_del(timer);
+
+    unsigned int cpu = cpu_current_id();
+    struct timer_base *base = &timer_bases[cpu];
+    uint64_t flags = spin_lock_irqsave(&base->lock);
+
+    /* Equal expiries run in the order they were added */
+    struct list_head *pos;
+    list_for_each(pos, &base->pending) {
+        if (list_entry(pos, struct timer, entry)->expires > expires) {
+            break;
+        }
+    }
+
+    timer->expires = expires ? expires : 1;
+    timer->cpu = cpu;
+    list_add_tail(&timer->entry, pos);
+    timer_program(base);
+
+    spin_unlock_irqrestore(&base->lock, flags);
+}
+
+/**
+ * timer_del - Cancel @timer; true if it was still pending
+ */
+bool timer_del(struct timer *timer)
+{
+    struct timer_base *base = &timer_bases[timer->cpu];
+    uint64_t flags = spin_lock_irqsave(&base->lock);
+    bool pending = timer_pending(timer);
+
+    if (pending) {
+        list_del(&timer->entry);
+        timer_program(base);
+    }
+
+    spin_unlock_irqrestore(&base->lock, flags);
+    return pending;
+}
+
+/**
+ * timer_next_expiry - Earliest pending timer of this CPU, 0 if none
+ *
+ * Read without the lock: the idle path only uses it as a hint.
+ */
+uint64_t timer_next_expiry(void)
+{
+    return __atomic_load_n(&timer_bases[cpu_current_id()].armed, __ATOMIC_RELAXED);
+}
+
+/**
+ * timer_interrupt - Run every expired timer of this CPU, then rearm
+ */
+static void timer_interrupt(struct interrupt_frame *frame)
+{
+    struct timer_base *base = &timer_bases[cpu_current_id()];
+
+    (void)frame;
+
+    spin_lock(&base->lock);
+    base->armed = 0;
+
+    while (!list_empty(&base->pending)) {
+        struct timer *timer = list_first_entry(&base->pending, struct timer, entry);
+        if (timer->expires > clock_ns()) {
+            break;
+        }
+
+        /* Unlinked first, so the callback may add it again */
+        list_del(&timer->entry);
+        spin_unlock(&base->lock);
+        timer->fn(timer);
+        spin_lock(&base->lock);
+    }
+
+    timer_program(base);
+    spin_unlock(&base->lock);
+}
+
+/**
+ * timer_subsystem_init - Measure the TSC and start the APIC timer
+ */
+int __init timer_subsystem_init(void)
+{
+    for (unsigned int cpu = 0; cpu < CPU_MAX; cpu++) {
+        spin_lock_init(&timer_bases[cpu].lock);
+        list_init(&timer_bases[cpu].pending);
+    }
+
+    tsc_khz = tsc_khz_from_cpuid();
+    if (!tsc_khz) {
+        tsc_khz = tsc_khz_from_pit();
+    }
+    if (!tsc_khz) {
+        return KERNEL_ERROR_NOTFOUND;
+    }
+
+    tsc_base = cpu_read_tsc();
+    ns_per_tsc = (NSEC_PER_MSEC << 32) / tsc_khz;
+    tsc_per_ns = (tsc_khz << 32) / NSEC_PER_MSEC;
+
+    interrupt_register_handler(LAPIC_TIMER_VECTOR, timer_interrupt);
+    return lapic_timer_init(LAPIC_TIMER_VECTOR, tsc_khz);
+}
+initcall(timer_subsystem_init, INITCALL_OPTIONAL, interrupt_system_init);
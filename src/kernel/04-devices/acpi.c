@@ -0,0 +1,196 @@
+/*
+ * Power1 OS - ACPI Table Discovery
+ * Locates the RSDP and the static tables it points to
+ *
+ * The boot loader hands over a copy of the RSDP in a multiboot2 tag; the
+ * BIOS area is scanned only when it does not. Tables inside the direct map
+ * are used in place, others are mapped once into the MMIO window.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/multiboot2.h"
+#include "../include/interrupts.h"
+#include "../include/acpi.h"
+#include "../include/string.h"
+#include "../include/init.h"
+
+#define ACPI_BIOS_START         0xE0000
+#define ACPI_BIOS_END           0x100000
+
+/* Root table: XSDT entries are 64-bit, RSDT entries 32-bit */
+static struct acpi_sdt_header *acpi_root = NULL;
+static size_t acpi_entry_size = 0;
+static bool acpi_madt_parsed = false;
+
+/**
+ * acpi_checksum_ok - Bytes of a table sum to zero
+ */
+static bool acpi_checksum_ok(const void *table, size_t length)
+{
+    const uint8_t *bytes = table;
+    uint8_t sum = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        sum += bytes[i];
+    }
+    return sum == 0;
+}
+
+/**
+ * acpi_map - Kernel pointer to @length bytes of firmware memory
+ */
+static void *acpi_map(uint64_t phys, size_t length)
+{
+    if (vmem_direct_mapped(phys, length)) {
+        return phys_to_direct(phys);
+    }
+    return vmem_map_phys(phys, length, 0);
+}
+
+/**
+ * acpi_map_table - Map and validate a whole table
+ */
+static struct acpi_sdt_header *acpi_map_table(uint64_t phys)
+{
+    struct acpi_sdt_header *header = acpi_map(phys, sizeof(*header));
+    if (!header || header->length < sizeof(*header)) {
+        return NULL;
+    }
+
+    uint32_t length = header->length;
+    if (!vmem_direct_mapped(phys, length)) {
+        header = acpi_map(phys, length);
+    }
+    return header && acpi_checksum_ok(header, length) ? header : NULL;
+}
+
+/**
+ * acpi_find_rsdp - RSDP from the boot loader, or from the BIOS area
+ */
+static struct acpi_rsdp *acpi_find_rsdp(void)
+{
+    struct multiboot_info *info = kernel_state.mb_info;
+    struct multiboot_tag *tag = NULL;
+
+    /* Prefer the ACPI 2.0 RSDP, which carries the XSDT address */
+    if (info) {
+        tag = multiboot2_find_tag(info, MULTIBOOT_TAG_TYPE_ACPI_NEW);
+        if (!tag) {
+            tag = multiboot2_find_tag(info, MULTIBOOT_TAG_TYPE_ACPI_OLD);
+        }
+    }
+    if (tag) {
+        return (struct acpi_rsdp *)(tag + 1);
+    }
+
+    for (uint64_t addr = ACPI_BIOS_START; addr < ACPI_BIOS_END; addr += 16) {
+        struct acpi_rsdp *candidate = phys_to_direct(addr);
+        if (memcmp(candidate->signature, "RSD PTR ", 8) == 0 &&
+            acpi_checksum_ok(candidate, 20)) {
+            return candidate;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * acpi_find_table - Locate a table by its four-character signature
+ */
+void *acpi_find_table(const char *signature)
+{
+    if (!acpi_root) {
+        return NULL;
+    }
+
+    size_t count = (acpi_root->length - sizeof(*acpi_root)) / acpi_entry_size;
+    const uint8_t *entries = (const uint8_t *)(acpi_root + 1);
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t phys = 0;
+        memcpy(&phys, entries + i * acpi_entry_size, acpi_entry_size);
+
+        struct acpi_sdt_header *header = acpi_map(phys, sizeof(*header));
+        if (header && memcmp(header->signature, signature, 4) == 0) {
+            return acpi_map_table(phys);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * acpi_parse_madt - Register every enabled processor with the APIC layer
+ *
+ * Returns false if the MADT could not be mapped yet.
+ */
+static bool acpi_parse_madt(void)
+{
+    struct acpi_madt *madt = acpi_find_table("APIC");
+    if (!madt) {
+        return false;
+    }
+
+    const uint8_t *entry = madt->entries;
+    const uint8_t *end = (const uint8_t *)madt + madt->header.length;
+
+    while (entry + sizeof(struct acpi_madt_entry) <= end) {
+        const struct acpi_madt_entry *header = (const struct acpi_madt_entry *)entry;
+        if (header->length < sizeof(*header)) {
+            break;
+        }
+
+        if (header->type == ACPI_MADT_LOCAL_APIC) {
+            const struct acpi_madt_local_apic *lapic = (const void *)entry;
+            if (lapic->flags & ACPI_MADT_ENABLED) {
+                lapic_add_cpu(lapic->apic_id);
+            }
+        } else if (header->type == ACPI_MADT_LOCAL_X2APIC) {
+            const struct acpi_madt_local_x2apic *x2apic = (const void *)entry;
+            if (x2apic->flags & ACPI_MADT_ENABLED) {
+                lapic_add_cpu(x2apic->x2apic_id);
+            }
+        }
+        entry += header->length;
+    }
+    return true;
+}
+
+/**
+ * acpi_init - Find the root table and read the processor topology
+ *
+ * The memory manager calls this for the SRAT before the device manager
+ * does, when only the direct map is available; a second call finishes
+ * whatever could not be mapped the first time.
+ */
+int __init acpi_init(void)
+{
+    if (acpi_root) {
+        if (!acpi_madt_parsed) {
+            acpi_madt_parsed = acpi_parse_madt();
+        }
+        return KERNEL_SUCCESS;
+    }
+
+    struct acpi_rsdp *rsdp = acpi_find_rsdp();
+    if (!rsdp) {
+        return KERNEL_ERROR_NOTFOUND;
+    }
+
+    if (rsdp->revision >= 2 && rsdp->xsdt_address) {
+        acpi_root = acpi_map_table(rsdp->xsdt_address);
+        acpi_entry_size = sizeof(uint64_t);
+    }
+    if (!acpi_root) {
+        acpi_root = acpi_map_table(rsdp->rsdt_address);
+        acpi_entry_size = sizeof(uint32_t);
+    }
+    if (!acpi_root) {
+        return KERNEL_ERROR_NOTFOUND;
+    }
+
+    acpi_madt_parsed = acpi_parse_madt();
+    return KERNEL_SUCCESS;
+}
@@ -0,0 +1,661 @@
+/*
+ * Power1 OS - Block Layer
+ * Bio submission, request merging, plugging and completion batching
+ *
+ * Callers describe I/O as bios. Without a plug each bio becomes one
+ * request and goes straight to the driver. Under a per-task plug, bios
+ * that extend an already held request (at either end) are merged into it,
+ * and when the plug is flushed the held requests are sorted by sector and
+ * merged once more, so a run of small sequential writes reaches the device
+ * as a few large requests. A request the hardware queue has no room for
+ * waits on the issuing CPU's software queue and is resubmitted, in order,
+ * as completions free slots. Drivers hand completions to the block layer
+ * one at a time and call blk_complete_batch after each reap pass, so bio
+ * callbacks and software queue restarts run once per batch. Inside an
+ * interrupt handler that pass is left to BLOCK_SOFTIRQ, which runs it
+ * after the handler returns.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/cpu.h"
+#include "../include/atomic.h"
+#include "../include/string.h"
+#include "../include/devices.h"
+#include "../include/block.h"
+#include "../include/process.h"
+#include "../include/softirq.h"
+#include "../include/init.h"
+
+/* Completed requests awaiting blk_complete_batch, per CPU */
+static struct blk_request *blk_done[CPU_MAX];
+
+static inline uint32_t bio_sectors(struct bio *bio)
+{
+    uint32_t bytes = 0;
+
+    for (uint16_t i = 0; i < bio->nr_vecs; i++) {
+        bytes += bio->vecs[i].length;
+    }
+    return bytes / IO_SECTOR_SIZE;
+}
+
+static inline struct blk_ctx *blk_current_ctx(struct blk_queue *queue)
+{
+    return &queue->ctx[cpu_current_id()];
+}
+
+/**
+ * blk_queue_create - Attach block layer state to a storage device
+ * @capacity: Device size in IO_SECTOR_SIZE units
+ * @max_segments: Most segments the driver accepts in one io_request
+ */
+struct blk_queue *blk_queue_create(struct device *dev, uint64_t capacity, uint16_t max_segments)
+{
+    struct blk_queue *queue = kzalloc(sizeof(*queue));
+    if (!queue) {
+        return NULL;
+    }
+
+    queue->dev = dev;
+    queue->capacity = capacity;
+    queue->max_sectors = BLK_MAX_SECTORS;
+    queue->max_segments = MIN(max_segments, IO_MAX_SEGMENTS);
+    for (int cpu = 0; cpu < CPU_MAX; cpu++) {
+        spin_lock_init(&queue->ctx[cpu].lock);
+    }
+
+    dev->queue = queue;
+    return queue;
+}
+
+/**
+ * bio_alloc - Allocate an empty bio with room for @max_vecs segments
+ */
+struct bio *bio_alloc(struct device *dev, uint32_t op, uint64_t sector, uint16_t max_vecs)
+{
+    max_vecs = MIN(max_vecs, IO_MAX_SEGMENTS);
+
+    struct bio *bio = kzalloc(sizeof(*bio) + max_vecs * sizeof(struct io_segment));
+    if (bio) {
+        bio->dev = dev;
+        bio->op = op;
+        bio->sector = sector;
+        bio->max_vecs = max_vecs;
+    }
+    return bio;
+}
+
+void bio_free(struct bio *bio)
+{
+    kfree(bio);
+}
+
+/**
+ * bio_add_buffer - Append a direct-mapped buffer to @bio
+ *
+ * Joins the previous segment when the memory is contiguous.
+ */
+int bio_add_buffer(struct bio *bio, void *buffer, uint32_t length)
+{
+    if (!length || (length & (IO_SECTOR_SIZE - 1))) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    if (bio->nr_vecs) {
+        struct io_segment *last = &bio->vecs[bio->nr_vecs - 1];
+        if ((uint8_t *)last->buffer + last->length == buffer) {
+            last->length += length;
+            return KERNEL_SUCCESS;
+        }
+    }
+    if (bio->nr_vecs == bio->max_vecs) {
+        return KERNEL_ERROR_NOSPC;
+    }
+
+    bio->vecs[bio->nr_vecs].buffer = buffer;
+    bio->vecs[bio->nr_vecs].length = length;
+    bio->nr_vecs++;
+    return KERNEL_SUCCESS;
+}
+
+static void bio_end(struct bio *bio, int status)
+{
+    bio->status = status;
+    if (bio->end_io) {
+        bio->end_io(bio);
+    }
+}
+
+/**
+ * blk_request_alloc - Take a request from this CPU's cache
+ */
+static struct blk_request *blk_request_alloc(struct blk_queue *queue)
+{
+    struct blk_ctx *ctx = blk_current_ctx(queue);
+    struct blk_request *req;
+
+    uint64_t flags = spin_lock_irqsave(&ctx->lock);
+    req = ctx->cache;
+    if (req) {
+        ctx->cache = req->next;
+        ctx->cached--;
+    }
+    spin_unlock_irqrestore(&ctx->lock, flags);
+
+    return req ? req : kmalloc(sizeof(*req));
+}
+
+static void blk_request_free(struct blk_request *req)
+{
+    struct blk_ctx *ctx = blk_current_ctx(req->queue);
+
+    uint64_t flags = spin_lock_irqsave(&ctx->lock);
+    if (ctx->cached < BLK_REQUEST_CACHE) {
+        req->next = ctx->cache;
+        ctx->cache = req;
+        ctx->cached++;
+        req = NULL;
+    }
+    spin_unlock_irqrestore(&ctx->lock, flags);
+
+    kfree(req);
+}
+
+/**
+ * blk_end_request - Finish every bio carried by @req
+ */
+static void blk_end_request(struct blk_request *req, int status)
+{
+    struct bio *bio = req->bio;
+
+    while (bio) {
+        struct bio *next = bio->next;
+        bio_end(bio, status);
+        bio = next;
+    }
+    blk_request_free(req);
+}
+
+/**
+ * blk_io_done - io_request completion from the driver
+ *
+ * Only queues the request; the work happens in blk_complete_batch.
+ */
+static void blk_io_done(struct io_request *io)
+{
+    struct blk_request *req = io->private;
+    unsigned int cpu = cpu_current_id();
+
+    uint64_t flags = cpu_irq_save();
+    req->next = blk_done[cpu];
+    blk_done[cpu] = req;
+    cpu_irq_restore(flags);
+
+    if (in_hardirq()) {
+        raise_softirq(BLOCK_SOFTIRQ);
+    }
+}
+
+/**
+ * blk_request_init - Turn one bio into a request
+ */
+static void blk_request_init(struct blk_request *req, struct blk_queue *queue, struct bio *bio)
+{
+    req->queue = queue;
+    req->bio = bio;
+    req->biotail = bio;
+    req->nr_sectors = bio_sectors(bio);
+    req->next = NULL;
+    bio->next = NULL;
+
+    req->io.op = bio->op;
+    req->io.flags = bio->flags;
+    req->io.nr_segments = bio->nr_vecs;
+    req->io.sector = bio->sector;
+    req->io.complete = blk_io_done;
+    req->io.private = req;
+    memcpy(req->io.segments, bio->vecs, bio->nr_vecs * sizeof(struct io_segment));
+}
+
+/**
+ * blk_append_segments - Add segments after @io's, joining contiguous memory
+ */
+static void blk_append_segments(struct io_request *io, const struct io_segment *segs, uint16_t count)
+{
+    for (uint16_t i = 0; i < count; i++) {
+        struct io_segment *last = io->nr_segments ? &io->segments[io->nr_segments - 1] : NULL;
+
+        if (last && (uint8_t *)last->buffer + last->length == segs[i].buffer) {
+            last->length += segs[i].length;
+        } else {
+            io->segments[io->nr_segments++] = segs[i];
+        }
+    }
+}
+
+/**
+ * blk_mergeable - Whether @sectors more sectors in @segments segments fit @req
+ */
+static bool blk_mergeable(struct blk_request *req, struct blk_queue *queue, uint32_t op,
+                          uint32_t flags, uint32_t sectors, uint16_t segments)
+{
+    return req->queue == queue && req->io.op == op && op != IO_OP_FLUSH &&
+           req->io.flags == flags && req->nr_sectors + sectors <= queue->max_sectors &&
+           req->io.nr_segments + segments <= queue->max_segments;
+}
+
+/**
+ * blk_segments_gap - Whether segments @next cannot follow @prev in one request
+ *
+ * Joining contiguous memory is always fine; otherwise both sides of the
+ * seam must sit on the queue's virtual boundary.
+ */
+static bool blk_segments_gap(const struct blk_queue *queue,
+                             const struct io_segment *prev, uint16_t nr_prev,
+                             const struct io_segment *next, uint16_t nr_next)
+{
+    if (!queue->virt_boundary || !nr_prev || !nr_next) {
+        return false;
+    }
+
+    uintptr_t end = (uintptr_t)prev[nr_prev - 1].buffer + prev[nr_prev - 1].length;
+
+    if (end == (uintptr_t)next->buffer) {
+        return false;
+    }
+    return ((end | (uintptr_t)next->buffer) & queue->virt_boundary) != 0;
+}
+
+/**
+ * blk_merge_bio - Try to merge @bio into @req at either end
+ */
+static bool blk_merge_bio(struct blk_request *req, struct blk_queue *queue, struct bio *bio)
+{
+    uint32_t sectors = bio_sectors(bio);
+
+    if (!blk_mergeable(req, queue, bio->op, bio->flags, sectors, bio->nr_vecs)) {
+        return false;
+    }
+
+    if (req->io.sector + req->nr_sectors == bio->sector) {
+        if (blk_segments_gap(queue, req->io.segments, req->io.nr_segments, bio->vecs, bio->nr_vecs)) {
+            return false;
+        }
+        blk_append_segments(&req->io, bio->vecs, bio->nr_vecs);
+        bio->next = NULL;
+        req->biotail->next = bio;
+        req->biotail = bio;
+    } else if (bio->sector + sectors == req->io.sector) {
+        struct io_segment held[IO_MAX_SEGMENTS];
+
+        if (blk_segments_gap(queue, bio->vecs, bio->nr_vecs, req->io.segments, req->io.nr_segments)) {
+            return false;
+        }
+        uint16_t count = req->io.nr_segments;
+
+        memcpy(held, req->io.segments, count * sizeof(struct io_segment));
+        req->io.nr_segments = 0;
+        blk_append_segments(&req->io, bio->vecs, bio->nr_vecs);
+        blk_append_segments(&req->io, held, count);
+        req->io.sector = bio->sector;
+        bio->next = req->bio;
+        req->bio = bio;
+    } else {
+        return false;
+    }
+
+    req->nr_sectors += sectors;
+    return true;
+}
+
+/**
+ * blk_merge_requests - Fold @next into @req when it directly follows it
+ */
+static bool blk_merge_requests(struct blk_request *req, struct blk_request *next)
+{
+    if (req->io.sector + req->nr_sectors != next->io.sector ||
+        !blk_mergeable(req, next->queue, next->io.op, next->io.flags, next->nr_sectors,
+                       next->io.nr_segments) ||
+        blk_segments_gap(req->queue, req->io.segments, req->io.nr_segments,
+                         next->io.segments, next->io.nr_segments)) {
+        return false;
+    }
+
+    blk_append_segments(&req->io, next->io.segments, next->io.nr_segments);
+    req->biotail->next = next->bio;
+    req->biotail = next->biotail;
+    req->nr_sectors += next->nr_sectors;
+    req->next = next->next;
+
+    next->bio = NULL;
+    blk_request_free(next);
+    return true;
+}
+
+/**
+ * blk_run_ctx - Resubmit requests waiting on a software queue
+ */
+static void blk_run_ctx(struct blk_queue *queue, struct blk_ctx *ctx)
+{
+    for (;;) {
+        uint64_t flags = spin_lock_irqsave(&ctx->lock);
+        struct blk_request *req = ctx->head;
+        if (!req) {
+            spin_unlock_irqrestore(&ctx->lock, flags);
+            return;
+        }
+        ctx->head = req->next;
+        if (!ctx->head) {
+            ctx->tail = NULL;
+        }
+        spin_unlock_irqrestore(&ctx->lock, flags);
+
+        int ret = device_submit(queue->dev, &req->io);
+        if (ret == KERNEL_ERROR_AGAIN) {
+            /* Still full: put it back at the front and wait for completions */
+            flags = spin_lock_irqsave(&ctx->lock);
+            req->next = ctx->head;
+            ctx->head = req;
+            if (!ctx->tail) {
+                ctx->tail = req;
+            }
+            ctx->requeued++;
+            spin_unlock_irqrestore(&ctx->lock, flags);
+            return;
+        }
+        if (ret != KERNEL_SUCCESS) {
+            blk_end_request(req, ret);
+        } else {
+            ctx->dispatched++;
+        }
+    }
+}
+
+/**
+ * blk_dispatch - Send a request to the hardware queue of this CPU
+ */
+static void blk_dispatch(struct blk_request *req)
+{
+    struct blk_queue *queue = req->queue;
+    unsigned int cpu = cpu_current_id();
+    struct blk_ctx *ctx = &queue->ctx[cpu];
+
+    req->io.queue_hint = (uint16_t)cpu;
+    req->next = NULL;
+
+    /* Keep submission order behind anything already waiting */
+    uint64_t flags = spin_lock_irqsave(&ctx->lock);
+    if (ctx->head) {
+        ctx->tail->next = req;
+        ctx->tail = req;
+        spin_unlock_irqrestore(&ctx->lock, flags);
+        blk_run_ctx(queue, ctx);
+        return;
+    }
+    spin_unlock_irqrestore(&ctx->lock, flags);
+
+    int ret = device_submit(queue->dev, &req->io);
+    if (ret == KERNEL_ERROR_AGAIN) {
+        flags = spin_lock_irqsave(&ctx->lock);
+        if (ctx->tail) {
+            ctx->tail->next = req;
+        } else {
+            ctx->head = req;
+        }
+        ctx->tail = req;
+        ctx->requeued++;
+        spin_unlock_irqrestore(&ctx->lock, flags);
+    } else if (ret != KERNEL_SUCCESS) {
+        blk_end_request(req, ret);
+    } else {
+        ctx->dispatched++;
+    }
+}
+
+/**
+ * blk_complete_done - Finish every request completed on this CPU
+ */
+static void blk_complete_done(void)
+{
+    unsigned int cpu = cpu_current_id();
+
+    uint64_t flags = cpu_irq_save();
+    struct blk_request *req = blk_done[cpu];
+    blk_done[cpu] = NULL;
+    cpu_irq_restore(flags);
+
+    struct blk_queue *last = NULL;
+    while (req) {
+        struct blk_request *next = req->next;
+        struct blk_queue *queue = req->queue;
+
+        blk_end_request(req, req->io.status);
+
+        /* Freed slots let waiting requests go; restart each queue once */
+        if (queue != last && queue->ctx[cpu].head) {
+            blk_run_ctx(queue, &queue->ctx[cpu]);
+        }
+        last = queue;
+        req = next;
+    }
+}
+
+/**
+ * blk_complete_batch - Finish requests the drivers have completed
+ *
+ * Called by drivers after each reap pass and by pollers. From a hard
+ * interrupt handler it does nothing: BLOCK_SOFTIRQ was raised as the
+ * requests were queued.
+ */
+void blk_complete_batch(void)
+{
+    if (!in_hardirq()) {
+        blk_complete_done();
+    }
+}
+
+/**
+ * blk_poll - Reap completions of @dev on this CPU's hardware queue
+ *
+ * Returns the number of requests the driver completed.
+ */
+int blk_poll(struct device *dev)
+{
+    int count = 0;
+
+    if (dev->ops && dev->ops->poll) {
+        count = dev->ops->poll(dev, cpu_current_id());
+    }
+    blk_complete_batch();
+    return count;
+}
+
+/**
+ * blk_plug_add - Hold @bio in @plug, merging it when possible
+ */
+static void blk_plug_add(struct blk_plug *plug, struct blk_queue *queue, struct bio *bio)
+{
+    struct blk_request **link = &plug->head;
+
+    while (*link) {
+        if (blk_merge_bio(*link, queue, bio)) {
+            blk_current_ctx(queue)->merged++;
+            return;
+        }
+        link = &(*link)->next;
+    }
+
+    struct blk_request *req = blk_request_alloc(queue);
+    if (!req) {
+        bio_end(bio, KERNEL_ERROR_NOMEM);
+        return;
+    }
+    blk_request_init(req, queue, bio);
+    *link = req;
+
+    if (++plug->count >= BLK_PLUG_MAX) {
+        blk_flush_plug(plug);
+    }
+}
+
+/**
+ * blk_sort - Order requests by device and start sector
+ *
+ * Plugs are short, so a stable insertion sort is enough.
+ */
+static struct blk_request *blk_sort(struct blk_request *list)
+{
+    struct blk_request *sorted = NULL;
+
+    while (list) {
+        struct blk_request *req = list;
+        struct blk_request **link = &sorted;
+
+        list = list->next;
+        while (*link && ((*link)->queue < req->queue ||
+                         ((*link)->queue == req->queue && (*link)->io.sector <= req->io.sector))) {
+            link = &(*link)->next;
+        }
+        req->next = *link;
+        *link = req;
+    }
+    return sorted;
+}
+
+/**
+ * blk_flush_plug - Sort, merge and dispatch everything @plug holds
+ */
+void blk_flush_plug(struct blk_plug *plug)
+{
+    struct blk_request *req = blk_sort(plug->head);
+
+    plug->head = NULL;
+    plug->count = 0;
+
+    while (req) {
+        while (req->next && blk_merge_requests(req, req->next)) {
+            blk_current_ctx(req->queue)->merged++;
+        }
+
+        struct blk_request *next = req->next;
+        blk_dispatch(req);
+        req = next;
+    }
+}
+
+/**
+ * blk_start_plug - Begin holding the current task's I/O in @plug
+ *
+ * Nested plugs are inert; the outermost one collects everything.
+ */
+void blk_start_plug(struct blk_plug *plug)
+{
+    plug->head = NULL;
+    plug->count = 0;
+
+    if (current_task && !current_task->plug) {
+        current_task->plug = plug;
+    }
+}
+
+/**
+ * blk_finish_plug - Dispatch held I/O and stop plugging
+ */
+void blk_finish_plug(struct blk_plug *plug)
+{
+    blk_flush_plug(plug);
+
+    if (current_task && current_task->plug == plug) {
+        current_task->plug = NULL;
+    }
+}
+
+/**
+ * submit_bio - Start I/O for @bio; end_io runs when it finishes
+ */
+void submit_bio(struct bio *bio)
+{
+    struct blk_queue *queue = bio->dev ? bio->dev->queue : NULL;
+    struct blk_plug *plug = current_task ? current_task->plug : NULL;
+
+    if (!queue) {
+        bio_end(bio, KERNEL_ERROR_INVALID);
+        return;
+    }
+
+    if (bio->op == IO_OP_FLUSH) {
+        if (bio->nr_vecs) {
+            bio_end(bio, KERNEL_ERROR_INVALID);
+            return;
+        }
+    } else {
+        uint32_t sectors = bio_sectors(bio);
+        if (!sectors || sectors > queue->max_sectors || bio->nr_vecs > queue->max_segments ||
+            bio->sector >= queue->capacity || sectors > queue->capacity - bio->sector) {
+            bio_end(bio, KERNEL_ERROR_INVALID);
+            return;
+        }
+    }
+
+    if (plug && bio->op != IO_OP_FLUSH) {
+        blk_plug_add(plug, queue, bio);
+        return;
+    }
+
+    /* A flush must not overtake the writes held before it */
+    if (plug) {
+        blk_flush_plug(plug);
+    }
+
+    struct blk_request *req = blk_request_alloc(queue);
+    if (!req) {
+        bio_end(bio, KERNEL_ERROR_NOMEM);
+        return;
+    }
+    blk_request_init(req, queue, bio);
+    blk_dispatch(req);
+}
+
+static void bio_wait_done(struct bio *bio)
+{
+    *(volatile bool *)bio->private = true;
+    device_io_wake(bio->dev);
+}
+
+/**
+ * submit_bio_wait - Submit @bio and wait until it completes
+ *
+ * Returns the bio's status. Anything plugged by the caller goes first.
+ * The wait uses the device's completion mode (see device_io_wait).
+ */
+int submit_bio_wait(struct bio *bio)
+{
+    volatile bool done = false;
+
+    bio->flags |= device_io_flags(bio->dev);
+    bio->end_io = bio_wait_done;
+    bio->private = (void *)&done;
+
+    uint64_t start = cpu_read_tsc();
+    submit_bio(bio);
+
+    if (current_task && current_task->plug) {
+        blk_flush_plug(current_task->plug);
+    }
+    device_io_wait(bio->dev, cpu_current_id(), &done, start);
+    return bio->status;
+}
+
+/**
+ * blk_init - Run completions from BLOCK_SOFTIRQ
+ */
+int __init blk_init(void)
+{
+    open_softirq(BLOCK_SOFTIRQ, blk_complete_done);
+    return KERNEL_SUCCESS;
+}
+initcall(blk_init, 0, softirq_init);
@@ -0,0 +1,184 @@
+/*
+ * Power1 OS - Completion Handling
+ * Adaptive interrupt, hybrid and polled waits for synchronous I/O
+ *
+ * A task waiting for its own request can learn of the completion three
+ * ways. Interrupt mode sleeps until the device interrupts, which costs
+ * nothing while the device is slow but adds the interrupt round trip.
+ * Poll mode spins in device_ops.poll, which is fastest for devices that
+ * answer in a few microseconds. Hybrid mode gives the CPU away for about
+ * half the expected latency and polls after that. Under the adaptive
+ * policy each finished wait updates a moving average of the latency and
+ * the next wait picks its mode from it. Polling only happens while some
+ * task is waiting, so an idle device costs no CPU in any mode.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/cpu.h"
+#include "../include/atomic.h"
+#include "../include/devices.h"
+#include "../include/process.h"
+#include "../include/cpuidle.h"
+
+extern struct task idle_task;
+
+/**
+ * device_completion_init - Default completion state for a new device
+ */
+void device_completion_init(struct device *dev)
+{
+    struct io_completion *completion = &dev->completion;
+
+    wait_queue_init(&completion->waiters);
+    if (completion->stats.policy == IO_MODE_ADAPTIVE) {
+        /* No measurement yet: try the cheapest mode first */
+        completion->stats.mode = IO_MODE_POLL;
+    } else {
+        completion->stats.mode = completion->stats.policy;
+    }
+}
+
+/**
+ * device_io_flags - Request flags for a synchronous request issued now
+ *
+ * Only interrupt-mode waits need the device to interrupt.
+ */
+uint32_t device_io_flags(struct device *dev)
+{
+    return dev->completion.stats.mode == IO_MODE_INTERRUPT ? 0 : IO_REQ_POLLED;
+}
+
+/**
+ * device_io_wake - Wake interrupt-mode waiters after a completion
+ */
+void device_io_wake(struct device *dev)
+{
+    wait_queue_wake_all(&dev->completion.waiters);
+}
+
+/**
+ * device_poll_once - One pass over the device's completions for @queue
+ */
+static void device_poll_once(struct device *dev, unsigned int queue)
+{
+    struct io_completion_stats *stats = &dev->completion.stats;
+
+    stats->polls++;
+    if (!dev->ops->poll || dev->ops->poll(dev, queue) <= 0) {
+        stats->empty_polls++;
+        cpu_relax();
+    }
+}
+
+/**
+ * device_io_account - Record a finished wait and pick the next mode
+ */
+static void device_io_account(struct device *dev, uint64_t latency)
+{
+    struct io_completion *completion = &dev->completion;
+    struct io_completion_stats *stats = &completion->stats;
+
+    stats->completions++;
+    if (stats->mean_latency) {
+        stats->mean_latency += (int64_t)(latency - stats->mean_latency) / 8;
+    } else {
+        stats->mean_latency = latency;
+    }
+
+    if (stats->policy != IO_MODE_ADAPTIVE) {
+        return;
+    }
+
+    uint32_t mode = IO_MODE_INTERRUPT;
+    if (stats->mean_latency < IO_POLL_MAX_LATENCY) {
+        mode = IO_MODE_POLL;
+    } else if (stats->mean_latency < IO_HYBRID_MAX_LATENCY ||
+               !(completion->caps & IO_CAP_IRQ)) {
+        mode = IO_MODE_HYBRID;
+    }
+
+    if (mode != stats->mode) {
+        stats->mode = mode;
+        stats->mode_switches++;
+    }
+}
+
+/**
+ * device_io_wait - Wait until *@done becomes true
+ * @queue: Hardware queue the request went to
+ * @start: TSC reading taken just before the request was submitted
+ *
+ * The request must have been submitted with device_io_flags(@dev), and
+ * its completion callback must set *@done and call device_io_wake.
+ */
+void device_io_wait(struct device *dev, unsigned int queue, volatile bool *done, uint64_t start)
+{
+    struct io_completion *completion = &dev->completion;
+    struct io_completion_stats *stats = &completion->stats;
+    uint32_t mode = stats->mode;
+
+    if (mode == IO_MODE_INTERRUPT) {
+        stats->interrupt_waits++;
+        while (!*done) {
+            if (current_task && current_task != &idle_task) {
+                wait_queue_sleep(&completion->waiters);
+            } else {
+                /* The idle task cannot sleep; wait for the interrupt itself */
+                cpu_idle();
+            }
+        }
+    } else {
+        if (mode == IO_MODE_HYBRID) {
+            uint64_t nap = stats->mean_latency / 2;
+
+            stats->hybrid_waits++;
+            while (!*done && cpu_read_tsc() - start < nap) {
+                schedule_next_task();
+            }
+        } else {
+            stats->poll_waits++;
+        }
+
+        while (!*done) {
+            device_poll_once(dev, queue);
+        }
+    }
+
+    device_io_account(dev, cpu_read_tsc() - start);
+}
+
+/**
+ * device_completion_ioctl - Generic completion statistics and policy
+ */
+int device_completion_ioctl(struct device *dev, uint32_t cmd, void *arg)
+{
+    struct io_completion *completion = &dev->completion;
+
+    if (!arg) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    switch (cmd) {
+    case DEVICE_IOCTL_GET_COMPLETION:
+        *(struct io_completion_stats *)arg = completion->stats;
+        return KERNEL_SUCCESS;
+
+    case DEVICE_IOCTL_SET_COMPLETION: {
+        uint32_t policy = *(uint32_t *)arg;
+        if (policy > IO_MODE_POLL ||
+            (policy == IO_MODE_INTERRUPT && !(completion->caps & IO_CAP_IRQ))) {
+            return KERNEL_ERROR_INVALID;
+        }
+        completion->stats.policy = policy;
+        if (policy != IO_MODE_ADAPTIVE && policy != completion->stats.mode) {
+            completion->stats.mode = policy;
+            completion->stats.mode_switches++;
+        }
+        return KERNEL_SUCCESS;
+    }
+    }
+    return KERNEL_ERROR_INVALID;
+}
@@ -0,0 +1,318 @@
+/*
+ * Power1 OS - Device Registry
+ * ID-indexed and per-type lookup of registered devices
+ *
+ * IDs index a two-level table (DEVICE_ID_LEAF_SIZE slots per leaf, leaves
+ * allocated on first use), so device_find_by_id is two dependent loads
+ * whatever the number of devices. Each type keeps its own list for
+ * enumeration. Lookups take no lock: registration publishes a device only
+ * once it is fully linked, and unregistration waits for a grace period
+ * before the driver's cleanup runs. Updates serialise on registry_lock.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/cpu.h"
+#include "../include/string.h"
+#include "../include/devices.h"
+#include "../include/spinlock.h"
+#include "../include/rcu.h"
+#include "../include/acpi.h"
+#include "../include/pci.h"
+#include "../include/init.h"
+
+#define DEVICE_ID_LEAVES        (DEVICE_ID_MAX / DEVICE_ID_LEAF_SIZE)
+
+struct device_leaf {
+    struct device *slots[DEVICE_ID_LEAF_SIZE];
+};
+
+static struct device_leaf *device_table[DEVICE_ID_LEAVES];
+static struct device *device_types[DEVICE_TYPE_MAX];
+static spinlock_t registry_lock = SPINLOCK_INIT;
+static uint32_t next_free_id = 1;
+
+/**
+ * device_slot - Table slot for @id, allocating its leaf if asked
+ *
+ * Called with registry_lock held.
+ */
+static struct device **device_slot(uint32_t id, bool create)
+{
+    struct device_leaf *leaf = device_table[id >> DEVICE_ID_LEAF_BITS];
+
+    if (!leaf) {
+        if (!create) {
+            return NULL;
+        }
+        leaf = kzalloc(sizeof(*leaf));
+        if (!leaf) {
+            return NULL;
+        }
+        rcu_assign_pointer(device_table[id >> DEVICE_ID_LEAF_BITS], leaf);
+    }
+    return &leaf->slots[id & (DEVICE_ID_LEAF_SIZE - 1)];
+}
+
+/**
+ * device_alloc_id - Lowest free ID at or above the allocation cursor
+ *
+ * Called with registry_lock held. Returns DEVICE_ID_ANY when full.
+ */
+static uint32_t device_alloc_id(void)
+{
+    for (uint32_t scanned = 0; scanned < DEVICE_ID_MAX - 1; scanned++) {
+        uint32_t id = next_free_id;
+        next_free_id = next_free_id + 1 < DEVICE_ID_MAX ? next_free_id + 1 : 1;
+
+        struct device **slot = device_slot(id, false);
+        if (!slot || !*slot) {
+            return id;
+        }
+    }
+    return DEVICE_ID_ANY;
+}
+
+/**
+ * device_register - Initialise @dev and make it visible to lookups
+ *
+ * A DEVICE_ID_ANY id is replaced by a free one.
+ */
+int device_register(struct device *dev)
+{
+    if (!dev || dev->type >= DEVICE_TYPE_MAX || dev->id >= DEVICE_ID_MAX) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    if (dev->ops && dev->ops->init) {
+        int ret = dev->ops->init(dev);
+        if (ret != KERNEL_SUCCESS) {
+            dev->status = DEVICE_STATUS_ERROR;
+            return ret;
+        }
+    }
+
+    spin_lock(&registry_lock);
+
+    if (dev->id == DEVICE_ID_ANY) {
+        dev->id = device_alloc_id();
+        if (dev->id == DEVICE_ID_ANY) {
+            spin_unlock(&registry_lock);
+            return KERNEL_ERROR_NOSPC;
+        }
+    }
+
+    struct device **slot = device_slot(dev->id, true);
+    if (!slot || *slot) {
+        spin_unlock(&registry_lock);
+        return slot ? KERNEL_ERROR_INVALID : KERNEL_ERROR_NOMEM;
+    }
+
+    if (dev->status == DEVICE_STATUS_UNKNOWN) {
+        dev->status = DEVICE_STATUS_READY;
+    }
+    device_completion_init(dev);
+    dev->type_next = device_types[dev->type];
+    rcu_assign_pointer(device_types[dev->type], dev);
+    rcu_assign_pointer(*slot, dev);
+
+    spin_unlock(&registry_lock);
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * device_unregister - Remove a device and run its cleanup
+ */
+int device_unregister(uint32_t device_id)
+{
+    if (device_id == DEVICE_ID_ANY || device_id >= DEVICE_ID_MAX) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    spin_lock(&registry_lock);
+
+    struct device **slot = device_slot(device_id, false);
+    struct device *dev = slot ? *slot : NULL;
+    if (!dev) {
+        spin_unlock(&registry_lock);
+        return KERNEL_ERROR_NOTFOUND;
+    }
+
+    rcu_assign_pointer(*slot, NULL);
+    for (struct device **link = &device_types[dev->type]; *link; link = &(*link)->type_next) {
+        if (*link == dev) {
+            /* dev->type_next stays valid for readers still on dev */
+            rcu_assign_pointer(*link, dev->type_next);
+            break;
+        }
+    }
+
+    spin_unlock(&registry_lock);
+
+    synchronize_rcu();
+    if (dev->ops && dev->ops->cleanup) {
+        dev->ops->cleanup(dev);
+    }
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * device_find_by_id - Resolve a device ID without locking
+ */
+struct device *device_find_by_id(uint32_t id)
+{
+    struct device *dev = NULL;
+
+    if (id >= DEVICE_ID_MAX) {
+        return NULL;
+    }
+
+    rcu_read_lock();
+    struct device_leaf *leaf = rcu_dereference(device_table[id >> DEVICE_ID_LEAF_BITS]);
+    if (leaf) {
+        dev = rcu_dereference(leaf->slots[id & (DEVICE_ID_LEAF_SIZE - 1)]);
+    }
+    rcu_read_unlock();
+    return dev;
+}
+
+/**
+ * device_find_by_type - Most recently registered device of @type
+ */
+struct device *device_find_by_type(uint32_t type)
+{
+    if (type >= DEVICE_TYPE_MAX) {
+        return NULL;
+    }
+    return rcu_dereference(device_types[type]);
+}
+
+/**
+ * device_next_of_type - Continue a device_find_by_type enumeration
+ */
+struct device *device_next_of_type(struct device *dev)
+{
+    return rcu_dereference(dev->type_next);
+}
+
+/**
+ * device_ioctl - Generic device commands, then the driver's own
+ */
+int device_ioctl(struct device *dev, uint32_t cmd, void *arg)
+{
+    if (!dev) {
+        return KERNEL_ERROR_INVALID;
+    }
+    if (cmd == DEVICE_IOCTL_GET_COMPLETION || cmd == DEVICE_IOCTL_SET_COMPLETION) {
+        return device_completion_ioctl(dev, cmd, arg);
+    }
+    if (dev->ops && dev->ops->ioctl) {
+        return dev->ops->ioctl(dev, cmd, arg);
+    }
+    return KERNEL_ERROR_INVALID;
+}
+
+/**
+ * device_submit - Queue an asynchronous request on @dev
+ */
+int device_submit(struct device *dev, struct io_request *req)
+{
+    if (!dev || !dev->ops || !dev->ops->submit) {
+        return KERNEL_ERROR_INVALID;
+    }
+    if (req->nr_segments > IO_MAX_SEGMENTS) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    req->status = IO_STATUS_PENDING;
+    return dev->ops->submit(dev, req);
+}
+
+/* Waiter state of one device_io_sync request */
+struct io_sync_wait {
+    volatile bool done;
+    struct device *dev;
+};
+
+static void device_io_sync_done(struct io_request *req)
+{
+    struct io_sync_wait *wait = req->private;
+
+    wait->done = true;
+    device_io_wake(wait->dev);
+}
+
+/**
+ * device_io_sync - Synchronous transfer through the asynchronous path
+ * @offset: Byte offset, a multiple of IO_SECTOR_SIZE, as is @size
+ *
+ * Splits @buffer at page boundaries into requests of up to IO_MAX_SEGMENTS
+ * segments and waits for each in the device's current completion mode.
+ */
+int device_io_sync(struct device *dev, uint32_t op, void *buffer, size_t size, uint64_t offset)
+{
+    struct io_request req;
+    struct io_sync_wait wait = { .dev = dev };
+    uint8_t *data = buffer;
+
+    if ((offset | size) & (IO_SECTOR_SIZE - 1)) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    while (size) {
+        size_t done = 0;
+
+        memset(&req, 0, sizeof(req));
+        req.op = op;
+        req.sector = offset / IO_SECTOR_SIZE;
+        req.queue_hint = (uint16_t)cpu_current_id();
+        req.flags = device_io_flags(dev);
+        req.complete = device_io_sync_done;
+        req.private = &wait;
+
+        while (done < size && req.nr_segments < IO_MAX_SEGMENTS) {
+            uint64_t addr = (uint64_t)(data + done);
+            uint32_t chunk = (uint32_t)MIN(size - done, PAGE_SIZE - (addr & PAGE_MASK));
+
+            req.segments[req.nr_segments].buffer = data + done;
+            req.segments[req.nr_segments].length = chunk;
+            req.nr_segments++;
+            done += chunk;
+        }
+
+        wait.done = false;
+        uint64_t start = cpu_read_tsc();
+        int ret = device_submit(dev, &req);
+        if (ret != KERNEL_SUCCESS) {
+            return ret;
+        }
+        device_io_wait(dev, req.queue_hint, &wait.done, start);
+        if (req.status != KERNEL_SUCCESS) {
+            return req.status;
+        }
+
+        data += done;
+        offset += done;
+        size -= done;
+    }
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * device_manager_init - Prepare the registry and discover buses
+ *
+ * Drivers register from their own initcalls once buses are known.
+ */
+int __init device_manager_init(void)
+{
+    spin_lock_init(&registry_lock);
+    next_free_id = 1;
+
+    /* Firmware tables are optional; PCI falls back to port I/O */
+    acpi_init();
+    return pci_init();
+}
+initcall(device_manager_init, 0, interrupt_system_init);
@@ -0,0 +1,741 @@
+/*
+ * Power1 OS - NVMe Driver
+ * Per-CPU submission/completion queue pairs for NVMe controllers
+ *
+ * Each CPU gets its own interrupt-driven queue pair, with the MSI-X vector
+ * of its completion queue steered to that CPU, and when the controller
+ * grants enough queues a second, interrupt-less pair for polled requests
+ * (IO_REQ_POLLED) whose submitter spins on the completion queue instead of
+ * taking an interrupt round trip. Queues are never shared between CPUs,
+ * so the only lock on the I/O path is uncontended.
+ *
+ * Data pointers are built straight from the request's segments: a PRP
+ * list when every inner segment boundary is page aligned, as it is for
+ * page-cache pages, otherwise an SGL when the controller supports them.
+ * Each command slot owns a preallocated list page, so nothing is allocated
+ * per I/O. Completion queue doorbells are written once per reap pass.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/io.h"
+#include "../include/atomic.h"
+#include "../include/string.h"
+#include "../include/interrupts.h"
+#include "../include/devices.h"
+#include "../include/block.h"
+#include "../include/nvme.h"
+#include "../include/init.h"
+
+#define NVME_ADMIN_DEPTH        32
+#define NVME_IO_DEPTH           256
+#define NVME_NSID               1
+#define NVME_REAP_BATCH         32
+#define NVME_READY_SPINS        5000000     /* Per 500ms unit of CAP.TO, roughly */
+#define NVME_ADMIN_SPINS        100000000
+#define NVME_PRP_ENTRIES        (PAGE_SIZE / sizeof(uint64_t))
+
+struct nvme_ctrl;
+
+/* Per command identifier state */
+struct nvme_slot {
+    struct io_request *req;
+    void *list;                 /* PRP list or SGL segment page */
+};
+
+struct nvme_queue {
+    struct nvme_ctrl *ctrl;
+    struct nvme_command *sq;
+    volatile struct nvme_completion *cq;
+    volatile uint32_t *sq_doorbell;
+    volatile uint32_t *cq_doorbell;
+    uint16_t qid;
+    uint16_t depth;
+    uint16_t sq_tail;
+    uint16_t cq_head;
+    uint8_t cq_phase;
+    bool polled;                /* Created without an interrupt */
+    struct nvme_slot *slots;
+    uint16_t *free_ids;         /* Stack of idle command identifiers */
+    uint16_t nr_free;
+    spinlock_t lock;
+} __attribute__((aligned(64)));
+
+struct nvme_ctrl {
+    struct pci_device *pdev;
+    volatile uint8_t *regs;
+    uint32_t doorbell_stride;
+    uint32_t lba_shift;         /* log2 of the namespace block size */
+    uint64_t capacity;          /* In IO_SECTOR_SIZE units */
+    uint32_t max_sectors;
+    bool sgl;
+    unsigned int nr_queues;     /* Interrupt-driven, one per CPU */
+    unsigned int nr_poll;       /* Polled, one per CPU when granted */
+    struct nvme_queue admin;
+    struct nvme_queue *queues;
+    struct nvme_queue *poll_queues;
+    spinlock_t admin_lock;
+};
+
+static unsigned int nvme_count = 0;
+
+static void *nvme_alloc_dma(size_t size)
+{
+    struct page *page = page_alloc(pmem_order_for(DIV_ROUND_UP(size, PAGE_SIZE)), ALLOC_ZERO);
+    return page ? page_address(page) : NULL;
+}
+
+/**
+ * nvme_queue_init - Allocate rings and command slots for one queue
+ */
+static int nvme_queue_init(struct nvme_ctrl *ctrl, struct nvme_queue *queue,
+                           uint16_t qid, uint16_t depth, bool lists)
+{
+    queue->ctrl = ctrl;
+    queue->qid = qid;
+    queue->depth = depth;
+    queue->cq_phase = 1;
+    queue->sq = nvme_alloc_dma(depth * sizeof(struct nvme_command));
+    queue->cq = nvme_alloc_dma(depth * sizeof(struct nvme_completion));
+    queue->sq_doorbell = (volatile uint32_t *)(ctrl->regs + NVME_REG_DOORBELL +
+                                               (2 * qid) * ctrl->doorbell_stride);
+    queue->cq_doorbell = (volatile uint32_t *)(ctrl->regs + NVME_REG_DOORBELL +
+                                               (2 * qid + 1) * ctrl->doorbell_stride);
+    queue->slots = kzalloc(depth * sizeof(struct nvme_slot));
+    queue->free_ids = kmalloc(depth * sizeof(uint16_t));
+    spin_lock_init(&queue->lock);
+
+    if (!queue->sq || !queue->cq || !queue->slots || !queue->free_ids) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    /* One entry stays empty so a full ring is distinguishable */
+    for (uint16_t i = 0; i < depth - 1; i++) {
+        queue->free_ids[i] = depth - 2 - i;
+        if (lists) {
+            queue->slots[i].list = nvme_alloc_dma(PAGE_SIZE);
+            if (!queue->slots[i].list) {
+                return KERNEL_ERROR_NOMEM;
+            }
+        }
+    }
+    queue->nr_free = depth - 1;
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * nvme_queue_push - Copy a command into the submission ring
+ *
+ * Called with the queue lock held; the doorbell is rung by the caller.
+ */
+static void nvme_queue_push(struct nvme_queue *queue, struct nvme_command *cmd)
+{
+    memcpy(&queue->sq[queue->sq_tail], cmd, sizeof(*cmd));
+    if (++queue->sq_tail == queue->depth) {
+        queue->sq_tail = 0;
+    }
+}
+
+/**
+ * nvme_cq_next - Next posted completion entry, or NULL
+ */
+static volatile struct nvme_completion *nvme_cq_next(struct nvme_queue *queue)
+{
+    volatile struct nvme_completion *cqe = &queue->cq[queue->cq_head];
+
+    if ((__atomic_load_n(&cqe->status, __ATOMIC_ACQUIRE) & 1) != queue->cq_phase) {
+        return NULL;
+    }
+    return cqe;
+}
+
+static void nvme_cq_advance(struct nvme_queue *queue)
+{
+    if (++queue->cq_head == queue->depth) {
+        queue->cq_head = 0;
+        queue->cq_phase ^= 1;
+    }
+}
+
+/**
+ * nvme_admin_command - Run one admin command and poll for its completion
+ * @result: Receives completion dword 0, may be NULL
+ */
+static int nvme_admin_command(struct nvme_ctrl *ctrl, struct nvme_command *cmd, uint32_t *result)
+{
+    struct nvme_queue *admin = &ctrl->admin;
+    int ret = KERNEL_ERROR_FAULT;
+
+    uint64_t flags = spin_lock_irqsave(&ctrl->admin_lock);
+
+    cmd->command_id = admin->sq_tail;
+    nvme_queue_push(admin, cmd);
+    smp_wmb();
+    mmio_write32(admin->sq_doorbell, admin->sq_tail);
+
+    for (uint64_t spins = 0; spins < NVME_ADMIN_SPINS; spins++) {
+        volatile struct nvme_completion *cqe = nvme_cq_next(admin);
+        if (!cqe) {
+            cpu_relax();
+            continue;
+        }
+
+        uint16_t status = cqe->status >> 1;
+        if (result) {
+            *result = cqe->result;
+        }
+        nvme_cq_advance(admin);
+        mmio_write32(admin->cq_doorbell, admin->cq_head);
+        ret = status ? KERNEL_ERROR_FAULT : KERNEL_SUCCESS;
+        break;
+    }
+
+    spin_unlock_irqrestore(&ctrl->admin_lock, flags);
+    return ret;
+}
+
+static int nvme_identify(struct nvme_ctrl *ctrl, uint32_t nsid, uint32_t cns, void *buffer)
+{
+    struct nvme_command cmd = {
+        .opcode = NVME_ADMIN_IDENTIFY,
+        .nsid = nsid,
+        .prp1 = direct_to_phys(buffer),
+        .cdw10 = cns,
+    };
+    return nvme_admin_command(ctrl, &cmd, NULL);
+}
+
+static int nvme_set_features(struct nvme_ctrl *ctrl, uint32_t feature, uint32_t value,
+                             uint32_t *result)
+{
+    struct nvme_command cmd = {
+        .opcode = NVME_ADMIN_SET_FEATURES,
+        .cdw10 = feature,
+        .cdw11 = value,
+    };
+    return nvme_admin_command(ctrl, &cmd, result);
+}
+
+/**
+ * nvme_create_queue_pair - Create I/O completion and submission queue @qid
+ * @vector: MSI-X entry of the completion queue, ignored when polled
+ */
+static int nvme_create_queue_pair(struct nvme_ctrl *ctrl, struct nvme_queue *queue,
+                                  uint16_t qid, uint16_t depth, bool polled, uint16_t vector)
+{
+    int ret = nvme_queue_init(ctrl, queue, qid, depth, true);
+    if (ret != KERNEL_SUCCESS) {
+        return ret;
+    }
+    queue->polled = polled;
+
+    struct nvme_command cmd = {
+        .opcode = NVME_ADMIN_CREATE_CQ,
+        .prp1 = direct_to_phys((void *)queue->cq),
+        .cdw10 = ((uint32_t)(depth - 1) << 16) | qid,
+        .cdw11 = NVME_QUEUE_CONTIGUOUS |
+                 (polled ? 0 : NVME_CQ_IRQ_ENABLED | ((uint32_t)vector << 16)),
+    };
+    ret = nvme_admin_command(ctrl, &cmd, NULL);
+    if (ret != KERNEL_SUCCESS) {
+        return ret;
+    }
+
+    cmd = (struct nvme_command){
+        .opcode = NVME_ADMIN_CREATE_SQ,
+        .prp1 = direct_to_phys(queue->sq),
+        .cdw10 = ((uint32_t)(depth - 1) << 16) | qid,
+        .cdw11 = NVME_QUEUE_CONTIGUOUS | ((uint32_t)qid << 16),
+    };
+    return nvme_admin_command(ctrl, &cmd, NULL);
+}
+
+/**
+ * nvme_setup_prps - Describe @req's data with PRP entries
+ *
+ * Returns false when a segment boundary inside the transfer is not page
+ * aligned, which PRPs cannot express.
+ */
+static bool nvme_setup_prps(struct io_request *req, struct nvme_command *cmd, uint64_t *list)
+{
+    unsigned int count = 0;
+    uint16_t last = req->nr_segments - 1;
+
+    for (uint16_t i = 0; i <= last; i++) {
+        uint64_t addr = direct_to_phys(req->segments[i].buffer);
+        uint64_t end = addr + req->segments[i].length;
+
+        if ((i > 0 && (addr & PAGE_MASK)) || (i < last && (end & PAGE_MASK))) {
+            return false;
+        }
+
+        /* PRP1 covers the first page, which may start mid-page */
+        uint64_t page = page_align_down(addr);
+        if (i == 0) {
+            cmd->prp1 = addr;
+            page += PAGE_SIZE;
+        }
+        for (; page < end; page += PAGE_SIZE) {
+            if (count == NVME_PRP_ENTRIES) {
+                return false;
+            }
+            list[count++] = page;
+        }
+    }
+
+    if (count == 1) {
+        cmd->prp2 = list[0];
+    } else if (count > 1) {
+        cmd->prp2 = direct_to_phys(list);
+    }
+    return true;
+}
+
+/**
+ * nvme_setup_sgl - Describe @req's data with an SGL, one block per segment
+ */
+static void nvme_setup_sgl(struct io_request *req, struct nvme_command *cmd,
+                           struct nvme_sgl_desc *list)
+{
+    struct nvme_sgl_desc desc = { 0 };
+
+    if (req->nr_segments == 1) {
+        desc.addr = direct_to_phys(req->segments[0].buffer);
+        desc.length = req->segments[0].length;
+        desc.type = NVME_SGL_DATA_BLOCK;
+    } else {
+        for (uint16_t i = 0; i < req->nr_segments; i++) {
+            list[i] = (struct nvme_sgl_desc){
+                .addr = direct_to_phys(req->segments[i].buffer),
+                .length = req->segments[i].length,
+                .type = NVME_SGL_DATA_BLOCK,
+            };
+        }
+        desc.addr = direct_to_phys(list);
+        desc.length = req->nr_segments * sizeof(struct nvme_sgl_desc);
+        desc.type = NVME_SGL_LAST_SEGMENT;
+    }
+
+    memcpy(&cmd->prp1, &desc, sizeof(desc));
+    cmd->flags |= NVME_CMD_PSDT_SGL;
+}
+
+/**
+ * nvme_reap - Complete everything posted on @queue's completion ring
+ *
+ * The doorbell is written once per pass; callbacks run outside the lock.
+ * Returns the number of requests completed.
+ */
+static int nvme_reap(struct nvme_queue *queue)
+{
+    struct io_request *done[NVME_REAP_BATCH];
+    int total = 0;
+
+    for (;;) {
+        unsigned int count = 0;
+        volatile struct nvme_completion *cqe;
+
+        uint64_t flags = spin_lock_irqsave(&queue->lock);
+        while (count < NVME_REAP_BATCH && (cqe = nvme_cq_next(queue)) != NULL) {
+            uint16_t id = cqe->command_id;
+            uint16_t status = cqe->status >> 1;
+            nvme_cq_advance(queue);
+
+            if (id >= queue->depth || !queue->slots[id].req) {
+                continue;
+            }
+            struct io_request *req = queue->slots[id].req;
+            queue->slots[id].req = NULL;
+            queue->free_ids[queue->nr_free++] = id;
+
+            req->status = status ? KERNEL_ERROR_FAULT : KERNEL_SUCCESS;
+            done[count++] = req;
+        }
+        if (count) {
+            mmio_write32(queue->cq_doorbell, queue->cq_head);
+        }
+        spin_unlock_irqrestore(&queue->lock, flags);
+
+        for (unsigned int i = 0; i < count; i++) {
+            if (done[i]->complete) {
+                done[i]->complete(done[i]);
+            }
+        }
+        if (count) {
+            blk_complete_batch();
+        }
+        total += count;
+
+        if (count < NVME_REAP_BATCH) {
+            return total;
+        }
+    }
+}
+
+static void nvme_irq(void *data)
+{
+    nvme_reap(data);
+}
+
+/**
+ * nvme_submit - Queue a request on the issuing CPU's queue pair
+ */
+static int nvme_submit(struct device *dev, struct io_request *req)
+{
+    struct nvme_ctrl *ctrl = dev->driver_data;
+    struct nvme_queue *queue;
+    uint32_t block_mask = (1u << (ctrl->lba_shift - 9)) - 1;
+    uint64_t sectors = 0;
+    struct nvme_command cmd = { 0 };
+
+    if ((req->flags & IO_REQ_POLLED) && ctrl->nr_poll) {
+        queue = &ctrl->poll_queues[req->queue_hint % ctrl->nr_poll];
+    } else {
+        queue = &ctrl->queues[req->queue_hint % ctrl->nr_queues];
+    }
+
+    if (req->op == IO_OP_FLUSH) {
+        if (req->nr_segments) {
+            return KERNEL_ERROR_INVALID;
+        }
+        cmd.opcode = NVME_CMD_FLUSH;
+    } else if (req->op == IO_OP_READ || req->op == IO_OP_WRITE) {
+        if (!req->nr_segments) {
+            return KERNEL_ERROR_INVALID;
+        }
+        for (uint16_t i = 0; i < req->nr_segments; i++) {
+            sectors += req->segments[i].length / IO_SECTOR_SIZE;
+        }
+        if ((req->sector & block_mask) || (sectors & block_mask) || !sectors ||
+            sectors > ctrl->max_sectors || req->sector >= ctrl->capacity ||
+            sectors > ctrl->capacity - req->sector) {
+            return KERNEL_ERROR_INVALID;
+        }
+
+        uint64_t lba = req->sector >> (ctrl->lba_shift - 9);
+        cmd.opcode = req->op == IO_OP_READ ? NVME_CMD_READ : NVME_CMD_WRITE;
+        cmd.cdw10 = (uint32_t)lba;
+        cmd.cdw11 = (uint32_t)(lba >> 32);
+        cmd.cdw12 = (uint32_t)((sectors >> (ctrl->lba_shift - 9)) - 1);
+    } else {
+        return KERNEL_ERROR_INVALID;
+    }
+    cmd.nsid = NVME_NSID;
+
+    uint64_t flags = spin_lock_irqsave(&queue->lock);
+
+    if (!queue->nr_free) {
+        spin_unlock_irqrestore(&queue->lock, flags);
+        return KERNEL_ERROR_AGAIN;
+    }
+    uint16_t id = queue->free_ids[--queue->nr_free];
+    struct nvme_slot *slot = &queue->slots[id];
+
+    if (req->nr_segments && !nvme_setup_prps(req, &cmd, slot->list)) {
+        if (!ctrl->sgl || req->nr_segments > PAGE_SIZE / sizeof(struct nvme_sgl_desc)) {
+            queue->nr_free++;
+            spin_unlock_irqrestore(&queue->lock, flags);
+            return KERNEL_ERROR_INVALID;
+        }
+        cmd.prp1 = cmd.prp2 = 0;
+        nvme_setup_sgl(req, &cmd, slot->list);
+    }
+
+    slot->req = req;
+    cmd.command_id = id;
+    nvme_queue_push(queue, &cmd);
+    smp_wmb();
+    mmio_write32(queue->sq_doorbell, queue->sq_tail);
+
+    spin_unlock_irqrestore(&queue->lock, flags);
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * nvme_poll - Reap both of a CPU's queue pairs
+ */
+static int nvme_poll(struct device *dev, unsigned int queue)
+{
+    struct nvme_ctrl *ctrl = dev->driver_data;
+    int count = 0;
+
+    if (ctrl->nr_poll) {
+        count += nvme_reap(&ctrl->poll_queues[queue % ctrl->nr_poll]);
+    }
+    count += nvme_reap(&ctrl->queues[queue % ctrl->nr_queues]);
+    return count;
+}
+
+static int nvme_read(struct device *dev, void *buffer, size_t size, uint64_t offset)
+{
+    return device_io_sync(dev, IO_OP_READ, buffer, size, offset);
+}
+
+static int nvme_write(struct device *dev, const void *buffer, size_t size, uint64_t offset)
+{
+    return device_io_sync(dev, IO_OP_WRITE, (void *)buffer, size, offset);
+}
+
+/**
+ * nvme_ioctl - Controller settings
+ *
+ * NVME_IOCTL_SET_COALESCING sets the aggregation threshold and time for
+ * every interrupt-driven completion queue.
+ */
+static int nvme_ioctl(struct device *dev, uint32_t cmd, void *arg)
+{
+    struct nvme_ctrl *ctrl = dev->driver_data;
+
+    if (cmd == NVME_IOCTL_SET_COALESCING) {
+        struct nvme_coalescing *setting = arg;
+        if (!setting) {
+            return KERNEL_ERROR_INVALID;
+        }
+
+        uint32_t value = 0;
+        if (setting->threshold) {
+            value = ((uint32_t)setting->time << 8) | (uint8_t)(setting->threshold - 1);
+        }
+        return nvme_set_features(ctrl, NVME_FEAT_IRQ_COALESCE, value, NULL);
+    }
+    return KERNEL_ERROR_INVALID;
+}
+
+static struct device_ops nvme_ops = {
+    .read = nvme_read,
+    .write = nvme_write,
+    .ioctl = nvme_ioctl,
+    .submit = nvme_submit,
+    .poll = nvme_poll,
+};
+
+/**
+ * nvme_wait_ready - Wait for CSTS.RDY to reach @ready
+ */
+static int nvme_wait_ready(struct nvme_ctrl *ctrl, uint64_t cap, bool ready)
+{
+    uint64_t spins = (uint64_t)(NVME_CAP_TIMEOUT(cap) + 1) * NVME_READY_SPINS;
+
+    while (spins--) {
+        uint32_t status = mmio_read32(ctrl->regs + NVME_REG_CSTS);
+        if (status & NVME_CSTS_CFS) {
+            return KERNEL_ERROR_FAULT;
+        }
+        if (!!(status & NVME_CSTS_RDY) == ready) {
+            return KERNEL_SUCCESS;
+        }
+        cpu_relax();
+    }
+    return KERNEL_ERROR_FAULT;
+}
+
+/**
+ * nvme_enable - Reset the controller and bring up the admin queue
+ */
+static int nvme_enable(struct nvme_ctrl *ctrl, uint64_t cap)
+{
+    uint32_t config = mmio_read32(ctrl->regs + NVME_REG_CC);
+
+    if (config & NVME_CC_ENABLE) {
+        mmio_write32(ctrl->regs + NVME_REG_CC, config & ~NVME_CC_ENABLE);
+    }
+    int ret = nvme_wait_ready(ctrl, cap, false);
+    if (ret != KERNEL_SUCCESS) {
+        return ret;
+    }
+
+    uint16_t depth = (uint16_t)MIN(NVME_ADMIN_DEPTH, NVME_CAP_MQES(cap));
+    ret = nvme_queue_init(ctrl, &ctrl->admin, 0, depth, false);
+    if (ret != KERNEL_SUCCESS) {
+        return ret;
+    }
+
+    mmio_write32(ctrl->regs + NVME_REG_AQA, ((uint32_t)(depth - 1) << 16) | (depth - 1));
+    mmio_write64(ctrl->regs + NVME_REG_ASQ, direct_to_phys(ctrl->admin.sq));
+    mmio_write64(ctrl->regs + NVME_REG_ACQ, direct_to_phys((void *)ctrl->admin.cq));
+    mmio_write32(ctrl->regs + NVME_REG_CC, NVME_CC_ENABLE | NVME_CC_IOSQES | NVME_CC_IOCQES);
+    return nvme_wait_ready(ctrl, cap, true);
+}
+
+/**
+ * nvme_identify_all - Read controller limits and namespace 1 geometry
+ */
+static int nvme_identify_all(struct nvme_ctrl *ctrl)
+{
+    uint8_t *data = nvme_alloc_dma(PAGE_SIZE);
+    if (!data) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    int ret = nvme_identify(ctrl, 0, NVME_ID_CONTROLLER, data);
+    if (ret == KERNEL_SUCCESS) {
+        uint8_t mdts = data[NVME_ID_CTRL_MDTS];
+        uint32_t sgls = *(uint32_t *)(data + NVME_ID_CTRL_SGLS);
+
+        ctrl->sgl = sgls & 3;
+        ctrl->max_sectors = BLK_MAX_SECTORS;
+        if (mdts && mdts < 20) {
+            ctrl->max_sectors = MIN(ctrl->max_sectors, (uint32_t)(PAGE_SIZE / IO_SECTOR_SIZE) << mdts);
+        }
+        ret = nvme_identify(ctrl, NVME_NSID, NVME_ID_NAMESPACE, data);
+    }
+    if (ret == KERNEL_SUCCESS) {
+        uint64_t blocks = *(uint64_t *)(data + NVME_ID_NS_NSZE);
+        uint8_t format = data[NVME_ID_NS_FLBAS] & 0xF;
+
+        ctrl->lba_shift = data[NVME_ID_NS_LBAF + format * 4 + 2];
+        if (ctrl->lba_shift < 9 || ctrl->lba_shift > 16 || !blocks) {
+            ret = KERNEL_ERROR_NOTFOUND;
+        }
+        ctrl->capacity = blocks << (ctrl->lba_shift - 9);
+    }
+
+    page_put(virt_to_page(data));
+    return ret;
+}
+
+/**
+ * nvme_setup_io_queues - One interrupt queue pair per CPU, plus polled pairs
+ */
+static int nvme_setup_io_queues(struct nvme_ctrl *ctrl, uint64_t cap)
+{
+    unsigned int cpus = MIN(lapic_cpu_count(), 0x8000u);
+    uint32_t wanted = 2 * cpus - 1;
+    uint32_t result;
+
+    int ret = nvme_set_features(ctrl, NVME_FEAT_NUM_QUEUES, (wanted << 16) | wanted, &result);
+    if (ret != KERNEL_SUCCESS) {
+        return ret;
+    }
+    unsigned int granted = MIN(result & 0xFFFF, result >> 16) + 1;
+
+    ctrl->nr_queues = MIN(cpus, granted);
+    ctrl->nr_poll = MIN(cpus, granted - ctrl->nr_queues);
+
+    /* MSI-X entry 0 belongs to the admin queue, which is always polled */
+    int vectors = pci_enable_msix(ctrl->pdev, ctrl->nr_queues + 1);
+    bool msix = vectors >= 2;
+    if (msix) {
+        ctrl->nr_queues = MIN(ctrl->nr_queues, (unsigned int)vectors - 1);
+        ctrl->pdev->dev.completion.caps |= IO_CAP_IRQ;
+    }
+
+    uint16_t depth = (uint16_t)MIN(NVME_IO_DEPTH, NVME_CAP_MQES(cap));
+    ctrl->queues = kzalloc(ctrl->nr_queues * sizeof(struct nvme_queue));
+    ctrl->poll_queues = ctrl->nr_poll ? kzalloc(ctrl->nr_poll * sizeof(struct nvme_queue)) : NULL;
+    if (!ctrl->queues || (ctrl->nr_poll && !ctrl->poll_queues)) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    uint16_t qid = 1;
+    for (unsigned int cpu = 0; cpu < ctrl->nr_queues; cpu++, qid++) {
+        struct nvme_queue *queue = &ctrl->queues[cpu];
+
+        ret = nvme_create_queue_pair(ctrl, queue, qid, depth, !msix, (uint16_t)(cpu + 1));
+        if (ret != KERNEL_SUCCESS) {
+            return ret;
+        }
+        if (msix) {
+            int vector = pci_msix_bind(ctrl->pdev, cpu + 1, nvme_irq, queue, cpu);
+            if (vector < 0) {
+                return vector;
+            }
+        }
+    }
+    for (unsigned int cpu = 0; cpu < ctrl->nr_poll; cpu++, qid++) {
+        ret = nvme_create_queue_pair(ctrl, &ctrl->poll_queues[cpu], qid, depth, true, 0);
+        if (ret != KERNEL_SUCCESS) {
+            return ret;
+        }
+    }
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * nvme_probe - Bring up an NVMe controller and its first namespace
+ */
+static int nvme_probe(struct pci_device *pdev, const struct pci_device_id *id)
+{
+    (void)id;
+
+    struct nvme_ctrl *ctrl = kzalloc(sizeof(*ctrl));
+    if (!ctrl) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    pci_enable_device(pdev);
+    ctrl->pdev = pdev;
+    ctrl->regs = pci_map_bar(pdev, 0);
+    spin_lock_init(&ctrl->admin_lock);
+    if (!ctrl->regs) {
+        kfree(ctrl);
+        return KERNEL_ERROR_NOTFOUND;
+    }
+
+    uint64_t cap = mmio_read64(ctrl->regs + NVME_REG_CAP);
+    ctrl->doorbell_stride = 4u << NVME_CAP_DSTRD(cap);
+
+    /* Host pages are 4KB */
+    if (NVME_CAP_MPSMIN(cap) != 0) {
+        kfree(ctrl);
+        return KERNEL_ERROR_INVALID;
+    }
+
+    int ret = nvme_enable(ctrl, cap);
+    if (ret == KERNEL_SUCCESS) {
+        ret = nvme_identify_all(ctrl);
+    }
+    if (ret == KERNEL_SUCCESS) {
+        ret = nvme_setup_io_queues(ctrl, cap);
+    }
+    if (ret != KERNEL_SUCCESS) {
+        /* Leave the controller disabled; its memory is abandoned */
+        mmio_write32(ctrl->regs + NVME_REG_CC, 0);
+        return ret;
+    }
+
+    struct blk_queue *queue = blk_queue_create(&pdev->dev, ctrl->capacity, IO_MAX_SEGMENTS);
+    if (!queue) {
+        return KERNEL_ERROR_NOMEM;
+    }
+    queue->max_sectors = ctrl->max_sectors;
+
+    /* PRPs need every seam inside a transfer page aligned; SGLs do not */
+    if (!ctrl->sgl) {
+        queue->virt_boundary = PAGE_MASK;
+    }
+
+    pdev->dev.id = DEVICE_ID_ANY;
+    pdev->dev.type = DEVICE_TYPE_STORAGE;
+    pdev->dev.status = DEVICE_STATUS_READY;
+    pdev->dev.driver_data = ctrl;
+    pdev->dev.ops = &nvme_ops;
+    strcpy(pdev->dev.name, "nvme0n1");
+    pdev->dev.name[4] = (char)('0' + nvme_count % 10);
+    nvme_count++;
+    return KERNEL_SUCCESS;
+}
+
+static const struct pci_device_id nvme_ids[] = {
+    { PCI_ANY_ID, PCI_ANY_ID, NVME_PCI_CLASS, NVME_PCI_SUBCLASS },
+    { 0, 0, 0, 0 },
+};
+
+static struct pci_driver nvme_driver = {
+    .name = "nvme",
+    .id_table = nvme_ids,
+    .probe = nvme_probe,
+};
+
+/**
+ * nvme_init - Register the driver with the PCI core
+ */
+int __init nvme_init(void)
+{
+    return pci_register_driver(&nvme_driver);
+}
+initcall(nvme_init, INITCALL_ASYNC | INITCALL_OPTIONAL,
+         device_manager_init, process_manager_init, blk_init);
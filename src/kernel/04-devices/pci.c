@@ -0,0 +1,509 @@
+/*
+ * Power1 OS - PCI Bus
+ * PCIe enumeration over ECAM, BAR discovery, MSI-X and driver binding
+ *
+ * Configuration space is reached through the memory-mapped ECAM windows
+ * described by the ACPI MCFG table: every register access is a single
+ * uncached load or store instead of the address/data port pair of the
+ * legacy 0xCF8 mechanism, which is kept only for machines without MCFG.
+ * A bus's 1MB ECAM window is mapped the first time the scan reaches it,
+ * and only buses reachable through bridges are scanned.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/io.h"
+#include "../include/acpi.h"
+#include "../include/pci.h"
+#include "../include/init.h"
+
+#define PCI_LEGACY_ADDRESS      0xCF8
+#define PCI_LEGACY_DATA         0xCFC
+#define PCI_ECAM_BUS_SIZE       (1UL << 20)
+#define PCI_SEGMENT_MAX         4
+
+/* ECAM windows from the MCFG table */
+static struct {
+    uint64_t base;
+    uint16_t segment;
+    uint8_t start_bus;
+    uint8_t end_bus;
+    volatile uint8_t *buses[PCI_MAX_BUSES];
+} pci_segments[PCI_SEGMENT_MAX];
+static int pci_segment_count = 0;
+
+static LIST_HEAD(pci_devices);
+static struct pci_driver *pci_drivers = NULL;
+
+/**
+ * pci_ecam_function - ECAM window of one function, mapping its bus if needed
+ */
+static volatile uint8_t *pci_ecam_function(int index, uint8_t bus, uint8_t slot, uint8_t function)
+{
+    if (bus < pci_segments[index].start_bus || bus > pci_segments[index].end_bus) {
+        return NULL;
+    }
+
+    volatile uint8_t *window = pci_segments[index].buses[bus];
+    if (!window) {
+        uint64_t phys = pci_segments[index].base +
+                        ((uint64_t)(bus - pci_segments[index].start_bus) << 20);
+        window = ioremap(phys, PCI_ECAM_BUS_SIZE);
+        if (!window) {
+            return NULL;
+        }
+        pci_segments[index].buses[bus] = window;
+    }
+    return window + (((uint32_t)slot << 15) | ((uint32_t)function << 12));
+}
+
+/**
+ * pci_legacy_address - CONFIG_ADDRESS value for port I/O access
+ */
+static inline uint32_t pci_legacy_address(struct pci_device *pdev, uint16_t offset)
+{
+    return (1U << 31) | ((uint32_t)pdev->bus << 16) | ((uint32_t)pdev->slot << 11) |
+           ((uint32_t)pdev->function << 8) | (offset & 0xFC);
+}
+
+uint32_t pci_config_read32(struct pci_device *pdev, uint16_t offset)
+{
+    if (pdev->config) {
+        return mmio_read32(pdev->config + offset);
+    }
+    if (offset >= 256) {
+        return 0xFFFFFFFF;
+    }
+    outl(PCI_LEGACY_ADDRESS, pci_legacy_address(pdev, offset));
+    return inl(PCI_LEGACY_DATA);
+}
+
+uint16_t pci_config_read16(struct pci_device *pdev, uint16_t offset)
+{
+    if (pdev->config) {
+        return mmio_read16(pdev->config + offset);
+    }
+    return (uint16_t)(pci_config_read32(pdev, offset) >> ((offset & 2) * 8));
+}
+
+uint8_t pci_config_read8(struct pci_device *pdev, uint16_t offset)
+{
+    if (pdev->config) {
+        return mmio_read8(pdev->config + offset);
+    }
+    return (uint8_t)(pci_config_read32(pdev, offset) >> ((offset & 3) * 8));
+}
+
+void pci_config_write32(struct pci_device *pdev, uint16_t offset, uint32_t value)
+{
+    if (pdev->config) {
+        mmio_write32(pdev->config + offset, value);
+    } else if (offset < 256) {
+        outl(PCI_LEGACY_ADDRESS, pci_legacy_address(pdev, offset));
+        outl(PCI_LEGACY_DATA, value);
+    }
+}
+
+void pci_config_write16(struct pci_device *pdev, uint16_t offset, uint16_t value)
+{
+    if (pdev->config) {
+        mmio_write16(pdev->config + offset, value);
+        return;
+    }
+    uint32_t shift = (offset & 2) * 8;
+    uint32_t word = pci_config_read32(pdev, offset);
+    word = (word & ~(0xFFFFU << shift)) | ((uint32_t)value << shift);
+    pci_config_write32(pdev, offset, word);
+}
+
+void pci_config_write8(struct pci_device *pdev, uint16_t offset, uint8_t value)
+{
+    if (pdev->config) {
+        mmio_write8(pdev->config + offset, value);
+        return;
+    }
+    uint32_t shift = (offset & 3) * 8;
+    uint32_t word = pci_config_read32(pdev, offset);
+    word = (word & ~(0xFFU << shift)) | ((uint32_t)value << shift);
+    pci_config_write32(pdev, offset, word);
+}
+
+/**
+ * pci_size_bars - Record the address and size of each BAR
+ *
+ * Decoding is switched off while the all-ones probe value is in place.
+ */
+static void pci_size_bars(struct pci_device *pdev)
+{
+    uint16_t command = pci_config_read16(pdev, PCI_COMMAND);
+    pci_config_write16(pdev, PCI_COMMAND, command & ~(PCI_COMMAND_IO | PCI_COMMAND_MEMORY));
+
+    for (int bar = 0; bar < PCI_MAX_BARS; bar++) {
+        uint16_t offset = PCI_BAR0 + bar * 4;
+        uint32_t original = pci_config_read32(pdev, offset);
+
+        pci_config_write32(pdev, offset, 0xFFFFFFFF);
+        uint32_t mask = pci_config_read32(pdev, offset);
+        pci_config_write32(pdev, offset, original);
+
+        if (original & PCI_BAR_IO) {
+            pdev->bar_flags[bar] = PCI_BAR_IO;
+            pdev->bar_base[bar] = original & ~0x3U;
+            pdev->bar_size[bar] = mask ? (uint16_t)(~(mask & ~0x3U) + 1) : 0;
+            continue;
+        }
+
+        uint64_t base = original & ~0xFU;
+        uint64_t size_mask = mask & ~0xFU;
+        pdev->bar_flags[bar] = original & (PCI_BAR_MEM_TYPE_64 | PCI_BAR_PREFETCH);
+
+        if ((original & PCI_BAR_MEM_TYPE_64) && bar + 1 < PCI_MAX_BARS) {
+            uint32_t upper = pci_config_read32(pdev, offset + 4);
+            pci_config_write32(pdev, offset + 4, 0xFFFFFFFF);
+            uint32_t upper_mask = pci_config_read32(pdev, offset + 4);
+            pci_config_write32(pdev, offset + 4, upper);
+
+            base |= (uint64_t)upper << 32;
+            size_mask |= (uint64_t)upper_mask << 32;
+        } else {
+            size_mask |= 0xFFFFFFFF00000000UL;
+        }
+
+        pdev->bar_base[bar] = base;
+        pdev->bar_size[bar] = size_mask ? ~size_mask + 1 : 0;
+
+        if (original & PCI_BAR_MEM_TYPE_64) {
+            bar++;      /* Upper half consumed */
+        }
+    }
+
+    pci_config_write16(pdev, PCI_COMMAND, command);
+}
+
+static void pci_scan_bus(int segment_index, uint16_t segment, uint8_t bus);
+
+/**
+ * pci_probe_function - Record one function and descend through bridges
+ */
+static void pci_probe_function(int segment_index, uint16_t segment, uint8_t bus,
+                               uint8_t slot, uint8_t function)
+{
+    struct pci_device probe = {
+        .segment = segment, .bus = bus, .slot = slot, .function = function,
+    };
+
+    if (segment_index >= 0) {
+        probe.config = pci_ecam_function(segment_index, bus, slot, function);
+        if (!probe.config) {
+            return;
+        }
+    }
+    if (pci_config_read16(&probe, PCI_VENDOR_ID) == 0xFFFF) {
+        return;
+    }
+
+    struct pci_device *pdev = kzalloc(sizeof(*pdev));
+    if (!pdev) {
+        return;
+    }
+    *pdev = probe;
+    pdev->vendor_id = pci_config_read16(pdev, PCI_VENDOR_ID);
+    pdev->device_id = pci_config_read16(pdev, PCI_DEVICE_ID);
+    pdev->revision = pci_config_read8(pdev, PCI_REVISION_ID);
+    pdev->prog_if = pci_config_read8(pdev, PCI_PROG_IF);
+    pdev->subclass = pci_config_read8(pdev, PCI_SUBCLASS);
+    pdev->class_code = pci_config_read8(pdev, PCI_CLASS_CODE);
+    pdev->header_type = pci_config_read8(pdev, PCI_HEADER_TYPE) & PCI_HEADER_TYPE_MASK;
+    list_add_tail(&pdev->list, &pci_devices);
+
+    if (pdev->header_type == 0) {
+        pci_size_bars(pdev);
+    } else if (pdev->header_type == PCI_HEADER_BRIDGE &&
+               pdev->class_code == PCI_CLASS_BRIDGE &&
+               pdev->subclass == PCI_SUBCLASS_PCI_BRIDGE) {
+        uint8_t secondary = pci_config_read8(pdev, PCI_SECONDARY_BUS);
+        if (secondary > bus) {
+            pci_scan_bus(segment_index, segment, secondary);
+        }
+    }
+}
+
+/**
+ * pci_scan_bus - Enumerate every slot of a bus
+ */
+static void pci_scan_bus(int segment_index, uint16_t segment, uint8_t bus)
+{
+    for (uint8_t slot = 0; slot < PCI_MAX_SLOTS; slot++) {
+        struct pci_device probe = { .segment = segment, .bus = bus, .slot = slot };
+
+        if (segment_index >= 0) {
+            probe.config = pci_ecam_function(segment_index, bus, slot, 0);
+            if (!probe.config) {
+                return;
+            }
+        }
+        if (pci_config_read16(&probe, PCI_VENDOR_ID) == 0xFFFF) {
+            continue;
+        }
+
+        bool multifunction = pci_config_read8(&probe, PCI_HEADER_TYPE) & PCI_HEADER_MULTIFUNC;
+        for (uint8_t function = 0; function < (multifunction ? PCI_MAX_FUNCTIONS : 1); function++) {
+            pci_probe_function(segment_index, segment, bus, slot, function);
+        }
+    }
+}
+
+/**
+ * pci_match - Entry of @driver's table matching @pdev, or NULL
+ */
+static const struct pci_device_id *pci_match(struct pci_driver *driver, struct pci_device *pdev)
+{
+    for (const struct pci_device_id *id = driver->id_table; id && id->vendor; id++) {
+        if ((id->vendor == PCI_ANY_ID || id->vendor == pdev->vendor_id) &&
+            (id->device == PCI_ANY_ID || id->device == pdev->device_id) &&
+            (id->class_code == PCI_ANY_CLASS || id->class_code == pdev->class_code) &&
+            (id->subclass == PCI_ANY_CLASS || id->subclass == pdev->subclass)) {
+            return id;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * pci_bind - Offer an unbound function to @driver
+ *
+ * A successful probe fills in the embedded struct device, which is then
+ * published through device_register.
+ */
+static void pci_bind(struct pci_driver *driver, struct pci_device *pdev)
+{
+    const struct pci_device_id *id = pci_match(driver, pdev);
+
+    if (pdev->driver || !id) {
+        return;
+    }
+    if (driver->probe(pdev, id) != KERNEL_SUCCESS) {
+        return;
+    }
+
+    pdev->driver = driver;
+    if (device_register(&pdev->dev) != KERNEL_SUCCESS) {
+        pdev->dev.status = DEVICE_STATUS_ERROR;
+    }
+}
+
+/**
+ * pci_register_driver - Add a driver and bind it to matching functions
+ */
+int pci_register_driver(struct pci_driver *driver)
+{
+    struct list_head *node;
+
+    if (!driver || !driver->probe || !driver->id_table) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    driver->next = pci_drivers;
+    pci_drivers = driver;
+
+    list_for_each(node, &pci_devices) {
+        pci_bind(driver, list_entry(node, struct pci_device, list));
+    }
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * pci_find_device - Iterate functions by vendor and device ID
+ * @from: Previous match, or NULL to start from the beginning
+ */
+struct pci_device *pci_find_device(uint16_t vendor, uint16_t device, struct pci_device *from)
+{
+    struct list_head *node = from ? from->list.next : pci_devices.next;
+
+    for (; node != &pci_devices; node = node->next) {
+        struct pci_device *pdev = list_entry(node, struct pci_device, list);
+        if ((vendor == PCI_ANY_ID || pdev->vendor_id == vendor) &&
+            (device == PCI_ANY_ID || pdev->device_id == device)) {
+            return pdev;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * pci_enable_device - Turn on memory decoding and bus mastering
+ *
+ * Legacy INTx is disabled; drivers use MSI-X.
+ */
+int pci_enable_device(struct pci_device *pdev)
+{
+    uint16_t command = pci_config_read16(pdev, PCI_COMMAND);
+
+    command |= PCI_COMMAND_MEMORY | PCI_COMMAND_IO | PCI_COMMAND_MASTER |
+               PCI_COMMAND_INTX_DISABLE;
+    pci_config_write16(pdev, PCI_COMMAND, command);
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * pci_map_bar - Map a memory BAR uncached
+ */
+void *pci_map_bar(struct pci_device *pdev, int bar)
+{
+    if (bar < 0 || bar >= PCI_MAX_BARS || !pdev->bar_size[bar] ||
+        (pdev->bar_flags[bar] & PCI_BAR_IO)) {
+        return NULL;
+    }
+    return ioremap(pdev->bar_base[bar], pdev->bar_size[bar]);
+}
+
+/**
+ * pci_find_capability - Offset of the next capability @cap_id after @start
+ * @start: 0 to search from the beginning of the list
+ *
+ * Returns 0 when there is none.
+ */
+uint8_t pci_find_capability(struct pci_device *pdev, uint8_t cap_id, uint8_t start)
+{
+    if (!(pci_config_read16(pdev, PCI_STATUS) & PCI_STATUS_CAP_LIST)) {
+        return 0;
+    }
+
+    uint8_t offset = start ? pci_config_read8(pdev, start + 1)
+                           : pci_config_read8(pdev, PCI_CAPABILITY_LIST);
+
+    /* Bound the walk in case of a looping list */
+    for (int guard = 0; offset >= 0x40 && guard < 48; guard++) {
+        offset &= ~0x3;
+        if (pci_config_read8(pdev, offset) == cap_id) {
+            return offset;
+        }
+        offset = pci_config_read8(pdev, offset + 1);
+    }
+    return 0;
+}
+
+/**
+ * pci_enable_msix - Enable MSI-X with up to @count vectors, all masked
+ *
+ * Returns the number of entries available to pci_msix_bind.
+ */
+int pci_enable_msix(struct pci_device *pdev, unsigned int count)
+{
+    uint8_t cap = pci_find_capability(pdev, PCI_CAP_ID_MSIX, 0);
+    if (!cap) {
+        return KERNEL_ERROR_NOTFOUND;
+    }
+
+    uint16_t control = pci_config_read16(pdev, cap + PCI_MSIX_CONTROL);
+    uint32_t table = pci_config_read32(pdev, cap + PCI_MSIX_TABLE);
+    unsigned int size = (control & PCI_MSIX_TABLE_SIZE) + 1;
+    int bir = table & PCI_MSIX_BIR_MASK;
+
+    if (bir >= PCI_MAX_BARS || !pdev->bar_size[bir]) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    count = MIN(count, size);
+    pdev->msix_vectors = kzalloc(count * sizeof(int));
+    pdev->msix_table = ioremap(pdev->bar_base[bir] + (table & ~PCI_MSIX_BIR_MASK),
+                               size * PCI_MSIX_ENTRY_SIZE);
+    if (!pdev->msix_vectors || !pdev->msix_table) {
+        kfree(pdev->msix_vectors);
+        pdev->msix_vectors = NULL;
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    /* Mask the function while the table is programmed */
+    pci_config_write16(pdev, cap + PCI_MSIX_CONTROL,
+                       control | PCI_MSIX_CONTROL_ENABLE | PCI_MSIX_CONTROL_MASK);
+    for (unsigned int entry = 0; entry < size; entry++) {
+        mmio_write32(pdev->msix_table + entry * PCI_MSIX_ENTRY_SIZE + PCI_MSIX_ENTRY_CTRL,
+                     PCI_MSIX_ENTRY_MASKED);
+    }
+    pci_config_write16(pdev, cap + PCI_MSIX_CONTROL,
+                       (control | PCI_MSIX_CONTROL_ENABLE) & ~PCI_MSIX_CONTROL_MASK);
+
+    pdev->msix_cap = cap;
+    pdev->msix_count = (uint16_t)count;
+    return (int)count;
+}
+
+/**
+ * pci_msix_mask - Mask or unmask one MSI-X entry
+ */
+void pci_msix_mask(struct pci_device *pdev, unsigned int entry, bool masked)
+{
+    if (entry < pdev->msix_count) {
+        mmio_write32(pdev->msix_table + entry * PCI_MSIX_ENTRY_SIZE + PCI_MSIX_ENTRY_CTRL,
+                     masked ? PCI_MSIX_ENTRY_MASKED : 0);
+    }
+}
+
+/**
+ * pci_msix_bind - Route MSI-X @entry to @handler on CPU @cpu
+ *
+ * Allocates a CPU vector, programs the entry's message to target that
+ * CPU's local APIC and unmasks it. Returns the vector.
+ */
+int pci_msix_bind(struct pci_device *pdev, unsigned int entry, irq_handler_t handler,
+                  void *data, unsigned int cpu)
+{
+    if (entry >= pdev->msix_count) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    if (pdev->msix_vectors[entry]) {
+        interrupt_free_vector(pdev->msix_vectors[entry]);
+        pdev->msix_vectors[entry] = 0;
+    }
+
+    int vector = interrupt_alloc_vector(handler, data);
+    if (vector < 0) {
+        return vector;
+    }
+
+    volatile uint8_t *slot = pdev->msix_table + entry * PCI_MSIX_ENTRY_SIZE;
+    uint32_t apic_id = lapic_cpu_apic_id(cpu);
+
+    pci_msix_mask(pdev, entry, true);
+    mmio_write32(slot + PCI_MSIX_ENTRY_ADDR_LO, PCI_MSI_ADDRESS_BASE | ((apic_id & 0xFF) << 12));
+    mmio_write32(slot + PCI_MSIX_ENTRY_ADDR_HI, 0);
+    mmio_write32(slot + PCI_MSIX_ENTRY_DATA, (uint32_t)vector);
+    pci_msix_mask(pdev, entry, false);
+
+    pdev->msix_vectors[entry] = vector;
+    return vector;
+}
+
+/**
+ * pci_init - Enumerate every PCI function
+ */
+int __init pci_init(void)
+{
+    struct acpi_mcfg *mcfg = acpi_find_table("MCFG");
+
+    if (mcfg) {
+        size_t count = (mcfg->header.length - sizeof(*mcfg)) / sizeof(struct acpi_mcfg_entry);
+        for (size_t i = 0; i < count && pci_segment_count < PCI_SEGMENT_MAX; i++) {
+            pci_segments[pci_segment_count].base = mcfg->entries[i].base_address;
+            pci_segments[pci_segment_count].segment = mcfg->entries[i].segment;
+            pci_segments[pci_segment_count].start_bus = mcfg->entries[i].start_bus;
+            pci_segments[pci_segment_count].end_bus = mcfg->entries[i].end_bus;
+            pci_segment_count++;
+        }
+    }
+
+    if (pci_segment_count == 0) {
+        pci_scan_bus(-1, 0, 0);
+        return KERNEL_SUCCESS;
+    }
+
+    for (int i = 0; i < pci_segment_count; i++) {
+        pci_scan_bus(i, pci_segments[i].segment, pci_segments[i].start_bus);
+    }
+    return KERNEL_SUCCESS;
+}
@@ -0,0 +1,390 @@
+/*
+ * Power1 OS - Virtio PCI Transport
+ * Feature negotiation and split virtqueues for virtio 1.x devices
+ *
+ * Notification suppression follows VIRTIO_F_RING_EVENT_IDX when offered:
+ * the driver kicks only when the device's avail_event says it is waiting
+ * for the descriptors just published, and the device interrupts only when
+ * it passes the used_event index the driver arms in virtqueue_enable_cb.
+ * A driver draining a queue therefore runs with interrupts suppressed and
+ * re-arms them once, after the last completion.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/io.h"
+#include "../include/atomic.h"
+#include "../include/virtio.h"
+
+#define VRING_USED_F_NO_NOTIFY  1
+
+/**
+ * virtio_write64 - 64-bit common config field as two 32-bit writes
+ */
+static void virtio_write64(volatile uint64_t *field, uint64_t value)
+{
+    volatile uint32_t *half = (volatile uint32_t *)field;
+    half[0] = (uint32_t)value;
+    half[1] = (uint32_t)(value >> 32);
+}
+
+/**
+ * virtio_map_cap - Map the region described by a virtio vendor capability
+ */
+static volatile uint8_t *virtio_map_cap(struct pci_device *pdev, uint8_t cap)
+{
+    uint8_t bar = pci_config_read8(pdev, cap + 4);
+    uint32_t offset = pci_config_read32(pdev, cap + 8);
+    uint32_t length = pci_config_read32(pdev, cap + 12);
+
+    if (bar >= PCI_MAX_BARS || !pdev->bar_size[bar] || (pdev->bar_flags[bar] & PCI_BAR_IO) ||
+        !length || (uint64_t)offset + length > pdev->bar_size[bar]) {
+        return NULL;
+    }
+    return ioremap(pdev->bar_base[bar] + offset, length);
+}
+
+/**
+ * virtio_pci_init - Locate and map the virtio 1.x register regions
+ */
+int virtio_pci_init(struct virtio_device *vdev, struct pci_device *pdev)
+{
+    uint8_t cap = 0;
+
+    vdev->pdev = pdev;
+    pci_enable_device(pdev);
+
+    while ((cap = pci_find_capability(pdev, PCI_CAP_ID_VENDOR, cap)) != 0) {
+        uint8_t type = pci_config_read8(pdev, cap + 3);
+
+        switch (type) {
+        case VIRTIO_PCI_CAP_COMMON_CFG:
+            if (!vdev->common) {
+                vdev->common = (volatile void *)virtio_map_cap(pdev, cap);
+            }
+            break;
+        case VIRTIO_PCI_CAP_NOTIFY_CFG:
+            if (!vdev->notify_base) {
+                vdev->notify_base = virtio_map_cap(pdev, cap);
+                vdev->notify_multiplier = pci_config_read32(pdev, cap + 16);
+            }
+            break;
+        case VIRTIO_PCI_CAP_ISR_CFG:
+            if (!vdev->isr) {
+                vdev->isr = virtio_map_cap(pdev, cap);
+            }
+            break;
+        case VIRTIO_PCI_CAP_DEVICE_CFG:
+            if (!vdev->device_cfg) {
+                vdev->device_cfg = virtio_map_cap(pdev, cap);
+            }
+            break;
+        }
+    }
+
+    /* Legacy-only devices expose none of these */
+    if (!vdev->common || !vdev->notify_base) {
+        return KERNEL_ERROR_NOTFOUND;
+    }
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * virtio_negotiate - Reset the device and agree on features
+ * @wanted: Feature bits the driver can use; VERSION_1 is always required
+ */
+int virtio_negotiate(struct virtio_device *vdev, uint64_t wanted)
+{
+    volatile struct virtio_pci_common_cfg *common = vdev->common;
+
+    common->device_status = 0;
+    while (common->device_status != 0) {
+        cpu_relax();
+    }
+    common->device_status = VIRTIO_STATUS_ACKNOWLEDGE;
+    common->device_status = VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER;
+
+    uint64_t offered;
+    common->device_feature_select = 0;
+    offered = common->device_feature;
+    common->device_feature_select = 1;
+    offered |= (uint64_t)common->device_feature << 32;
+
+    wanted |= 1ULL << VIRTIO_F_VERSION_1;
+    vdev->features = offered & wanted;
+    if (!virtio_has_feature(vdev, VIRTIO_F_VERSION_1)) {
+        virtio_fail(vdev);
+        return KERNEL_ERROR_NOTFOUND;
+    }
+
+    common->driver_feature_select = 0;
+    common->driver_feature = (uint32_t)vdev->features;
+    common->driver_feature_select = 1;
+    common->driver_feature = (uint32_t)(vdev->features >> 32);
+
+    common->device_status |= VIRTIO_STATUS_FEATURES_OK;
+    if (!(common->device_status & VIRTIO_STATUS_FEATURES_OK)) {
+        virtio_fail(vdev);
+        return KERNEL_ERROR_INVALID;
+    }
+
+    /* Configuration changes are not handled; keep them quiet */
+    common->msix_config = VIRTIO_MSI_NO_VECTOR;
+    return KERNEL_SUCCESS;
+}
+
+void virtio_driver_ok(struct virtio_device *vdev)
+{
+    vdev->common->device_status |= VIRTIO_STATUS_DRIVER_OK;
+}
+
+void virtio_fail(struct virtio_device *vdev)
+{
+    vdev->common->device_status |= VIRTIO_STATUS_FAILED;
+}
+
+/**
+ * vring_alloc - Zeroed, physically contiguous ring memory
+ */
+static void *vring_alloc(size_t size)
+{
+    struct page *page = page_alloc(pmem_order_for(DIV_ROUND_UP(size, PAGE_SIZE)), ALLOC_ZERO);
+    return page ? page_address(page) : NULL;
+}
+
+static inline uint16_t *vring_used_event(struct virtqueue *vq)
+{
+    return &vq->avail->ring[vq->size];
+}
+
+static inline volatile uint16_t *vring_avail_event(struct virtqueue *vq)
+{
+    return (volatile uint16_t *)&vq->used->ring[vq->size];
+}
+
+/**
+ * virtqueue_create - Set up queue @index with at most @max_size entries
+ * @msix_entry: MSI-X table entry for its interrupts, or VIRTIO_MSI_NO_VECTOR
+ */
+struct virtqueue *virtqueue_create(struct virtio_device *vdev, uint16_t index,
+                                   uint16_t max_size, uint16_t msix_entry)
+{
+    volatile struct virtio_pci_common_cfg *common = vdev->common;
+
+    common->queue_select = index;
+    uint16_t size = common->queue_size;
+    if (!size) {
+        return NULL;
+    }
+
+    /* Split rings are a power of two in size */
+    size = MIN(size, max_size);
+    while (size & (size - 1)) {
+        size &= size - 1;
+    }
+
+    struct virtqueue *vq = kzalloc(sizeof(*vq));
+    if (!vq) {
+        return NULL;
+    }
+
+    vq->vdev = vdev;
+    vq->index = index;
+    vq->size = size;
+    vq->num_free = size;
+    vq->event_idx = virtio_has_feature(vdev, VIRTIO_F_RING_EVENT_IDX);
+    vq->indirect = virtio_has_feature(vdev, VIRTIO_F_RING_INDIRECT_DESC);
+    vq->desc = vring_alloc(size * sizeof(struct vring_desc));
+    vq->avail = vring_alloc(sizeof(struct vring_avail) + (size + 1) * sizeof(uint16_t));
+    vq->used = vring_alloc(sizeof(struct vring_used) +
+                           size * sizeof(struct vring_used_elem) + sizeof(uint16_t));
+    vq->tokens = kzalloc(size * sizeof(void *));
+    spin_lock_init(&vq->lock);
+
+    if (!vq->desc || !vq->avail || !vq->used || !vq->tokens) {
+        return NULL;    /* Probe failure; the device is abandoned */
+    }
+
+    for (uint16_t i = 0; i < size - 1; i++) {
+        vq->desc[i].next = i + 1;
+    }
+
+    common->queue_size = size;
+    virtio_write64(&common->queue_desc, direct_to_phys(vq->desc));
+    virtio_write64(&common->queue_driver, direct_to_phys(vq->avail));
+    virtio_write64(&common->queue_device, direct_to_phys(vq->used));
+    common->queue_msix_vector = msix_entry;
+    if (common->queue_msix_vector != msix_entry) {
+        common->queue_msix_vector = VIRTIO_MSI_NO_VECTOR;
+    }
+
+    vq->notify = (volatile uint16_t *)(vdev->notify_base +
+                                       common->queue_notify_off * vdev->notify_multiplier);
+    common->queue_enable = 1;
+    return vq;
+}
+
+/**
+ * virtqueue_add - Publish a buffer chain to the device
+ * @chain: Descriptors in order; the NEXT links are filled in here
+ * @token: Returned by virtqueue_get_buf when the device is done
+ *
+ * With indirect descriptors a multi-entry chain is used in place as the
+ * indirect table and must stay valid, in direct-mapped memory, until
+ * completion. Otherwise it is copied into ring descriptors. Called with
+ * vq->lock held.
+ */
+int virtqueue_add(struct virtqueue *vq, struct vring_desc *chain, uint16_t count, void *token)
+{
+    bool indirect = vq->indirect && count > 1;
+    uint16_t needed = indirect ? 1 : count;
+
+    if (!count || vq->num_free < needed) {
+        return KERNEL_ERROR_NOSPC;
+    }
+
+    for (uint16_t i = 0; i + 1 < count; i++) {
+        chain[i].flags |= VRING_DESC_F_NEXT;
+        chain[i].next = i + 1;
+    }
+    chain[count - 1].flags &= ~VRING_DESC_F_NEXT;
+
+    uint16_t head = vq->free_head;
+    uint16_t slot = head;
+
+    if (indirect) {
+        struct vring_desc *desc = &vq->desc[slot];
+        vq->free_head = desc->next;
+        desc->addr = direct_to_phys(chain);
+        desc->len = count * sizeof(struct vring_desc);
+        desc->flags = VRING_DESC_F_INDIRECT;
+    } else {
+        for (uint16_t i = 0; i < count; i++) {
+            struct vring_desc *desc = &vq->desc[slot];
+            uint16_t next = desc->next;
+
+            desc->addr = chain[i].addr;
+            desc->len = chain[i].len;
+            desc->flags = chain[i].flags;
+            if (i + 1 < count) {
+                desc->next = next;
+            }
+            slot = next;
+        }
+        vq->free_head = slot;
+    }
+
+    vq->num_free -= needed;
+    vq->tokens[head] = token;
+
+    vq->avail->ring[vq->avail_idx & (vq->size - 1)] = head;
+    smp_wmb();
+    vq->avail_idx++;
+    __atomic_store_n(&vq->avail->idx, vq->avail_idx, __ATOMIC_RELEASE);
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * virtqueue_kick_prepare - Whether the device must be notified
+ *
+ * Covers everything added since the previous call. Called with vq->lock
+ * held; the notification itself can be sent after dropping it.
+ */
+bool virtqueue_kick_prepare(struct virtqueue *vq)
+{
+    uint16_t new_idx = vq->avail_idx;
+    uint16_t old_idx = vq->kicked_idx;
+    bool needed;
+
+    /* Publish avail->idx before reading the device's suppression state */
+    smp_mb();
+
+    if (vq->event_idx) {
+        uint16_t event = *vring_avail_event(vq);
+        needed = (uint16_t)(new_idx - event - 1) < (uint16_t)(new_idx - old_idx);
+    } else {
+        needed = !(__atomic_load_n(&vq->used->flags, __ATOMIC_RELAXED) & VRING_USED_F_NO_NOTIFY);
+    }
+
+    vq->kicked_idx = new_idx;
+    return needed;
+}
+
+/**
+ * virtqueue_notify - Tell the device new buffers are available
+ */
+void virtqueue_notify(struct virtqueue *vq)
+{
+    mmio_write16(vq->notify, vq->index);
+}
+
+/**
+ * virtqueue_get_buf - Take the next completed chain, or NULL
+ * @length: Receives the number of bytes the device wrote
+ *
+ * Called with vq->lock held.
+ */
+void *virtqueue_get_buf(struct virtqueue *vq, uint32_t *length)
+{
+    uint16_t used_idx = __atomic_load_n(&vq->used->idx, __ATOMIC_ACQUIRE);
+
+    if (vq->last_used_idx == used_idx) {
+        return NULL;
+    }
+
+    struct vring_used_elem *elem = &vq->used->ring[vq->last_used_idx & (vq->size - 1)];
+    uint16_t head = (uint16_t)elem->id;
+    void *token = vq->tokens[head];
+
+    if (length) {
+        *length = elem->len;
+    }
+    vq->last_used_idx++;
+
+    /* Return the chain to the free list */
+    uint16_t tail = head;
+    vq->num_free++;
+    while (vq->desc[tail].flags & VRING_DESC_F_NEXT) {
+        tail = vq->desc[tail].next;
+        vq->num_free++;
+    }
+    vq->desc[tail].next = vq->free_head;
+    vq->free_head = head;
+    vq->tokens[head] = NULL;
+
+    return token;
+}
+
+/**
+ * virtqueue_disable_cb - Ask the device not to interrupt
+ *
+ * With event indices this is implicit: used_event stays where it was
+ * armed and the device will not interrupt again until it is moved.
+ */
+void virtqueue_disable_cb(struct virtqueue *vq)
+{
+    if (!vq->event_idx) {
+        vq->avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
+    }
+}
+
+/**
+ * virtqueue_enable_cb - Re-arm interrupts after draining
+ *
+ * Returns false if completions arrived in the meantime; the caller must
+ * drain again or it could miss them.
+ */
+bool virtqueue_enable_cb(struct virtqueue *vq)
+{
+    if (vq->event_idx) {
+        __atomic_store_n(vring_used_event(vq), vq->last_used_idx, __ATOMIC_RELAXED);
+    } else {
+        vq->avail->flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
+    }
+
+    smp_mb();
+    return __atomic_load_n(&vq->used->idx, __ATOMIC_RELAXED) == vq->last_used_idx;
+}
@@ -0,0 +1,373 @@
+/*
+ * Power1 OS - Virtio Block Driver
+ * Multi-queue virtio-blk with asynchronous request submission
+ *
+ * With VIRTIO_BLK_F_MQ the device gets one virtqueue per CPU, each with
+ * its own lock and its own MSI-X vector steered to that CPU, so submission
+ * and completion of a request stay on the CPU that issued it and queues
+ * never share a lock or a cache line. Every ring entry has a request slot
+ * holding the request header, status byte and an indirect descriptor
+ * table, so a request of any segment count takes a single ring entry and
+ * nothing is allocated on the I/O path.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/io.h"
+#include "../include/string.h"
+#include "../include/interrupts.h"
+#include "../include/devices.h"
+#include "../include/block.h"
+#include "../include/virtio.h"
+#include "../include/init.h"
+
+#define VIRTIO_BLK_DEVICE_TRANSITIONAL  0x1001
+#define VIRTIO_BLK_DEVICE_MODERN        0x1042
+
+/* Device feature bits */
+#define VIRTIO_BLK_F_SEG_MAX    2
+#define VIRTIO_BLK_F_BLK_SIZE   6
+#define VIRTIO_BLK_F_FLUSH      9
+#define VIRTIO_BLK_F_MQ         12
+
+/* Device configuration layout */
+#define VIRTIO_BLK_CFG_CAPACITY     0
+#define VIRTIO_BLK_CFG_SEG_MAX      12
+#define VIRTIO_BLK_CFG_NUM_QUEUES   34
+
+/* Request types and status */
+#define VIRTIO_BLK_T_IN         0
+#define VIRTIO_BLK_T_OUT        1
+#define VIRTIO_BLK_T_FLUSH      4
+#define VIRTIO_BLK_S_OK         0
+
+#define VBLK_QUEUE_DEPTH        128
+#define VBLK_REAP_BATCH         32
+
+struct virtio_blk_req_header {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+};
+
+/* Per ring entry request state, reused for the queue's lifetime */
+struct vblk_slot {
+    struct virtio_blk_req_header header;
+    struct vring_desc table[IO_MAX_SEGMENTS + 2];
+    struct io_request *req;
+    uint8_t status;
+};
+
+struct vblk_device;
+
+struct vblk_queue {
+    struct vblk_device *vblk;
+    struct virtqueue *vq;
+    struct vblk_slot *slots;
+    uint16_t *free_slots;       /* Stack of idle slot indices */
+    uint16_t nr_free;
+} __attribute__((aligned(64)));
+
+struct vblk_device {
+    struct virtio_device vdev;
+    uint64_t capacity;          /* In IO_SECTOR_SIZE units */
+    uint32_t seg_max;
+    unsigned int nr_queues;
+    struct vblk_queue *queues;
+};
+
+static unsigned int vblk_count = 0;
+
+/**
+ * vblk_reap - Complete everything the device has finished on @queue
+ *
+ * Interrupts stay suppressed while the ring is drained and are re-armed
+ * once at the end. Completion callbacks run outside the queue lock so they
+ * may submit again. Returns the number of requests completed.
+ */
+static int vblk_reap(struct vblk_queue *queue)
+{
+    struct io_request *done[VBLK_REAP_BATCH];
+    int total = 0;
+
+    for (;;) {
+        unsigned int count = 0;
+        uint64_t flags = spin_lock_irqsave(&queue->vq->lock);
+        bool idle = false;
+
+        virtqueue_disable_cb(queue->vq);
+        while (count < VBLK_REAP_BATCH) {
+            struct vblk_slot *slot = virtqueue_get_buf(queue->vq, NULL);
+            if (!slot) {
+                idle = virtqueue_enable_cb(queue->vq);
+                break;
+            }
+
+            slot->req->status = slot->status == VIRTIO_BLK_S_OK ? KERNEL_SUCCESS
+                                                                : KERNEL_ERROR_FAULT;
+            done[count++] = slot->req;
+            slot->req = NULL;
+            queue->free_slots[queue->nr_free++] = (uint16_t)(slot - queue->slots);
+        }
+        spin_unlock_irqrestore(&queue->vq->lock, flags);
+
+        for (unsigned int i = 0; i < count; i++) {
+            if (done[i]->complete) {
+                done[i]->complete(done[i]);
+            }
+        }
+        if (count) {
+            blk_complete_batch();
+        }
+        total += count;
+
+        if (idle) {
+            return total;
+        }
+    }
+}
+
+static void vblk_irq(void *data)
+{
+    vblk_reap(data);
+}
+
+/**
+ * vblk_submit - Queue a request on the hinted CPU's virtqueue
+ */
+static int vblk_submit(struct device *dev, struct io_request *req)
+{
+    struct vblk_device *vblk = dev->driver_data;
+    struct vblk_queue *queue = &vblk->queues[req->queue_hint % vblk->nr_queues];
+    uint64_t sectors = 0;
+
+    if (req->op == IO_OP_FLUSH) {
+        if (req->nr_segments) {
+            return KERNEL_ERROR_INVALID;
+        }
+    } else if (req->op == IO_OP_READ || req->op == IO_OP_WRITE) {
+        if (!req->nr_segments || req->nr_segments > vblk->seg_max) {
+            return KERNEL_ERROR_INVALID;
+        }
+        for (uint16_t i = 0; i < req->nr_segments; i++) {
+            if (!req->segments[i].length || (req->segments[i].length & (IO_SECTOR_SIZE - 1))) {
+                return KERNEL_ERROR_INVALID;
+            }
+            sectors += req->segments[i].length / IO_SECTOR_SIZE;
+        }
+        if (req->sector >= vblk->capacity || sectors > vblk->capacity - req->sector) {
+            return KERNEL_ERROR_INVALID;
+        }
+    } else {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    uint64_t flags = spin_lock_irqsave(&queue->vq->lock);
+
+    if (!queue->nr_free) {
+        spin_unlock_irqrestore(&queue->vq->lock, flags);
+        return KERNEL_ERROR_AGAIN;
+    }
+    struct vblk_slot *slot = &queue->slots[queue->free_slots[--queue->nr_free]];
+    uint16_t count = 0;
+
+    slot->req = req;
+    slot->status = 0xFF;
+    slot->header.type = req->op == IO_OP_READ ? VIRTIO_BLK_T_IN :
+                        req->op == IO_OP_WRITE ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_FLUSH;
+    slot->header.reserved = 0;
+    slot->header.sector = req->op == IO_OP_FLUSH ? 0 : req->sector;
+
+    slot->table[count++] = (struct vring_desc){
+        .addr = direct_to_phys(&slot->header), .len = sizeof(slot->header), .flags = 0,
+    };
+    for (uint16_t i = 0; i < req->nr_segments; i++) {
+        slot->table[count++] = (struct vring_desc){
+            .addr = direct_to_phys(req->segments[i].buffer),
+            .len = req->segments[i].length,
+            .flags = req->op == IO_OP_READ ? VRING_DESC_F_WRITE : 0,
+        };
+    }
+    slot->table[count++] = (struct vring_desc){
+        .addr = direct_to_phys(&slot->status), .len = 1, .flags = VRING_DESC_F_WRITE,
+    };
+
+    int ret = virtqueue_add(queue->vq, slot->table, count, slot);
+    bool kick = false;
+    if (ret == KERNEL_SUCCESS) {
+        kick = virtqueue_kick_prepare(queue->vq);
+    } else {
+        slot->req = NULL;
+        queue->nr_free++;
+        ret = KERNEL_ERROR_AGAIN;
+    }
+    spin_unlock_irqrestore(&queue->vq->lock, flags);
+
+    /* The doorbell is an MMIO exit on most hypervisors; keep it unlocked */
+    if (kick) {
+        virtqueue_notify(queue->vq);
+    }
+    return ret;
+}
+
+static int vblk_poll(struct device *dev, unsigned int queue)
+{
+    struct vblk_device *vblk = dev->driver_data;
+    return vblk_reap(&vblk->queues[queue % vblk->nr_queues]);
+}
+
+static int vblk_read(struct device *dev, void *buffer, size_t size, uint64_t offset)
+{
+    return device_io_sync(dev, IO_OP_READ, buffer, size, offset);
+}
+
+static int vblk_write(struct device *dev, const void *buffer, size_t size, uint64_t offset)
+{
+    return device_io_sync(dev, IO_OP_WRITE, (void *)buffer, size, offset);
+}
+
+static struct device_ops vblk_ops = {
+    .read = vblk_read,
+    .write = vblk_write,
+    .submit = vblk_submit,
+    .poll = vblk_poll,
+};
+
+/**
+ * vblk_setup_queue - Create virtqueue @index and its request slots
+ */
+static int vblk_setup_queue(struct vblk_device *vblk, unsigned int index, bool msix)
+{
+    struct vblk_queue *queue = &vblk->queues[index];
+    uint16_t entry = msix ? (uint16_t)index : VIRTIO_MSI_NO_VECTOR;
+
+    queue->vblk = vblk;
+    queue->vq = virtqueue_create(&vblk->vdev, (uint16_t)index, VBLK_QUEUE_DEPTH, entry);
+    if (!queue->vq) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    uint16_t depth = queue->vq->size;
+    queue->slots = kzalloc(depth * sizeof(struct vblk_slot));
+    queue->free_slots = kmalloc(depth * sizeof(uint16_t));
+    if (!queue->slots || !queue->free_slots) {
+        return KERNEL_ERROR_NOMEM;
+    }
+    for (uint16_t i = 0; i < depth; i++) {
+        queue->free_slots[i] = depth - 1 - i;
+    }
+    queue->nr_free = depth;
+
+    /* Queue i completes on CPU i */
+    if (msix) {
+        int vector = pci_msix_bind(vblk->vdev.pdev, index, vblk_irq, queue, index);
+        if (vector < 0) {
+            return vector;
+        }
+    }
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * vblk_probe - Bring up a virtio-blk function
+ */
+static int vblk_probe(struct pci_device *pdev, const struct pci_device_id *id)
+{
+    (void)id;
+
+    struct vblk_device *vblk = kzalloc(sizeof(*vblk));
+    if (!vblk) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    int ret = virtio_pci_init(&vblk->vdev, pdev);
+    if (ret == KERNEL_SUCCESS) {
+        ret = virtio_negotiate(&vblk->vdev, (1ULL << VIRTIO_F_RING_INDIRECT_DESC) |
+                                            (1ULL << VIRTIO_F_RING_EVENT_IDX) |
+                                            (1ULL << VIRTIO_BLK_F_SEG_MAX) |
+                                            (1ULL << VIRTIO_BLK_F_BLK_SIZE) |
+                                            (1ULL << VIRTIO_BLK_F_FLUSH) |
+                                            (1ULL << VIRTIO_BLK_F_MQ));
+    }
+    if (ret != KERNEL_SUCCESS || !vblk->vdev.device_cfg) {
+        kfree(vblk);
+        return ret != KERNEL_SUCCESS ? ret : KERNEL_ERROR_NOTFOUND;
+    }
+
+    volatile uint8_t *cfg = vblk->vdev.device_cfg;
+    vblk->capacity = mmio_read64(cfg + VIRTIO_BLK_CFG_CAPACITY);
+
+    /* Without indirect descriptors a request must fit the ring as a chain */
+    vblk->seg_max = IO_MAX_SEGMENTS;
+    if (virtio_has_feature(&vblk->vdev, VIRTIO_BLK_F_SEG_MAX)) {
+        vblk->seg_max = MIN(vblk->seg_max, mmio_read32(cfg + VIRTIO_BLK_CFG_SEG_MAX));
+    }
+
+    unsigned int nr_queues = 1;
+    if (virtio_has_feature(&vblk->vdev, VIRTIO_BLK_F_MQ)) {
+        nr_queues = mmio_read16(cfg + VIRTIO_BLK_CFG_NUM_QUEUES);
+    }
+    nr_queues = MAX(1u, MIN(nr_queues, lapic_cpu_count()));
+
+    int vectors = pci_enable_msix(pdev, nr_queues);
+    bool msix = vectors > 0;
+    if (msix) {
+        nr_queues = (unsigned int)vectors;
+    }
+
+    vblk->nr_queues = nr_queues;
+    vblk->queues = kzalloc(nr_queues * sizeof(struct vblk_queue));
+    if (!vblk->queues) {
+        virtio_fail(&vblk->vdev);
+        return KERNEL_ERROR_NOMEM;
+    }
+    for (unsigned int i = 0; i < nr_queues; i++) {
+        ret = vblk_setup_queue(vblk, i, msix);
+        if (ret != KERNEL_SUCCESS) {
+            virtio_fail(&vblk->vdev);
+            return ret;
+        }
+    }
+
+    if (!blk_queue_create(&pdev->dev, vblk->capacity, (uint16_t)vblk->seg_max)) {
+        virtio_fail(&vblk->vdev);
+        return KERNEL_ERROR_NOMEM;
+    }
+    virtio_driver_ok(&vblk->vdev);
+
+    pdev->dev.id = DEVICE_ID_ANY;
+    pdev->dev.type = DEVICE_TYPE_STORAGE;
+    pdev->dev.status = DEVICE_STATUS_READY;
+    pdev->dev.driver_data = vblk;
+    pdev->dev.ops = &vblk_ops;
+    pdev->dev.completion.caps = msix ? IO_CAP_IRQ : 0;
+    memcpy(pdev->dev.name, "vblk", 4);
+    pdev->dev.name[4] = (char)('0' + vblk_count % 10);
+    vblk_count++;
+    return KERNEL_SUCCESS;
+}
+
+static const struct pci_device_id vblk_ids[] = {
+    { VIRTIO_PCI_VENDOR, VIRTIO_BLK_DEVICE_MODERN, PCI_ANY_CLASS, PCI_ANY_CLASS },
+    { VIRTIO_PCI_VENDOR, VIRTIO_BLK_DEVICE_TRANSITIONAL, PCI_ANY_CLASS, PCI_ANY_CLASS },
+    { 0, 0, 0, 0 },
+};
+
+static struct pci_driver vblk_driver = {
+    .name = "virtio-blk",
+    .id_table = vblk_ids,
+    .probe = vblk_probe,
+};
+
+/**
+ * virtio_blk_init - Register the driver with the PCI core
+ */
+int __init virtio_blk_init(void)
+{
+    return pci_register_driver(&vblk_driver);
+}
+initcall(virtio_blk_init, INITCALL_ASYNC | INITCALL_OPTIONAL,
+         device_manager_init, process_manager_init, blk_init);
@@ -0,0 +1,152 @@
+/*
+ * Power1 OS - Block Device Files
+ * Storage devices as page-cached files under /dev
+ *
+ * Every storage device with a block queue is bound at /dev/<name>. Reads
+ * fill the page cache one page per bio; writes dirty cached pages and
+ * writepage submits them asynchronously, so page_cache_writeback's plug
+ * merges a dirty run into a few large requests.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/fs.h"
+#include "../include/string.h"
+#include "../include/devices.h"
+#include "../include/block.h"
+#include "../include/init.h"
+
+/**
+ * blockdev_readpage - Read one page of the device synchronously
+ */
+static int blockdev_readpage(struct inode *inode, struct page *page)
+{
+    struct device *dev = inode->private_data;
+    uint64_t offset = page->index << 12;
+    uint8_t *frame = page_address(page);
+    uint32_t length = (uint32_t)MIN(PAGE_SIZE, inode->size - offset);
+
+    struct bio *bio = bio_alloc(dev, IO_OP_READ, offset / IO_SECTOR_SIZE, 1);
+    if (!bio) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    int ret = bio_add_buffer(bio, frame, length);
+    if (ret == KERNEL_SUCCESS) {
+        ret = submit_bio_wait(bio);
+    }
+    bio_free(bio);
+
+    memset(frame + length, 0, PAGE_SIZE - length);
+    return ret;
+}
+
+/**
+ * blockdev_write_done - Writeback completion of one page
+ */
+static void blockdev_write_done(struct bio *bio)
+{
+    struct page *page = bio->private;
+
+    page->flags &= ~PG_WRITEBACK;
+    if (bio->status != KERNEL_SUCCESS) {
+        page_cache_set_dirty(page);
+    }
+    page_put(page);
+    bio_free(bio);
+}
+
+/**
+ * blockdev_writepage - Start writing one page back to the device
+ */
+static int blockdev_writepage(struct inode *inode, struct page *page)
+{
+    struct device *dev = inode->private_data;
+    uint64_t offset = page->index << 12;
+    uint32_t length = (uint32_t)MIN(PAGE_SIZE, inode->size - offset);
+
+    struct bio *bio = bio_alloc(dev, IO_OP_WRITE, offset / IO_SECTOR_SIZE, 1);
+    if (!bio) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    int ret = bio_add_buffer(bio, page_address(page), length);
+    if (ret != KERNEL_SUCCESS) {
+        bio_free(bio);
+        return ret;
+    }
+
+    page_get(page);
+    page->flags |= PG_WRITEBACK;
+    bio->private = page;
+    bio->end_io = blockdev_write_done;
+    submit_bio(bio);
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * blockdev_ioctl - Pass commands on to the device
+ */
+static int blockdev_ioctl(struct file_descriptor *fd, uint32_t cmd, void *arg)
+{
+    return device_ioctl(fd->inode->private_data, cmd, arg);
+}
+
+/* Data goes through the page cache; only ioctl is device specific */
+static struct file_operations blockdev_fops = {
+    .ioctl = blockdev_ioctl,
+};
+
+static struct page_cache_ops blockdev_ops = {
+    .readpage = blockdev_readpage,
+    .writepage = blockdev_writepage,
+    .release = NULL
+};
+
+/**
+ * blockdev_add - Bind one storage device under /dev
+ */
+static int blockdev_add(struct device *dev)
+{
+    char path[PATH_MAX];
+
+    struct inode *inode = kzalloc(sizeof(*inode));
+    if (!inode) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    inode->ino = dev->id;
+    inode->mode = S_IFBLK | S_IRUSR | S_IWUSR;
+    inode->nlink = 1;
+    inode->size = dev->queue->capacity * IO_SECTOR_SIZE;
+    inode->ops = &blockdev_fops;
+    inode->pc_ops = &blockdev_ops;
+    inode->private_data = dev;
+    atomic_set(&inode->refcount, 1);
+
+    strcpy(path, "/dev/");
+    strncpy(path + 5, dev->name, sizeof(dev->name));
+    path[5 + sizeof(dev->name) - 1] = '\0';
+    return vfs_bind(path, inode);
+}
+
+/**
+ * blockdev_init - Publish every registered storage device
+ */
+int __init blockdev_init(void)
+{
+    for (struct device *dev = device_find_by_type(DEVICE_TYPE_STORAGE);
+         dev; dev = device_next_of_type(dev)) {
+
+        if (dev->queue) {
+            int ret = blockdev_add(dev);
+            if (ret != KERNEL_SUCCESS) {
+                return ret;
+            }
+        }
+    }
+    return KERNEL_SUCCESS;
+}
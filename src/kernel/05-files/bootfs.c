@@ -0,0 +1,112 @@
+/*
+ * Power1 OS - Boot Module File System
+ * Exposes multiboot2 modules as read-only files
+ *
+ * Each module is bound at the path given as the first word of its command
+ * line (e.g. "/sbin/init"). The module image stays where the boot loader
+ * put it; pages enter the page cache one at a time as they are read or
+ * mapped, so nothing is copied for parts of a file that are never used.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/fs.h"
+#include "../include/multiboot2.h"
+#include "../include/string.h"
+#include "../include/init.h"
+
+/**
+ * bootfs_readpage - Fill a cache page from the module image
+ */
+static int bootfs_readpage(struct inode *inode, struct page *page)
+{
+    uint64_t base = (uint64_t)inode->private_data;
+    uint64_t offset = page->index << 12;
+    uint8_t *frame = page_address(page);
+    size_t length = 0;
+
+    if (offset < inode->size) {
+        length = MIN(PAGE_SIZE, inode->size - offset);
+        memcpy(frame, phys_to_direct(base + offset), length);
+    }
+    memset(frame + length, 0, PAGE_SIZE - length);
+    return KERNEL_SUCCESS;
+}
+
+static struct page_cache_ops bootfs_ops = {
+    .readpage = bootfs_readpage,
+    .writepage = NULL,
+    .release = NULL
+};
+
+/**
+ * bootfs_module_path - Path for a module from its command line
+ */
+static void bootfs_module_path(const char *cmdline, char *path, int number)
+{
+    size_t length = 0;
+
+    while (cmdline[length] && cmdline[length] != ' ' && length < PATH_MAX - 1) {
+        length++;
+    }
+
+    if (cmdline[0] == '/' && length > 1) {
+        memcpy(path, cmdline, length);
+        path[length] = '\0';
+        return;
+    }
+
+    strcpy(path, "/boot/module0");
+    path[12] = (char)('0' + number % 10);
+}
+
+/**
+ * bootfs_add_module - Bind one module into the namespace
+ */
+static int bootfs_add_module(struct multiboot_tag_module *module, int number)
+{
+    char path[PATH_MAX];
+
+    struct inode *inode = kzalloc(sizeof(*inode));
+    if (!inode) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    inode->ino = (uint32_t)number + 1;
+    inode->mode = S_IFREG | S_IRUSR | S_IXUSR | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
+    inode->nlink = 1;
+    inode->size = module->mod_end - module->mod_start;
+    inode->pc_ops = &bootfs_ops;
+    inode->private_data = (void *)(uint64_t)module->mod_start;
+    atomic_set(&inode->refcount, 1);
+
+    bootfs_module_path(module->cmdline, path, number);
+    return vfs_bind(path, inode);
+}
+
+/**
+ * filesystem_init - Publish block devices and the boot modules
+ */
+int __init filesystem_init(void)
+{
+    struct multiboot_tag *const *tags;
+    size_t count;
+
+    int ret = blockdev_init();
+    if (ret != KERNEL_SUCCESS) {
+        return ret;
+    }
+
+    tags = multiboot2_find_tags(MULTIBOOT_TAG_TYPE_MODULE, &count);
+    for (size_t i = 0; i < count; i++) {
+        ret = bootfs_add_module((struct multiboot_tag_module *)tags[i], (int)i);
+        if (ret != KERNEL_SUCCESS) {
+            return ret;
+        }
+    }
+    return KERNEL_SUCCESS;
+}
+initcall(filesystem_init, 0, virtio_blk_init, nvme_init);
@@ -0,0 +1,134 @@
+/*
+ * Power1 OS - Shared-Memory Channels
+ * Creation of the message ring objects described in channel.h
+ *
+ * A channel is a shared memory inode laid out as a header page followed
+ * by the slots. Processes reach it through the returned descriptor, a
+ * fork, or its name under /ipc, and map it with MAP_SHARED; from then on
+ * messages move through the mapping alone. Futex keys are physical, so
+ * the doorbells work across processes mapping the object at different
+ * addresses.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/fs.h"
+#include "../include/string.h"
+#include "../include/channel.h"
+
+#define CHANNEL_PREFIX          "/ipc/"
+
+/**
+ * channel_init_slots - Give every slot its first-lap sequence number
+ */
+static int channel_init_slots(struct inode *inode, const struct channel_header *ch)
+{
+    struct page *page = NULL;
+    uint64_t cached = ~0UL;
+
+    for (uint64_t i = 0; i < ch->slot_count; i++) {
+        uint64_t offset = ch->slots_offset + i * ch->slot_size;
+
+        /* Slots are cache-line aligned, so seq never straddles a page */
+        if ((offset >> 12) != cached) {
+            if (page) {
+                page_put(page);
+            }
+            cached = offset >> 12;
+            page = page_cache_get(inode, cached);
+            if (!page) {
+                return KERNEL_ERROR_NOMEM;
+            }
+        }
+        struct channel_slot *slot = (void *)((uint8_t *)page_address(page) + (offset & PAGE_MASK));
+        slot->seq = i;
+    }
+
+    if (page) {
+        page_put(page);
+    }
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * channel_create - Create a channel and open a description of it
+ * @name: Published as /ipc/<name> for unrelated processes, or NULL
+ * @payload_size: Largest message in bytes
+ * @slot_count: Ring capacity in messages, a power of two
+ * @flags: CHANNEL_MPSC to allow several producers
+ * @file: Receives the open description, readable and writable
+ *
+ * Fails with KERNEL_ERROR_NOMEM if the slots would take more than
+ * CHANNEL_RING_MAX bytes.
+ */
+int channel_create(const char *name, uint32_t payload_size, uint32_t slot_count,
+                   uint32_t flags, struct file_descriptor **file)
+{
+    char path[PATH_MAX];
+    struct channel_header header;
+
+    if (!payload_size || payload_size > CHANNEL_SLOT_SIZE_MAX ||
+        !slot_count || slot_count > CHANNEL_SLOTS_MAX || (slot_count & (slot_count - 1)) ||
+        (flags & ~CHANNEL_MPSC)) {
+        return KERNEL_ERROR_INVALID;
+    }
+    if (name && (!name[0] || strlen(name) + sizeof(CHANNEL_PREFIX) > PATH_MAX)) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = CHANNEL_MAGIC;
+    header.flags = flags;
+    header.slot_size = (uint32_t)ALIGN_UP(sizeof(struct channel_slot) + payload_size,
+                                          CHANNEL_CACHELINE);
+    header.slot_count = slot_count;
+    header.slots_offset = PAGE_SIZE;
+    if ((uint64_t)header.slot_size * slot_count > CHANNEL_RING_MAX) {
+        return KERNEL_ERROR_NOMEM;
+    }
+    header.size = PAGE_SIZE + page_align_up((uint64_t)header.slot_size * slot_count);
+
+    struct inode *inode = shmem_inode_create(header.size);
+    struct file_descriptor *desc = kzalloc(sizeof(*desc));
+    if (!inode || !desc) {
+        inode_put(inode);
+        kfree(desc);
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    int ret = channel_init_slots(inode, &header);
+    if (ret == KERNEL_SUCCESS) {
+        struct page *page = page_cache_get(inode, 0);
+        if (page) {
+            memcpy(page_address(page), &header, sizeof(header));
+            page_put(page);
+        } else {
+            ret = KERNEL_ERROR_NOMEM;
+        }
+    }
+    if (ret == KERNEL_SUCCESS && name) {
+        memcpy(path, CHANNEL_PREFIX, sizeof(CHANNEL_PREFIX) - 1);
+        strcpy(path + sizeof(CHANNEL_PREFIX) - 1, name);
+        struct inode *existing = vfs_lookup(path);
+        if (existing) {
+            inode_put(existing);
+            ret = KERNEL_ERROR_INVALID;
+        } else {
+            ret = vfs_bind(path, inode);
+        }
+    }
+    if (ret != KERNEL_SUCCESS) {
+        inode_put(inode);
+        kfree(desc);
+        return ret;
+    }
+
+    desc->flags = O_RDWR;
+    desc->inode = inode;
+    atomic_set(&desc->refcount, 1);
+    *file = desc;
+    return KERNEL_SUCCESS;
+}
@@ -0,0 +1,398 @@
+/*
+ * Power1 OS - epoll
+ * Persistent interest sets with callback-driven ready lists
+ *
+ * An epoll instance keeps its interests in a red-black tree keyed by
+ * (description, descriptor number) and registers each one on its file's
+ * wait queues once, when it is added. A wake on such a queue puts the
+ * interest on the ready list; epoll_wait polls only the interests found
+ * there, so its cost follows the number of ready descriptors, not the
+ * size of the set.
+ *
+ * Level-triggered interests that are still ready go back on the list
+ * after being reported; edge-triggered ones wait for the next wake, and
+ * one-shot ones are disarmed until EPOLL_CTL_MOD rearms them.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/fs.h"
+#include "../include/list.h"
+#include "../include/rbtree.h"
+#include "../include/spinlock.h"
+#include "../include/process.h"
+#include "../include/timer.h"
+#include "../include/poll.h"
+
+#define EP_PRIVATE_BITS         (EPOLLET | EPOLLONESHOT)
+#define EP_WAITS_MAX            2       /* Wait queues one file may register */
+
+struct eventpoll {
+    spinlock_t lock;
+    struct rb_root items;
+    struct list_head ready;
+    struct wait_queue wait;         /* Tasks in epoll_wait */
+    struct wait_queue poll_wait;    /* Wakes for an epoll polling this one */
+};
+
+struct ep_wait {
+    struct wait_callback cb;
+    struct epitem *item;
+};
+
+struct epitem {
+    struct rb_node node;
+    struct list_head ready_link;    /* Empty while not on the ready list */
+    struct eventpoll *ep;
+    struct file_descriptor *file;
+    int fd;
+    struct epoll_event event;
+    struct epitem *file_next;       /* Other interests in the same file */
+    unsigned int nwait;
+    struct ep_wait waits[EP_WAITS_MAX];
+};
+
+/* Poll table for registering a new interest */
+struct ep_pqueue {
+    struct poll_table pt;
+    struct epitem *item;
+};
+
+static struct file_operations eventpoll_fops;
+
+static int ep_cmp(const struct epitem *item, const struct file_descriptor *file, int fd)
+{
+    if (item->file != file) {
+        return item->file < file ? -1 : 1;
+    }
+    return item->fd == fd ? 0 : (item->fd < fd ? -1 : 1);
+}
+
+/**
+ * ep_find - Interest for (@file, @fd), or NULL
+ */
+static struct epitem *ep_find(struct eventpoll *ep, struct file_descriptor *file, int fd)
+{
+    struct rb_node *node = ep->items.node;
+
+    while (node) {
+        struct epitem *item = rb_entry(node, struct epitem, node);
+        int cmp = ep_cmp(item, file, fd);
+        if (!cmp) {
+            return item;
+        }
+        node = cmp > 0 ? node->left : node->right;
+    }
+    return NULL;
+}
+
+/**
+ * ep_callback - A queue the interest registered on was woken
+ */
+static void ep_callback(struct wait_callback *cb)
+{
+    struct epitem *item = container_of(cb, struct ep_wait, cb)->item;
+    struct eventpoll *ep = item->ep;
+
+    spin_lock(&ep->lock);
+    if (!(item->event.events & ~EP_PRIVATE_BITS) || !list_empty(&item->ready_link)) {
+        spin_unlock(&ep->lock);
+        return;
+    }
+    list_add_tail(&item->ready_link, &ep->ready);
+    spin_unlock(&ep->lock);
+
+    wait_queue_wake_all(&ep->wait);
+    wait_queue_wake_all(&ep->poll_wait);
+}
+
+/**
+ * ep_queue - Poll table method: register the new interest on @wq
+ */
+static void ep_queue(struct poll_table *pt, struct wait_queue *wq)
+{
+    struct epitem *item = container_of(pt, struct ep_pqueue, pt)->item;
+
+    if (item->nwait < EP_WAITS_MAX) {
+        struct ep_wait *wait = &item->waits[item->nwait++];
+        wait->cb.func = ep_callback;
+        wait->item = item;
+        wait_queue_add_callback(wq, &wait->cb);
+    }
+}
+
+static inline uint32_t ep_wanted(const struct epitem *item)
+{
+    return (item->event.events & ~EP_PRIVATE_BITS) | POLL_ALWAYS;
+}
+
+/**
+ * ep_insert - Add an interest and report it ready if it already is
+ */
+static int ep_insert(struct eventpoll *ep, struct file_descriptor *file, int fd,
+                     const struct epoll_event *event)
+{
+    struct rb_node **link = &ep->items.node;
+    struct rb_node *parent = NULL;
+    struct ep_pqueue epq;
+
+    struct epitem *item = kzalloc(sizeof(*item));
+    if (!item) {
+        return KERNEL_ERROR_NOMEM;
+    }
+    list_init(&item->ready_link);
+    item->ep = ep;
+    item->file = file;
+    item->fd = fd;
+    item->event = *event;
+
+    while (*link) {
+        parent = *link;
+        link = ep_cmp(rb_entry(parent, struct epitem, node), file, fd) > 0 ?
+               &parent->left : &parent->right;
+    }
+    rb_link_node(&item->node, parent, link);
+    rb_insert_color(&item->node, &ep->items);
+
+    item->file_next = file->epitems;
+    file->epitems = item;
+
+    epq.pt.queue = ep_queue;
+    epq.item = item;
+    if (vfs_poll(file, &epq.pt) & ep_wanted(item)) {
+        list_add_tail(&item->ready_link, &ep->ready);
+    }
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * ep_remove - Drop an interest, detaching it from its file's queues
+ */
+static void ep_remove(struct eventpoll *ep, struct epitem *item)
+{
+    for (unsigned int i = 0; i < item->nwait; i++) {
+        wait_queue_remove_callback(&item->waits[i].cb);
+    }
+
+    struct epitem **link = &item->file->epitems;
+    while (*link != item) {
+        link = &(*link)->file_next;
+    }
+    *link = item->file_next;
+
+    rb_erase(&item->node, &ep->items);
+    list_del(&item->ready_link);
+    kfree(item);
+}
+
+/**
+ * eventpoll_release - Remove every interest in @file as it closes
+ */
+void eventpoll_release(struct file_descriptor *file)
+{
+    while (file->epitems) {
+        struct eventpoll *ep = file->epitems->ep;
+        spin_lock(&ep->lock);
+        ep_remove(ep, file->epitems);
+        spin_unlock(&ep->lock);
+    }
+}
+
+/**
+ * eventpoll_poll - An epoll instance is readable while its ready list is not empty
+ */
+static uint32_t eventpoll_poll(struct file_descriptor *file, struct poll_table *pt)
+{
+    struct eventpoll *ep = file->private_data;
+
+    poll_wait(&ep->poll_wait, pt);
+    return list_empty(&ep->ready) ? 0 : POLLIN | POLLRDNORM;
+}
+
+/**
+ * eventpoll_close - Drop every interest and free the instance
+ */
+static int eventpoll_close(struct file_descriptor *file)
+{
+    struct eventpoll *ep = file->private_data;
+    struct rb_node *node;
+
+    spin_lock(&ep->lock);
+    while ((node = rb_first(&ep->items))) {
+        ep_remove(ep, rb_entry(node, struct epitem, node));
+    }
+    spin_unlock(&ep->lock);
+
+    kfree(ep);
+    return KERNEL_SUCCESS;
+}
+
+static struct file_operations eventpoll_fops = {
+    .close = eventpoll_close,
+    .poll = eventpoll_poll,
+};
+
+/**
+ * eventpoll_create - Make an empty epoll instance and open it
+ */
+int eventpoll_create(struct file_descriptor **file)
+{
+    struct eventpoll *ep = kzalloc(sizeof(*ep));
+    struct file_descriptor *desc = kzalloc(sizeof(*desc));
+
+    if (!ep || !desc) {
+        kfree(ep);
+        kfree(desc);
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    spin_lock_init(&ep->lock);
+    ep->items.node = NULL;
+    list_init(&ep->ready);
+    wait_queue_init(&ep->wait);
+    wait_queue_init(&ep->poll_wait);
+
+    desc->flags = O_RDWR;
+    desc->ops = &eventpoll_fops;
+    desc->private_data = ep;
+    atomic_set(&desc->refcount, 1);
+    *file = desc;
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * eventpoll_ctl - Add, change or remove the interest in descriptor @fd
+ */
+int eventpoll_ctl(struct file_descriptor *epfile, int op, int fd, const struct epoll_event *event)
+{
+    struct file_descriptor *file = fd_get(fd);
+    int ret = KERNEL_SUCCESS;
+
+    if (!epfile || epfile->ops != &eventpoll_fops || !file) {
+        return KERNEL_ERROR_BADF;
+    }
+    if (file == epfile || (op != EPOLL_CTL_DEL && !event)) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    struct eventpoll *ep = epfile->private_data;
+    spin_lock(&ep->lock);
+
+    struct epitem *item = ep_find(ep, file, fd);
+    switch (op) {
+    case EPOLL_CTL_ADD:
+        ret = item ? KERNEL_ERROR_INVALID : ep_insert(ep, file, fd, event);
+        break;
+    case EPOLL_CTL_DEL:
+        if (item) {
+            ep_remove(ep, item);
+        } else {
+            ret = KERNEL_ERROR_NOTFOUND;
+        }
+        break;
+    case EPOLL_CTL_MOD:
+        if (!item) {
+            ret = KERNEL_ERROR_NOTFOUND;
+            break;
+        }
+        item->event = *event;
+        if (list_empty(&item->ready_link) && (vfs_poll(file, NULL) & ep_wanted(item))) {
+            list_add_tail(&item->ready_link, &ep->ready);
+        }
+        break;
+    default:
+        ret = KERNEL_ERROR_INVALID;
+        break;
+    }
+
+    bool ready = !list_empty(&ep->ready);
+    spin_unlock(&ep->lock);
+
+    if (ready) {
+        wait_queue_wake_all(&ep->wait);
+        wait_queue_wake_all(&ep->poll_wait);
+    }
+    return ret;
+}
+
+/**
+ * ep_collect - Report ready interests into @events
+ *
+ * Interests found not ready after all are simply dropped from the list;
+ * their next wake puts them back.
+ */
+static int ep_collect(struct eventpoll *ep, struct epoll_event *events, int maxevents)
+{
+    LIST_HEAD(again);
+    int count = 0;
+
+    while (count < maxevents && !list_empty(&ep->ready)) {
+        struct epitem *item = list_first_entry(&ep->ready, struct epitem, ready_link);
+        list_del(&item->ready_link);
+
+        uint32_t revents = vfs_poll(item->file, NULL) & ep_wanted(item);
+        if (!revents) {
+            continue;
+        }
+
+        events[count].events = revents;
+        events[count].data = item->event.data;
+        count++;
+
+        if (item->event.events & EPOLLONESHOT) {
+            item->event.events &= EP_PRIVATE_BITS;
+        } else if (!(item->event.events & EPOLLET)) {
+            list_add_tail(&item->ready_link, &again);
+        }
+    }
+
+    /* Level-triggered interests are looked at again by the next wait */
+    while (!list_empty(&again)) {
+        struct epitem *item = list_first_entry(&again, struct epitem, ready_link);
+        list_del(&item->ready_link);
+        list_add_tail(&item->ready_link, &ep->ready);
+    }
+    return count;
+}
+
+/**
+ * eventpoll_wait - Wait for ready interests and report up to @maxevents
+ * @timeout_ms: Longest wait; 0 only collects, negative waits indefinitely
+ *
+ * Returns the number of events stored, 0 on timeout.
+ */
+int64_t eventpoll_wait(struct file_descriptor *epfile, struct epoll_event *events,
+                       int maxevents, int64_t timeout_ms)
+{
+    uint64_t deadline = timeout_ms > 0 ? clock_ns() + (uint64_t)timeout_ms * NSEC_PER_MSEC : 0;
+
+    if (!epfile || epfile->ops != &eventpoll_fops) {
+        return KERNEL_ERROR_BADF;
+    }
+    if (maxevents <= 0) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    struct eventpoll *ep = epfile->private_data;
+    for (;;) {
+        spin_lock(&ep->lock);
+        int count = ep_collect(ep, events, maxevents);
+        bool idle = list_empty(&ep->ready);
+        spin_unlock(&ep->lock);
+
+        if (count || !timeout_ms) {
+            return count;
+        }
+        if (!idle) {
+            continue;
+        }
+        if (timeout_ms < 0) {
+            wait_queue_sleep(&ep->wait);
+        } else if (!wait_queue_sleep_timeout(&ep->wait, deadline)) {
+            return 0;
+        }
+    }
+}
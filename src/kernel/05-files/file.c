@@ -0,0 +1,138 @@
+/*
+ * Power1 OS - File Descriptor Table
+ * Per-process mapping of small integers to open file descriptions
+ *
+ * Open file descriptions are reference counted so fork can share them
+ * between the parent's and the child's tables, as POSIX requires for the
+ * file offset.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/fs.h"
+#include "../include/process.h"
+
+/**
+ * fd_current_table - Descriptor table of the running task
+ */
+static struct fd_table *fd_current_table(void)
+{
+    return current_task ? current_task->files : NULL;
+}
+
+/**
+ * fd_get - Resolve a descriptor number
+ */
+struct file_descriptor *fd_get(int fd)
+{
+    struct fd_table *table = fd_current_table();
+
+    if (!table || fd < 0 || fd >= FD_MAX) {
+        return NULL;
+    }
+    return table->fds[fd];
+}
+
+/**
+ * fd_install - Bind @file to the lowest free descriptor number
+ *
+ * The table takes over the caller's reference on @file.
+ */
+int fd_install(struct file_descriptor *file)
+{
+    struct fd_table *table = fd_current_table();
+
+    if (!table) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    for (int fd = 0; fd < FD_MAX; fd++) {
+        if (!table->fds[fd]) {
+            table->fds[fd] = file;
+            file->fd = (uint32_t)fd;
+            return fd;
+        }
+    }
+    return KERNEL_ERROR_NOSPC;
+}
+
+/**
+ * fd_remove - Unbind a descriptor number, returning what it referred to
+ *
+ * The table's reference passes to the caller.
+ */
+struct file_descriptor *fd_remove(int fd)
+{
+    struct file_descriptor *file = fd_get(fd);
+    if (file) {
+        fd_current_table()->fds[fd] = NULL;
+    }
+    return file;
+}
+
+/**
+ * file_get - Take a reference on an open file description
+ */
+void file_get(struct file_descriptor *file)
+{
+    atomic_inc(&file->refcount);
+}
+
+/**
+ * file_put - Drop a reference, closing the description with the last one
+ */
+void file_put(struct file_descriptor *file)
+{
+    if (file && atomic_dec_and_test(&file->refcount)) {
+        vfs_close(file);
+    }
+}
+
+/**
+ * fd_table_create - Allocate an empty descriptor table
+ */
+struct fd_table *fd_table_create(void)
+{
+    struct fd_table *table = kzalloc(sizeof(*table));
+    if (table) {
+        atomic_set(&table->users, 1);
+    }
+    return table;
+}
+
+/**
+ * fd_table_clone - Duplicate a table for fork, sharing the descriptions
+ */
+struct fd_table *fd_table_clone(struct fd_table *table)
+{
+    struct fd_table *copy = fd_table_create();
+    if (!copy || !table) {
+        return copy;
+    }
+
+    for (int fd = 0; fd < FD_MAX; fd++) {
+        if (table->fds[fd]) {
+            file_get(table->fds[fd]);
+            copy->fds[fd] = table->fds[fd];
+        }
+    }
+    return copy;
+}
+
+/**
+ * fd_table_release - Drop a table reference, closing everything with the last
+ */
+void fd_table_release(struct fd_table *table)
+{
+    if (!table || !atomic_dec_and_test(&table->users)) {
+        return;
+    }
+
+    for (int fd = 0; fd < FD_MAX; fd++) {
+        file_put(table->fds[fd]);
+    }
+    kfree(table);
+}
@@ -0,0 +1,268 @@
+/*
+ * Power1 OS - Page Cache
+ * File pages shared between read paths and memory mappings
+ *
+ * Cached frames are looked up by (inode, page index) through one global
+ * hash table. The cache holds a single reference on every frame; each user
+ * mapping takes its own, so an mmap of a cached file maps the very same
+ * frames without copying.
+ *
+ * Writes only dirty cached frames. Each inode tracks the index range of
+ * its dirty pages, and writeback walks that range under a block plug so
+ * the writepage calls for neighbouring pages merge into large requests.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/fs.h"
+#include "../include/string.h"
+#include "../include/block.h"
+
+#define PAGE_CACHE_BUCKETS      (1UL << PAGE_CACHE_HASH_BITS)
+
+static struct page *page_cache_hash[PAGE_CACHE_BUCKETS];
+
+/**
+ * page_cache_bucket - Hash chain for (inode, index)
+ */
+static struct page **page_cache_bucket(struct inode *inode, uint64_t index)
+{
+    uint64_t key = ((uint64_t)inode >> 6) + index;
+    key *= 0x9E3779B97F4A7C15UL;
+    return &page_cache_hash[key >> (64 - PAGE_CACHE_HASH_BITS)];
+}
+
+/**
+ * page_cache_insert - Publish a filled page under its (mapping, index)
+ *
+ * The allocation reference becomes the cache's; one more is taken for
+ * the caller.
+ */
+static void page_cache_insert(struct inode *inode, struct page *page)
+{
+    struct page **bucket = page_cache_bucket(inode, page->index);
+
+    page->flags |= PG_CACHE | PG_UPTODATE;
+    page->hash_next = *bucket;
+    *bucket = page;
+    inode->nrpages++;
+
+    page_get(page);
+}
+
+/**
+ * page_cache_find - Look up a cached page without doing any I/O
+ *
+ * Returns the page with a reference held, or NULL when it is not cached.
+ */
+struct page *page_cache_find(struct inode *inode, uint64_t index)
+{
+    for (struct page *page = *page_cache_bucket(inode, index);
+         page; page = page->hash_next) {
+
+        if (page->mapping == inode && page->index == index) {
+            page_get(page);
+            return page;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * page_cache_get - Return a cached page, reading it in on a miss
+ *
+ * Returns the page with a reference held, or NULL past EOF or on error.
+ */
+struct page *page_cache_get(struct inode *inode, uint64_t index)
+{
+    struct page *page = page_cache_find(inode, index);
+    if (page) {
+        return page;
+    }
+
+    if (index >= DIV_ROUND_UP(inode->size, PAGE_SIZE) ||
+        !inode->pc_ops || !inode->pc_ops->readpage) {
+        return NULL;
+    }
+
+    page = page_alloc(0, 0);
+    if (!page) {
+        return NULL;
+    }
+
+    page->mapping = inode;
+    page->index = index;
+    if (inode->pc_ops->readpage(inode, page) < 0) {
+        page->mapping = NULL;
+        page_put(page);
+        return NULL;
+    }
+
+    page_cache_insert(inode, page);
+    return page;
+}
+
+/**
+ * page_cache_overwrite - Cached page about to be rewritten from offset 0
+ * @length: Bytes the caller will write
+ *
+ * A page that will be overwritten up to EOF is not read in first.
+ */
+static struct page *page_cache_overwrite(struct inode *inode, uint64_t index, size_t length)
+{
+    uint64_t offset = index << 12;
+
+    if (length < PAGE_SIZE && offset + length < inode->size) {
+        return page_cache_get(inode, index);
+    }
+
+    struct page *page = page_cache_find(inode, index);
+    if (page) {
+        return page;
+    }
+
+    page = page_alloc(0, 0);
+    if (!page) {
+        return NULL;
+    }
+    memset((uint8_t *)page_address(page) + length, 0, PAGE_SIZE - length);
+    page->mapping = inode;
+    page->index = index;
+    page_cache_insert(inode, page);
+    return page;
+}
+
+/**
+ * page_cache_set_dirty - Record that a cached page needs writing back
+ */
+void page_cache_set_dirty(struct page *page)
+{
+    struct inode *inode = page->mapping;
+
+    if (page->flags & PG_DIRTY) {
+        return;
+    }
+    page->flags |= PG_DIRTY;
+
+    if (!inode) {
+        return;
+    }
+    if (inode->nrdirty++ == 0) {
+        inode->dirty_first = inode->dirty_last = page->index;
+    } else {
+        inode->dirty_first = MIN(inode->dirty_first, page->index);
+        inode->dirty_last = MAX(inode->dirty_last, page->index);
+    }
+}
+
+/**
+ * page_cache_write - Copy data into the cache, dirtying the pages
+ *
+ * Writes stay within the current file size. Starts writeback once the
+ * inode has PAGE_CACHE_DIRTY_BATCH dirty pages. Returns the bytes written.
+ */
+ssize_t page_cache_write(struct inode *inode, uint64_t offset, const void *buf, size_t count)
+{
+    const uint8_t *in = buf;
+    size_t done = 0;
+
+    if (offset >= inode->size) {
+        return KERNEL_ERROR_NOSPC;
+    }
+    count = MIN(count, inode->size - offset);
+
+    while (done < count) {
+        uint64_t in_page = offset & PAGE_MASK;
+        size_t chunk = MIN(count - done, PAGE_SIZE - in_page);
+
+        struct page *page = in_page ? page_cache_get(inode, offset >> 12)
+                                    : page_cache_overwrite(inode, offset >> 12, chunk);
+        if (!page) {
+            break;
+        }
+        memcpy((uint8_t *)page_address(page) + in_page, in + done, chunk);
+        page_cache_set_dirty(page);
+        page_put(page);
+
+        done += chunk;
+        offset += chunk;
+    }
+
+    if (inode->nrdirty >= PAGE_CACHE_DIRTY_BATCH) {
+        page_cache_writeback(inode);
+    }
+    return done ? (ssize_t)done : KERNEL_ERROR_NOMEM;
+}
+
+/**
+ * page_cache_writeback - Start writing every dirty page of @inode
+ *
+ * Pages are handed to writepage in index order under a plug, so the
+ * backing store sees sequential runs as single requests. Completion is
+ * asynchronous. Returns the first writepage error, if any.
+ */
+int page_cache_writeback(struct inode *inode)
+{
+    int ret = KERNEL_SUCCESS;
+    struct blk_plug plug;
+
+    if (!inode->nrdirty || !inode->pc_ops || !inode->pc_ops->writepage) {
+        return KERNEL_SUCCESS;
+    }
+
+    uint64_t first = inode->dirty_first;
+    uint64_t last = inode->dirty_last;
+    inode->nrdirty = 0;
+
+    blk_start_plug(&plug);
+    for (uint64_t index = first; index <= last; index++) {
+        struct page *page = page_cache_find(inode, index);
+        if (!page) {
+            continue;
+        }
+
+        if (page->flags & PG_DIRTY) {
+            page->flags &= ~PG_DIRTY;
+            int err = inode->pc_ops->writepage(inode, page);
+            if (err < 0) {
+                page_cache_set_dirty(page);
+                if (ret == KERNEL_SUCCESS) {
+                    ret = err;
+                }
+            }
+        }
+        page_put(page);
+    }
+    blk_finish_plug(&plug);
+
+    return ret;
+}
+
+/**
+ * page_cache_evict_inode - Drop every cached page of @inode
+ *
+ * Pages still mapped somewhere survive until their last mapping goes.
+ */
+void page_cache_evict_inode(struct inode *inode)
+{
+    for (uint64_t bucket = 0; bucket < PAGE_CACHE_BUCKETS && inode->nrpages; bucket++) {
+        struct page **link = &page_cache_hash[bucket];
+
+        while (*link) {
+            struct page *page = *link;
+            if (page->mapping != inode) {
+                link = &page->hash_next;
+                continue;
+            }
+
+            *link = page->hash_next;
+            page->hash_next = NULL;
+            page->flags &= ~PG_CACHE;
+            inode->nrpages--;
+            page_put(page);
+        }
+    }
+}
@@ -0,0 +1,631 @@
+/*
+ * Power1 OS - Pipes and Splice
+ * Pipes as rings of page references, and page moves between descriptors
+ *
+ * A pipe holds up to PIPE_BUFFERS page references, each with the offset
+ * and length of the data it carries. write() copies into pages the pipe
+ * owns, topping up the last one while it has room. splice() from a file
+ * puts page cache pages into the ring by reference, and splice() between
+ * pipes moves references, so data read from a file reaches another pipe
+ * or a reader without being copied on the way. A spliced page cache page
+ * is shared, not snapshotted: a later write to the file shows through.
+ *
+ * A pipe is serialised by a sleeping lock rather than a spinlock: its
+ * holder reads the page cache, writes to a splice destination and copies
+ * to and from user memory, any of which may block.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/fs.h"
+#include "../include/string.h"
+#include "../include/spinlock.h"
+#include "../include/process.h"
+#include "../include/poll.h"
+
+#define PIPE_BUF_CAN_MERGE      (1 << 0)    /* Page owned by the pipe; writes may append */
+
+struct pipe_buffer {
+    struct page *page;
+    uint32_t offset;
+    uint32_t len;
+    uint32_t flags;
+};
+
+struct pipe {
+    struct pipe_buffer bufs[PIPE_BUFFERS];
+    unsigned int head;          /* Next slot to fill; free-running */
+    unsigned int tail;          /* Oldest filled slot */
+    unsigned int readers;
+    unsigned int writers;
+    struct wait_queue read_wait;
+    struct wait_queue write_wait;
+    struct wait_queue lock_wait;    /* Tasks waiting for the pipe lock */
+    bool locked;
+    spinlock_t lock;                /* Guards locked */
+};
+
+static struct file_operations pipe_read_fops;
+static struct file_operations pipe_write_fops;
+
+static inline bool pipe_empty(const struct pipe *pipe)
+{
+    return pipe->head == pipe->tail;
+}
+
+static inline bool pipe_full(const struct pipe *pipe)
+{
+    return pipe->head - pipe->tail >= PIPE_BUFFERS;
+}
+
+/**
+ * file_pipe - The pipe behind @file, or NULL for any other file
+ */
+static struct pipe *file_pipe(struct file_descriptor *file)
+{
+    if (file && (file->ops == &pipe_read_fops || file->ops == &pipe_write_fops)) {
+        return file->inode->private_data;
+    }
+    return NULL;
+}
+
+/**
+ * pipe_consume - Drop @len bytes from the front of the oldest buffer
+ */
+static void pipe_consume(struct pipe *pipe, uint32_t len)
+{
+    struct pipe_buffer *buf = &pipe->bufs[pipe->tail % PIPE_BUFFERS];
+
+    buf->offset += len;
+    buf->len -= len;
+    if (!buf->len) {
+        page_put(buf->page);
+        buf->page = NULL;
+        pipe->tail++;
+    }
+}
+
+/**
+ * pipe_push - Append a buffer; the pipe takes over the page reference
+ */
+static void pipe_push(struct pipe *pipe, struct page *page, uint32_t offset,
+                      uint32_t len, uint32_t flags)
+{
+    struct pipe_buffer *buf = &pipe->bufs[pipe->head % PIPE_BUFFERS];
+
+    buf->page = page;
+    buf->offset = offset;
+    buf->len = len;
+    buf->flags = flags;
+    pipe->head++;
+}
+
+/**
+ * pipe_lock - Take the pipe's sleeping lock
+ */
+static void pipe_lock(struct pipe *pipe)
+{
+    spin_lock(&pipe->lock);
+    while (pipe->locked) {
+        spin_unlock(&pipe->lock);
+        wait_queue_sleep(&pipe->lock_wait);
+        spin_lock(&pipe->lock);
+    }
+    pipe->locked = true;
+    spin_unlock(&pipe->lock);
+}
+
+/**
+ * pipe_unlock - Release the pipe lock and hand it to the next waiter
+ */
+static void pipe_unlock(struct pipe *pipe)
+{
+    spin_lock(&pipe->lock);
+    pipe->locked = false;
+    wait_queue_wake_one(&pipe->lock_wait);
+    spin_unlock(&pipe->lock);
+}
+
+/**
+ * pipe_wait - Sleep on @wq with the pipe unlocked
+ */
+static void pipe_wait(struct pipe *pipe, struct wait_queue *wq)
+{
+    pipe_unlock(pipe);
+    wait_queue_sleep(wq);
+    pipe_lock(pipe);
+}
+
+/**
+ * pipe_read - Copy buffered data out, waiting while the pipe is empty
+ *
+ * Returns 0 once the pipe is empty and every write end is closed.
+ */
+static ssize_t pipe_read(struct file_descriptor *file, void *out, size_t count)
+{
+    struct pipe *pipe = file->inode->private_data;
+    size_t done = 0;
+
+    if (!count) {
+        return 0;
+    }
+
+    pipe_lock(pipe);
+    while (pipe_empty(pipe)) {
+        if (!pipe->writers) {
+            pipe_unlock(pipe);
+            return 0;
+        }
+        if (file->flags & O_NONBLOCK) {
+            pipe_unlock(pipe);
+            return KERNEL_ERROR_AGAIN;
+        }
+        pipe_wait(pipe, &pipe->read_wait);
+    }
+
+    while (!pipe_empty(pipe) && done < count) {
+        struct pipe_buffer *buf = &pipe->bufs[pipe->tail % PIPE_BUFFERS];
+        uint32_t chunk = (uint32_t)MIN(count - done, buf->len);
+
+        memcpy((uint8_t *)out + done, (uint8_t *)page_address(buf->page) + buf->offset, chunk);
+        pipe_consume(pipe, chunk);
+        done += chunk;
+    }
+
+    wait_queue_wake_all(&pipe->write_wait);
+    pipe_unlock(pipe);
+    return (ssize_t)done;
+}
+
+/**
+ * pipe_write - Copy data in, waiting while the ring is full
+ *
+ * Fails with KERNEL_ERROR_PIPE once no read end is open.
+ */
+static ssize_t pipe_write(struct file_descriptor *file, const void *in, size_t count)
+{
+    struct pipe *pipe = file->inode->private_data;
+    size_t done = 0;
+
+    pipe_lock(pipe);
+    while (done < count) {
+        if (!pipe->readers) {
+            pipe_unlock(pipe);
+            return done ? (ssize_t)done : KERNEL_ERROR_PIPE;
+        }
+
+        /* Top up the newest buffer while its page has room */
+        if (!pipe_empty(pipe)) {
+            struct pipe_buffer *last = &pipe->bufs[(pipe->head - 1) % PIPE_BUFFERS];
+            uint32_t end = last->offset + last->len;
+            if ((last->flags & PIPE_BUF_CAN_MERGE) && end < PAGE_SIZE) {
+                uint32_t chunk = (uint32_t)MIN(count - done, PAGE_SIZE - end);
+                memcpy((uint8_t *)page_address(last->page) + end, (const uint8_t *)in + done, chunk);
+                last->len += chunk;
+                done += chunk;
+                continue;
+            }
+        }
+
+        if (pipe_full(pipe)) {
+            wait_queue_wake_all(&pipe->read_wait);
+            if (file->flags & O_NONBLOCK) {
+                break;
+            }
+            pipe_wait(pipe, &pipe->write_wait);
+            continue;
+        }
+
+        struct page *page = page_alloc(0, 0);
+        if (!page) {
+            break;
+        }
+        pipe_push(pipe, page, 0, 0, PIPE_BUF_CAN_MERGE);
+    }
+
+    wait_queue_wake_all(&pipe->read_wait);
+    pipe_unlock(pipe);
+
+    if (!done) {
+        return (file->flags & O_NONBLOCK) ? KERNEL_ERROR_AGAIN : KERNEL_ERROR_NOMEM;
+    }
+    return (ssize_t)done;
+}
+
+/**
+ * pipe_close - Drop one end, waking whoever waits on the other
+ */
+static int pipe_close(struct file_descriptor *file)
+{
+    struct pipe *pipe = file->inode->private_data;
+
+    pipe_lock(pipe);
+    if (file->ops == &pipe_read_fops) {
+        pipe->readers--;
+        wait_queue_wake_all(&pipe->write_wait);
+    } else {
+        pipe->writers--;
+        wait_queue_wake_all(&pipe->read_wait);
+    }
+    pipe_unlock(pipe);
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * pipe_release - Free the pipe once both ends' inode references are gone
+ */
+static void pipe_release(struct inode *inode)
+{
+    struct pipe *pipe = inode->private_data;
+
+    while (!pipe_empty(pipe)) {
+        pipe_consume(pipe, pipe->bufs[pipe->tail % PIPE_BUFFERS].len);
+    }
+    kfree(pipe);
+    kfree(inode);
+}
+
+/**
+ * pipe_poll - Readable with data or no writers, writable with a free slot
+ */
+static uint32_t pipe_poll(struct file_descriptor *file, struct poll_table *pt)
+{
+    struct pipe *pipe = file->inode->private_data;
+    uint32_t mask = 0;
+
+    if (file->ops == &pipe_read_fops) {
+        poll_wait(&pipe->read_wait, pt);
+        if (!pipe_empty(pipe)) {
+            mask |= POLLIN | POLLRDNORM;
+        }
+        if (!pipe->writers) {
+            mask |= POLLHUP;
+        }
+    } else {
+        poll_wait(&pipe->write_wait, pt);
+        if (!pipe_full(pipe)) {
+            mask |= POLLOUT | POLLWRNORM;
+        }
+        if (!pipe->readers) {
+            mask |= POLLERR;
+        }
+    }
+    return mask;
+}
+
+static struct file_operations pipe_read_fops = {
+    .close = pipe_close,
+    .read = pipe_read,
+    .poll = pipe_poll,
+};
+
+static struct file_operations pipe_write_fops = {
+    .close = pipe_close,
+    .write = pipe_write,
+    .poll = pipe_poll,
+};
+
+static struct page_cache_ops pipe_inode_ops = {
+    .release = pipe_release,
+};
+
+/**
+ * pipe_create - Make a pipe and open descriptions of both ends
+ * @flags: O_NONBLOCK, applied to both ends
+ */
+int pipe_create(struct file_descriptor *ends[2], uint32_t flags)
+{
+    struct pipe *pipe = kzalloc(sizeof(*pipe));
+    struct inode *inode = kzalloc(sizeof(*inode));
+    struct file_descriptor *read_end = kzalloc(sizeof(*read_end));
+    struct file_descriptor *write_end = kzalloc(sizeof(*write_end));
+
+    if (!pipe || !inode || !read_end || !write_end) {
+        kfree(pipe);
+        kfree(inode);
+        kfree(read_end);
+        kfree(write_end);
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    spin_lock_init(&pipe->lock);
+    wait_queue_init(&pipe->read_wait);
+    wait_queue_init(&pipe->write_wait);
+    wait_queue_init(&pipe->lock_wait);
+    pipe->readers = 1;
+    pipe->writers = 1;
+
+    inode->mode = S_IFIFO | S_IRUSR | S_IWUSR;
+    inode->pc_ops = &pipe_inode_ops;
+    inode->private_data = pipe;
+    atomic_set(&inode->refcount, 2);
+
+    read_end->flags = O_RDONLY | (flags & O_NONBLOCK);
+    read_end->inode = inode;
+    read_end->ops = &pipe_read_fops;
+    atomic_set(&read_end->refcount, 1);
+
+    write_end->flags = O_WRONLY | (flags & O_NONBLOCK);
+    write_end->inode = inode;
+    write_end->ops = &pipe_write_fops;
+    atomic_set(&write_end->refcount, 1);
+
+    ends[0] = read_end;
+    ends[1] = write_end;
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * splice_file_to_pipe - Queue page cache pages of @in by reference
+ */
+static ssize_t splice_file_to_pipe(struct file_descriptor *in, uint64_t *offset,
+                                   struct pipe *out, size_t len, uint32_t flags)
+{
+    struct inode *inode = in->inode;
+    size_t done = 0;
+
+    if (!inode->pc_ops || !inode->pc_ops->readpage) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    pipe_lock(out);
+    while (done < len && *offset < inode->size) {
+        if (!out->readers) {
+            pipe_unlock(out);
+            return done ? (ssize_t)done : KERNEL_ERROR_PIPE;
+        }
+        if (pipe_full(out)) {
+            wait_queue_wake_all(&out->read_wait);
+            if (done || (flags & SPLICE_F_NONBLOCK)) {
+                break;
+            }
+            pipe_wait(out, &out->write_wait);
+            continue;
+        }
+
+        struct page *page = page_cache_get(inode, *offset >> 12);
+        if (!page) {
+            break;
+        }
+
+        uint32_t in_page = (uint32_t)(*offset & PAGE_MASK);
+        uint32_t chunk = (uint32_t)MIN(MIN(len - done, PAGE_SIZE - in_page), inode->size - *offset);
+        pipe_push(out, page, in_page, chunk, 0);
+        *offset += chunk;
+        done += chunk;
+    }
+
+    wait_queue_wake_all(&out->read_wait);
+    pipe_unlock(out);
+
+    if (!done && len && *offset < inode->size) {
+        return (flags & SPLICE_F_NONBLOCK) ? KERNEL_ERROR_AGAIN : KERNEL_ERROR_NOMEM;
+    }
+    return (ssize_t)done;
+}
+
+/**
+ * splice_write - Write kernel data to a non-pipe file at @offset
+ * @offset: Explicit position, or NULL for the file offset
+ */
+static ssize_t splice_write(struct file_descriptor *out, uint64_t *offset,
+                            const void *data, size_t len)
+{
+    struct inode *inode = out->inode;
+
+    if (offset && !out->ops && inode && inode->pc_ops && inode->pc_ops->writepage) {
+        ssize_t ret = page_cache_write(inode, *offset, data, len);
+        if (ret > 0) {
+            *offset += (uint64_t)ret;
+        }
+        return ret;
+    }
+    if (offset) {
+        return KERNEL_ERROR_INVALID;
+    }
+    return vfs_write(out, data, len);
+}
+
+/**
+ * splice_pipe_to_file - Write buffered pages to @out and consume them
+ *
+ * The only copy is the one into the destination.
+ */
+static ssize_t splice_pipe_to_file(struct pipe *in, struct file_descriptor *out,
+                                   uint64_t *offset, size_t len, uint32_t flags)
+{
+    size_t done = 0;
+    ssize_t ret = 0;
+
+    pipe_lock(in);
+    while (pipe_empty(in)) {
+        if (!in->writers) {
+            pipe_unlock(in);
+            return 0;
+        }
+        if (flags & SPLICE_F_NONBLOCK) {
+            pipe_unlock(in);
+            return KERNEL_ERROR_AGAIN;
+        }
+        pipe_wait(in, &in->read_wait);
+    }
+
+    while (!pipe_empty(in) && done < len) {
+        struct pipe_buffer *buf = &in->bufs[in->tail % PIPE_BUFFERS];
+        uint32_t chunk = (uint32_t)MIN(len - done, buf->len);
+
+        ret = splice_write(out, offset, (uint8_t *)page_address(buf->page) + buf->offset, chunk);
+        if (ret <= 0) {
+            break;
+        }
+        pipe_consume(in, (uint32_t)ret);
+        done += (size_t)ret;
+        if ((uint32_t)ret < chunk) {
+            break;
+        }
+    }
+
+    wait_queue_wake_all(&in->write_wait);
+    pipe_unlock(in);
+    return done ? (ssize_t)done : ret;
+}
+
+/**
+ * splice_pipe_to_pipe - Move buffers from @in to @out by reference
+ *
+ * A buffer only partly wanted is split: both pipes then reference the
+ * page, and neither may append to it any more.
+ */
+static ssize_t splice_pipe_to_pipe(struct pipe *in, struct pipe *out, size_t len, uint32_t flags)
+{
+    struct pipe *first = in < out ? in : out;
+    struct pipe *second = in < out ? out : in;
+    size_t done = 0;
+    ssize_t ret = 0;
+
+    if (in == out) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    pipe_lock(first);
+    pipe_lock(second);
+
+    while (done < len) {
+        if (!out->readers) {
+            ret = KERNEL_ERROR_PIPE;
+            break;
+        }
+        if (pipe_empty(in) && !in->writers) {
+            break;
+        }
+        if (pipe_empty(in) || pipe_full(out)) {
+            if (done) {
+                break;
+            }
+            if (flags & SPLICE_F_NONBLOCK) {
+                ret = KERNEL_ERROR_AGAIN;
+                break;
+            }
+
+            /* Sleep with both pipes unlocked on whichever side blocks */
+            struct wait_queue *wq = pipe_empty(in) ? &in->read_wait : &out->write_wait;
+            pipe_unlock(second);
+            pipe_unlock(first);
+            wait_queue_sleep(wq);
+            pipe_lock(first);
+            pipe_lock(second);
+            continue;
+        }
+
+        struct pipe_buffer *buf = &in->bufs[in->tail % PIPE_BUFFERS];
+        if (buf->len <= len - done) {
+            pipe_push(out, buf->page, buf->offset, buf->len, buf->flags);
+            done += buf->len;
+            buf->page = NULL;
+            buf->len = 0;
+            in->tail++;
+        } else {
+            uint32_t chunk = (uint32_t)(len - done);
+            page_get(buf->page);
+            buf->flags &= ~PIPE_BUF_CAN_MERGE;
+            pipe_push(out, buf->page, buf->offset, chunk, 0);
+            pipe_consume(in, chunk);
+            done += chunk;
+        }
+    }
+
+    wait_queue_wake_all(&in->write_wait);
+    wait_queue_wake_all(&out->read_wait);
+    pipe_unlock(second);
+    pipe_unlock(first);
+    return done ? (ssize_t)done : ret;
+}
+
+/**
+ * do_splice - Move up to @len bytes between descriptors, one being a pipe
+ * @off_in: Position in a non-pipe input, or NULL for its file offset
+ * @off_out: Likewise for the output
+ */
+ssize_t do_splice(struct file_descriptor *in, uint64_t *off_in,
+                  struct file_descriptor *out, uint64_t *off_out,
+                  size_t len, uint32_t flags)
+{
+    struct pipe *in_pipe = file_pipe(in);
+    struct pipe *out_pipe = file_pipe(out);
+
+    if (!in || !out || (in->flags & O_ACCMODE) == O_WRONLY ||
+        (out->flags & O_ACCMODE) == O_RDONLY) {
+        return KERNEL_ERROR_BADF;
+    }
+    if ((in_pipe && off_in) || (out_pipe && off_out)) {
+        return KERNEL_ERROR_INVALID;
+    }
+    if (out->flags & O_NONBLOCK) {
+        flags |= SPLICE_F_NONBLOCK;
+    }
+
+    if (in_pipe && out_pipe) {
+        return splice_pipe_to_pipe(in_pipe, out_pipe, len, flags);
+    }
+    if (in_pipe) {
+        return splice_pipe_to_file(in_pipe, out, off_out, len, flags);
+    }
+    if (out_pipe) {
+        uint64_t *offset = off_in ? off_in : &in->offset;
+        return splice_file_to_pipe(in, offset, out_pipe, len, flags);
+    }
+    return KERNEL_ERROR_INVALID;
+}
+
+/**
+ * do_sendfile - Copy @count bytes of a page-cached file straight to @out
+ * @offset: Position in @in, or NULL for its file offset
+ *
+ * Data goes from the page cache to the destination with no user buffer
+ * in between: into a pipe by reference, elsewhere with the single copy
+ * the destination makes.
+ */
+ssize_t do_sendfile(struct file_descriptor *out, struct file_descriptor *in,
+                    uint64_t *offset, size_t count)
+{
+    struct pipe *out_pipe = file_pipe(out);
+    struct inode *inode = in ? in->inode : NULL;
+    uint64_t *pos = offset ? offset : (in ? &in->offset : NULL);
+    size_t done = 0;
+
+    if (!in || !out || (in->flags & O_ACCMODE) == O_WRONLY ||
+        (out->flags & O_ACCMODE) == O_RDONLY) {
+        return KERNEL_ERROR_BADF;
+    }
+    if (!inode || !inode->pc_ops || !inode->pc_ops->readpage || file_pipe(in)) {
+        return KERNEL_ERROR_INVALID;
+    }
+    if (out_pipe) {
+        return splice_file_to_pipe(in, pos, out_pipe, count, 0);
+    }
+
+    while (done < count && *pos < inode->size) {
+        struct page *page = page_cache_get(inode, *pos >> 12);
+        if (!page) {
+            break;
+        }
+
+        uint32_t in_page = (uint32_t)(*pos & PAGE_MASK);
+        size_t chunk = MIN(MIN(count - done, PAGE_SIZE - in_page), inode->size - *pos);
+        ssize_t ret = splice_write(out, NULL, (uint8_t *)page_address(page) + in_page, chunk);
+        page_put(page);
+
+        if (ret <= 0) {
+            return done ? (ssize_t)done : ret;
+        }
+        *pos += (uint64_t)ret;
+        done += (size_t)ret;
+        if ((size_t)ret < chunk) {
+            break;
+        }
+    }
+    return (ssize_t)done;
+}
@@ -0,0 +1,161 @@
+/*
+ * Power1 OS - poll()
+ * One-shot readiness waits over a set of descriptors
+ *
+ * The first scan of the set passes a poll table, so each file hangs a
+ * callback entry on the wait queues that signal it; any wake on them
+ * marks the poll triggered and wakes the caller, which rescans without
+ * registering again. Every entry is removed before returning.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/fs.h"
+#include "../include/process.h"
+#include "../include/timer.h"
+#include "../include/poll.h"
+
+struct poll_wqueues;
+
+struct poll_entry {
+    struct wait_callback cb;
+    struct poll_wqueues *owner;
+};
+
+#define POLL_CHUNK_ENTRIES      ((PAGE_SIZE - 16) / sizeof(struct poll_entry))
+
+struct poll_chunk {
+    struct poll_chunk *next;
+    uint64_t used;
+    struct poll_entry entries[POLL_CHUNK_ENTRIES];
+};
+
+struct poll_wqueues {
+    struct poll_table pt;
+    struct wait_queue wait;         /* The polling task sleeps here */
+    bool triggered;
+    int error;
+    struct poll_chunk *chunks;
+};
+
+/**
+ * poll_wake - Callback entry: a registered queue was woken
+ */
+static void poll_wake(struct wait_callback *cb)
+{
+    struct poll_wqueues *pwq = container_of(cb, struct poll_entry, cb)->owner;
+
+    pwq->triggered = true;
+    wait_queue_wake_all(&pwq->wait);
+}
+
+/**
+ * poll_queue - Poll table method: hang a callback entry on @wq
+ */
+static void poll_queue(struct poll_table *pt, struct wait_queue *wq)
+{
+    struct poll_wqueues *pwq = container_of(pt, struct poll_wqueues, pt);
+    struct poll_chunk *chunk = pwq->chunks;
+
+    if (!chunk || chunk->used == POLL_CHUNK_ENTRIES) {
+        chunk = kmalloc(sizeof(*chunk));
+        if (!chunk) {
+            pwq->error = KERNEL_ERROR_NOMEM;
+            return;
+        }
+        chunk->next = pwq->chunks;
+        chunk->used = 0;
+        pwq->chunks = chunk;
+    }
+
+    struct poll_entry *entry = &chunk->entries[chunk->used++];
+    entry->cb.func = poll_wake;
+    entry->owner = pwq;
+    wait_queue_add_callback(wq, &entry->cb);
+}
+
+/**
+ * poll_free - Detach and free every callback entry
+ */
+static void poll_free(struct poll_wqueues *pwq)
+{
+    while (pwq->chunks) {
+        struct poll_chunk *chunk = pwq->chunks;
+        for (uint64_t i = 0; i < chunk->used; i++) {
+            wait_queue_remove_callback(&chunk->entries[i].cb);
+        }
+        pwq->chunks = chunk->next;
+        kfree(chunk);
+    }
+}
+
+/**
+ * poll_scan - Fill in revents for the whole set, returning how many are set
+ */
+static uint32_t poll_scan(struct pollfd *fds, uint32_t nfds, struct poll_table *pt)
+{
+    uint32_t ready = 0;
+
+    for (uint32_t i = 0; i < nfds; i++) {
+        uint32_t mask = 0;
+
+        if (fds[i].fd >= 0) {
+            struct file_descriptor *file = fd_get(fds[i].fd);
+            mask = file ? vfs_poll(file, pt) & ((uint16_t)fds[i].events | POLL_ALWAYS) : POLLNVAL;
+        }
+        fds[i].revents = (int16_t)mask;
+        if (mask) {
+            ready++;
+        }
+    }
+    return ready;
+}
+
+/**
+ * do_poll - Wait until a descriptor in @fds is ready
+ * @timeout_ms: Longest wait; 0 polls once, negative waits indefinitely
+ *
+ * Returns the number of entries with revents set, 0 on timeout.
+ */
+int64_t do_poll(struct pollfd *fds, uint32_t nfds, int64_t timeout_ms)
+{
+    struct poll_wqueues pwq = {
+        .pt = { .queue = poll_queue },
+        .triggered = false,
+        .error = KERNEL_SUCCESS,
+        .chunks = NULL,
+    };
+    uint64_t deadline = timeout_ms > 0 ? clock_ns() + (uint64_t)timeout_ms * NSEC_PER_MSEC : 0;
+    struct poll_table *pt = timeout_ms ? &pwq.pt : NULL;
+    uint32_t ready;
+
+    if (nfds > POLL_FDS_MAX) {
+        return KERNEL_ERROR_INVALID;
+    }
+    wait_queue_init(&pwq.wait);
+
+    for (;;) {
+        ready = poll_scan(fds, nfds, pt);
+        pt = NULL;
+        if (ready || !timeout_ms || pwq.error) {
+            break;
+        }
+
+        /* A wake between the scan and here leaves triggered set */
+        if (!pwq.triggered) {
+            if (timeout_ms < 0) {
+                wait_queue_sleep(&pwq.wait);
+            } else if (!wait_queue_sleep_timeout(&pwq.wait, deadline)) {
+                ready = poll_scan(fds, nfds, NULL);
+                break;
+            }
+        }
+        pwq.triggered = false;
+    }
+
+    poll_free(&pwq);
+    return ready || !pwq.error ? (int64_t)ready : pwq.error;
+}
@@ -0,0 +1,60 @@
+/*
+ * Power1 OS - Anonymous Shared Memory
+ * Page-cache backed objects for MAP_SHARED | MAP_ANONYMOUS
+ *
+ * A shared anonymous mapping must resolve to the same frames in every
+ * process that inherits it, including pages first touched after fork.
+ * Backing it with an unnamed inode gives it a page cache identity, so the
+ * ordinary file fault path provides the sharing.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/fs.h"
+#include "../include/string.h"
+
+/**
+ * shmem_readpage - New shared memory reads as zeros
+ */
+static int shmem_readpage(struct inode *inode, struct page *page)
+{
+    (void)inode;
+    memset(page_address(page), 0, PAGE_SIZE);
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * shmem_release - Free the object once nothing maps or references it
+ */
+static void shmem_release(struct inode *inode)
+{
+    page_cache_evict_inode(inode);
+    kfree(inode);
+}
+
+static struct page_cache_ops shmem_ops = {
+    .readpage = shmem_readpage,
+    .writepage = NULL,
+    .release = shmem_release
+};
+
+/**
+ * shmem_inode_create - Allocate an unnamed zero-filled object of @size bytes
+ */
+struct inode *shmem_inode_create(uint64_t size)
+{
+    struct inode *inode = kzalloc(sizeof(*inode));
+    if (!inode) {
+        return NULL;
+    }
+
+    inode->mode = S_IFREG | S_IRUSR | S_IWUSR;
+    inode->nlink = 0;
+    inode->size = page_align_up(size);
+    inode->pc_ops = &shmem_ops;
+    atomic_set(&inode->refcount, 1);
+    return inode;
+}
@@ -0,0 +1,244 @@
+/*
+ * Power1 OS - Virtual File System
+ * Path namespace, open file descriptions and generic read/write
+ *
+ * The namespace is a flat table of absolute paths bound to inodes by the
+ * file systems that own them; there is no directory hierarchy yet. Reads
+ * and writes of inodes without their own methods go through the page
+ * cache; dirty pages are written back in bulk, at the latest on close.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/fs.h"
+#include "../include/string.h"
+#include "../include/poll.h"
+
+static struct {
+    char path[PATH_MAX];
+    struct inode *inode;
+} vfs_namespace[VFS_NAMESPACE_MAX];
+
+/**
+ * inode_get - Take a reference on an inode
+ */
+void inode_get(struct inode *inode)
+{
+    atomic_inc(&inode->refcount);
+}
+
+/**
+ * inode_put - Drop a reference, releasing the inode with the last one
+ */
+void inode_put(struct inode *inode)
+{
+    if (inode && atomic_dec_and_test(&inode->refcount) &&
+        inode->pc_ops && inode->pc_ops->release) {
+        inode->pc_ops->release(inode);
+    }
+}
+
+/**
+ * vfs_bind - Publish @inode under an absolute path
+ */
+int vfs_bind(const char *pathname, struct inode *inode)
+{
+    if (!pathname || pathname[0] != '/' || strlen(pathname) >= PATH_MAX) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    for (int i = 0; i < VFS_NAMESPACE_MAX; i++) {
+        if (!vfs_namespace[i].inode) {
+            strncpy(vfs_namespace[i].path, pathname, PATH_MAX);
+            vfs_namespace[i].inode = inode;
+            inode_get(inode);
+            return KERNEL_SUCCESS;
+        }
+    }
+    return KERNEL_ERROR_NOSPC;
+}
+
+/**
+ * vfs_lookup - Resolve an absolute path, returning a referenced inode
+ */
+struct inode *vfs_lookup(const char *pathname)
+{
+    for (int i = 0; i < VFS_NAMESPACE_MAX; i++) {
+        if (vfs_namespace[i].inode &&
+            strcmp(vfs_namespace[i].path, pathname) == 0) {
+            inode_get(vfs_namespace[i].inode);
+            return vfs_namespace[i].inode;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * vfs_open - Open a file by path
+ */
+struct file_descriptor *vfs_open(const char *pathname, int flags)
+{
+    struct inode *inode = vfs_lookup(pathname);
+    if (!inode) {
+        return NULL;
+    }
+
+    struct file_descriptor *file = kzalloc(sizeof(*file));
+    if (!file) {
+        inode_put(inode);
+        return NULL;
+    }
+
+    file->flags = (uint32_t)flags;
+    file->inode = inode;
+    file->ops = inode->ops;
+    atomic_set(&file->refcount, 1);
+
+    if (file->ops && file->ops->open && file->ops->open(inode, file) < 0) {
+        inode_put(inode);
+        kfree(file);
+        return NULL;
+    }
+    return file;
+}
+
+/**
+ * vfs_close - Tear down an open file description
+ */
+int vfs_close(struct file_descriptor *fd)
+{
+    int ret = KERNEL_SUCCESS;
+
+    if (!fd) {
+        return KERNEL_ERROR_BADF;
+    }
+    if (fd->epitems) {
+        eventpoll_release(fd);
+    }
+    if (fd->ops && fd->ops->close) {
+        ret = fd->ops->close(fd);
+    }
+    if (fd->inode && fd->inode->nrdirty) {
+        page_cache_writeback(fd->inode);
+    }
+    inode_put(fd->inode);
+    kfree(fd);
+    return ret;
+}
+
+/**
+ * vfs_read_inode - Copy file data out of the page cache
+ *
+ * Returns the bytes read, which is short only at EOF.
+ */
+ssize_t vfs_read_inode(struct inode *inode, uint64_t offset, void *buf, size_t count)
+{
+    uint8_t *out = buf;
+    size_t done = 0;
+
+    if (offset >= inode->size) {
+        return 0;
+    }
+    count = MIN(count, inode->size - offset);
+
+    while (done < count) {
+        uint64_t in_page = offset & PAGE_MASK;
+        size_t chunk = MIN(count - done, PAGE_SIZE - in_page);
+
+        struct page *page = page_cache_get(inode, offset >> 12);
+        if (!page) {
+            break;
+        }
+        memcpy(out + done, (uint8_t *)page_address(page) + in_page, chunk);
+        page_put(page);
+
+        done += chunk;
+        offset += chunk;
+    }
+
+    return done ? (ssize_t)done : KERNEL_ERROR_FAULT;
+}
+
+/**
+ * vfs_read_cached - Read through the page cache at the file offset
+ */
+static ssize_t vfs_read_cached(struct file_descriptor *fd, void *buf, size_t count)
+{
+    ssize_t ret = vfs_read_inode(fd->inode, fd->offset, buf, count);
+    if (ret > 0) {
+        fd->offset += (uint64_t)ret;
+    }
+    return ret;
+}
+
+/**
+ * vfs_read - Read from an open file
+ */
+ssize_t vfs_read(struct file_descriptor *fd, void *buf, size_t count)
+{
+    if (!fd || (fd->flags & O_ACCMODE) == O_WRONLY) {
+        return KERNEL_ERROR_BADF;
+    }
+    if (fd->ops && fd->ops->read) {
+        return fd->ops->read(fd, buf, count);
+    }
+    if (fd->inode && fd->inode->pc_ops) {
+        return vfs_read_cached(fd, buf, count);
+    }
+    return KERNEL_ERROR_INVALID;
+}
+
+/**
+ * vfs_write - Write to an open file
+ */
+ssize_t vfs_write(struct file_descriptor *fd, const void *buf, size_t count)
+{
+    if (!fd || (fd->flags & O_ACCMODE) == O_RDONLY) {
+        return KERNEL_ERROR_BADF;
+    }
+    if (fd->ops && fd->ops->write) {
+        return fd->ops->write(fd, buf, count);
+    }
+    if (fd->inode && fd->inode->pc_ops && fd->inode->pc_ops->writepage) {
+        ssize_t ret = page_cache_write(fd->inode, fd->offset, buf, count);
+        if (ret > 0) {
+            fd->offset += (uint64_t)ret;
+        }
+        return ret;
+    }
+    return KERNEL_ERROR_INVALID;
+}
+
+/**
+ * vfs_poll - Current readiness of an open file as POLL* bits
+ * @pt: Registers the wait queues signalling changes, or NULL
+ *
+ * Files without a poll operation never block, so they are always ready.
+ * Only pipes and epoll instances implement it: regular and block device
+ * files go through the page cache, and the console is not reachable
+ * through a descriptor, so there is no character device to wait on.
+ */
+uint32_t vfs_poll(struct file_descriptor *fd, struct poll_table *pt)
+{
+    if (fd->ops && fd->ops->poll) {
+        return fd->ops->poll(fd, pt);
+    }
+    return DEFAULT_POLLMASK;
+}
+
+/**
+ * vfs_ioctl - Device-specific control of an open file
+ */
+int vfs_ioctl(struct file_descriptor *fd, uint32_t cmd, void *arg)
+{
+    if (!fd) {
+        return KERNEL_ERROR_BADF;
+    }
+    if (fd->ops && fd->ops->ioctl) {
+        return fd->ops->ioctl(fd, cmd, arg);
+    }
+    return KERNEL_ERROR_INVALID;
+}
@@ -0,0 +1,286 @@
+/*
+ * Power1 OS - Program Execution
+ * Binary format registry, execve and posix_spawn-style process creation
+ *
+ * A new image is always built in a fresh address space that is not yet
+ * live: the binary format maps the program, then the argument and
+ * environment strings are written onto the initial stack through the
+ * direct map. execve swaps the space in; spawn hands it to a new task
+ * directly, never copying or even sharing the parent's mappings.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/fs.h"
+#include "../include/process.h"
+#include "../include/syscall.h"
+#include "../include/cpu.h"
+#include "../include/elf.h"
+#include "../include/string.h"
+#include "../include/fpu.h"
+
+/* Initial user RFLAGS: interrupts enabled, reserved bit 1 set */
+#define USER_RFLAGS_INIT        0x202
+
+static struct binary_format *binary_formats = NULL;
+
+/**
+ * binfmt_register - Add an executable format handler
+ */
+int binfmt_register(struct binary_format *format)
+{
+    if (!format || !format->load) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    format->next = binary_formats;
+    binary_formats = format;
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * exec_count - Entries in a NULL-terminated vector
+ */
+static int exec_count(char **vector)
+{
+    int count = 0;
+    while (vector && vector[count]) {
+        count++;
+    }
+    return count;
+}
+
+/**
+ * exec_push - Copy @length bytes onto the image's stack
+ */
+static int exec_push(struct exec_params *params, const void *data, size_t length)
+{
+    params->stack_pointer -= length;
+    return vm_copy_to_space(params->space, params->stack_pointer, data, length);
+}
+
+/**
+ * exec_setup_stack - Build the System V initial process stack
+ *
+ * From the stack pointer upwards: argc, argv[], NULL, envp[], NULL, the
+ * auxiliary vector, then the AT_RANDOM bytes and the strings themselves.
+ */
+static int exec_setup_stack(struct exec_params *params)
+{
+    uint64_t pointers[2 * EXEC_ARG_MAX + 2 * EXEC_AUXV_MAX + 10];
+    uint64_t envp_addr[EXEC_ARG_MAX], argv_addr[EXEC_ARG_MAX];
+    int count = 0;
+    int ret;
+
+    int64_t base = vm_mmap(params->space, USER_STACK_TOP - USER_STACK_SIZE, USER_STACK_SIZE,
+                           PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+                           NULL, 0);
+    if (base < 0) {
+        return (int)base;
+    }
+    params->stack_pointer = USER_STACK_TOP;
+
+    /* Strings, envp first so argv ends up lowest */
+    for (int i = params->envc - 1; i >= 0; i--) {
+        ret = exec_push(params, params->envp[i], strlen(params->envp[i]) + 1);
+        if (ret != KERNEL_SUCCESS) {
+            return ret;
+        }
+        envp_addr[i] = params->stack_pointer;
+    }
+    for (int i = params->argc - 1; i >= 0; i--) {
+        ret = exec_push(params, params->argv[i], strlen(params->argv[i]) + 1);
+        if (ret != KERNEL_SUCCESS) {
+            return ret;
+        }
+        argv_addr[i] = params->stack_pointer;
+    }
+
+    /* Seed for the C library's stack protector and pointer guard */
+    uint64_t seed[2] = { cpu_read_tsc(), cpu_read_tsc() * 0x9E3779B97F4A7C15UL };
+    params->stack_pointer = ALIGN_DOWN(params->stack_pointer, 16);
+    ret = exec_push(params, seed, sizeof(seed));
+    if (ret != KERNEL_SUCCESS) {
+        return ret;
+    }
+    uint64_t random_addr = params->stack_pointer;
+
+    pointers[count++] = (uint64_t)params->argc;
+    for (int i = 0; i < params->argc; i++) {
+        pointers[count++] = argv_addr[i];
+    }
+    pointers[count++] = 0;
+    for (int i = 0; i < params->envc; i++) {
+        pointers[count++] = envp_addr[i];
+    }
+    pointers[count++] = 0;
+
+    pointers[count++] = AT_PAGESZ;
+    pointers[count++] = PAGE_SIZE;
+    pointers[count++] = AT_RANDOM;
+    pointers[count++] = random_addr;
+    for (int i = 0; i < 2 * params->auxc; i++) {
+        pointers[count++] = params->auxv[i];
+    }
+    pointers[count++] = AT_NULL;
+    pointers[count++] = 0;
+
+    /* rsp must be 16-byte aligned at the entry point */
+    params->stack_pointer = ALIGN_DOWN(params->stack_pointer - count * sizeof(uint64_t), 16);
+    return vm_copy_to_space(params->space, params->stack_pointer, pointers,
+                            count * sizeof(uint64_t));
+}
+
+/**
+ * exec_build_image - Load @params->path into a new address space
+ */
+static int exec_build_image(struct exec_params *params)
+{
+    params->argc = exec_count(params->argv);
+    params->envc = exec_count(params->envp);
+    if (params->argc > EXEC_ARG_MAX || params->envc > EXEC_ARG_MAX) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    params->inode = vfs_lookup(params->path);
+    if (!params->inode) {
+        return KERNEL_ERROR_NOTFOUND;
+    }
+
+    params->space = vm_space_create();
+    if (!params->space) {
+        inode_put(params->inode);
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    int ret = KERNEL_ERROR_NOEXEC;
+    for (struct binary_format *format = binary_formats; format; format = format->next) {
+        ret = format->load(params);
+        if (ret != KERNEL_ERROR_NOEXEC) {
+            break;
+        }
+    }
+
+    /* sysret to a non-canonical rip would fault in ring 0 */
+    if (ret == KERNEL_SUCCESS &&
+        (params->entry < USER_SPACE_START || params->entry > USER_SPACE_END)) {
+        ret = KERNEL_ERROR_NOEXEC;
+    }
+    if (ret == KERNEL_SUCCESS) {
+        ret = exec_setup_stack(params);
+    }
+
+    inode_put(params->inode);
+    params->inode = NULL;
+    if (ret != KERNEL_SUCCESS) {
+        vm_space_destroy(params->space);
+        params->space = NULL;
+    }
+    return ret;
+}
+
+/**
+ * exec_task_name - Name a task after the last component of @path
+ */
+static void exec_task_name(struct task *task, const char *path)
+{
+    const char *name = path;
+
+    for (const char *p = path; *p; p++) {
+        if (*p == '/') {
+            name = p + 1;
+        }
+    }
+    memset(task->name, 0, TASK_NAME_LEN);
+    strncpy(task->name, name, TASK_NAME_LEN - 1);
+}
+
+/**
+ * exec_initial_frame - User register state at the entry point
+ */
+static void exec_initial_frame(struct syscall_frame *frame, const struct exec_params *params)
+{
+    memset(frame, 0, sizeof(*frame));
+    frame->rip = params->entry;
+    frame->rsp = params->stack_pointer;
+    frame->rflags = USER_RFLAGS_INIT;
+}
+
+/**
+ * process_exec - Replace the current task's image
+ *
+ * On success the interrupted system call returns into the new program.
+ */
+int process_exec(const char *path, char **argv, char **envp)
+{
+    struct task *task = current_task;
+    struct exec_params params = { .path = path, .argv = argv, .envp = envp };
+
+    if (!task->user_frame) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    int ret = exec_build_image(&params);
+    if (ret != KERNEL_SUCCESS) {
+        return ret;
+    }
+
+    struct vm_space *old = task->vm;
+    task->vm = params.space;
+    vm_space_activate(params.space);
+    vm_space_destroy(old);
+
+    /* A vfork child has stopped using the parent's space */
+    task_release_vfork(task);
+
+    /* The new program starts from the initial FPU state */
+    fpu_release(task);
+
+    exec_task_name(task, path);
+    exec_initial_frame(task->user_frame, &params);
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * process_spawn - Start @path in a new child process
+ *
+ * The child inherits the descriptor table and nothing else; its address
+ * space is built from scratch, so the cost is independent of the parent's
+ * size. Returns the child's pid.
+ */
+int64_t process_spawn(const char *path, char **argv, char **envp)
+{
+    struct task *parent = current_task;
+    struct exec_params params = { .path = path, .argv = argv, .envp = envp };
+    struct syscall_frame frame;
+
+    int ret = exec_build_image(&params);
+    if (ret != KERNEL_SUCCESS) {
+        return ret;
+    }
+
+    struct task *child = task_alloc(path);
+    if (child) {
+        child->files = fd_table_clone(parent->files);
+    }
+    if (!child || !child->files) {
+        if (child) {
+            task_free(child);
+        }
+        vm_space_destroy(params.space);
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    child->vm = params.space;
+    child->parent = parent;
+    list_add_tail(&child->sibling, &parent->children);
+    exec_task_name(child, path);
+
+    exec_initial_frame(&frame, &params);
+    task_prepare_user_return(child, &frame);
+    task_enqueue(child);
+    return child->pid;
+}
@@ -0,0 +1,134 @@
+/*
+ * Power1 OS - Process Exit
+ * Task teardown, zombies and waitpid
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/fs.h"
+#include "../include/process.h"
+#include "../include/fpu.h"
+
+extern struct task idle_task;
+
+/**
+ * task_release_vfork - Hand a borrowed address space back to the parent
+ */
+void task_release_vfork(struct task *task)
+{
+    if (task->flags & TASK_VFORK) {
+        task->flags &= ~TASK_VFORK;
+        wait_queue_wake_all(&task->vfork_done);
+    }
+}
+
+/**
+ * task_reparent_children - Give orphans to init, or to idle without one
+ */
+static void task_reparent_children(struct task *task)
+{
+    struct task *reaper = task_find(1);
+    struct list_head *node, *next;
+
+    if (!reaper || reaper == task) {
+        reaper = &idle_task;
+    }
+
+    list_for_each_safe(node, next, &task->children) {
+        struct task *child = list_entry(node, struct task, sibling);
+        list_del(&child->sibling);
+        child->parent = reaper;
+        list_add_tail(&child->sibling, &reaper->children);
+    }
+
+    if (!list_empty(&reaper->children)) {
+        wait_queue_wake_all(&reaper->child_exit);
+    }
+}
+
+/**
+ * task_exit - Terminate the current task
+ * @code: Wait status reported to the parent
+ *
+ * Everything but the task structure and kernel stack is released here;
+ * those go when the parent reaps the zombie.
+ */
+void task_exit(int code)
+{
+    struct task *task = current_task;
+
+    if (task == &idle_task) {
+        kernel_panic("Idle task exited");
+    }
+
+    fd_table_release(task->files);
+    task->files = NULL;
+    fpu_release(task);
+
+    if (task->vm) {
+        struct vm_space *vm = task->vm;
+        task->vm = NULL;
+        vm_space_destroy(vm);
+    }
+
+    task_release_vfork(task);
+    task_reparent_children(task);
+
+    task->exit_code = code;
+    task->state = TASK_ZOMBIE;
+    if (task->parent) {
+        wait_queue_wake_all(&task->parent->child_exit);
+    }
+
+    schedule();
+    kernel_panic("Zombie task rescheduled");
+    __builtin_unreachable();
+}
+
+/**
+ * process_wait - Reap an exited child
+ * @pid: Child to wait for, or -1 for any
+ * @status: Receives the wait status when non-NULL
+ *
+ * Returns the reaped pid, 0 under WNOHANG when no child has exited yet,
+ * or KERNEL_ERROR_CHILD when there is nothing to wait for.
+ */
+int64_t process_wait(int64_t pid, int *status, int options)
+{
+    struct task *task = current_task;
+
+    for (;;) {
+        struct list_head *node, *next;
+        bool found = false;
+
+        list_for_each_safe(node, next, &task->children) {
+            struct task *child = list_entry(node, struct task, sibling);
+
+            if (pid > 0 && child->pid != (uint64_t)pid) {
+                continue;
+            }
+            found = true;
+
+            if (child->state == TASK_ZOMBIE) {
+                int64_t reaped = child->pid;
+                if (status) {
+                    *status = child->exit_code;
+                }
+                list_del(&child->sibling);
+                task_free(child);
+                return reaped;
+            }
+        }
+
+        if (!found) {
+            return KERNEL_ERROR_CHILD;
+        }
+        if (options & WNOHANG) {
+            return 0;
+        }
+        wait_queue_sleep(&task->child_exit);
+    }
+}
@@ -0,0 +1,162 @@
+/*
+ * Power1 OS - Process Creation
+ * Copy-on-write fork and vfork
+ *
+ * fork copies page tables, not pages: every private frame is mapped
+ * read-only in both parent and child with one extra reference, and the
+ * first write on either side goes through fault_write_protect, which
+ * copies the frame or, once the other side has let go of it, simply
+ * re-enables writing. vfork skips even the table copy by lending the
+ * parent's space to the child until it calls execve or exits.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/cpu.h"
+#include "../include/fs.h"
+#include "../include/process.h"
+#include "../include/syscall.h"
+#include "../include/fpu.h"
+
+/**
+ * vm_fork_range - Share the present pages of @vma with @child
+ *
+ * Works a page table at a time: one walk per 2MB in each space, then a
+ * linear pass over the entries.
+ */
+static int vm_fork_range(struct vm_space *parent, struct vm_space *child,
+                         struct vm_area *vma)
+{
+    bool cow = !(vma->flags & VMA_SHARED);
+    uint64_t vaddr = vma->start;
+
+    while (vaddr < vma->end) {
+        uint64_t chunk_end = MIN(ALIGN_DOWN(vaddr, LARGE_PAGE_SIZE) + LARGE_PAGE_SIZE, vma->end);
+        uint64_t count = (chunk_end - vaddr) >> 12;
+        uint64_t *src = vm_lookup_pte(parent, vaddr, false);
+        uint64_t *dst = NULL;
+
+        for (uint64_t i = 0; src && i < count; i++) {
+            if (!(src[i] & PAGE_PRESENT)) {
+                continue;
+            }
+            if (!dst) {
+                dst = vm_lookup_pte(child, vaddr, true);
+                if (!dst) {
+                    return KERNEL_ERROR_NOMEM;
+                }
+            }
+
+            if (cow) {
+                src[i] &= ~PAGE_WRITABLE;
+            }
+            dst[i] = src[i];
+            page_get(phys_to_page(src[i] & PAGE_ADDR_MASK));
+            child->resident_pages++;
+        }
+        vaddr = chunk_end;
+    }
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * vm_space_fork - Duplicate @parent copy-on-write
+ */
+struct vm_space *vm_space_fork(struct vm_space *parent)
+{
+    struct vm_space *child = vm_space_create();
+    if (!child) {
+        return NULL;
+    }
+
+    struct vm_area **tail = &child->areas;
+    int ret = KERNEL_SUCCESS;
+
+    for (struct vm_area *vma = parent->areas; vma; vma = vma->next) {
+        struct vm_area *copy = kmalloc(sizeof(*copy));
+        if (!copy) {
+            ret = KERNEL_ERROR_NOMEM;
+            break;
+        }
+
+        *copy = *vma;
+        if (copy->inode) {
+            inode_get(copy->inode);
+        }
+        copy->space = child;
+        copy->next = NULL;
+        *tail = copy;
+        tail = &copy->next;
+
+        ret = vm_fork_range(parent, child, vma);
+        if (ret != KERNEL_SUCCESS) {
+            break;
+        }
+    }
+
+    /* Parent entries lost their write bit: drop stale TLB entries */
+    if (parent == current_vm_space) {
+        cpu_write_cr3(cpu_read_cr3());
+    }
+
+    if (ret != KERNEL_SUCCESS) {
+        vm_space_destroy(child);
+        return NULL;
+    }
+    return child;
+}
+
+/**
+ * process_fork - Create a child resuming from the current system call
+ * @share_vm: vfork semantics; the caller sleeps until the child execs or exits
+ *
+ * Returns the child's pid to the parent; the child sees 0.
+ */
+int64_t process_fork(bool share_vm)
+{
+    struct task *parent = current_task;
+
+    if (!parent->user_frame || !parent->vm) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    struct task *child = task_alloc(parent->name);
+    if (!child) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    if (share_vm) {
+        atomic_inc(&parent->vm->users);
+        child->vm = parent->vm;
+        child->flags |= TASK_VFORK;
+    } else {
+        child->vm = vm_space_fork(parent->vm);
+    }
+    child->files = fd_table_clone(parent->files);
+
+    if (!child->vm || !child->files || fpu_fork(child, parent) != KERNEL_SUCCESS) {
+        vm_space_destroy(child->vm);
+        fd_table_release(child->files);
+        task_free(child);
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    child->mempolicy = parent->mempolicy;
+    child->parent = parent;
+    list_add_tail(&child->sibling, &parent->children);
+
+    task_prepare_user_return(child, parent->user_frame);
+    child->user_frame->rax = 0;
+
+    int64_t pid = child->pid;
+    task_enqueue(child);
+
+    /* The child cannot be reaped before we return: only we wait for it */
+    while (child->flags & TASK_VFORK) {
+        wait_queue_sleep(&child->vfork_done);
+    }
+    return pid;
+}
@@ -0,0 +1,290 @@
+/*
+ * Power1 OS - Futexes
+ * Hashed wait queues keyed by physical page and offset
+ *
+ * Waiters hang off FUTEX_HASH_SIZE buckets, each with its own lock and
+ * cache line, hashed by the physical address of the futex word. Each
+ * waiter sleeps on a private wait queue, so a wake goes straight to the
+ * tasks it picks and requeue only moves list entries between buckets.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/spinlock.h"
+#include "../include/process.h"
+#include "../include/timer.h"
+#include "../include/futex.h"
+#include "../include/init.h"
+
+struct futex_bucket {
+    spinlock_t lock;
+    struct list_head waiters;
+} __attribute__((aligned(64)));
+
+/* One sleeping task, on its own stack */
+struct futex_waiter {
+    struct list_head list;      /* Bucket linkage, empty once woken */
+    uint64_t key;
+    struct wait_queue wq;
+};
+
+static struct futex_bucket futex_buckets[FUTEX_HASH_SIZE];
+
+/**
+ * futex_bucket_for - Bucket of @key
+ */
+static struct futex_bucket *futex_bucket_for(uint64_t key)
+{
+    /* Words of one page spread over buckets; so do pages */
+    uint64_t hash = (key >> 2) * 0x9E3779B97F4A7C15UL;
+    return &futex_buckets[hash >> (64 - FUTEX_HASH_BITS)];
+}
+
+/**
+ * futex_key - Physical address of the futex word at @uaddr
+ *
+ * The page is faulted in first, for writing if the mapping allows it, so
+ * the key names the frame the process will actually store to rather than
+ * a shared zero or copy-on-write page.
+ */
+static int futex_key(uint32_t *uaddr, uint64_t *key)
+{
+    struct vm_space *space = current_vm_space;
+    uint64_t addr = (uint64_t)uaddr;
+
+    if (addr & 3) {
+        return KERNEL_ERROR_INVALID;
+    }
+    if (!user_range_ok(addr, sizeof(uint32_t), false)) {
+        return KERNEL_ERROR_FAULT;
+    }
+
+    struct vm_area *vma = vma_find(space, addr);
+    uint32_t error = PF_USER | ((vma->flags & VMA_WRITE) ? PF_WRITE : 0);
+    int ret = vm_handle_fault(space, addr, error);
+    if (ret != KERNEL_SUCCESS) {
+        return ret;
+    }
+
+    uint64_t *pte = vm_lookup_pte(space, page_align_down(addr), false);
+    if (!pte || !(*pte & PAGE_PRESENT)) {
+        return KERNEL_ERROR_FAULT;
+    }
+
+    *key = (*pte & PAGE_ADDR_MASK) | (addr & (PAGE_SIZE - 1));
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * futex_wake_waiter - Unlink @waiter and make its task runnable
+ *
+ * Called with the bucket locked.
+ */
+static void futex_wake_waiter(struct futex_waiter *waiter)
+{
+    list_del(&waiter->list);
+    wait_queue_wake_all(&waiter->wq);
+}
+
+/**
+ * futex_wait - Sleep while *@uaddr == @val, until woken or @timeout passes
+ * @timeout: Relative user timespec, or NULL to wait indefinitely
+ */
+int64_t futex_wait(uint32_t *uaddr, uint32_t val, const struct timespec *timeout)
+{
+    struct futex_waiter waiter;
+    uint64_t deadline = 0;
+    uint32_t current;
+    int ret;
+
+    if (timeout) {
+        struct timespec ts;
+        if (copy_from_user(&ts, timeout, sizeof(ts)) != KERNEL_SUCCESS) {
+            return KERNEL_ERROR_FAULT;
+        }
+        if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= (int64_t)NSEC_PER_SEC) {
+            return KERNEL_ERROR_INVALID;
+        }
+        if (!clock_tsc_khz()) {
+            return KERNEL_ERROR_NOSYS;
+        }
+
+        uint64_t ns = (uint64_t)ts.tv_sec * NSEC_PER_SEC + (uint64_t)ts.tv_nsec;
+        deadline = clock_ns() + ns;
+        if (deadline < ns || (uint64_t)ts.tv_sec > UINT64_MAX / NSEC_PER_SEC) {
+            deadline = UINT64_MAX;
+        }
+    }
+
+    ret = futex_key(uaddr, &waiter.key);
+    if (ret != KERNEL_SUCCESS) {
+        return ret;
+    }
+
+    struct futex_bucket *bucket = futex_bucket_for(waiter.key);
+    spin_lock(&bucket->lock);
+
+    /* Checked under the lock, so a waker that changed it first is seen */
+    if (copy_from_user(&current, uaddr, sizeof(current)) != KERNEL_SUCCESS) {
+        spin_unlock(&bucket->lock);
+        return KERNEL_ERROR_FAULT;
+    }
+    if (current != val) {
+        spin_unlock(&bucket->lock);
+        return KERNEL_ERROR_AGAIN;
+    }
+
+    wait_queue_init(&waiter.wq);
+    list_add_tail(&waiter.list, &bucket->waiters);
+    spin_unlock(&bucket->lock);
+
+    /*
+     * Wakers run in other tasks' system calls, never from interrupts, and
+     * the scheduler is cooperative, so nobody can wake us between the
+     * unlock and the sleep. A requeue may move us to another bucket, so
+     * the key is reread after waking.
+     */
+    while (!list_empty(&waiter.list)) {
+        if (!deadline) {
+            wait_queue_sleep(&waiter.wq);
+            continue;
+        }
+        if (!wait_queue_sleep_timeout(&waiter.wq, deadline) && !list_empty(&waiter.list)) {
+            bucket = futex_bucket_for(waiter.key);
+            spin_lock(&bucket->lock);
+            bool queued = !list_empty(&waiter.list);
+            if (queued) {
+                list_del(&waiter.list);
+            }
+            spin_unlock(&bucket->lock);
+            if (queued) {
+                return KERNEL_ERROR_TIMEDOUT;
+            }
+        }
+    }
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * futex_wake - Wake up to @nr_wake tasks waiting on @uaddr
+ *
+ * Returns the number woken.
+ */
+int64_t futex_wake(uint32_t *uaddr, uint32_t nr_wake)
+{
+    uint64_t key;
+    int64_t woken = 0;
+    int ret = futex_key(uaddr, &key);
+
+    if (ret != KERNEL_SUCCESS) {
+        return ret;
+    }
+
+    struct futex_bucket *bucket = futex_bucket_for(key);
+    struct list_head *pos, *tmp;
+
+    spin_lock(&bucket->lock);
+    list_for_each_safe(pos, tmp, &bucket->waiters) {
+        struct futex_waiter *waiter = list_entry(pos, struct futex_waiter, list);
+        if ((uint64_t)woken >= nr_wake) {
+            break;
+        }
+        if (waiter->key == key) {
+            futex_wake_waiter(waiter);
+            woken++;
+        }
+    }
+    spin_unlock(&bucket->lock);
+    return woken;
+}
+
+/**
+ * futex_requeue - Wake @nr_wake waiters of @uaddr and move up to
+ *                 @nr_requeue others to @uaddr2
+ * @compare: Fail with KERNEL_ERROR_AGAIN unless *@uaddr == @val3
+ *
+ * Lets a condition variable broadcast wake one task and hand the rest to
+ * the mutex, instead of waking them all to fight over it. Returns the
+ * number of tasks woken plus requeued.
+ */
+int64_t futex_requeue(uint32_t *uaddr, uint32_t nr_wake, uint32_t nr_requeue,
+                      uint32_t *uaddr2, bool compare, uint32_t val3)
+{
+    uint64_t key, key2;
+    int64_t done = 0;
+    int ret;
+
+    if ((ret = futex_key(uaddr, &key)) != KERNEL_SUCCESS ||
+        (ret = futex_key(uaddr2, &key2)) != KERNEL_SUCCESS) {
+        return ret;
+    }
+
+    struct futex_bucket *bucket = futex_bucket_for(key);
+    struct futex_bucket *bucket2 = futex_bucket_for(key2);
+
+    /* Both locks, in address order */
+    if (bucket < bucket2) {
+        spin_lock(&bucket->lock);
+        spin_lock(&bucket2->lock);
+    } else {
+        spin_lock(&bucket2->lock);
+        if (bucket2 != bucket) {
+            spin_lock(&bucket->lock);
+        }
+    }
+
+    if (compare) {
+        uint32_t current;
+        if (copy_from_user(&current, uaddr, sizeof(current)) != KERNEL_SUCCESS) {
+            done = KERNEL_ERROR_FAULT;
+        } else if (current != val3) {
+            done = KERNEL_ERROR_AGAIN;
+        }
+    }
+
+    if (done == 0) {
+        uint32_t woken = 0, moved = 0;
+        struct list_head *pos, *tmp;
+
+        list_for_each_safe(pos, tmp, &bucket->waiters) {
+            struct futex_waiter *waiter = list_entry(pos, struct futex_waiter, list);
+            if (waiter->key != key) {
+                continue;
+            }
+            if (woken < nr_wake) {
+                futex_wake_waiter(waiter);
+                woken++;
+            } else if (moved < nr_requeue) {
+                list_del(&waiter->list);
+                waiter->key = key2;
+                list_add_tail(&waiter->list, &bucket2->waiters);
+                moved++;
+            } else {
+                break;
+            }
+        }
+        done = woken + moved;
+    }
+
+    spin_unlock(&bucket->lock);
+    if (bucket2 != bucket) {
+        spin_unlock(&bucket2->lock);
+    }
+    return done;
+}
+
+/**
+ * futex_init - Empty every hash bucket
+ */
+int __init futex_init(void)
+{
+    for (unsigned int i = 0; i < FUTEX_HASH_SIZE; i++) {
+        spin_lock_init(&futex_buckets[i].lock);
+        list_init(&futex_buckets[i].waiters);
+    }
+    return KERNEL_SUCCESS;
+}
+initcall(futex_init, 0);
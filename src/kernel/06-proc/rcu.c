@@ -0,0 +1,343 @@
+/*
+ * Power1 OS - Read-Copy-Update
+ * Grace period tracking and deferred callbacks
+ *
+ * A grace period is numbered; gp_started is the latest one begun and
+ * gp_completed the latest one finished. Starting one snapshots the online
+ * CPUs into cpus_pending, and each CPU clears its bit at its next context
+ * switch or idle pass. The last CPU to report completes the period and,
+ * if callbacks are already waiting for the next, starts it at once.
+ *
+ * Every CPU keeps its callbacks in three segments: next (queued, no grace
+ * period assigned), wait (waiting for gp wait_gp) and done (ready to run).
+ * All callbacks queued while a grace period is in flight move into wait
+ * together, so one grace period serves the whole batch. Only this CPU
+ * touches its segments, with interrupts off; the shared state is written
+ * once per CPU per grace period.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/cpu.h"
+#include "../include/interrupts.h"
+#include "../include/spinlock.h"
+#include "../include/process.h"
+#include "../include/rcu.h"
+#include "../include/init.h"
+
+#define RCU_BATCH_LIMIT         64      /* Callbacks invoked per pass */
+
+struct rcu_data {
+    uint64_t gp_seen;           /* gp_started when this CPU last reported */
+    struct rcu_head *done;
+    struct rcu_head **done_tail;
+    struct rcu_head *wait;
+    struct rcu_head **wait_tail;
+    uint64_t wait_gp;           /* Grace period wait is waiting for */
+    struct rcu_head *next;
+    struct rcu_head **next_tail;
+} __attribute__((aligned(64)));
+
+static struct rcu_data rcu_data[CPU_MAX];
+
+static struct {
+    spinlock_t lock;
+    uint64_t gp_started;
+    uint64_t gp_completed;
+    uint64_t gp_requested;      /* Highest grace period a callback waits for */
+    uint64_t cpus_pending;      /* Online CPUs yet to report this period */
+    uint64_t cpus_online;
+    unsigned int online_count;
+} rcu_state = { .lock = SPINLOCK_INIT };
+
+/* synchronize_rcu waiter */
+struct rcu_synchronize {
+    struct rcu_head head;
+    struct wait_queue wq;
+    bool done;
+};
+
+/**
+ * rcu_start_gp - Begin the next grace period if one is wanted and none runs
+ *
+ * Called with rcu_state.lock held.
+ */
+static void rcu_start_gp(void)
+{
+    if (rcu_state.gp_started != rcu_state.gp_completed ||
+        rcu_state.gp_requested <= rcu_state.gp_completed) {
+        return;
+    }
+
+    rcu_state.cpus_pending = rcu_state.cpus_online;
+    __atomic_store_n(&rcu_state.gp_started, rcu_state.gp_started + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * rcu_report_qs - Record that @cpu passed a quiescent state
+ *
+ * Called with rcu_state.lock held.
+ */
+static void rcu_report_qs(unsigned int cpu)
+{
+    uint64_t bit = 1ULL << cpu;
+
+    rcu_data[cpu].gp_seen = rcu_state.gp_started;
+    if (!(rcu_state.cpus_pending & bit)) {
+        return;
+    }
+
+    rcu_state.cpus_pending &= ~bit;
+    if (!rcu_state.cpus_pending) {
+        __atomic_store_n(&rcu_state.gp_completed, rcu_state.gp_started, __ATOMIC_RELEASE);
+        rcu_start_gp();
+    }
+}
+
+/**
+ * rcu_accelerate - Give newly queued callbacks a grace period
+ *
+ * Only done while wait is empty, so wait always holds one batch. The
+ * callbacks were queued before the period after gp_started begins, which
+ * makes that one sufficient whether or not a period is running now.
+ */
+static void rcu_accelerate(struct rcu_data *rdp)
+{
+    if (rdp->wait || !rdp->next) {
+        return;
+    }
+
+    rdp->wait = rdp->next;
+    rdp->wait_tail = rdp->next_tail;
+    rdp->next = NULL;
+    rdp->next_tail = &rdp->next;
+
+    spin_lock(&rcu_state.lock);
+    rdp->wait_gp = rcu_state.gp_started + 1;
+    if (rcu_state.gp_requested < rdp->wait_gp) {
+        rcu_state.gp_requested = rdp->wait_gp;
+    }
+    rcu_start_gp();
+    spin_unlock(&rcu_state.lock);
+}
+
+/**
+ * rcu_advance - Move the wait batch to done once its grace period is over
+ */
+static void rcu_advance(struct rcu_data *rdp)
+{
+    if (!rdp->wait ||
+        __atomic_load_n(&rcu_state.gp_completed, __ATOMIC_ACQUIRE) < rdp->wait_gp) {
+        return;
+    }
+
+    *rdp->done_tail = rdp->wait;
+    rdp->done_tail = rdp->wait_tail;
+    rdp->wait = NULL;
+    rdp->wait_tail = &rdp->wait;
+}
+
+/**
+ * rcu_invoke - Run one callback, or kfree the object for kfree_rcu
+ */
+static void rcu_invoke(struct rcu_head *head)
+{
+    uintptr_t offset = (uintptr_t)head->func;
+
+    if (offset < RCU_KFREE_OFFSET_MAX) {
+        kfree((uint8_t *)head - offset);
+    } else {
+        head->func(head);
+    }
+}
+
+/**
+ * rcu_do_batch - Invoke up to RCU_BATCH_LIMIT ready callbacks
+ *
+ * Callbacks run with interrupts enabled. Returns true if any ran.
+ */
+static bool rcu_do_batch(struct rcu_data *rdp)
+{
+    uint64_t flags = cpu_irq_save();
+    struct rcu_head *list = rdp->done;
+    rdp->done = NULL;
+    rdp->done_tail = &rdp->done;
+    cpu_irq_restore(flags);
+
+    if (!list) {
+        return false;
+    }
+
+    for (unsigned int count = 0; list && count < RCU_BATCH_LIMIT; count++) {
+        struct rcu_head *head = list;
+        list = head->next;
+        rcu_invoke(head);
+    }
+
+    /* Put the rest back in front of anything that became ready meanwhile */
+    if (list) {
+        struct rcu_head **tail = &list;
+        while (*tail) {
+            tail = &(*tail)->next;
+        }
+
+        flags = cpu_irq_save();
+        *tail = rdp->done;
+        if (!rdp->done) {
+            rdp->done_tail = tail;
+        }
+        rdp->done = list;
+        cpu_irq_restore(flags);
+    }
+    return true;
+}
+
+/**
+ * rcu_quiescent - Report a quiescent state and process this CPU's callbacks
+ *
+ * Must be called outside any read-side section. The check of gp_seen
+ * only reads shared state, so CPUs that have already reported for the
+ * current period do not touch the lock.
+ */
+static bool rcu_quiescent(void)
+{
+    unsigned int cpu = cpu_current_id();
+    struct rcu_data *rdp = &rcu_data[cpu];
+
+    if (!(rcu_state.cpus_online & (1ULL << cpu))) {
+        return false;
+    }
+
+    uint64_t flags = cpu_irq_save();
+
+    rcu_accelerate(rdp);
+    if (rdp->gp_seen != __atomic_load_n(&rcu_state.gp_started, __ATOMIC_ACQUIRE)) {
+        spin_lock(&rcu_state.lock);
+        rcu_report_qs(cpu);
+        spin_unlock(&rcu_state.lock);
+    }
+    rcu_advance(rdp);
+
+    cpu_irq_restore(flags);
+    return rcu_do_batch(rdp);
+}
+
+/**
+ * rcu_note_context_switch - Quiescent state at a task switch
+ */
+void rcu_note_context_switch(void)
+{
+    rcu_quiescent();
+}
+
+/**
+ * rcu_idle - Quiescent state from the idle loop
+ *
+ * Returns true if callbacks ran, in which case the caller should look for
+ * runnable tasks again instead of halting.
+ */
+bool rcu_idle(void)
+{
+    return rcu_quiescent();
+}
+
+/**
+ * call_rcu - Run @func on @head once all current readers are done
+ *
+ * Safe from interrupt handlers. The callback runs on this CPU, from the
+ * scheduler or the idle loop, with interrupts enabled.
+ */
+void call_rcu(struct rcu_head *head, rcu_callback_t func)
+{
+    struct rcu_data *rdp = &rcu_data[cpu_current_id()];
+
+    head->func = func;
+    head->next = NULL;
+
+    uint64_t flags = cpu_irq_save();
+    *rdp->next_tail = head;
+    rdp->next_tail = &head->next;
+    cpu_irq_restore(flags);
+}
+
+/**
+ * rcu_wakeme - Callback of a synchronize_rcu waiter
+ */
+static void rcu_wakeme(struct rcu_head *head)
+{
+    struct rcu_synchronize *rs = (struct rcu_synchronize *)head;
+
+    __atomic_store_n(&rs->done, true, __ATOMIC_RELEASE);
+    wait_queue_wake_all(&rs->wq);
+}
+
+/**
+ * synchronize_rcu - Wait until every reader that started before returns
+ *
+ * With one CPU online the caller's own call is the only possible reader,
+ * and it is not in a read-side section, so there is nothing to wait for.
+ */
+void synchronize_rcu(void)
+{
+    struct rcu_synchronize rs;
+
+    if (__atomic_load_n(&rcu_state.online_count, __ATOMIC_ACQUIRE) <= 1) {
+        smp_mb();
+        return;
+    }
+
+    rs.done = false;
+    wait_queue_init(&rs.wq);
+    call_rcu(&rs.head, rcu_wakeme);
+
+    while (!__atomic_load_n(&rs.done, __ATOMIC_ACQUIRE)) {
+        /* The idle task cannot block; drive the grace period by hand */
+        if (current_task && current_task->pid != 0) {
+            wait_queue_sleep(&rs.wq);
+        } else {
+            rcu_quiescent();
+            cpu_relax();
+        }
+    }
+}
+
+/**
+ * rcu_cpu_online - Start waiting for @cpu in grace periods
+ *
+ * It joins from the next period on; the one in flight does not wait for it.
+ */
+void rcu_cpu_online(unsigned int cpu)
+{
+    struct rcu_data *rdp = &rcu_data[cpu];
+
+    rdp->done_tail = &rdp->done;
+    rdp->wait_tail = &rdp->wait;
+    rdp->next_tail = &rdp->next;
+
+    uint64_t flags = spin_lock_irqsave(&rcu_state.lock);
+    rdp->gp_seen = rcu_state.gp_started;
+    if (!(rcu_state.cpus_online & (1ULL << cpu))) {
+        rcu_state.cpus_online |= 1ULL << cpu;
+        rcu_state.online_count++;
+    }
+    spin_unlock_irqrestore(&rcu_state.lock, flags);
+}
+
+/**
+ * rcu_init - Bring the boot CPU into RCU
+ */
+int __init rcu_init(void)
+{
+    for (unsigned int cpu = 0; cpu < CPU_MAX; cpu++) {
+        rcu_data[cpu].done_tail = &rcu_data[cpu].done;
+        rcu_data[cpu].wait_tail = &rcu_data[cpu].wait;
+        rcu_data[cpu].next_tail = &rcu_data[cpu].next;
+    }
+
+    rcu_cpu_online(cpu_current_id());
+    return KERNEL_SUCCESS;
+}
+initcall(rcu_init, 0, cpu_registers_init);
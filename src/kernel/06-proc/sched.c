@@ -0,0 +1,232 @@
+/*
+ * Power1 OS - Scheduler
+ * Round-robin run queue and wait queues
+ *
+ * Scheduling is cooperative: tasks switch only when they block, exit or
+ * yield. The idle task runs whenever the run queue is empty and is never
+ * queued itself.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/cpu.h"
+#include "../include/process.h"
+#include "../include/block.h"
+#include "../include/rcu.h"
+#include "../include/timer.h"
+#include "../include/workqueue.h"
+#include "../include/cpuidle.h"
+#include "../include/fpu.h"
+
+extern struct task idle_task;
+
+struct task *current_task = NULL;
+
+static LIST_HEAD(run_queue);
+
+/**
+ * task_enqueue - Make @task runnable
+ */
+void task_enqueue(struct task *task)
+{
+    if (task->worker && task->state == TASK_BLOCKED) {
+        wq_worker_waking(task);
+    }
+    task->state = TASK_READY;
+    list_add_tail(&task->run_list, &run_queue);
+
+    /* The boot CPU serves the run queue; end its idle wait */
+    cpuidle_wake(0);
+}
+
+/**
+ * schedule - Switch to the next runnable task
+ *
+ * A running caller is requeued behind the other runnable tasks; a caller
+ * that has blocked or exited must already have changed its state.
+ */
+void schedule(void)
+{
+    struct task *prev = current_task;
+    struct task *next;
+
+    /* No read-side section spans a switch: a quiescent state */
+    rcu_note_context_switch();
+
+    /* Held I/O must not wait for the task to run again */
+    if (prev->plug) {
+        blk_flush_plug(prev->plug);
+    }
+
+    /* A blocking worker may hand its pool's work to another */
+    if (prev->worker && prev->state == TASK_BLOCKED) {
+        wq_worker_sleeping(prev);
+    }
+
+    if (prev->state == TASK_RUNNING && prev != &idle_task) {
+        task_enqueue(prev);
+    }
+
+    if (list_empty(&run_queue)) {
+        next = &idle_task;
+    } else {
+        next = list_first_entry(&run_queue, struct task, run_list);
+        list_del(&next->run_list);
+    }
+
+    next->state = TASK_RUNNING;
+    if (next == prev) {
+        return;
+    }
+
+    /* Kernel threads run on whatever tables are live */
+    if (next->vm && next->vm != current_vm_space) {
+        vm_space_activate(next->vm);
+    }
+    if (next->kernel_stack) {
+        cpu_set_kernel_stack((uint64_t)next->kernel_stack + KERNEL_STACK_SIZE);
+    }
+
+    current_task = next;
+    fpu_switch(next);
+    switch_context(&prev->context_rsp, next->context_rsp);
+}
+
+/**
+ * schedule_next_task - Yield the CPU to any other runnable task
+ */
+void schedule_next_task(void)
+{
+    schedule();
+}
+
+/**
+ * scheduler_loop - Idle task body
+ */
+void scheduler_loop(void)
+{
+    for (;;) {
+        schedule();
+        cpu_idle();
+    }
+}
+
+/**
+ * wait_queue_init - Initialise an empty wait queue
+ */
+void wait_queue_init(struct wait_queue *wq)
+{
+    list_init(&wq->waiters);
+    list_init(&wq->callbacks);
+}
+
+/**
+ * wait_queue_add_callback - Have @cb run on every wake of @wq
+ */
+void wait_queue_add_callback(struct wait_queue *wq, struct wait_callback *cb)
+{
+    list_add_tail(&cb->entry, &wq->callbacks);
+}
+
+/**
+ * wait_queue_remove_callback - Detach @cb from its queue
+ */
+void wait_queue_remove_callback(struct wait_callback *cb)
+{
+    list_del(&cb->entry);
+}
+
+/**
+ * wait_queue_run_callbacks - Tell every callback entry about a wake
+ *
+ * A callback may remove itself.
+ */
+static void wait_queue_run_callbacks(struct wait_queue *wq)
+{
+    struct list_head *pos, *tmp;
+
+    list_for_each_safe(pos, tmp, &wq->callbacks) {
+        struct wait_callback *cb = list_entry(pos, struct wait_callback, entry);
+        cb->func(cb);
+    }
+}
+
+/**
+ * wait_queue_sleep - Block the current task on @wq until woken
+ *
+ * Callers re-check their condition after returning.
+ */
+void wait_queue_sleep(struct wait_queue *wq)
+{
+    current_task->state = TASK_BLOCKED;
+    list_add_tail(&current_task->run_list, &wq->waiters);
+    schedule();
+}
+
+/**
+ * wait_queue_timeout - Timer callback ending a bounded sleep
+ *
+ * A task that was woken normally is no longer blocked and is left alone.
+ */
+static void wait_queue_timeout(struct timer *timer)
+{
+    struct task *task = timer->data;
+
+    if (task->state == TASK_BLOCKED) {
+        list_del(&task->run_list);
+        task_enqueue(task);
+    }
+}
+
+/**
+ * wait_queue_sleep_timeout - wait_queue_sleep until at most clock_ns() @deadline
+ *
+ * Returns false if the deadline ended the sleep.
+ */
+bool wait_queue_sleep_timeout(struct wait_queue *wq, uint64_t deadline)
+{
+    struct timer timer;
+
+    if (clock_ns() >= deadline) {
+        return false;
+    }
+
+    timer_init(&timer, wait_queue_timeout, current_task);
+    timer_add(&timer, deadline);
+    wait_queue_sleep(wq);
+    return timer_del(&timer);
+}
+
+/**
+ * wait_queue_wake_one - Make the longest waiter runnable
+ *
+ * Callback entries are not counted as waiters; each of them runs.
+ */
+bool wait_queue_wake_one(struct wait_queue *wq)
+{
+    wait_queue_run_callbacks(wq);
+    if (list_empty(&wq->waiters)) {
+        return false;
+    }
+
+    struct task *task = list_first_entry(&wq->waiters, struct task, run_list);
+    list_del(&task->run_list);
+    task_enqueue(task);
+    return true;
+}
+
+/**
+ * wait_queue_wake_all - Make every waiter runnable
+ */
+void wait_queue_wake_all(struct wait_queue *wq)
+{
+    wait_queue_run_callbacks(wq);
+    while (!list_empty(&wq->waiters)) {
+        struct task *task = list_first_entry(&wq->waiters, struct task, run_list);
+        list_del(&task->run_list);
+        task_enqueue(task);
+    }
+}
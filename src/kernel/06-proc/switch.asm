@@ -0,0 +1,34 @@
+; Power1 OS - Context Switch
+; Callee-saved register swap between kernel stacks
+
+[bits 64]
+section .text
+
+extern task_exit
+
+; void switch_context(uint64_t *prev_rsp, uint64_t next_rsp)
+global switch_context
+switch_context:
+    push rbx
+    push rbp
+    push r12
+    push r13
+    push r14
+    push r15
+    mov [rdi], rsp
+    mov rsp, rsi
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop rbp
+    pop rbx
+    ret
+
+; First run of a kernel thread: r12 = entry function, r13 = argument
+global kthread_trampoline
+kthread_trampoline:
+    mov rdi, r13
+    call r12
+    mov edi, eax
+    call task_exit                  ; Does not return
@@ -0,0 +1,184 @@
+/*
+ * Power1 OS - Tasks
+ * Task allocation, kernel threads and the initial context of new tasks
+ *
+ * Every task owns a kernel stack. A task that has never run is given a
+ * stack that looks as if it had called switch_context itself, so the first
+ * switch to it "returns" into either kthread_trampoline or syscall_return.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/fs.h"
+#include "../include/process.h"
+#include "../include/syscall.h"
+#include "../include/string.h"
+#include "../include/fpu.h"
+#include "../include/init.h"
+
+/* Registers popped by switch_context: r15, r14, r13, r12, rbp, rbx */
+#define SWITCH_FRAME_WORDS      6
+
+/* Low-level user return path (entry.asm) */
+extern void syscall_return(void);
+
+static LIST_HEAD(task_list);
+static uint32_t next_pid = 1;
+
+/* The boot context becomes pid 0, the idle task */
+struct task idle_task;
+
+/**
+ * task_stack_top - First address above a task's kernel stack
+ */
+static inline uint64_t *task_stack_top(struct task *task)
+{
+    return (uint64_t *)((uint8_t *)task->kernel_stack + KERNEL_STACK_SIZE);
+}
+
+/**
+ * task_init_common - Initialise the list heads and queues of a task
+ */
+static void task_init_common(struct task *task, const char *name)
+{
+    list_init(&task->children);
+    list_init(&task->sibling);
+    list_init(&task->run_list);
+    wait_queue_init(&task->child_exit);
+    wait_queue_init(&task->vfork_done);
+    strncpy(task->name, name, TASK_NAME_LEN - 1);
+    list_add_tail(&task->all_list, &task_list);
+}
+
+/**
+ * task_alloc - Allocate a task with a fresh pid and kernel stack
+ *
+ * The task is not runnable until its context is prepared and it is
+ * passed to task_enqueue.
+ */
+struct task *task_alloc(const char *name)
+{
+    struct task *task = kzalloc(sizeof(*task));
+    if (!task) {
+        return NULL;
+    }
+
+    struct page *stack = page_alloc(pmem_order_for(KERNEL_STACK_SIZE / PAGE_SIZE), 0);
+    if (!stack) {
+        kfree(task);
+        return NULL;
+    }
+
+    task->kernel_stack = page_address(stack);
+    task->pid = next_pid++;
+    task->state = TASK_READY;
+    task_init_common(task, name);
+    return task;
+}
+
+/**
+ * task_free - Release a reaped task and its kernel stack
+ */
+void task_free(struct task *task)
+{
+    list_del(&task->all_list);
+    fpu_release(task);
+    page_free(virt_to_page(task->kernel_stack), pmem_order_for(KERNEL_STACK_SIZE / PAGE_SIZE));
+    kfree(task);
+}
+
+/**
+ * task_find - Look a task up by pid
+ */
+struct task *task_find(uint32_t pid)
+{
+    struct list_head *node;
+
+    list_for_each(node, &task_list) {
+        struct task *task = list_entry(node, struct task, all_list);
+        if (task->pid == pid) {
+            return task;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * task_push_switch_frame - Seed the registers switch_context restores
+ * @sp: Stack pointer just below the return address
+ */
+static void task_push_switch_frame(struct task *task, uint64_t *sp,
+                                   uint64_t r12, uint64_t r13)
+{
+    *--sp = 0;              /* rbx */
+    *--sp = 0;              /* rbp */
+    *--sp = r12;
+    *--sp = r13;
+    *--sp = 0;              /* r14 */
+    *--sp = 0;              /* r15 */
+    task->context_rsp = (uint64_t)sp;
+}
+
+/**
+ * kthread_create - Start a kernel thread running @fn(@arg)
+ *
+ * The thread exits with @fn's return value when @fn returns.
+ */
+struct task *kthread_create(const char *name, int (*fn)(void *), void *arg)
+{
+    struct task *task = task_alloc(name);
+    if (!task) {
+        return NULL;
+    }
+
+    /* Keep rsp 16-byte aligned once the trampoline address is popped */
+    uint64_t *sp = task_stack_top(task) - 2;
+    *--sp = (uint64_t)kthread_trampoline;
+    task_push_switch_frame(task, sp, (uint64_t)fn, (uint64_t)arg);
+
+    task->flags |= TASK_KTHREAD;
+    task->parent = &idle_task;
+    list_add_tail(&task->sibling, &idle_task.children);
+    task_enqueue(task);
+    return task;
+}
+
+/**
+ * task_prepare_user_return - Make @task resume in user mode with @frame
+ *
+ * The frame is copied to the top of the task's kernel stack, where
+ * syscall_return expects it, and becomes the task's user_frame.
+ */
+void task_prepare_user_return(struct task *task, const struct syscall_frame *frame)
+{
+    uint64_t *sp = task_stack_top(task) - sizeof(*frame) / sizeof(uint64_t);
+    struct syscall_frame *copy = (struct syscall_frame *)sp;
+
+    *copy = *frame;
+    task->user_frame = copy;
+
+    *--sp = (uint64_t)syscall_return;
+    task_push_switch_frame(task, sp, 0, 0);
+}
+
+/**
+ * process_manager_init - Turn the boot context into the idle task
+ */
+int __init process_manager_init(void)
+{
+    idle_task.pid = 0;
+    idle_task.state = TASK_RUNNING;
+    idle_task.flags = TASK_KTHREAD;
+    idle_task.files = fd_table_create();
+    if (!idle_task.files) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    task_init_common(&idle_task, "idle");
+    current_task = &idle_task;
+    return KERNEL_SUCCESS;
+}
+initcall(process_manager_init, 0, memory_manager_init);
@@ -0,0 +1,381 @@
+/*
+ * Power1 OS - Workqueues
+ * Concurrency-managed worker pools, one per CPU
+ *
+ * A pool counts its workers that are running work and not blocked. The
+ * scheduler reports a worker blocking inside a work function and its
+ * wake-up, so the count is exact: when it drops to zero with work left,
+ * an idle worker is woken, and a worker finding it non-zero goes idle.
+ * The pool therefore uses one thread's worth of CPU however much work is
+ * queued, and only grows when work functions sleep. The worker about to
+ * run the last idle one's share first starts a spare, so a blocking work
+ * function always has someone to hand over to, up to WQ_MAX_WORKERS.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/cpu.h"
+#include "../include/interrupts.h"
+#include "../include/spinlock.h"
+#include "../include/process.h"
+#include "../include/workqueue.h"
+#include "../include/init.h"
+
+struct worker_pool;
+
+struct worker {
+    struct list_head entry;         /* In the pool's worker list */
+    struct task *task;
+    struct worker_pool *pool;
+    struct work_struct *current;    /* Item being run, or NULL */
+    bool sleeping;                  /* Blocked inside a work function */
+};
+
+struct worker_pool {
+    spinlock_t lock;
+    unsigned int cpu;
+    struct list_head worklist;
+    struct list_head workers;
+    struct wait_queue idle_wait;    /* Idle workers */
+    struct wait_queue done_wait;    /* flush_work callers */
+    unsigned int nr_workers;
+    unsigned int nr_idle;
+    unsigned int nr_running;
+    bool spawning;
+} __attribute__((aligned(64)));
+
+static struct worker_pool worker_pools[CPU_MAX];
+static unsigned int wq_nr_pools = 0;
+
+struct workqueue *system_wq = NULL;
+
+static int worker_thread(void *arg);
+
+/**
+ * worker_create - Start another worker in @pool
+ */
+static struct worker *worker_create(struct worker_pool *pool)
+{
+    struct worker *worker = kzalloc(sizeof(*worker));
+    if (!worker) {
+        return NULL;
+    }
+    worker->pool = pool;
+
+    worker->task = kthread_create("kworker", worker_thread, worker);
+    if (!worker->task) {
+        kfree(worker);
+        return NULL;
+    }
+
+    /* Not run before the creator yields, so this is in time */
+    worker->task->worker = worker;
+
+    /* Counted idle until it first looks for work */
+    uint64_t flags = spin_lock_irqsave(&pool->lock);
+    list_add_tail(&worker->entry, &pool->workers);
+    pool->nr_workers++;
+    pool->nr_idle++;
+    spin_unlock_irqrestore(&pool->lock, flags);
+    return worker;
+}
+
+/**
+ * worker_take_batch - Move the first item and others with its function
+ *
+ * Same-function items further back are taken too, up to WQ_BATCH_MAX, so
+ * they run back to back with their code and data still cached. They stay
+ * WORK_PENDING while on @batch, so nothing can queue them a second time
+ * until worker_run_batch has unlinked them.
+ */
+static void worker_take_batch(struct worker_pool *pool, struct list_head *batch)
+{
+    struct work_struct *first = list_first_entry(&pool->worklist, struct work_struct, entry);
+    struct list_head *pos, *tmp;
+    unsigned int taken = 0;
+    unsigned int scanned = 0;
+
+    list_for_each_safe(pos, tmp, &pool->worklist) {
+        struct work_struct *work = list_entry(pos, struct work_struct, entry);
+
+        if (scanned++ == WQ_BATCH_SCAN || taken == WQ_BATCH_MAX) {
+            break;
+        }
+        if (work->func == first->func) {
+            list_del(&work->entry);
+            list_add_tail(&work->entry, batch);
+            taken++;
+        }
+    }
+}
+
+/**
+ * worker_run_batch - Run the items on @batch; the pool lock is not held
+ */
+static void worker_run_batch(struct worker *worker, struct list_head *batch)
+{
+    while (!list_empty(batch)) {
+        struct work_struct *work = list_first_entry(batch, struct work_struct, entry);
+        struct workqueue *wq = work->wq;
+
+        /* Off every list now: from here the function may free or requeue it */
+        list_del(&work->entry);
+        worker->current = work;
+        __atomic_and_fetch(&work->flags, ~WORK_PENDING, __ATOMIC_RELEASE);
+        work->func(work);
+        worker->current = NULL;
+
+        if (atomic_add_return(&wq->nr_pending, -1) == 0) {
+            wait_queue_wake_all(&wq->flush_wait);
+        }
+    }
+}
+
+/**
+ * worker_thread - Worker body: run batches while no other worker runs
+ */
+static int worker_thread(void *arg)
+{
+    struct worker *worker = arg;
+    struct worker_pool *pool = worker->pool;
+    LIST_HEAD(batch);
+
+    uint64_t flags = spin_lock_irqsave(&pool->lock);
+    pool->nr_idle--;
+    for (;;) {
+        if (list_empty(&pool->worklist) || pool->nr_running) {
+            if (pool->nr_idle >= WQ_IDLE_MAX) {
+                break;
+            }
+            pool->nr_idle++;
+            spin_unlock_irqrestore(&pool->lock, flags);
+            wait_queue_sleep(&pool->idle_wait);
+            flags = spin_lock_irqsave(&pool->lock);
+            pool->nr_idle--;
+            continue;
+        }
+
+        /* Keep a spare to take over should this worker block */
+        if (!pool->nr_idle && !pool->spawning && pool->nr_workers < WQ_MAX_WORKERS) {
+            pool->spawning = true;
+            spin_unlock_irqrestore(&pool->lock, flags);
+            worker_create(pool);
+            flags = spin_lock_irqsave(&pool->lock);
+            pool->spawning = false;
+            continue;
+        }
+
+        pool->nr_running++;
+        worker_take_batch(pool, &batch);
+        spin_unlock_irqrestore(&pool->lock, flags);
+
+        worker_run_batch(worker, &batch);
+
+        /* Woken flush_work callers may be workers, whose hook takes the lock */
+        wait_queue_wake_all(&pool->done_wait);
+        flags = spin_lock_irqsave(&pool->lock);
+        pool->nr_running--;
+    }
+
+    /* Surplus idle worker */
+    list_del(&worker->entry);
+    pool->nr_workers--;
+    worker->task->worker = NULL;
+    spin_unlock_irqrestore(&pool->lock, flags);
+    kfree(worker);
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * wq_worker_sleeping - Scheduler hook: @task blocks
+ *
+ * A worker blocking inside a work function stops counting as running;
+ * if that leaves queued work with no runner, an idle worker takes over.
+ */
+void wq_worker_sleeping(struct task *task)
+{
+    struct worker *worker = task->worker;
+
+    if (!worker->current) {
+        return;
+    }
+
+    struct worker_pool *pool = worker->pool;
+    uint64_t flags = spin_lock_irqsave(&pool->lock);
+    worker->sleeping = true;
+    bool wake = --pool->nr_running == 0 && !list_empty(&pool->worklist);
+    spin_unlock_irqrestore(&pool->lock, flags);
+
+    if (wake) {
+        wait_queue_wake_one(&pool->idle_wait);
+    }
+}
+
+/**
+ * wq_worker_waking - Scheduler hook: @task becomes runnable
+ */
+void wq_worker_waking(struct task *task)
+{
+    struct worker *worker = task->worker;
+
+    if (!worker->sleeping) {
+        return;
+    }
+
+    struct worker_pool *pool = worker->pool;
+    uint64_t flags = spin_lock_irqsave(&pool->lock);
+    worker->sleeping = false;
+    pool->nr_running++;
+    spin_unlock_irqrestore(&pool->lock, flags);
+}
+
+/**
+ * work_init - Prepare @work to run @func
+ */
+void work_init(struct work_struct *work, work_func_t func)
+{
+    list_init(&work->entry);
+    work->func = func;
+    work->wq = NULL;
+    work->flags = 0;
+}
+
+/**
+ * queue_work_on - Queue @work on @cpu's pool unless it is already queued
+ *
+ * Returns false if @work was still pending. An item queued again while it
+ * runs runs again afterwards.
+ */
+bool queue_work_on(unsigned int cpu, struct workqueue *wq, struct work_struct *work)
+{
+    if (__atomic_fetch_or(&work->flags, WORK_PENDING, __ATOMIC_ACQ_REL) & WORK_PENDING) {
+        return false;
+    }
+    if (cpu >= wq_nr_pools) {
+        cpu = cpu_current_id();
+    }
+
+    struct worker_pool *pool = &worker_pools[cpu];
+    work->wq = wq;
+    atomic_inc(&wq->nr_pending);
+
+    uint64_t flags = spin_lock_irqsave(&pool->lock);
+    list_add_tail(&work->entry, &pool->worklist);
+    bool wake = !pool->nr_running;
+    spin_unlock_irqrestore(&pool->lock, flags);
+
+    if (wake) {
+        wait_queue_wake_one(&pool->idle_wait);
+    }
+    return true;
+}
+
+/**
+ * queue_work - Queue @work on the current CPU
+ */
+bool queue_work(struct workqueue *wq, struct work_struct *work)
+{
+    return queue_work_on(cpu_current_id(), wq, work);
+}
+
+/**
+ * flush_workqueue - Wait until every item queued on @wq has run
+ *
+ * Must not be called from a work item of @wq.
+ */
+void flush_workqueue(struct workqueue *wq)
+{
+    while (atomic_read(&wq->nr_pending)) {
+        wait_queue_sleep(&wq->flush_wait);
+    }
+}
+
+/**
+ * work_busy - @work is queued or being run by a worker of @pool
+ */
+static bool work_busy(struct worker_pool *pool, struct work_struct *work)
+{
+    struct list_head *pos;
+
+    if (__atomic_load_n(&work->flags, __ATOMIC_ACQUIRE) & WORK_PENDING) {
+        return true;
+    }
+    list_for_each(pos, &pool->workers) {
+        if (list_entry(pos, struct worker, entry)->current == work) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * flush_work - Wait until @work is neither queued nor running
+ */
+void flush_work(struct work_struct *work)
+{
+    for (unsigned int cpu = 0; cpu < wq_nr_pools; cpu++) {
+        struct worker_pool *pool = &worker_pools[cpu];
+
+        uint64_t flags = spin_lock_irqsave(&pool->lock);
+        while (work_busy(pool, work)) {
+            spin_unlock_irqrestore(&pool->lock, flags);
+            wait_queue_sleep(&pool->done_wait);
+            flags = spin_lock_irqsave(&pool->lock);
+        }
+        spin_unlock_irqrestore(&pool->lock, flags);
+    }
+}
+
+/**
+ * alloc_workqueue - Create a workqueue for flushing a group of items
+ */
+struct workqueue *alloc_workqueue(const char *name)
+{
+    struct workqueue *wq = kzalloc(sizeof(*wq));
+    if (!wq) {
+        return NULL;
+    }
+
+    wq->name = name;
+    atomic_set(&wq->nr_pending, 0);
+    wait_queue_init(&wq->flush_wait);
+    return wq;
+}
+
+/**
+ * destroy_workqueue - Flush @wq and free it
+ */
+void destroy_workqueue(struct workqueue *wq)
+{
+    flush_workqueue(wq);
+    kfree(wq);
+}
+
+/**
+ * workqueue_init - Create a worker pool per online CPU and the system workqueue
+ */
+int __init workqueue_init(void)
+{
+    wq_nr_pools = MIN(lapic_online_count(), CPU_MAX);
+    for (unsigned int cpu = 0; cpu < wq_nr_pools; cpu++) {
+        struct worker_pool *pool = &worker_pools[cpu];
+
+        spin_lock_init(&pool->lock);
+        pool->cpu = cpu;
+        list_init(&pool->worklist);
+        list_init(&pool->workers);
+        wait_queue_init(&pool->idle_wait);
+        wait_queue_init(&pool->done_wait);
+
+        if (!worker_create(pool)) {
+            return KERNEL_ERROR_NOMEM;
+        }
+    }
+
+    system_wq = alloc_workqueue("events");
+    return system_wq ? KERNEL_SUCCESS : KERNEL_ERROR_NOMEM;
+}
+initcall(workqueue_init, 0, process_manager_init);
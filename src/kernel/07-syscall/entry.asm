@@ -0,0 +1,59 @@
+; Power1 OS - System Call Entry
+; SYSCALL lands here with the user rip in rcx and rflags in r11. The stub
+; switches to the task's kernel stack, saves a struct syscall_frame
+; (rax first, rflags last) and calls syscall_handler. syscall_return is
+; also the first instruction run by a newly forked or spawned task.
+
+[bits 64]
+section .text
+
+extern syscall_handler
+extern syscall_kernel_rsp
+extern syscall_user_rsp
+
+global syscall_entry
+syscall_entry:
+    mov [rel syscall_user_rsp], rsp
+    mov rsp, [rel syscall_kernel_rsp]
+
+    push r11                        ; rflags
+    push rcx                        ; rip
+    push r15
+    push r14
+    push r13
+    push r12
+    push r11
+    push r10
+    push r9
+    push r8
+    push qword [rel syscall_user_rsp]
+    push rbp
+    push rdi
+    push rsi
+    push rdx
+    push rcx
+    push rbx
+    push rax
+
+    mov rdi, rsp                    ; struct syscall_frame *
+    call syscall_handler
+
+global syscall_return
+syscall_return:
+    mov rax, [rsp + 0]
+    mov rbx, [rsp + 8]
+    mov rdx, [rsp + 24]
+    mov rsi, [rsp + 32]
+    mov rdi, [rsp + 40]
+    mov rbp, [rsp + 48]
+    mov r8,  [rsp + 64]
+    mov r9,  [rsp + 72]
+    mov r10, [rsp + 80]
+    mov r12, [rsp + 96]
+    mov r13, [rsp + 104]
+    mov r14, [rsp + 112]
+    mov r15, [rsp + 120]
+    mov rcx, [rsp + 128]            ; rip
+    mov r11, [rsp + 136]            ; rflags
+    mov rsp, [rsp + 56]             ; user rsp
+    o64 sysret
@@ -0,0 +1,335 @@
+/*
+ * Power1 OS - File System Calls
+ * Descriptor I/O, pipes, splice, sendfile, channels, poll and epoll
+ *
+ * User buffers are checked against the caller's VMAs and then accessed in
+ * place, so read and write copy once, between the file and user memory.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/fs.h"
+#include "../include/syscall.h"
+#include "../include/channel.h"
+#include "../include/poll.h"
+
+/**
+ * sys_read - Read from a descriptor into user memory
+ */
+uint64_t sys_read(int fd, void *buf, size_t count)
+{
+    struct file_descriptor *file = fd_get(fd);
+
+    if (!file) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_BADF;
+    }
+    if (!user_range_ok((uint64_t)buf, count, true)) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_FAULT;
+    }
+    return (uint64_t)(int64_t)vfs_read(file, buf, count);
+}
+
+/**
+ * sys_write - Write user memory to a descriptor
+ */
+uint64_t sys_write(int fd, const void *buf, size_t count)
+{
+    struct file_descriptor *file = fd_get(fd);
+
+    if (!file) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_BADF;
+    }
+    if (!user_range_ok((uint64_t)buf, count, false)) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_FAULT;
+    }
+    return (uint64_t)(int64_t)vfs_write(file, buf, count);
+}
+
+/**
+ * sys_open - Open a path, returning the lowest free descriptor
+ * @mode: Unused; files cannot be created
+ */
+uint64_t sys_open(const char *pathname, int flags, int mode)
+{
+    char path[PATH_MAX];
+    (void)mode;
+
+    if (strncpy_from_user(path, pathname, sizeof(path)) < 0) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_FAULT;
+    }
+
+    struct file_descriptor *file = vfs_open(path, flags);
+    if (!file) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_NOTFOUND;
+    }
+
+    int fd = fd_install(file);
+    if (fd < 0) {
+        file_put(file);
+    }
+    return (uint64_t)(int64_t)fd;
+}
+
+/**
+ * sys_close - Release a descriptor
+ */
+uint64_t sys_close(int fd)
+{
+    struct file_descriptor *file = fd_remove(fd);
+
+    if (!file) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_BADF;
+    }
+    file_put(file);
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * sys_pipe - Create a pipe, storing its read and write descriptors
+ */
+uint64_t sys_pipe(int *fds)
+{
+    struct file_descriptor *ends[2];
+    int numbers[2];
+
+    if (!user_range_ok((uint64_t)fds, sizeof(numbers), true)) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_FAULT;
+    }
+
+    int ret = pipe_create(ends, 0);
+    if (ret < 0) {
+        return (uint64_t)(int64_t)ret;
+    }
+
+    numbers[0] = fd_install(ends[0]);
+    numbers[1] = numbers[0] < 0 ? numbers[0] : fd_install(ends[1]);
+    if (numbers[1] < 0) {
+        if (numbers[0] >= 0) {
+            fd_remove(numbers[0]);
+        }
+        file_put(ends[0]);
+        file_put(ends[1]);
+        return (uint64_t)(int64_t)numbers[1];
+    }
+
+    if (copy_to_user(fds, numbers, sizeof(numbers)) != KERNEL_SUCCESS) {
+        file_put(fd_remove(numbers[0]));
+        file_put(fd_remove(numbers[1]));
+        return (uint64_t)(int64_t)KERNEL_ERROR_FAULT;
+    }
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * splice_offset_in - Fetch an optional user file position
+ */
+static int splice_offset_in(const int64_t *user_off, uint64_t *offset)
+{
+    int64_t value;
+
+    if (copy_from_user(&value, user_off, sizeof(value)) != KERNEL_SUCCESS) {
+        return KERNEL_ERROR_FAULT;
+    }
+    if (value < 0) {
+        return KERNEL_ERROR_INVALID;
+    }
+    *offset = (uint64_t)value;
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * sys_splice - Move data between a pipe and another descriptor
+ * @off_in: Position to read a non-pipe input at, updated on return, or
+ *          NULL to use and advance its file offset
+ * @off_out: Likewise for a non-pipe output
+ */
+uint64_t sys_splice(int fd_in, int64_t *off_in, int fd_out, int64_t *off_out,
+                    size_t len, unsigned int flags)
+{
+    struct file_descriptor *in = fd_get(fd_in);
+    struct file_descriptor *out = fd_get(fd_out);
+    uint64_t pos_in = 0;
+    uint64_t pos_out = 0;
+    int ret;
+
+    if (!in || !out) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_BADF;
+    }
+    if (off_in && (ret = splice_offset_in(off_in, &pos_in)) < 0) {
+        return (uint64_t)(int64_t)ret;
+    }
+    if (off_out && (ret = splice_offset_in(off_out, &pos_out)) < 0) {
+        return (uint64_t)(int64_t)ret;
+    }
+
+    ssize_t done = do_splice(in, off_in ? &pos_in : NULL, out, off_out ? &pos_out : NULL,
+                             len, flags);
+    if (done > 0) {
+        if (off_in && copy_to_user(off_in, &pos_in, sizeof(pos_in)) != KERNEL_SUCCESS) {
+            return (uint64_t)(int64_t)KERNEL_ERROR_FAULT;
+        }
+        if (off_out && copy_to_user(off_out, &pos_out, sizeof(pos_out)) != KERNEL_SUCCESS) {
+            return (uint64_t)(int64_t)KERNEL_ERROR_FAULT;
+        }
+    }
+    return (uint64_t)(int64_t)done;
+}
+
+/**
+ * sys_sendfile - Copy file data to another descriptor inside the kernel
+ * @offset: Position in @in_fd, updated on return, or NULL to use and
+ *          advance its file offset
+ */
+uint64_t sys_sendfile(int out_fd, int in_fd, int64_t *offset, size_t count)
+{
+    struct file_descriptor *in = fd_get(in_fd);
+    struct file_descriptor *out = fd_get(out_fd);
+    uint64_t pos = 0;
+    int ret;
+
+    if (!in || !out) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_BADF;
+    }
+    if (offset && (ret = splice_offset_in(offset, &pos)) < 0) {
+        return (uint64_t)(int64_t)ret;
+    }
+
+    ssize_t done = do_sendfile(out, in, offset ? &pos : NULL, count);
+    if (done > 0 && offset && copy_to_user(offset, &pos, sizeof(pos)) != KERNEL_SUCCESS) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_FAULT;
+    }
+    return (uint64_t)(int64_t)done;
+}
+
+/**
+ * sys_channel_create - Create a shared-memory channel and open it
+ * @name: User string naming it under /ipc, or NULL for an unnamed channel
+ *
+ * Returns a descriptor to mmap() with MAP_SHARED; the header at offset 0
+ * describes the ring.
+ */
+uint64_t sys_channel_create(const char *name, uint32_t payload_size, uint32_t slot_count,
+                            uint32_t flags)
+{
+    char path[PATH_MAX];
+    struct file_descriptor *file;
+
+    if (name && strncpy_from_user(path, name, sizeof(path)) < 0) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_FAULT;
+    }
+
+    int ret = channel_create(name ? path : NULL, payload_size, slot_count, flags, &file);
+    if (ret < 0) {
+        return (uint64_t)(int64_t)ret;
+    }
+
+    int fd = fd_install(file);
+    if (fd < 0) {
+        file_put(file);
+    }
+    return (uint64_t)(int64_t)fd;
+}
+
+/**
+ * sys_poll - Wait for readiness on a set of descriptors
+ * @timeout: Milliseconds; negative waits indefinitely
+ */
+uint64_t sys_poll(struct pollfd *fds, uint32_t nfds, int timeout)
+{
+    size_t size = (size_t)nfds * sizeof(struct pollfd);
+
+    if (nfds > POLL_FDS_MAX) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_INVALID;
+    }
+    if (!user_range_ok((uint64_t)fds, size, true)) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_FAULT;
+    }
+
+    struct pollfd *kfds = kmalloc(size ? size : sizeof(*kfds));
+    if (!kfds) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_NOMEM;
+    }
+    if (copy_from_user(kfds, fds, size) != KERNEL_SUCCESS) {
+        kfree(kfds);
+        return (uint64_t)(int64_t)KERNEL_ERROR_FAULT;
+    }
+
+    int64_t ret = do_poll(kfds, nfds, timeout);
+    if (ret >= 0 && copy_to_user(fds, kfds, size) != KERNEL_SUCCESS) {
+        ret = KERNEL_ERROR_FAULT;
+    }
+    kfree(kfds);
+    return (uint64_t)ret;
+}
+
+/**
+ * sys_epoll_create - Open a new epoll instance
+ * @size: Ignored beyond being positive
+ */
+uint64_t sys_epoll_create(int size)
+{
+    struct file_descriptor *file;
+
+    if (size <= 0) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_INVALID;
+    }
+
+    int ret = eventpoll_create(&file);
+    if (ret < 0) {
+        return (uint64_t)(int64_t)ret;
+    }
+
+    int fd = fd_install(file);
+    if (fd < 0) {
+        file_put(file);
+    }
+    return (uint64_t)(int64_t)fd;
+}
+
+/**
+ * sys_epoll_ctl - Change the interest set of @epfd
+ */
+uint64_t sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+    struct epoll_event kevent;
+
+    if (op != EPOLL_CTL_DEL &&
+        copy_from_user(&kevent, event, sizeof(kevent)) != KERNEL_SUCCESS) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_FAULT;
+    }
+    return (uint64_t)(int64_t)eventpoll_ctl(fd_get(epfd), op, fd,
+                                            op != EPOLL_CTL_DEL ? &kevent : NULL);
+}
+
+/**
+ * sys_epoll_wait - Wait for events on @epfd
+ * @timeout: Milliseconds; negative waits indefinitely
+ */
+uint64_t sys_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+    if (maxevents <= 0) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_INVALID;
+    }
+    maxevents = MIN(maxevents, EPOLL_EVENTS_MAX);
+
+    size_t size = (size_t)maxevents * sizeof(struct epoll_event);
+    if (!user_range_ok((uint64_t)events, size, true)) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_FAULT;
+    }
+
+    struct epoll_event *kevents = kmalloc(size);
+    if (!kevents) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_NOMEM;
+    }
+
+    int64_t ret = eventpoll_wait(fd_get(epfd), kevents, maxevents, timeout);
+    if (ret > 0 &&
+        copy_to_user(events, kevents, (size_t)ret * sizeof(struct epoll_event)) != KERNEL_SUCCESS) {
+        ret = KERNEL_ERROR_FAULT;
+    }
+    kfree(kevents);
+    return (uint64_t)ret;
+}
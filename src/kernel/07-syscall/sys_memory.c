@@ -0,0 +1,88 @@
+/*
+ * Power1 OS - Memory System Calls
+ * mmap and munmap on the current address space, NUMA memory policy
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/fs.h"
+#include "../include/syscall.h"
+#include "../include/process.h"
+#include "../include/numa.h"
+
+/**
+ * sys_mmap - Map anonymous memory or a file into the caller
+ */
+uint64_t sys_mmap(void *addr, size_t length, int prot, int flags, int fd, uint64_t offset)
+{
+    struct inode *inode = NULL;
+
+    if (!current_vm_space) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_INVALID;
+    }
+
+    if (!(flags & MAP_ANONYMOUS)) {
+        struct file_descriptor *file = fd_get(fd);
+        if (!file || !file->inode) {
+            return (uint64_t)(int64_t)KERNEL_ERROR_BADF;
+        }
+
+        /* The mapping may never grant more than the descriptor does */
+        uint32_t mode = file->flags & O_ACCMODE;
+        if (mode == O_WRONLY) {
+            return (uint64_t)(int64_t)KERNEL_ERROR_PERM;
+        }
+        if ((flags & MAP_SHARED) && (prot & PROT_WRITE) && mode != O_RDWR) {
+            return (uint64_t)(int64_t)KERNEL_ERROR_PERM;
+        }
+        inode = file->inode;
+    }
+
+    return (uint64_t)vm_mmap(current_vm_space, (uint64_t)addr, length,
+                             prot, flags, inode, offset);
+}
+
+/**
+ * sys_munmap - Remove mappings from the caller
+ */
+uint64_t sys_munmap(void *addr, size_t length)
+{
+    if (!current_vm_space) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_INVALID;
+    }
+    return (uint64_t)(int64_t)vm_munmap(current_vm_space, (uint64_t)addr, length);
+}
+
+/**
+ * sys_set_mempolicy - Choose the nodes the caller's pages come from
+ * @nodemask: User bitmap of @maxnode bits; only the first word is read,
+ *            since there are at most NUMA_MAX_NODES nodes
+ *
+ * Applies to allocations made after the call, and is inherited by fork.
+ */
+uint64_t sys_set_mempolicy(int mode, const unsigned long *nodemask, unsigned long maxnode)
+{
+    unsigned long nodes = 0;
+
+    if (mode < 0) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_INVALID;
+    }
+
+    if (mode != MPOL_DEFAULT) {
+        if (!nodemask || !maxnode) {
+            return (uint64_t)(int64_t)KERNEL_ERROR_INVALID;
+        }
+        if (copy_from_user(&nodes, nodemask, sizeof(nodes)) != KERNEL_SUCCESS) {
+            return (uint64_t)(int64_t)KERNEL_ERROR_FAULT;
+        }
+        if (maxnode < 8 * sizeof(nodes)) {
+            nodes &= (1UL << maxnode) - 1;
+        }
+    }
+
+    return (uint64_t)(int64_t)mempolicy_set(&current_task->mempolicy, (uint32_t)mode,
+                                            (uint32_t)nodes);
+}
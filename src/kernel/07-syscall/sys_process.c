@@ -0,0 +1,210 @@
+/*
+ * Power1 OS - Process System Calls
+ * exit, fork, vfork, execve, spawn, waitpid, getpid and futex
+ *
+ * User argument vectors are copied into kernel memory before the process
+ * layer sees them: execve destroys the address space they live in.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/process.h"
+#include "../include/syscall.h"
+#include "../include/string.h"
+#include "../include/timer.h"
+#include "../include/futex.h"
+
+/* Longest single argument or environment string accepted */
+#define EXEC_STRING_MAX         PAGE_SIZE
+
+/**
+ * exec_vector_free - Release a vector built by exec_vector_copy
+ */
+static void exec_vector_free(char **vector)
+{
+    if (!vector) {
+        return;
+    }
+    for (int i = 0; vector[i]; i++) {
+        kfree(vector[i]);
+    }
+    kfree(vector);
+}
+
+/**
+ * exec_string_copy - Duplicate a user string into the kernel heap
+ */
+static char *exec_string_copy(const char *user_string, char *scratch)
+{
+    int64_t length = strncpy_from_user(scratch, user_string, EXEC_STRING_MAX);
+    if (length < 0) {
+        return NULL;
+    }
+
+    char *copy = kmalloc((size_t)length + 1);
+    if (copy) {
+        memcpy(copy, scratch, (size_t)length + 1);
+    }
+    return copy;
+}
+
+/**
+ * exec_vector_copy - Duplicate a NULL-terminated user string vector
+ */
+static int exec_vector_copy(char *const *user_vector, char *scratch, char ***out)
+{
+    char **vector = kzalloc((EXEC_ARG_MAX + 1) * sizeof(char *));
+    if (!vector) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    for (int i = 0; user_vector; i++) {
+        char *user_string;
+
+        if (copy_from_user(&user_string, &user_vector[i], sizeof(user_string)) != KERNEL_SUCCESS) {
+            exec_vector_free(vector);
+            return KERNEL_ERROR_FAULT;
+        }
+        if (!user_string) {
+            break;
+        }
+        if (i == EXEC_ARG_MAX) {
+            exec_vector_free(vector);
+            return KERNEL_ERROR_INVALID;
+        }
+
+        vector[i] = exec_string_copy(user_string, scratch);
+        if (!vector[i]) {
+            exec_vector_free(vector);
+            return KERNEL_ERROR_FAULT;
+        }
+    }
+
+    *out = vector;
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * exec_run - Copy execve/spawn arguments in and run @spawn or exec
+ */
+static int64_t exec_run(const char *user_path, char *const *user_argv,
+                        char *const *user_envp, bool spawn)
+{
+    char **argv = NULL, **envp = NULL;
+    char *path = NULL;
+    int64_t ret;
+
+    struct page *scratch_page = page_alloc(0, 0);
+    if (!scratch_page) {
+        return KERNEL_ERROR_NOMEM;
+    }
+    char *scratch = page_address(scratch_page);
+
+    path = exec_string_copy(user_path, scratch);
+    ret = path ? exec_vector_copy(user_argv, scratch, &argv) : KERNEL_ERROR_FAULT;
+    if (ret == KERNEL_SUCCESS) {
+        ret = exec_vector_copy(user_envp, scratch, &envp);
+    }
+    page_free(scratch_page, 0);
+
+    if (ret == KERNEL_SUCCESS) {
+        ret = spawn ? process_spawn(path, argv, envp) : process_exec(path, argv, envp);
+    }
+
+    exec_vector_free(envp);
+    exec_vector_free(argv);
+    kfree(path);
+    return ret;
+}
+
+/**
+ * sys_exit - Terminate the calling process
+ */
+uint64_t sys_exit(int status)
+{
+    task_exit(TASK_WSTATUS_EXIT(status));
+}
+
+/**
+ * sys_fork - Duplicate the caller copy-on-write
+ */
+uint64_t sys_fork(void)
+{
+    return (uint64_t)process_fork(false);
+}
+
+/**
+ * sys_vfork - Create a child that borrows the caller's address space
+ */
+uint64_t sys_vfork(void)
+{
+    return (uint64_t)process_fork(true);
+}
+
+/**
+ * sys_execve - Replace the caller's program
+ */
+uint64_t sys_execve(const char *pathname, char *const argv[], char *const envp[])
+{
+    return (uint64_t)exec_run(pathname, argv, envp, false);
+}
+
+/**
+ * sys_spawn - Start a program in a new child without forking
+ */
+uint64_t sys_spawn(const char *pathname, char *const argv[], char *const envp[])
+{
+    return (uint64_t)exec_run(pathname, argv, envp, true);
+}
+
+/**
+ * sys_waitpid - Reap a child and report its status
+ */
+uint64_t sys_waitpid(int64_t pid, int *status, int options)
+{
+    int code = 0;
+    int64_t ret = process_wait(pid, &code, options);
+
+    if (ret > 0 && status && copy_to_user(status, &code, sizeof(code)) != KERNEL_SUCCESS) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_FAULT;
+    }
+    return (uint64_t)ret;
+}
+
+/**
+ * sys_getpid - Caller's process id
+ */
+uint64_t sys_getpid(void)
+{
+    return current_task->pid;
+}
+
+/**
+ * sys_futex - Wait on or wake tasks sharing a user-space word
+ * @timeout: Relative timeout for FUTEX_WAIT; the requeue count otherwise
+ */
+uint64_t sys_futex(uint32_t *uaddr, int op, uint32_t val, const struct timespec *timeout,
+                   uint32_t *uaddr2, uint32_t val3)
+{
+    if (op & FUTEX_CLOCK_REALTIME) {
+        return (uint64_t)(int64_t)KERNEL_ERROR_NOSYS;
+    }
+
+    switch (op & FUTEX_CMD_MASK) {
+    case FUTEX_WAIT:
+        return (uint64_t)futex_wait(uaddr, val, timeout);
+    case FUTEX_WAKE:
+        return (uint64_t)futex_wake(uaddr, val);
+    case FUTEX_REQUEUE:
+        return (uint64_t)futex_requeue(uaddr, val, (uint32_t)(uint64_t)timeout,
+                                       uaddr2, false, 0);
+    case FUTEX_CMP_REQUEUE:
+        return (uint64_t)futex_requeue(uaddr, val, (uint32_t)(uint64_t)timeout,
+                                       uaddr2, true, val3);
+    default:
+        return (uint64_t)(int64_t)KERNEL_ERROR_NOSYS;
+    }
+}
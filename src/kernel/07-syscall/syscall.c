@@ -0,0 +1,199 @@
+/*
+ * Power1 OS - System Call Dispatch
+ * Table-driven dispatch from the saved user register frame
+ *
+ * Arguments follow the x86_64 convention: rdi, rsi, rdx, r10, r8, r9, with
+ * the call number in rax. Each table slot unpacks the frame for one
+ * sys_* handler so the handlers keep their natural C prototypes.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/syscall.h"
+#include "../include/process.h"
+#include "../include/init.h"
+
+typedef uint64_t (*syscall_entry_t)(struct syscall_frame *frame);
+
+static uint64_t syscall_exit(struct syscall_frame *frame)
+{
+    sys_exit((int)frame->rdi);
+}
+
+static uint64_t syscall_fork(struct syscall_frame *frame)
+{
+    (void)frame;
+    return sys_fork();
+}
+
+static uint64_t syscall_vfork(struct syscall_frame *frame)
+{
+    (void)frame;
+    return sys_vfork();
+}
+
+static uint64_t syscall_execve(struct syscall_frame *frame)
+{
+    return sys_execve((const char *)frame->rdi, (char *const *)frame->rsi,
+                      (char *const *)frame->rdx);
+}
+
+static uint64_t syscall_spawn(struct syscall_frame *frame)
+{
+    return sys_spawn((const char *)frame->rdi, (char *const *)frame->rsi,
+                     (char *const *)frame->rdx);
+}
+
+static uint64_t syscall_waitpid(struct syscall_frame *frame)
+{
+    return sys_waitpid((int64_t)frame->rdi, (int *)frame->rsi, (int)frame->rdx);
+}
+
+static uint64_t syscall_getpid(struct syscall_frame *frame)
+{
+    (void)frame;
+    return sys_getpid();
+}
+
+static uint64_t syscall_read(struct syscall_frame *frame)
+{
+    return sys_read((int)frame->rdi, (void *)frame->rsi, frame->rdx);
+}
+
+static uint64_t syscall_write(struct syscall_frame *frame)
+{
+    return sys_write((int)frame->rdi, (const void *)frame->rsi, frame->rdx);
+}
+
+static uint64_t syscall_open(struct syscall_frame *frame)
+{
+    return sys_open((const char *)frame->rdi, (int)frame->rsi, (int)frame->rdx);
+}
+
+static uint64_t syscall_close(struct syscall_frame *frame)
+{
+    return sys_close((int)frame->rdi);
+}
+
+static uint64_t syscall_pipe(struct syscall_frame *frame)
+{
+    return sys_pipe((int *)frame->rdi);
+}
+
+static uint64_t syscall_splice(struct syscall_frame *frame)
+{
+    return sys_splice((int)frame->rdi, (int64_t *)frame->rsi, (int)frame->rdx,
+                      (int64_t *)frame->r10, frame->r8, (unsigned int)frame->r9);
+}
+
+static uint64_t syscall_sendfile(struct syscall_frame *frame)
+{
+    return sys_sendfile((int)frame->rdi, (int)frame->rsi, (int64_t *)frame->rdx, frame->r10);
+}
+
+static uint64_t syscall_poll(struct syscall_frame *frame)
+{
+    return sys_poll((struct pollfd *)frame->rdi, (uint32_t)frame->rsi, (int)frame->rdx);
+}
+
+static uint64_t syscall_epoll_create(struct syscall_frame *frame)
+{
+    return sys_epoll_create((int)frame->rdi);
+}
+
+static uint64_t syscall_epoll_ctl(struct syscall_frame *frame)
+{
+    return sys_epoll_ctl((int)frame->rdi, (int)frame->rsi, (int)frame->rdx,
+                         (struct epoll_event *)frame->r10);
+}
+
+static uint64_t syscall_epoll_wait(struct syscall_frame *frame)
+{
+    return sys_epoll_wait((int)frame->rdi, (struct epoll_event *)frame->rsi,
+                          (int)frame->rdx, (int)frame->r10);
+}
+
+static uint64_t syscall_mmap(struct syscall_frame *frame)
+{
+    return sys_mmap((void *)frame->rdi, frame->rsi, (int)frame->rdx,
+                    (int)frame->r10, (int)frame->r8, frame->r9);
+}
+
+static uint64_t syscall_munmap(struct syscall_frame *frame)
+{
+    return sys_munmap((void *)frame->rdi, frame->rsi);
+}
+
+static uint64_t syscall_futex(struct syscall_frame *frame)
+{
+    return sys_futex((uint32_t *)frame->rdi, (int)frame->rsi, (uint32_t)frame->rdx,
+                     (const struct timespec *)frame->r10, (uint32_t *)frame->r8,
+                     (uint32_t)frame->r9);
+}
+
+static uint64_t syscall_set_mempolicy(struct syscall_frame *frame)
+{
+    return sys_set_mempolicy((int)frame->rdi, (const unsigned long *)frame->rsi, frame->rdx);
+}
+
+static uint64_t syscall_channel_create(struct syscall_frame *frame)
+{
+    return sys_channel_create((const char *)frame->rdi, (uint32_t)frame->rsi,
+                              (uint32_t)frame->rdx, (uint32_t)frame->r10);
+}
+
+static const syscall_entry_t syscall_table[SYSCALL_MAX] = {
+    [SYS_EXIT]    = syscall_exit,
+    [SYS_FORK]    = syscall_fork,
+    [SYS_READ]    = syscall_read,
+    [SYS_WRITE]   = syscall_write,
+    [SYS_OPEN]    = syscall_open,
+    [SYS_CLOSE]   = syscall_close,
+    [SYS_WAITPID] = syscall_waitpid,
+    [SYS_EXECVE]  = syscall_execve,
+    [SYS_GETPID]  = syscall_getpid,
+    [SYS_PIPE]    = syscall_pipe,
+    [SYS_MMAP]    = syscall_mmap,
+    [SYS_MUNMAP]  = syscall_munmap,
+    [SYS_POLL]    = syscall_poll,
+    [SYS_SENDFILE] = syscall_sendfile,
+    [SYS_VFORK]   = syscall_vfork,
+    [SYS_FUTEX]   = syscall_futex,
+    [SYS_EPOLL_CREATE] = syscall_epoll_create,
+    [SYS_EPOLL_CTL] = syscall_epoll_ctl,
+    [SYS_EPOLL_WAIT] = syscall_epoll_wait,
+    [SYS_SET_MEMPOLICY] = syscall_set_mempolicy,
+    [SYS_SPLICE]  = syscall_splice,
+    [SYS_SPAWN]   = syscall_spawn,
+    [SYS_CHANNEL_CREATE] = syscall_channel_create,
+};
+
+/**
+ * syscall_handler - Dispatch the call described by @frame
+ */
+uint64_t syscall_handler(struct syscall_frame *frame)
+{
+    uint64_t number = frame->rax;
+
+    /* fork and execve act on the frame of the call in progress */
+    current_task->user_frame = frame;
+
+    if (number >= SYSCALL_MAX || !syscall_table[number]) {
+        frame->rax = (uint64_t)(int64_t)KERNEL_ERROR_NOSYS;
+        return frame->rax;
+    }
+
+    frame->rax = syscall_table[number](frame);
+    return frame->rax;
+}
+
+/**
+ * syscall_interface_init - Prepare the system call layer
+ */
+int __init syscall_interface_init(void)
+{
+    return KERNEL_SUCCESS;
+}
+initcall(syscall_interface_init, 0, cpu_registers_init);
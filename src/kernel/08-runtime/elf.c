@@ -0,0 +1,229 @@
+/*
+ * Power1 OS - ELF Program Loader
+ * Maps ELF64 executables for execve and spawn
+ *
+ * Nothing is read at exec time beyond the headers. Each PT_LOAD segment
+ * becomes a private file mapping of the executable, so the first touch of
+ * a page faults it in from the page cache: read-only text and rodata are
+ * mapped straight from the cached frames and therefore shared by every
+ * process running the same binary, while writable data is copied on its
+ * first write. The part of a segment beyond its file size (.bss) is an
+ * anonymous mapping, zero-filled on demand.
+ *
+ * ET_DYN (static PIE) images are loaded at ELF_ET_DYN_BASE. ET_EXEC images
+ * must be linked inside the user half (above USER_SPACE_START). Images
+ * requesting an interpreter are refused.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/fs.h"
+#include "../include/process.h"
+#include "../include/elf.h"
+#include "../include/init.h"
+
+#define ELF_ET_DYN_BASE         0x0000555555554000UL
+#define ELF_PHDR_MAX            64
+
+/**
+ * elf_read - Read exactly @length bytes of the image
+ */
+static int elf_read(struct inode *inode, uint64_t offset, void *buf, size_t length)
+{
+    ssize_t ret = vfs_read_inode(inode, offset, buf, length);
+    if (ret < 0) {
+        return (int)ret;
+    }
+    return (size_t)ret == length ? KERNEL_SUCCESS : KERNEL_ERROR_NOEXEC;
+}
+
+/**
+ * elf_check_header - Accept only x86_64 little-endian executables
+ */
+static int elf_check_header(const Elf64_Ehdr *ehdr)
+{
+    if (ehdr->e_ident[0] != ELFMAG0 || ehdr->e_ident[1] != ELFMAG1 ||
+        ehdr->e_ident[2] != ELFMAG2 || ehdr->e_ident[3] != ELFMAG3) {
+        return KERNEL_ERROR_NOEXEC;
+    }
+    if (ehdr->e_ident[EI_CLASS] != ELFCLASS64 || ehdr->e_ident[EI_DATA] != ELFDATA2LSB ||
+        ehdr->e_machine != EM_X86_64) {
+        return KERNEL_ERROR_NOEXEC;
+    }
+    if (ehdr->e_type != ET_EXEC && ehdr->e_type != ET_DYN) {
+        return KERNEL_ERROR_NOEXEC;
+    }
+    if (ehdr->e_phentsize != sizeof(Elf64_Phdr) ||
+        ehdr->e_phnum == 0 || ehdr->e_phnum > ELF_PHDR_MAX) {
+        return KERNEL_ERROR_INVALID;
+    }
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * elf_segment_prot - mmap protection for a segment
+ */
+static int elf_segment_prot(const Elf64_Phdr *phdr)
+{
+    int prot = 0;
+
+    if (phdr->p_flags & PF_R) {
+        prot |= PROT_READ;
+    }
+    if (phdr->p_flags & PF_W) {
+        prot |= PROT_WRITE;
+    }
+    if (phdr->p_flags & PF_X) {
+        prot |= PROT_EXEC;
+    }
+    return prot;
+}
+
+/**
+ * elf_map_segment - Map one PT_LOAD segment lazily
+ */
+static int elf_map_segment(struct exec_params *params, const Elf64_Phdr *phdr, uint64_t bias)
+{
+    uint64_t vaddr = phdr->p_vaddr + bias;
+    uint64_t file_end = vaddr + phdr->p_filesz;
+    uint64_t mem_end = vaddr + phdr->p_memsz;
+    uint64_t start = page_align_down(vaddr);
+    int prot = elf_segment_prot(phdr);
+    int64_t ret;
+
+    if (phdr->p_filesz > phdr->p_memsz || mem_end < vaddr ||
+        ((phdr->p_vaddr - phdr->p_offset) & PAGE_MASK) ||
+        phdr->p_offset + phdr->p_filesz > params->inode->size) {
+        return KERNEL_ERROR_INVALID;
+    }
+
+    if (phdr->p_filesz) {
+        ret = vm_mmap(params->space, start, page_align_up(file_end) - start, prot,
+                      MAP_PRIVATE | MAP_FIXED, params->inode,
+                      page_align_down(phdr->p_offset));
+        if (ret < 0) {
+            return (int)ret;
+        }
+    }
+
+    if (phdr->p_memsz > phdr->p_filesz) {
+        uint64_t bss_start = phdr->p_filesz ? page_align_up(file_end) : start;
+        uint64_t bss_end = page_align_up(mem_end);
+
+        /* The file page holding the start of .bss must read as zeros past it */
+        if (phdr->p_filesz && (file_end & PAGE_MASK) && (prot & PROT_WRITE)) {
+            ret = vm_clear_space(params->space, file_end, bss_start - file_end);
+            if (ret < 0) {
+                return (int)ret;
+            }
+        }
+
+        if (bss_end > bss_start) {
+            ret = vm_mmap(params->space, bss_start, bss_end - bss_start, prot,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, NULL, 0);
+            if (ret < 0) {
+                return (int)ret;
+            }
+        }
+    }
+    return KERNEL_SUCCESS;
+}
+
+/**
+ * elf_phdr_address - User address of the program headers, 0 if unmapped
+ */
+static uint64_t elf_phdr_address(const Elf64_Ehdr *ehdr, const Elf64_Phdr *phdrs, uint64_t bias)
+{
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        if (phdrs[i].p_type == PT_PHDR) {
+            return phdrs[i].p_vaddr + bias;
+        }
+    }
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        if (phdrs[i].p_type == PT_LOAD && phdrs[i].p_offset <= ehdr->e_phoff &&
+            ehdr->e_phoff < phdrs[i].p_offset + phdrs[i].p_filesz) {
+            return phdrs[i].p_vaddr + (ehdr->e_phoff - phdrs[i].p_offset) + bias;
+        }
+    }
+    return 0;
+}
+
+/**
+ * elf_push_auxv - Record one auxiliary vector entry
+ */
+static void elf_push_auxv(struct exec_params *params, uint64_t type, uint64_t value)
+{
+    if (params->auxc < EXEC_AUXV_MAX) {
+        params->auxv[2 * params->auxc] = type;
+        params->auxv[2 * params->auxc + 1] = value;
+        params->auxc++;
+    }
+}
+
+/**
+ * elf_load - binary_format load method
+ */
+static int elf_load(struct exec_params *params)
+{
+    Elf64_Ehdr ehdr;
+
+    int ret = elf_read(params->inode, 0, &ehdr, sizeof(ehdr));
+    if (ret != KERNEL_SUCCESS) {
+        return KERNEL_ERROR_NOEXEC;
+    }
+    ret = elf_check_header(&ehdr);
+    if (ret != KERNEL_SUCCESS) {
+        return ret;
+    }
+
+    size_t phdrs_size = ehdr.e_phnum * sizeof(Elf64_Phdr);
+    Elf64_Phdr *phdrs = kmalloc(phdrs_size);
+    if (!phdrs) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    ret = elf_read(params->inode, ehdr.e_phoff, phdrs, phdrs_size);
+    if (ret != KERNEL_SUCCESS) {
+        kfree(phdrs);
+        return KERNEL_ERROR_INVALID;
+    }
+
+    uint64_t bias = ehdr.e_type == ET_DYN ? ELF_ET_DYN_BASE : 0;
+
+    for (int i = 0; i < ehdr.e_phnum && ret == KERNEL_SUCCESS; i++) {
+        if (phdrs[i].p_type == PT_INTERP) {
+            ret = KERNEL_ERROR_INVALID;     /* No dynamic linker support */
+        } else if (phdrs[i].p_type == PT_LOAD && phdrs[i].p_memsz) {
+            ret = elf_map_segment(params, &phdrs[i], bias);
+        }
+    }
+
+    if (ret == KERNEL_SUCCESS) {
+        params->entry = ehdr.e_entry + bias;
+        elf_push_auxv(params, AT_PHDR, elf_phdr_address(&ehdr, phdrs, bias));
+        elf_push_auxv(params, AT_PHENT, sizeof(Elf64_Phdr));
+        elf_push_auxv(params, AT_PHNUM, ehdr.e_phnum);
+        elf_push_auxv(params, AT_BASE, 0);
+        elf_push_auxv(params, AT_ENTRY, params->entry);
+    }
+
+    kfree(phdrs);
+    return ret;
+}
+
+static struct binary_format elf_format = {
+    .name = "elf64",
+    .load = elf_load,
+    .next = NULL
+};
+
+/**
+ * elf_binfmt_init - Register the ELF64 loader
+ */
+int __init elf_binfmt_init(void)
+{
+    return binfmt_register(&elf_format);
+}
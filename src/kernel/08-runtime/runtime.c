@@ -0,0 +1,20 @@
+/*
+ * Power1 OS - Runtime Services
+ * Program execution support for user space
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/elf.h"
+#include "../include/init.h"
+
+/**
+ * runtime_services_init - Register the executable formats
+ */
+int __init runtime_services_init(void)
+{
+    return elf_binfmt_init();
+}
+initcall(runtime_services_init, 0, memory_manager_init);
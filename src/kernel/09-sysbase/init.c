@@ -0,0 +1,35 @@
+/*
+ * Power1 OS - System Base
+ * Starts the first user process
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/fs.h"
+#include "../include/process.h"
+#include "../include/init.h"
+
+#define INIT_PATH               "/sbin/init"
+
+/**
+ * system_base_init - Spawn init from the boot modules, if one was loaded
+ *
+ * init runs as pid 1 once the boot context enters the scheduler.
+ */
+int __init system_base_init(void)
+{
+    char *argv[] = { INIT_PATH, NULL };
+    char *envp[] = { "PATH=/sbin:/bin", NULL };
+
+    struct inode *inode = vfs_lookup(INIT_PATH);
+    if (!inode) {
+        return KERNEL_SUCCESS;
+    }
+    inode_put(inode);
+
+    int64_t pid = process_spawn(INIT_PATH, argv, envp);
+    return pid < 0 ? (int)pid : KERNEL_SUCCESS;
+}
+initcall(system_base_init, 0, filesystem_init, runtime_services_init, syscall_interface_init);
@@ -0,0 +1,141 @@
+/*
+ * Power1 OS - ACPI Definitions
+ * Static firmware tables used for platform discovery
+ */
+
+#ifndef _ACPI_H
+#define _ACPI_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+
+/* Root System Description Pointer */
+struct acpi_rsdp {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+    uint32_t length;            /* ACPI 2.0+ */
+    uint64_t xsdt_address;
+    uint8_t extended_checksum;
+    uint8_t reserved[3];
+} __attribute__((packed));
+
+/* Common header of every system description table */
+struct acpi_sdt_header {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+
+/* PCI Express memory-mapped configuration space (MCFG) */
+struct acpi_mcfg_entry {
+    uint64_t base_address;
+    uint16_t segment;
+    uint8_t start_bus;
+    uint8_t end_bus;
+    uint32_t reserved;
+} __attribute__((packed));
+
+struct acpi_mcfg {
+    struct acpi_sdt_header header;
+    uint64_t reserved;
+    struct acpi_mcfg_entry entries[];
+} __attribute__((packed));
+
+/* Multiple APIC Description Table (MADT) */
+#define ACPI_MADT_LOCAL_APIC        0
+#define ACPI_MADT_LOCAL_X2APIC      9
+#define ACPI_MADT_ENABLED           (1 << 0)
+
+struct acpi_madt {
+    struct acpi_sdt_header header;
+    uint32_t lapic_address;
+    uint32_t flags;
+    uint8_t entries[];
+} __attribute__((packed));
+
+struct acpi_madt_entry {
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed));
+
+struct acpi_madt_local_apic {
+    struct acpi_madt_entry header;
+    uint8_t processor_id;
+    uint8_t apic_id;
+    uint32_t flags;
+} __attribute__((packed));
+
+struct acpi_madt_local_x2apic {
+    struct acpi_madt_entry header;
+    uint16_t reserved;
+    uint32_t x2apic_id;
+    uint32_t flags;
+    uint32_t processor_uid;
+} __attribute__((packed));
+
+/* System Resource Affinity Table (SRAT) */
+#define ACPI_SRAT_CPU_AFFINITY      0
+#define ACPI_SRAT_MEMORY_AFFINITY   1
+#define ACPI_SRAT_X2APIC_AFFINITY   2
+#define ACPI_SRAT_ENABLED           (1 << 0)
+
+struct acpi_srat {
+    struct acpi_sdt_header header;
+    uint32_t table_revision;
+    uint64_t reserved;
+    uint8_t entries[];
+} __attribute__((packed));
+
+struct acpi_srat_cpu_affinity {
+    struct acpi_madt_entry header;
+    uint8_t proximity_low;
+    uint8_t apic_id;
+    uint32_t flags;
+    uint8_t sapic_eid;
+    uint8_t proximity_high[3];
+    uint32_t clock_domain;
+} __attribute__((packed));
+
+struct acpi_srat_memory_affinity {
+    struct acpi_madt_entry header;
+    uint32_t proximity_domain;
+    uint16_t reserved1;
+    uint64_t base_address;
+    uint64_t length;
+    uint32_t reserved2;
+    uint32_t flags;
+    uint64_t reserved3;
+} __attribute__((packed));
+
+struct acpi_srat_x2apic_affinity {
+    struct acpi_madt_entry header;
+    uint16_t reserved1;
+    uint32_t proximity_domain;
+    uint32_t x2apic_id;
+    uint32_t flags;
+    uint32_t clock_domain;
+    uint32_t reserved2;
+} __attribute__((packed));
+
+/* System Locality Information Table (SLIT) */
+struct acpi_slit {
+    struct acpi_sdt_header header;
+    uint64_t locality_count;
+    uint8_t entries[];          /* locality_count x locality_count distances */
+} __attribute__((packed));
+
+/* Function prototypes */
+int acpi_init(void);
+void *acpi_find_table(const char *signature);
+
+#endif /* _ACPI_H */
@@ -0,0 +1,45 @@
+/*
+ * Power1 OS - Alternatives
+ * Boot-time choice between CPU-specific versions of a routine
+ *
+ * A routine with faster versions for some processors is called through a
+ * function pointer initialised to its generic version, which works on
+ * any x86_64 CPU and before the choice is made. Each faster version
+ * registers with alternative(), naming the pointer, the X86_FEATURE_* it
+ * needs and a rank. Once the CPU's features are known, alternatives_apply
+ * points every pointer at the highest-ranked version the CPU supports,
+ * so the choice costs nothing per call beyond the indirect call itself.
+ * The table lives in .init and is freed after boot.
+ */
+
+#ifndef _ALTERNATIVE_H
+#define _ALTERNATIVE_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+
+struct alternative {
+    void **slot;                /* Function pointer to redirect */
+    void *impl;                 /* Version to point it at */
+    uint32_t feature;           /* X86_FEATURE_* the version needs */
+    uint32_t rank;              /* Higher wins among supported versions */
+};
+
+/*
+ * alternative - Use @impl for @slot on CPUs with @feature
+ * @rank: Preference over other versions registered for @slot
+ */
+#define alternative(slot, impl, feature, rank)                              \
+    static const struct alternative __alternative_##impl                    \
+        __attribute__((used, section(".alternatives"), aligned(8))) = {     \
+        (void **)&(slot), (void *)(impl), (feature), (rank)                 \
+    }
+
+/* Linker provided bounds */
+extern const struct alternative __alternatives_start[];
+extern const struct alternative __alternatives_end[];
+
+void alternatives_apply(void);
+
+#endif /* _ALTERNATIVE_H */
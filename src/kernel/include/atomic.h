@@ -0,0 +1,65 @@
+/*
+ * Power1 OS - Atomic Operations
+ * Thin wrappers over the compiler __atomic builtins
+ */
+
+#ifndef _ATOMIC_H
+#define _ATOMIC_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+/* Atomic counter */
+typedef struct {
+    volatile int32_t value;
+} atomic_t;
+
+#define ATOMIC_INIT(v)          { (v) }
+
+static inline int32_t atomic_read(const atomic_t *a)
+{
+    return __atomic_load_n(&a->value, __ATOMIC_RELAXED);
+}
+
+static inline void atomic_set(atomic_t *a, int32_t v)
+{
+    __atomic_store_n(&a->value, v, __ATOMIC_RELAXED);
+}
+
+static inline void atomic_inc(atomic_t *a)
+{
+    __atomic_add_fetch(&a->value, 1, __ATOMIC_RELAXED);
+}
+
+static inline int32_t atomic_add_return(atomic_t *a, int32_t v)
+{
+    return __atomic_add_fetch(&a->value, v, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * atomic_dec_and_test - Decrement and report whether the count hit zero
+ */
+static inline bool atomic_dec_and_test(atomic_t *a)
+{
+    return __atomic_sub_fetch(&a->value, 1, __ATOMIC_ACQ_REL) == 0;
+}
+
+static inline bool atomic_cmpxchg(atomic_t *a, int32_t old, int32_t new_value)
+{
+    return __atomic_compare_exchange_n(&a->value, &old, new_value, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+/* Compiler and CPU barriers */
+#define barrier()       __asm__ volatile ("" ::: "memory")
+#define cpu_relax()     __asm__ volatile ("pause" ::: "memory")
+
+/*
+ * Memory ordering against other CPUs and devices. x86 only reorders a
+ * store with a later load, so just the full barrier needs an instruction.
+ */
+#define smp_mb()        __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define smp_rmb()       barrier()
+#define smp_wmb()       barrier()
+
+#endif /* _ATOMIC_H */
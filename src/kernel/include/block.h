@@ -0,0 +1,105 @@
+/*
+ * Power1 OS - Block Layer Definitions
+ * Bios, request merging, plugging and software queues
+ */
+
+#ifndef _BLOCK_H
+#define _BLOCK_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+#include "spinlock.h"
+#include "devices.h"
+#include "interrupts.h"
+
+#define BLK_MAX_SECTORS         2048    /* Largest merged request (1MB) */
+#define BLK_PLUG_MAX            32      /* Requests a plug holds before flushing */
+#define BLK_REQUEST_CACHE       16      /* Idle requests kept per CPU */
+
+struct bio;
+typedef void (*bio_end_io_t)(struct bio *bio);
+
+/*
+ * One contiguous range of sectors with the memory it transfers. A bio is
+ * the unit callers submit; the block layer merges bios into requests and
+ * calls end_io for each once the request carrying it completes.
+ */
+struct bio {
+    struct device *dev;
+    uint32_t op;                /* IO_OP_* */
+    uint16_t nr_vecs;
+    uint16_t max_vecs;
+    uint32_t flags;             /* IO_REQ_* */
+    uint64_t sector;
+    int status;
+    bio_end_io_t end_io;
+    void *private;
+    struct bio *next;           /* Within a request */
+    struct io_segment vecs[];
+};
+
+/* What the driver sees: one io_request made of one or more merged bios */
+struct blk_request {
+    struct io_request io;
+    struct blk_queue *queue;
+    struct bio *bio;
+    struct bio *biotail;
+    uint32_t nr_sectors;
+    struct blk_request *next;   /* Plug, software queue or completion list */
+};
+
+/*
+ * Per-CPU software queue. Requests wait here, in submission order, while
+ * the hardware queue of the same CPU is full.
+ */
+struct blk_ctx {
+    spinlock_t lock;
+    struct blk_request *head;
+    struct blk_request *tail;
+    struct blk_request *cache;  /* Idle requests for reuse */
+    unsigned int cached;
+    uint64_t dispatched;
+    uint64_t merged;            /* Bios that joined an existing request */
+    uint64_t requeued;          /* Submissions the hardware refused */
+} __attribute__((aligned(64)));
+
+/* Block layer state of one storage device */
+struct blk_queue {
+    struct device *dev;
+    uint64_t capacity;          /* In IO_SECTOR_SIZE units */
+    uint32_t max_sectors;       /* Largest request, at most BLK_MAX_SECTORS */
+    uint16_t max_segments;
+    uint64_t virt_boundary;     /* Mask segments must start and end on inside a request, 0 if any */
+    struct blk_ctx ctx[CPU_MAX];
+};
+
+/*
+ * Per-task plug. While one is active, submitted bios are held and merged
+ * instead of being dispatched, then sorted and sent as a few large
+ * requests when the plug is finished or the task sleeps.
+ */
+struct blk_plug {
+    struct blk_request *head;
+    unsigned int count;
+};
+
+/* Queues */
+int blk_init(void);
+struct blk_queue *blk_queue_create(struct device *dev, uint64_t capacity, uint16_t max_segments);
+void blk_complete_batch(void);
+int blk_poll(struct device *dev);
+
+/* Bios */
+struct bio *bio_alloc(struct device *dev, uint32_t op, uint64_t sector, uint16_t max_vecs);
+void bio_free(struct bio *bio);
+int bio_add_buffer(struct bio *bio, void *buffer, uint32_t length);
+void submit_bio(struct bio *bio);
+int submit_bio_wait(struct bio *bio);
+
+/* Plugging */
+void blk_start_plug(struct blk_plug *plug);
+void blk_finish_plug(struct blk_plug *plug);
+void blk_flush_plug(struct blk_plug *plug);
+
+#endif /* _BLOCK_H */
@@ -0,0 +1,41 @@
+/*
+ * Power1 OS - Boot Trace
+ * TSC timestamps for each boot stage and subsystem initialisation
+ */
+
+#ifndef _BOOTTRACE_H
+#define _BOOTTRACE_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+
+#define BOOT_TRACE_MAX          64
+
+/*
+ * Stages timestamped by boot.asm before any C code runs. The assembly
+ * stores raw RDTSC values into boot_tsc[] at these indices, so the two
+ * lists must stay in step.
+ */
+#define BOOT_TSC_ENTRY          0       /* _start reached */
+#define BOOT_TSC_MULTIBOOT      1       /* Loader magic verified */
+#define BOOT_TSC_CPUID          2       /* Long mode support confirmed */
+#define BOOT_TSC_PAGING         3       /* Identity map enabled */
+#define BOOT_TSC_GDT            4       /* 64-bit GDT loaded */
+#define BOOT_TSC_LONG_MODE      5       /* First 64-bit instruction */
+#define BOOT_TSC_STAGES         6
+
+/* One timeline event; end is zero for a point mark */
+struct boot_trace_entry {
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+};
+
+extern uint64_t boot_tsc[BOOT_TSC_STAGES];
+
+void boot_trace_mark(const char *name);
+int boot_trace_call(const char *name, int (*fn)(void));
+void boot_trace_report(void);
+
+#endif /* _BOOTTRACE_H */
@@ -0,0 +1,257 @@
+/*
+ * Power1 OS - Shared-Memory Channels
+ * Lock-free message rings mapped into every process that uses them
+ *
+ * A channel is a shared memory object holding a ring of fixed-size slots.
+ * The kernel only creates it; after mmap() both sides exchange messages
+ * with the inline operations below and never enter the kernel unless one
+ * of them has to sleep. Each slot carries a sequence number that says
+ * whose turn it is:
+ *
+ *     seq == pos                  free, for the producer claiming pos
+ *     seq == pos + 1              full, for the consumer reading pos
+ *     seq == pos + slot_count     free again, one lap later
+ *
+ * An SPSC producer owns head outright; MPSC producers claim a position by
+ * compare-and-swap on head. The consumer side is always single.
+ *
+ * Doorbells are futex words. A side about to sleep reads the doorbell,
+ * marks itself waiting, rechecks the ring and only then waits on the
+ * value it read; the other side rings (increments and FUTEX_WAKEs) the
+ * doorbell only when it sees the waiting mark, so the common case costs
+ * no syscall at all:
+ *
+ *     bool wake;
+ *     int len;
+ *     while ((len = channel_recv(ch, buf, size, &wake)) == CHANNEL_EMPTY) {
+ *         uint32_t bell = channel_recv_prepare_wait(ch);
+ *         if (!channel_empty(ch)) { channel_recv_cancel_wait(ch); continue; }
+ *         futex(&ch->data_bell, FUTEX_WAIT, bell);
+ *         channel_recv_cancel_wait(ch);
+ *     }
+ *     if (wake) futex(&ch->space_bell, FUTEX_WAKE, 1);
+ *
+ * channel_send() returning CHANNEL_WAKE means the consumer was asleep and
+ * the sender must futex(&ch->data_bell, FUTEX_WAKE, 1); channel_recv()
+ * setting wake likewise means a producer waits on space_bell for room.
+ */
+
+#ifndef _CHANNEL_H
+#define _CHANNEL_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+
+#define CHANNEL_MAGIC           0x314E4843  /* "CHN1" */
+#define CHANNEL_CACHELINE       64
+
+/* Creation flags */
+#define CHANNEL_MPSC            (1 << 0)    /* Several producers */
+
+#define CHANNEL_SLOTS_MAX       65536
+#define CHANNEL_SLOT_SIZE_MAX   65536
+#define CHANNEL_RING_MAX        (16UL << 20)    /* Bytes of slots per channel */
+
+/* Result of channel_send / channel_recv, or a message length >= 0 */
+#define CHANNEL_OK              0
+#define CHANNEL_WAKE            1           /* Sent; ring the other side */
+#define CHANNEL_EMPTY           -1
+#define CHANNEL_FULL            -2
+#define CHANNEL_TOOBIG          -3
+
+/* Slot: sequence word and length, then the payload */
+struct channel_slot {
+    uint64_t seq;
+    uint32_t len;
+    uint32_t reserved;
+    uint8_t data[];
+};
+
+/*
+ * Object header, at offset 0. Producer and consumer state live on separate
+ * cache lines so the two sides only share a line when one hands over.
+ */
+struct channel_header {
+    uint32_t magic;
+    uint32_t flags;
+    uint32_t slot_size;         /* Bytes per slot, header included */
+    uint32_t slot_count;        /* Power of two */
+    uint64_t slots_offset;      /* Byte offset of slot 0 */
+    uint64_t size;              /* Whole object */
+
+    /* Producer side */
+    uint64_t head __attribute__((aligned(CHANNEL_CACHELINE)));
+    uint32_t space_bell;        /* Futex: producers waiting for room */
+    uint32_t space_waiters;
+
+    /* Consumer side */
+    uint64_t tail __attribute__((aligned(CHANNEL_CACHELINE)));
+    uint32_t data_bell;         /* Futex: consumer waiting for messages */
+    uint32_t data_waiters;
+} __attribute__((aligned(CHANNEL_CACHELINE)));
+
+static inline uint32_t channel_payload_max(const struct channel_header *ch)
+{
+    return ch->slot_size - (uint32_t)sizeof(struct channel_slot);
+}
+
+static inline struct channel_slot *channel_slot_at(struct channel_header *ch, uint64_t pos)
+{
+    uint64_t index = pos & (ch->slot_count - 1);
+    return (struct channel_slot *)((uint8_t *)ch + ch->slots_offset + index * ch->slot_size);
+}
+
+static inline void channel_copy(void *dest, const void *src, uint32_t len)
+{
+    uint8_t *d = dest;
+    const uint8_t *s = src;
+    while (len--) {
+        *d++ = *s++;
+    }
+}
+
+/**
+ * channel_ring_needed - Whether a side marked itself waiting on @bell
+ *
+ * The full fence orders the publication before the check, pairing with
+ * the fence in channel_*_prepare_wait.
+ */
+static inline bool channel_ring_needed(uint32_t *bell, uint32_t *waiters)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(waiters, __ATOMIC_RELAXED)) {
+        return false;
+    }
+    __atomic_add_fetch(bell, 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+ * channel_send - Copy one message into the ring
+ *
+ * Returns CHANNEL_OK, CHANNEL_WAKE if the consumer must be woken through
+ * data_bell, or CHANNEL_FULL / CHANNEL_TOOBIG without sending.
+ */
+static inline int channel_send(struct channel_header *ch, const void *msg, uint32_t len)
+{
+    struct channel_slot *slot;
+    uint64_t pos;
+
+    if (len > channel_payload_max(ch)) {
+        return CHANNEL_TOOBIG;
+    }
+
+    pos = __atomic_load_n(&ch->head, __ATOMIC_RELAXED);
+    for (;;) {
+        slot = channel_slot_at(ch, pos);
+        uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq < pos) {
+            return CHANNEL_FULL;        /* Not yet consumed from the last lap */
+        }
+        if (seq > pos) {
+            pos = __atomic_load_n(&ch->head, __ATOMIC_RELAXED);  /* Lost a race */
+            continue;
+        }
+        if (!(ch->flags & CHANNEL_MPSC)) {
+            __atomic_store_n(&ch->head, pos + 1, __ATOMIC_RELAXED);
+            break;
+        }
+        if (__atomic_compare_exchange_n(&ch->head, &pos, pos + 1, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    channel_copy(slot->data, msg, len);
+    slot->len = len;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+    return channel_ring_needed(&ch->data_bell, &ch->data_waiters) ? CHANNEL_WAKE : CHANNEL_OK;
+}
+
+/**
+ * channel_recv - Copy the oldest message out of the ring
+ * @wake: Set when a producer waits for room and must be woken through
+ *        space_bell
+ *
+ * Returns the message length, or CHANNEL_EMPTY / CHANNEL_TOOBIG. A
+ * message longer than @size stays queued.
+ */
+static inline int channel_recv(struct channel_header *ch, void *buf, uint32_t size, bool *wake)
+{
+    uint64_t pos = __atomic_load_n(&ch->tail, __ATOMIC_RELAXED);
+    struct channel_slot *slot = channel_slot_at(ch, pos);
+
+    *wake = false;
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+        return CHANNEL_EMPTY;
+    }
+
+    uint32_t len = slot->len;
+    if (len > size) {
+        return CHANNEL_TOOBIG;
+    }
+    channel_copy(buf, slot->data, len);
+
+    __atomic_store_n(&slot->seq, pos + ch->slot_count, __ATOMIC_RELEASE);
+    __atomic_store_n(&ch->tail, pos + 1, __ATOMIC_RELAXED);
+
+    *wake = channel_ring_needed(&ch->space_bell, &ch->space_waiters);
+    return (int)len;
+}
+
+static inline bool channel_empty(struct channel_header *ch)
+{
+    uint64_t pos = __atomic_load_n(&ch->tail, __ATOMIC_RELAXED);
+    return __atomic_load_n(&channel_slot_at(ch, pos)->seq, __ATOMIC_ACQUIRE) != pos + 1;
+}
+
+static inline bool channel_full(struct channel_header *ch)
+{
+    uint64_t pos = __atomic_load_n(&ch->head, __ATOMIC_RELAXED);
+    return __atomic_load_n(&channel_slot_at(ch, pos)->seq, __ATOMIC_ACQUIRE) < pos;
+}
+
+/**
+ * channel_recv_prepare_wait - Mark the consumer waiting, returning the bell
+ *
+ * The caller must recheck channel_empty() before waiting on the value.
+ */
+static inline uint32_t channel_recv_prepare_wait(struct channel_header *ch)
+{
+    uint32_t bell = __atomic_load_n(&ch->data_bell, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&ch->data_waiters, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return bell;
+}
+
+static inline void channel_recv_cancel_wait(struct channel_header *ch)
+{
+    __atomic_store_n(&ch->data_waiters, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * channel_send_prepare_wait - Count a producer as waiting for room
+ *
+ * The caller must recheck channel_full() before waiting on the value.
+ */
+static inline uint32_t channel_send_prepare_wait(struct channel_header *ch)
+{
+    uint32_t bell = __atomic_load_n(&ch->space_bell, __ATOMIC_ACQUIRE);
+    __atomic_add_fetch(&ch->space_waiters, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return bell;
+}
+
+static inline void channel_send_cancel_wait(struct channel_header *ch)
+{
+    __atomic_sub_fetch(&ch->space_waiters, 1, __ATOMIC_RELAXED);
+}
+
+/* Kernel side */
+struct file_descriptor;
+int channel_create(const char *name, uint32_t payload_size, uint32_t slot_count,
+                   uint32_t flags, struct file_descriptor **file);
+
+#endif /* _CHANNEL_H */
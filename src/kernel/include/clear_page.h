@@ -0,0 +1,25 @@
+/*
+ * Power1 OS - Non-Temporal Page Clearing
+ * Zeroing pages that nobody will read for a while
+ *
+ * clear_pages_nt zeroes a batch of pages with stores that bypass the
+ * cache, so the zeroing does not evict the working set. Vector versions
+ * live in lib/simd and are chosen at boot through alternatives; they run
+ * the whole batch inside one kernel FPU region, so callers should pass
+ * as many pages at once as they have. The stores are weakly ordered:
+ * callers issue sfence before the pages are handed to anyone else.
+ */
+
+#ifndef _CLEAR_PAGE_H
+#define _CLEAR_PAGE_H
+
+#include "stdint.h"
+#include "stddef.h"
+
+void clear_pages_nt(void *const *pages, size_t count);
+
+/* lib/simd kernels, only called between kernel_fpu_begin and kernel_fpu_end */
+void clear_page_nt_sse(void *addr);
+void clear_page_nt_avx2(void *addr);
+
+#endif /* _CLEAR_PAGE_H */
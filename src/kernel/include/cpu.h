@@ -33,25 +33,113 @@
 #define CPU_FEATURE_SSE         (1 << 25)
 #define CPU_FEATURE_SSE2        (1 << 26)
 
+/* CPUID leaf 1 ECX features */
+#define CPU_FEATURE_ECX_TSC_DEADLINE (1 << 24)
+
 /* Extended CPU features */
 #define CPU_FEATURE_EXT_SYSCALL (1 << 11)
 #define CPU_FEATURE_EXT_NX      (1 << 20)
 #define CPU_FEATURE_EXT_LM      (1 << 29)
 
-/* CPU information structure */
+/* Feature words of struct cpu_info, one per CPUID register */
+#define CPUID_1_EDX             0
+#define CPUID_1_ECX             1
+#define CPUID_7_EBX             2
+#define CPUID_7_ECX             3
+#define CPUID_7_EDX             4
+#define CPUID_80000001_EDX      5
+#define CPUID_80000001_ECX      6
+#define CPUID_D_1_EAX           7       /* XSAVE instruction variants */
+#define CPU_FEATURE_WORDS       8
+
+/* Features for cpu_has_feature, as word * 32 + bit */
+#define X86_FEATURE(word, bit)  ((uint32_t)(word) * 32 + (bit))
+#define X86_FEATURE_FPU         X86_FEATURE(CPUID_1_EDX, 0)
+#define X86_FEATURE_TSC         X86_FEATURE(CPUID_1_EDX, 4)
+#define X86_FEATURE_APIC        X86_FEATURE(CPUID_1_EDX, 9)
+#define X86_FEATURE_CLFLUSH     X86_FEATURE(CPUID_1_EDX, 19)
+#define X86_FEATURE_FXSR        X86_FEATURE(CPUID_1_EDX, 24)
+#define X86_FEATURE_SSE         X86_FEATURE(CPUID_1_EDX, 25)
+#define X86_FEATURE_SSE2        X86_FEATURE(CPUID_1_EDX, 26)
+#define X86_FEATURE_SSE3        X86_FEATURE(CPUID_1_ECX, 0)
+#define X86_FEATURE_PCLMULQDQ   X86_FEATURE(CPUID_1_ECX, 1)
+#define X86_FEATURE_MONITOR     X86_FEATURE(CPUID_1_ECX, 3)
+#define X86_FEATURE_SSSE3       X86_FEATURE(CPUID_1_ECX, 9)
+#define X86_FEATURE_SSE4_1      X86_FEATURE(CPUID_1_ECX, 19)
+#define X86_FEATURE_SSE4_2      X86_FEATURE(CPUID_1_ECX, 20)
+#define X86_FEATURE_X2APIC      X86_FEATURE(CPUID_1_ECX, 21)
+#define X86_FEATURE_POPCNT      X86_FEATURE(CPUID_1_ECX, 23)
+#define X86_FEATURE_TSC_DEADLINE X86_FEATURE(CPUID_1_ECX, 24)
+#define X86_FEATURE_XSAVE       X86_FEATURE(CPUID_1_ECX, 26)
+#define X86_FEATURE_OSXSAVE     X86_FEATURE(CPUID_1_ECX, 27)
+#define X86_FEATURE_AVX         X86_FEATURE(CPUID_1_ECX, 28)
+#define X86_FEATURE_BMI1        X86_FEATURE(CPUID_7_EBX, 3)
+#define X86_FEATURE_AVX2        X86_FEATURE(CPUID_7_EBX, 5)
+#define X86_FEATURE_SMEP        X86_FEATURE(CPUID_7_EBX, 7)
+#define X86_FEATURE_BMI2        X86_FEATURE(CPUID_7_EBX, 8)
+#define X86_FEATURE_ERMS        X86_FEATURE(CPUID_7_EBX, 9)
+#define X86_FEATURE_AVX512F     X86_FEATURE(CPUID_7_EBX, 16)
+#define X86_FEATURE_SMAP        X86_FEATURE(CPUID_7_EBX, 20)
+#define X86_FEATURE_VPCLMULQDQ  X86_FEATURE(CPUID_7_ECX, 10)
+#define X86_FEATURE_FSRM        X86_FEATURE(CPUID_7_EDX, 4)
+#define X86_FEATURE_SYSCALL     X86_FEATURE(CPUID_80000001_EDX, 11)
+#define X86_FEATURE_NX          X86_FEATURE(CPUID_80000001_EDX, 20)
+#define X86_FEATURE_GBPAGES     X86_FEATURE(CPUID_80000001_EDX, 26)
+#define X86_FEATURE_RDTSCP      X86_FEATURE(CPUID_80000001_EDX, 27)
+#define X86_FEATURE_LM          X86_FEATURE(CPUID_80000001_EDX, 29)
+#define X86_FEATURE_XSAVEOPT    X86_FEATURE(CPUID_D_1_EAX, 0)
+#define X86_FEATURE_XSAVEC      X86_FEATURE(CPUID_D_1_EAX, 1)
+#define X86_FEATURE_XSAVES      X86_FEATURE(CPUID_D_1_EAX, 3)
+
+/* Model specific registers */
+#define MSR_EFER                0xC0000080
+#define EFER_SCE                (1UL << 0)
+#define EFER_LME                (1UL << 8)
+#define EFER_NXE                (1UL << 11)
+#define MSR_STAR                0xC0000081
+#define MSR_LSTAR               0xC0000082
+#define MSR_FMASK               0xC0000084
+#define MSR_FS_BASE             0xC0000100
+#define MSR_GS_BASE             0xC0000101
+#define MSR_TSC_DEADLINE        0x6E0
+
+/* GDT selectors installed by cpu_registers_init */
+#define GDT_KERNEL_CODE         0x08
+#define GDT_KERNEL_DATA         0x10
+#define GDT_USER_DATA           0x18
+#define GDT_USER_CODE           0x20
+#define GDT_TSS                 0x28
+#define GDT_RPL_USER            3
+
+/* RFLAGS bits */
+#define RFLAGS_TF               (1UL << 8)
+#define RFLAGS_IF               (1UL << 9)
+#define RFLAGS_DF               (1UL << 10)
+
+/* Control register bits */
+#define CR0_MP                  (1UL << 1)
+#define CR0_EM                  (1UL << 2)
+#define CR0_TS                  (1UL << 3)
+#define CR0_WP                  (1UL << 16)
+#define CR4_OSFXSR              (1UL << 9)
+#define CR4_OSXMMEXCPT          (1UL << 10)
+#define CR4_OSXSAVE             (1UL << 18)
+
+/* XCR0 state components */
+#define XFEATURE_X87            (1UL << 0)
+#define XFEATURE_SSE            (1UL << 1)
+#define XFEATURE_YMM            (1UL << 2)
+
+/* CPU information, filled once by cpu_detect_features */
 struct cpu_info {
-    uint32_t vendor_id[4];
-    uint32_t brand_string[12];
+    uint32_t vendor_id[4];                  /* 12 characters and a NUL */
+    uint32_t brand_string[13];              /* 48 characters and a NUL */
     uint32_t family;
     uint32_t model;
     uint32_t stepping;
-    uint32_t features_edx;
-    uint32_t features_ecx;
-    uint32_t ext_features_edx;
-    uint32_t ext_features_ecx;
-    bool long_mode_supported;
-    bool sse_supported;
-    bool fpu_supported;
+    uint32_t max_leaf;
+    uint32_t max_ext_leaf;
+    uint32_t features[CPU_FEATURE_WORDS];
 };
 
 /* Register state structure */
@@ -69,11 +157,13 @@ void cpu_early_init(void);
 int cpu_registers_init(void);
 void cpu_detect_features(void);
 bool cpu_has_feature(uint32_t feature);
+void cpu_clear_feature(uint32_t feature);
 void cpu_enable_sse(void);
 void cpu_enable_syscall(void);
 uint64_t cpu_read_msr(uint32_t msr);
 void cpu_write_msr(uint32_t msr, uint64_t value);
 void cpu_get_info(struct cpu_info *info);
+void cpu_set_kernel_stack(uint64_t stack_top);
 
 /* Inline assembly helpers */
 static inline void cpu_halt(void)
@@ -91,6 +181,25 @@ static inline void cpu_enable_interrupts(void)
     __asm__ volatile ("sti" ::: "memory");
 }
 
+/* Save RFLAGS and disable interrupts; undo with cpu_irq_restore */
+static inline uint64_t cpu_irq_save(void)
+{
+    uint64_t flags;
+    __asm__ volatile ("pushfq; pop %0; cli" : "=r" (flags) :: "memory");
+    return flags;
+}
+
+static inline void cpu_irq_restore(uint64_t flags)
+{
+    __asm__ volatile ("push %0; popfq" :: "r" (flags) : "memory", "cc");
+}
+
+/* Index of the executing CPU; only the boot CPU runs for now */
+static inline unsigned int cpu_current_id(void)
+{
+    return 0;
+}
+
 static inline uint64_t cpu_read_cr0(void)
 {
     uint64_t val;
@@ -103,6 +212,13 @@ static inline void cpu_write_cr0(uint64_t val)
     __asm__ volatile ("mov %0, %%cr0" :: "r" (val) : "memory");
 }
 
+static inline uint64_t cpu_read_cr2(void)
+{
+    uint64_t val;
+    __asm__ volatile ("mov %%cr2, %0" : "=r" (val));
+    return val;
+}
+
 static inline uint64_t cpu_read_cr3(void)
 {
     uint64_t val;
@@ -127,4 +243,37 @@ static inline void cpu_write_cr4(uint64_t val)
     __asm__ volatile ("mov %0, %%cr4" :: "r" (val) : "memory");
 }
 
+static inline void cpu_invlpg(uint64_t vaddr)
+{
+    __asm__ volatile ("invlpg (%0)" :: "r" (vaddr) : "memory");
+}
+
+static inline void cpu_cpuid(uint32_t leaf, uint32_t subleaf,
+                             uint32_t *eax, uint32_t *ebx,
+                             uint32_t *ecx, uint32_t *edx)
+{
+    __asm__ volatile ("cpuid"
+                      : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+                      : "a" (leaf), "c" (subleaf));
+}
+
+/* Clear CR0.TS, letting FPU and vector instructions run without #NM */
+static inline void cpu_clts(void)
+{
+    __asm__ volatile ("clts" ::: "memory");
+}
+
+static inline void cpu_xsetbv(uint32_t index, uint64_t value)
+{
+    __asm__ volatile ("xsetbv" :: "c" (index),
+                      "a" ((uint32_t)value), "d" ((uint32_t)(value >> 32)));
+}
+
+static inline uint64_t cpu_read_tsc(void)
+{
+    uint32_t low, high;
+    __asm__ volatile ("rdtsc" : "=a" (low), "=d" (high));
+    return ((uint64_t)high << 32) | low;
+}
+
 #endif /* _CPU_H */
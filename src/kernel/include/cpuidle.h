@@ -0,0 +1,43 @@
+/*
+ * Power1 OS - CPU Idle
+ * Idle states and the governor choosing between them
+ *
+ * An idle CPU enters the deepest state it expects to stay in long enough
+ * to pay back the state's exit latency. The expected idle time is the
+ * nearer of the next pending timer and a running average of past idle
+ * periods. Where CPUID offers MONITOR/MWAIT the states are the MWAIT
+ * C-states, armed on a per-CPU wake word; a store to that word wakes the
+ * CPU, so waking an idle CPU needs no interrupt. Otherwise the CPU halts.
+ *
+ * cpu_idle is called with interrupts disabled and returns with them
+ * disabled, after an interrupt or a wake.
+ */
+
+#ifndef _CPUIDLE_H
+#define _CPUIDLE_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+
+#define CPUIDLE_STATE_MAX       8       /* Poll, then MWAIT C1..C7 or HLT */
+
+/* State flags */
+#define CPUIDLE_FLAG_POLL       (1 << 0)    /* Spin on the wake word */
+#define CPUIDLE_FLAG_MWAIT      (1 << 1)    /* MWAIT on the wake word */
+#define CPUIDLE_FLAG_HLT        (1 << 2)    /* Halt; only interrupts wake it */
+
+struct cpuidle_state {
+    const char *name;
+    uint32_t flags;
+    uint32_t mwait_hint;        /* EAX for MWAIT: C-state and sub-state */
+    uint64_t exit_latency;      /* ns from wake to running again */
+    uint64_t target_residency;  /* ns of idle needed to gain from entering */
+};
+
+int cpuidle_init(void);
+void cpu_idle(void);
+bool cpuidle_wake(unsigned int cpu);
+void cpuidle_set_latency_limit(uint64_t ns);
+
+#endif /* _CPUIDLE_H */
@@ -9,6 +9,7 @@
 #include "stdint.h"
 #include "stdbool.h"
 #include "stddef.h"
+#include "process.h"
 
 /* Device types */
 #define DEVICE_TYPE_STORAGE     1
@@ -16,6 +17,13 @@
 #define DEVICE_TYPE_INPUT       3
 #define DEVICE_TYPE_OUTPUT      4
 #define DEVICE_TYPE_TIMER       5
+#define DEVICE_TYPE_MAX         8
+
+/* Registry limits */
+#define DEVICE_ID_ANY           0           /* Ask device_register for an ID */
+#define DEVICE_ID_MAX           4096
+#define DEVICE_ID_LEAF_BITS     6
+#define DEVICE_ID_LEAF_SIZE     (1 << DEVICE_ID_LEAF_BITS)
 
 /* Device status */
 #define DEVICE_STATUS_UNKNOWN   0
@@ -23,7 +31,50 @@
 #define DEVICE_STATUS_BUSY      2
 #define DEVICE_STATUS_ERROR     3
 
-/* Device structure */
+struct blk_queue;
+
+/* Completion handling modes */
+#define IO_MODE_ADAPTIVE        0   /* Policy only: choose from measured latency */
+#define IO_MODE_INTERRUPT       1   /* Sleep until the completion interrupt */
+#define IO_MODE_HYBRID          2   /* Yield for half the expected latency, then poll */
+#define IO_MODE_POLL            3   /* Busy-poll the completion queue */
+
+/* Completion capabilities, set by the driver */
+#define IO_CAP_IRQ              (1 << 0)    /* Completions raise interrupts */
+
+/* Adaptive thresholds on the mean completion latency, in TSC cycles */
+#define IO_POLL_MAX_LATENCY     40000
+#define IO_HYBRID_MAX_LATENCY   400000
+
+/* Generic device ioctl commands */
+#define DEVICE_IOCTL_GET_COMPLETION 0x4401  /* arg: struct io_completion_stats * */
+#define DEVICE_IOCTL_SET_COMPLETION 0x4402  /* arg: uint32_t * holding an IO_MODE_* */
+
+struct io_completion_stats {
+    uint32_t policy;            /* IO_MODE_*, as requested */
+    uint32_t mode;              /* IO_MODE_* in effect */
+    uint64_t mean_latency;      /* Moving average, TSC cycles */
+    uint64_t completions;       /* Synchronous waits finished */
+    uint64_t interrupt_waits;
+    uint64_t hybrid_waits;
+    uint64_t poll_waits;
+    uint64_t polls;             /* Calls into device_ops.poll */
+    uint64_t empty_polls;       /* ... that found nothing */
+    uint64_t mode_switches;
+};
+
+/* Per-device completion handling state */
+struct io_completion {
+    uint32_t caps;              /* IO_CAP_* */
+    struct io_completion_stats stats;
+    struct wait_queue waiters;  /* Tasks sleeping in interrupt mode */
+};
+
+/*
+ * Device structure. Registered devices are reachable without locks: by ID
+ * through a two-level table and by type through type_next, so both links
+ * are only written by the registry under its lock.
+ */
 struct device {
     uint32_t id;
     uint32_t type;
@@ -31,7 +82,44 @@ struct device {
     char name[32];
     void *driver_data;
     struct device_ops *ops;
-    struct device *next;
+    struct blk_queue *queue;    /* Block layer state of storage devices */
+    struct io_completion completion;
+    struct device *type_next;   /* Next registered device of the same type */
+};
+
+/* Asynchronous I/O request operations */
+#define IO_OP_READ              0
+#define IO_OP_WRITE             1
+#define IO_OP_FLUSH             2
+
+#define IO_SECTOR_SIZE          512
+#define IO_MAX_SEGMENTS         32
+#define IO_STATUS_PENDING       1   /* Positive while in flight */
+
+/* Request flags */
+#define IO_REQ_POLLED           (1 << 0)    /* Submitter polls; no interrupt wanted */
+
+/* One physically contiguous piece of a request's data */
+struct io_segment {
+    void *buffer;               /* Direct-mapped kernel address */
+    uint32_t length;
+};
+
+/*
+ * Asynchronous request handed to device_ops.submit. The driver owns it
+ * until it sets status to KERNEL_SUCCESS or an error and calls complete,
+ * which may happen from interrupt context.
+ */
+struct io_request {
+    uint32_t op;
+    uint16_t nr_segments;
+    uint16_t queue_hint;        /* Preferred hardware queue, usually the CPU */
+    uint32_t flags;             /* IO_REQ_* */
+    uint64_t sector;            /* IO_SECTOR_SIZE units */
+    struct io_segment segments[IO_MAX_SEGMENTS];
+    volatile int status;
+    void (*complete)(struct io_request *req);
+    void *private;
 };
 
 /* Device operations */
@@ -41,6 +129,8 @@ struct device_ops {
     int (*write)(struct device *dev, const void *buffer, size_t size, uint64_t offset);
     int (*ioctl)(struct device *dev, uint32_t cmd, void *arg);
     void (*cleanup)(struct device *dev);
+    int (*submit)(struct device *dev, struct io_request *req);
+    int (*poll)(struct device *dev, unsigned int queue);  /* Reap completions */
 };
 
 /* Function prototypes */
@@ -49,5 +139,16 @@ int device_register(struct device *dev);
 int device_unregister(uint32_t device_id);
 struct device *device_find_by_type(uint32_t type);
 struct device *device_find_by_id(uint32_t id);
+struct device *device_next_of_type(struct device *dev);
+int device_ioctl(struct device *dev, uint32_t cmd, void *arg);
+int device_submit(struct device *dev, struct io_request *req);
+int device_io_sync(struct device *dev, uint32_t op, void *buffer, size_t size, uint64_t offset);
+
+/* Completion handling */
+void device_completion_init(struct device *dev);
+int device_completion_ioctl(struct device *dev, uint32_t cmd, void *arg);
+uint32_t device_io_flags(struct device *dev);
+void device_io_wait(struct device *dev, unsigned int queue, volatile bool *done, uint64_t start);
+void device_io_wake(struct device *dev);
 
 #endif /* _DEVICES_H */
@@ -0,0 +1,81 @@
+/*
+ * Power1 OS - ELF Definitions
+ * ELF64 file format structures for the program loader
+ */
+
+#ifndef _ELF_H
+#define _ELF_H
+
+#include "stdint.h"
+
+/* e_ident */
+#define EI_NIDENT           16
+#define EI_CLASS            4
+#define EI_DATA             5
+#define ELFMAG0             0x7F
+#define ELFMAG1             'E'
+#define ELFMAG2             'L'
+#define ELFMAG3             'F'
+#define ELFCLASS64          2
+#define ELFDATA2LSB         1
+
+/* e_type */
+#define ET_EXEC             2
+#define ET_DYN              3
+
+/* e_machine */
+#define EM_X86_64           62
+
+/* p_type */
+#define PT_NULL             0
+#define PT_LOAD             1
+#define PT_DYNAMIC          2
+#define PT_INTERP           3
+#define PT_PHDR             6
+
+/* p_flags */
+#define PF_X                0x1
+#define PF_W                0x2
+#define PF_R                0x4
+
+/* Auxiliary vector types */
+#define AT_NULL             0
+#define AT_PHDR             3
+#define AT_PHENT            4
+#define AT_PHNUM            5
+#define AT_PAGESZ           6
+#define AT_BASE             7
+#define AT_ENTRY            9
+#define AT_RANDOM           25
+
+typedef struct {
+    uint8_t  e_ident[EI_NIDENT];
+    uint16_t e_type;
+    uint16_t e_machine;
+    uint32_t e_version;
+    uint64_t e_entry;
+    uint64_t e_phoff;
+    uint64_t e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize;
+    uint16_t e_phentsize;
+    uint16_t e_phnum;
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
+} Elf64_Ehdr;
+
+typedef struct {
+    uint32_t p_type;
+    uint32_t p_flags;
+    uint64_t p_offset;
+    uint64_t p_vaddr;
+    uint64_t p_paddr;
+    uint64_t p_filesz;
+    uint64_t p_memsz;
+    uint64_t p_align;
+} Elf64_Phdr;
+
+int elf_binfmt_init(void);
+
+#endif /* _ELF_H */
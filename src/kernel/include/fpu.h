@@ -0,0 +1,62 @@
+/*
+ * Power1 OS - FPU and Extended State
+ * Lazy switching of the x87, SSE and AVX register state
+ *
+ * The registers hold one task's user state at a time, the CPU's owner.
+ * A switch to any other task sets CR0.TS, so the state is only moved
+ * when that task actually executes an FPU or vector instruction: the
+ * resulting #NM saves the owner's registers and loads the task's own.
+ * Tasks that never touch the FPU never get a save area.
+ *
+ * The kernel is built without vector instructions. Code that wants them
+ * brackets their use with kernel_fpu_begin and kernel_fpu_end; begin
+ * saves the owner's state only if it is live in the registers, and the
+ * owner reloads it on its next use. Such a region must not sleep or
+ * nest. The vector code itself lives in lib/simd, the only place built
+ * with vector instructions enabled.
+ *
+ * The state is saved with the best XSAVE variant the CPU offers, or
+ * FXSAVE without XSAVE, chosen once at boot.
+ */
+
+#ifndef _FPU_H
+#define _FPU_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+
+struct task;
+
+#define FPU_FXSAVE_SIZE         512
+#define FPU_AREA_ALIGN          64
+#define FPU_FCW_DEFAULT         0x037F  /* x87 exceptions masked, extended precision */
+#define FPU_MXCSR_DEFAULT       0x1F80  /* SSE exceptions masked, round to nearest */
+
+extern uint32_t fpu_xstate_size;
+extern void (*fpu_save_impl)(void *area);
+extern void (*fpu_restore_impl)(const void *area);
+
+void fpu_xstate_init(void);
+int fpu_init(void);
+
+/* Scheduler and process lifetime hooks */
+void fpu_switch(struct task *next);
+int fpu_fork(struct task *child, struct task *parent);
+void fpu_release(struct task *task);
+
+/* Vector instructions in kernel code */
+void kernel_fpu_begin(void);
+void kernel_fpu_end(void);
+
+static inline void fpu_save(void *area)
+{
+    fpu_save_impl(area);
+}
+
+static inline void fpu_restore(const void *area)
+{
+    fpu_restore_impl(area);
+}
+
+#endif /* _FPU_H */
@@ -8,6 +8,8 @@
 
 #include "stdint.h"
 #include "stddef.h"
+#include "stdbool.h"
+#include "atomic.h"
 
 /* File types */
 #define S_IFREG     0x8000  /* Regular file */
@@ -27,6 +29,38 @@
 #define S_IWOTH     0x0002  /* Write by others */
 #define S_IXOTH     0x0001  /* Execute by others */
 
+/* Open flags */
+#define O_RDONLY    0x0000
+#define O_WRONLY    0x0001
+#define O_RDWR      0x0002
+#define O_ACCMODE   0x0003
+#define O_NONBLOCK  0x0800
+
+/* splice() flags */
+#define SPLICE_F_MOVE       0x01    /* Advisory: pages are always moved */
+#define SPLICE_F_NONBLOCK   0x02    /* Do not wait on the pipe */
+#define SPLICE_F_MORE       0x04    /* Advisory: more data follows */
+
+/* Page references a pipe holds */
+#define PIPE_BUFFERS        16
+
+/* Descriptor table size */
+#define FD_MAX      256
+
+/* Page cache hash table size (buckets) */
+#define PAGE_CACHE_HASH_BITS    12
+
+/* Dirty pages an inode may collect before writes start writeback */
+#define PAGE_CACHE_DIRTY_BATCH  64
+
+struct page;
+struct poll_table;
+struct epitem;
+
+/* Path lookup limits */
+#define PATH_MAX    256
+#define VFS_NAMESPACE_MAX   128
+
 /* File descriptor structure */
 struct file_descriptor {
     uint32_t fd;
@@ -34,6 +68,15 @@ struct file_descriptor {
     uint64_t offset;
     struct inode *inode;
     struct file_operations *ops;
+    atomic_t refcount;          /* Descriptor table slots referring to it */
+    void *private_data;         /* Owned by ops */
+    struct epitem *epitems;     /* epoll interests in this description */
+};
+
+/* Per-process descriptor table, shared by vfork children */
+struct fd_table {
+    atomic_t users;
+    struct file_descriptor *fds[FD_MAX];
 };
 
 /* Inode structure */
@@ -48,9 +91,26 @@ struct inode {
     uint64_t mtime;
     uint64_t ctime;
     struct file_operations *ops;
+    struct page_cache_ops *pc_ops;
+    uint64_t nrpages;           /* Pages of this inode in the page cache */
+    uint64_t nrdirty;           /* Dirty pages awaiting writeback */
+    uint64_t dirty_first;       /* Page index range holding them */
+    uint64_t dirty_last;
+    atomic_t refcount;
     void *private_data;
 };
 
+/*
+ * Page cache backing operations. readpage fills one page-sized frame with
+ * file contents (zero-filling past EOF); mappings and reads are then served
+ * straight from the cached frame.
+ */
+struct page_cache_ops {
+    int (*readpage)(struct inode *inode, struct page *page);
+    int (*writepage)(struct inode *inode, struct page *page);
+    void (*release)(struct inode *inode);   /* Last reference dropped */
+};
+
 /* File operations */
 struct file_operations {
     int (*open)(struct inode *inode, struct file_descriptor *fd);
@@ -58,6 +118,7 @@ struct file_operations {
     ssize_t (*read)(struct file_descriptor *fd, void *buf, size_t count);
     ssize_t (*write)(struct file_descriptor *fd, const void *buf, size_t count);
     int (*ioctl)(struct file_descriptor *fd, uint32_t cmd, void *arg);
+    uint32_t (*poll)(struct file_descriptor *fd, struct poll_table *pt);
 };
 
 /* Function prototypes */
@@ -67,5 +128,44 @@ struct file_descriptor *vfs_open(const char *pathname, int flags);
 int vfs_close(struct file_descriptor *fd);
 ssize_t vfs_read(struct file_descriptor *fd, void *buf, size_t count);
 ssize_t vfs_write(struct file_descriptor *fd, const void *buf, size_t count);
+int vfs_ioctl(struct file_descriptor *fd, uint32_t cmd, void *arg);
+ssize_t vfs_read_inode(struct inode *inode, uint64_t offset, void *buf, size_t count);
+
+struct inode *vfs_lookup(const char *pathname);
+int vfs_bind(const char *pathname, struct inode *inode);
+void inode_get(struct inode *inode);
+void inode_put(struct inode *inode);
+
+/* Descriptor table */
+struct file_descriptor *fd_get(int fd);
+int fd_install(struct file_descriptor *file);
+struct file_descriptor *fd_remove(int fd);
+struct fd_table *fd_table_create(void);
+struct fd_table *fd_table_clone(struct fd_table *table);
+void fd_table_release(struct fd_table *table);
+void file_get(struct file_descriptor *file);
+void file_put(struct file_descriptor *file);
+
+/* Page cache */
+struct page *page_cache_find(struct inode *inode, uint64_t index);
+struct page *page_cache_get(struct inode *inode, uint64_t index);
+ssize_t page_cache_write(struct inode *inode, uint64_t offset, const void *buf, size_t count);
+void page_cache_set_dirty(struct page *page);
+int page_cache_writeback(struct inode *inode);
+void page_cache_evict_inode(struct inode *inode);
+
+/* Pipes and splicing */
+int pipe_create(struct file_descriptor *ends[2], uint32_t flags);
+ssize_t do_splice(struct file_descriptor *in, uint64_t *off_in,
+                  struct file_descriptor *out, uint64_t *off_out,
+                  size_t len, uint32_t flags);
+ssize_t do_sendfile(struct file_descriptor *out, struct file_descriptor *in,
+                    uint64_t *offset, size_t count);
+
+/* Block device files */
+int blockdev_init(void);
+
+/* Anonymous shared memory objects */
+struct inode *shmem_inode_create(uint64_t size);
 
 #endif /* _FS_H */
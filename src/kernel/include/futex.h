@@ -0,0 +1,47 @@
+/*
+ * Power1 OS - Futexes
+ * Kernel wait queues behind user-space atomic words
+ *
+ * A user-space lock is a 32-bit word updated with atomic instructions;
+ * the kernel is only entered when a thread has to sleep or wake someone.
+ * The usual mutex: 0 unlocked, 1 locked, 2 locked with waiters.
+ *
+ *     lock:   if cmpxchg(word, 0, 1) succeeds, done          (no syscall)
+ *             while xchg(word, 2) != 0: futex(word, FUTEX_WAIT, 2)
+ *     unlock: if xchg(word, 0) == 2: futex(word, FUTEX_WAKE, 1)
+ *
+ * FUTEX_WAIT rechecks the word against the expected value under the
+ * bucket lock, so a wake between the user-space check and the sleep is
+ * never lost. Waiters are keyed by the physical address of the word, so
+ * a futex in shared memory works across processes.
+ */
+
+#ifndef _FUTEX_H
+#define _FUTEX_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+
+/* Operations (Linux numbering) */
+#define FUTEX_WAIT              0
+#define FUTEX_WAKE              1
+#define FUTEX_REQUEUE           3
+#define FUTEX_CMP_REQUEUE       4
+
+#define FUTEX_PRIVATE_FLAG      128     /* Accepted; keys are physical anyway */
+#define FUTEX_CLOCK_REALTIME    256
+#define FUTEX_CMD_MASK          (~(FUTEX_PRIVATE_FLAG | FUTEX_CLOCK_REALTIME))
+
+#define FUTEX_HASH_BITS         8
+#define FUTEX_HASH_SIZE         (1 << FUTEX_HASH_BITS)
+
+struct timespec;
+
+int futex_init(void);
+int64_t futex_wait(uint32_t *uaddr, uint32_t val, const struct timespec *timeout);
+int64_t futex_wake(uint32_t *uaddr, uint32_t nr_wake);
+int64_t futex_requeue(uint32_t *uaddr, uint32_t nr_wake, uint32_t nr_requeue,
+                      uint32_t *uaddr2, bool compare, uint32_t val3);
+
+#endif /* _FUTEX_H */
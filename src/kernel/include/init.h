@@ -0,0 +1,57 @@
+/*
+ * Power1 OS - Initcalls
+ * Subsystem initialisers registered in the .initcall section
+ *
+ * Each subsystem registers its initialiser with initcall(), naming the
+ * initcalls it needs to have finished first. initcalls_run orders the
+ * table by those dependencies, runs asynchronous entries in kernel
+ * threads so independent probes overlap their device waits, and finally
+ * releases the .init sections.
+ */
+
+#ifndef _INIT_H
+#define _INIT_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+
+#define INITCALL_MAX            32
+#define INITCALL_MAX_DEPS       8
+
+/* Initcall flags */
+#define INITCALL_ASYNC          (1 << 0)    /* May run in its own thread */
+#define INITCALL_OPTIONAL       (1 << 1)    /* Failure is recorded, not fatal */
+
+/* Code and data only used during boot; freed once the initcalls are done */
+#define __init                  __attribute__((section(".init.text"), cold))
+#define __initdata              __attribute__((section(".init.data")))
+
+struct initcall {
+    const char *name;
+    int (*fn)(void);
+    const char *deps;           /* Comma-separated initcall names */
+    uint32_t flags;
+};
+
+/*
+ * initcall - Register @fn to run at boot
+ * @flags: INITCALL_* flags
+ * @...: Initcalls that must finish before @fn starts
+ */
+#define initcall(fn, flags, ...)                                            \
+    static const struct initcall __initcall_##fn                            \
+        __attribute__((used, section(".initcall"), aligned(8))) = {         \
+        #fn, fn, #__VA_ARGS__, flags                                        \
+    }
+
+/* Linker provided bounds */
+extern const struct initcall __initcall_start[];
+extern const struct initcall __initcall_end[];
+extern uint8_t __init_begin[];
+extern uint8_t __init_end[];
+
+int initcalls_run(void);
+const char *initcall_failure_message(void);
+
+#endif /* _INIT_H */
@@ -0,0 +1,88 @@
+/*
+ * Power1 OS - Interrupt Management Definitions
+ * IDT layout, exception vectors and interrupt dispatch
+ */
+
+#ifndef _INTERRUPTS_H
+#define _INTERRUPTS_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+
+/* Vector space */
+#define IDT_ENTRIES                 256
+#define EXCEPTION_COUNT             32
+#define IRQ_BASE_VECTOR             32
+#define IRQ_DYNAMIC_FIRST           48      /* 32-47 stay with the masked PIC */
+#define IRQ_DYNAMIC_LAST            0xEF
+#define LAPIC_TIMER_VECTOR          0xF0
+#define SPURIOUS_VECTOR             0xFF
+
+/* Processors the interrupt layer can address */
+#define CPU_MAX                     64
+
+/* CPU exception vectors */
+#define EXCEPTION_DIVIDE_ERROR      0
+#define EXCEPTION_DEBUG             1
+#define EXCEPTION_NMI               2
+#define EXCEPTION_BREAKPOINT        3
+#define EXCEPTION_INVALID_OPCODE    6
+#define EXCEPTION_DEVICE_NA         7
+#define EXCEPTION_DOUBLE_FAULT      8
+#define EXCEPTION_GENERAL_PROT      13
+#define EXCEPTION_PAGE_FAULT        14
+
+/* Gate types */
+#define IDT_GATE_INTERRUPT          0x8E    /* Present, DPL0, 64-bit interrupt gate */
+#define IDT_GATE_TRAP               0x8F    /* Present, DPL0, 64-bit trap gate */
+
+/* Kernel code selector installed by boot.asm */
+#define KERNEL_CODE_SELECTOR        0x08
+
+/*
+ * Register state saved by the common entry stub in isr.asm, lowest
+ * address first. Vector and error code are pushed by the per-vector stub;
+ * everything from rip on is the hardware frame.
+ */
+struct interrupt_frame {
+    uint64_t r15, r14, r13, r12, r11, r10, r9, r8;
+    uint64_t rbp, rdi, rsi, rdx, rcx, rbx, rax;
+    uint64_t vector;
+    uint64_t error_code;
+    uint64_t rip, cs, rflags, rsp, ss;
+} __attribute__((packed));
+
+typedef void (*interrupt_handler_t)(struct interrupt_frame *frame);
+
+/* Device interrupt handler, called with the data given at allocation */
+typedef void (*irq_handler_t)(void *data);
+
+/* Function prototypes */
+int interrupt_system_init(void);
+int interrupt_register_handler(uint8_t vector, interrupt_handler_t handler);
+void interrupt_dispatch(struct interrupt_frame *frame);
+int interrupt_alloc_vector(irq_handler_t handler, void *data);
+void interrupt_free_vector(int vector);
+
+/* Local APIC */
+int lapic_init(void);
+void lapic_eoi(void);
+uint32_t lapic_id(void);
+void lapic_add_cpu(uint32_t apic_id);
+unsigned int lapic_cpu_count(void);
+unsigned int lapic_online_count(void);
+uint32_t lapic_cpu_apic_id(unsigned int cpu);
+int lapic_timer_init(uint8_t vector, uint64_t tsc_khz);
+void lapic_timer_arm(uint64_t tsc_deadline);
+
+/* Exception handlers owned by other subsystems */
+void page_fault_handler(struct interrupt_frame *frame);
+
+/* Interrupted context came from ring 3 */
+static inline bool interrupt_from_user(const struct interrupt_frame *frame)
+{
+    return (frame->cs & 3) == 3;
+}
+
+#endif /* _INTERRUPTS_H */
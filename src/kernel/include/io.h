@@ -26,6 +26,65 @@ static inline uint8_t inb(uint16_t port)
     return data;
 }
 
+/**
+ * outl - Output doubleword to I/O port
+ */
+static inline void outl(uint16_t port, uint32_t data)
+{
+    __asm__ volatile ("outl %0, %1" :: "a"(data), "Nd"(port));
+}
+
+/**
+ * inl - Input doubleword from I/O port
+ */
+static inline uint32_t inl(uint16_t port)
+{
+    uint32_t data;
+    __asm__ volatile ("inl %1, %0" : "=a"(data) : "Nd"(port));
+    return data;
+}
+
+/* Memory-mapped register access; volatile keeps each access */
+static inline uint8_t mmio_read8(const volatile void *addr)
+{
+    return *(const volatile uint8_t *)addr;
+}
+
+static inline uint16_t mmio_read16(const volatile void *addr)
+{
+    return *(const volatile uint16_t *)addr;
+}
+
+static inline uint32_t mmio_read32(const volatile void *addr)
+{
+    return *(const volatile uint32_t *)addr;
+}
+
+static inline uint64_t mmio_read64(const volatile void *addr)
+{
+    return *(const volatile uint64_t *)addr;
+}
+
+static inline void mmio_write8(volatile void *addr, uint8_t value)
+{
+    *(volatile uint8_t *)addr = value;
+}
+
+static inline void mmio_write16(volatile void *addr, uint16_t value)
+{
+    *(volatile uint16_t *)addr = value;
+}
+
+static inline void mmio_write32(volatile void *addr, uint32_t value)
+{
+    *(volatile uint32_t *)addr = value;
+}
+
+static inline void mmio_write64(volatile void *addr, uint64_t value)
+{
+    *(volatile uint64_t *)addr = value;
+}
+
 /**
  * io_wait - Short delay for I/O operations
  */
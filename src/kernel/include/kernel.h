@@ -36,6 +36,7 @@ extern int interrupt_system_init(void);
 extern int device_manager_init(void);
 extern int filesystem_init(void);
 extern int syscall_interface_init(void);
+extern int process_manager_init(void);
 extern int runtime_services_init(void);
 extern int system_base_init(void);
 
@@ -55,6 +56,16 @@ struct multiboot_tag;
 #define KERNEL_ERROR_NOMEM      -1
 #define KERNEL_ERROR_INVALID    -2
 #define KERNEL_ERROR_NOTFOUND   -3
+#define KERNEL_ERROR_FAULT      -4
+#define KERNEL_ERROR_NOSPC      -5
+#define KERNEL_ERROR_PERM       -6
+#define KERNEL_ERROR_BADF       -7
+#define KERNEL_ERROR_NOSYS      -8
+#define KERNEL_ERROR_NOEXEC     -9
+#define KERNEL_ERROR_CHILD      -10
+#define KERNEL_ERROR_AGAIN      -11
+#define KERNEL_ERROR_TIMEDOUT   -12
+#define KERNEL_ERROR_PIPE       -13
 
 /* Console interface */
 struct console_ops {
@@ -70,13 +81,15 @@ struct memory_region {
     uint64_t base_addr;
     uint64_t length;
     uint32_t type;
-    struct memory_region *next;
 };
 
+#define MEMORY_MAP_MAX          128
+
 /* Early kernel state */
 struct kernel_early_state {
     struct multiboot_info *mb_info;
-    struct memory_region *memory_map;
+    struct memory_region *memory_map;   /* Sorted by base, no overlaps */
+    size_t memory_map_count;
     uint64_t total_memory;
     uint64_t available_memory;
     bool console_initialized;
@@ -114,6 +127,7 @@ extern struct kernel_early_state kernel_state;
 #define ARRAY_SIZE(x)           (sizeof(x) / sizeof((x)[0]))
 #define MIN(a, b)               ((a) < (b) ? (a) : (b))
 #define MAX(a, b)               ((a) > (b) ? (a) : (b))
+#define DIV_ROUND_UP(n, d)      (((n) + (d) - 1) / (d))
 
 /* Compiler attributes */
 #define __packed                __attribute__((packed))
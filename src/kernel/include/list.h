@@ -0,0 +1,83 @@
+/*
+ * Power1 OS - Intrusive Linked Lists
+ * Circular doubly linked lists embedded in the objects they chain
+ */
+
+#ifndef _LIST_H
+#define _LIST_H
+
+#include "stddef.h"
+#include "stdbool.h"
+
+/* List head embedded in every member object */
+struct list_head {
+    struct list_head *next;
+    struct list_head *prev;
+};
+
+#define LIST_HEAD_INIT(name)    { &(name), &(name) }
+#define LIST_HEAD(name)         struct list_head name = LIST_HEAD_INIT(name)
+
+/* Recover the containing object from an embedded list head */
+#define container_of(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define list_entry(ptr, type, member)   container_of(ptr, type, member)
+#define list_first_entry(head, type, member) \
+    list_entry((head)->next, type, member)
+
+#define list_for_each(pos, head) \
+    for ((pos) = (head)->next; (pos) != (head); (pos) = (pos)->next)
+
+#define list_for_each_safe(pos, tmp, head) \
+    for ((pos) = (head)->next, (tmp) = (pos)->next; (pos) != (head); \
+         (pos) = (tmp), (tmp) = (pos)->next)
+
+static inline void list_init(struct list_head *head)
+{
+    head->next = head;
+    head->prev = head;
+}
+
+static inline void __list_insert(struct list_head *entry,
+                                 struct list_head *prev,
+                                 struct list_head *next)
+{
+    next->prev = entry;
+    entry->next = next;
+    entry->prev = prev;
+    prev->next = entry;
+}
+
+/**
+ * list_add - Insert entry right after head (stack order)
+ */
+static inline void list_add(struct list_head *entry, struct list_head *head)
+{
+    __list_insert(entry, head, head->next);
+}
+
+/**
+ * list_add_tail - Insert entry right before head (queue order)
+ */
+static inline void list_add_tail(struct list_head *entry, struct list_head *head)
+{
+    __list_insert(entry, head->prev, head);
+}
+
+/**
+ * list_del - Unlink entry and leave it self-referencing
+ */
+static inline void list_del(struct list_head *entry)
+{
+    entry->next->prev = entry->prev;
+    entry->prev->next = entry->next;
+    list_init(entry);
+}
+
+static inline bool list_empty(const struct list_head *head)
+{
+    return head->next == head;
+}
+
+#endif /* _LIST_H */
@@ -0,0 +1,68 @@
+/*
+ * Power1 OS - Lock Statistics
+ * Optional per-class contention, wait and hold time accounting
+ *
+ * Built only with -DLOCK_STAT (make lockstat-build). Every lock carries a
+ * struct lock_stat naming its class; locks never given one count towards
+ * the default class of their type. Times are in TSC cycles. Without
+ * LOCK_STAT the hooks compile away and locks keep their plain layout.
+ */
+
+#ifndef _LOCKSTAT_H
+#define _LOCKSTAT_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+#ifdef LOCK_STAT
+
+#include "cpu.h"
+
+/* Counters shared by every lock of one kind, e.g. all inode locks */
+struct lock_class {
+    const char *name;
+    uint64_t acquisitions;
+    uint64_t contentions;       /* Acquisitions that had to wait */
+    uint64_t wait_cycles;
+    uint64_t max_wait;
+    uint64_t holds;             /* Exclusive holds only */
+    uint64_t hold_cycles;
+    uint64_t max_hold;
+    bool registered;
+    struct lock_class *next;
+};
+
+/* Per-lock state */
+struct lock_stat {
+    struct lock_class *class;
+    uint64_t acquired_at;
+};
+
+#define DEFINE_LOCK_CLASS(var, label)   struct lock_class var = { .name = (label) }
+#define LOCK_STAT_INIT                  , { 0, 0 }
+
+extern struct lock_class lock_class_spinlock;
+extern struct lock_class lock_class_mcs;
+extern struct lock_class lock_class_rwlock;
+
+void lock_stat_acquired(struct lock_stat *stat, struct lock_class *fallback,
+                        uint64_t wait_start, bool contended, bool exclusive);
+void lock_stat_released(struct lock_stat *stat);
+void lock_stat_report(void);
+
+#define lock_stat_set_class(lock, cls)  ((lock)->stat.class = (cls))
+#define lock_stat_now()                 cpu_read_tsc()
+
+#else /* !LOCK_STAT */
+
+#define DEFINE_LOCK_CLASS(var, label)   extern struct lock_class var
+#define LOCK_STAT_INIT
+#define lock_stat_set_class(lock, cls)  ((void)(lock))
+
+static inline void lock_stat_report(void)
+{
+}
+
+#endif /* LOCK_STAT */
+
+#endif /* _LOCKSTAT_H */
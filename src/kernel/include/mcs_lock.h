@@ -0,0 +1,51 @@
+/*
+ * Power1 OS - MCS Queued Locks
+ * FIFO spinlocks where every waiter spins on its own cache line
+ *
+ * A ticket lock makes all waiters poll the same line, so each release
+ * costs a broadcast invalidation that grows with the number of CPUs in
+ * line. An MCS lock links waiters into a queue of caller-provided nodes;
+ * the holder hands over by writing only its successor's node, so the
+ * release cost stays constant however many CPUs wait. The node must stay
+ * valid from mcs_lock until the matching mcs_unlock, which in practice
+ * means a local variable in the function holding the lock.
+ */
+
+#ifndef _MCS_LOCK_H
+#define _MCS_LOCK_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+#include "atomic.h"
+#include "lockstat.h"
+
+struct mcs_node {
+    struct mcs_node *next;
+    bool locked;                /* Set by the predecessor on handoff */
+} __attribute__((aligned(64)));
+
+typedef struct {
+    struct mcs_node *tail;      /* Last waiter, or the holder, or NULL */
+#ifdef LOCK_STAT
+    struct lock_stat stat;
+#endif
+} mcs_lock_t;
+
+#define MCS_LOCK_INIT           { NULL LOCK_STAT_INIT }
+
+static inline void mcs_lock_init(mcs_lock_t *lock)
+{
+    *lock = (mcs_lock_t)MCS_LOCK_INIT;
+}
+
+static inline bool mcs_is_locked(mcs_lock_t *lock)
+{
+    return __atomic_load_n(&lock->tail, __ATOMIC_RELAXED) != NULL;
+}
+
+void mcs_lock(mcs_lock_t *lock, struct mcs_node *node);
+bool mcs_trylock(mcs_lock_t *lock, struct mcs_node *node);
+void mcs_unlock(mcs_lock_t *lock, struct mcs_node *node);
+
+#endif /* _MCS_LOCK_H */
@@ -9,6 +9,10 @@
 #include "stdint.h"
 #include "stddef.h"
 #include "stdbool.h"
+#include "atomic.h"
+#include "list.h"
+
+struct inode;
 
 /* Memory layout constants */
 #define PAGE_SIZE                   4096
@@ -20,6 +24,23 @@
 #define KERNEL_HEAP_START           0xFFFFFFFF90000000UL
 #define USER_SPACE_END              0x00007FFFFFFFFFFF
 
+/*
+ * The kernel is linked at 1MB and runs from the identity mapping built by
+ * boot.asm, so PML4 slot 0 stays a supervisor-only direct map of physical
+ * memory (extended to all of RAM by memory_manager_init) and is shared by
+ * every address space. User space starts at the next PML4 slot.
+ */
+#define DIRECT_MAP_BASE             0x0000000000000000UL
+#define DIRECT_MAP_LIMIT            0x0000008000000000UL  /* 512GB */
+#define USER_SPACE_START            0x0000008000000000UL
+#define USER_MMAP_BASE              0x0000100000000000UL
+#define USER_STACK_TOP              0x00007FFFFFFFF000UL
+#define USER_STACK_SIZE             (8UL * 1024 * 1024)
+
+/* Kernel window for device memory (PML4 slot 508), mapped uncached */
+#define MMIO_BASE                   0xFFFFFE0000000000UL
+#define MMIO_SIZE                   0x0000008000000000UL  /* 512GB */
+
 /* Page table entry flags */
 #define PAGE_PRESENT                (1UL << 0)
 #define PAGE_WRITABLE               (1UL << 1)
@@ -31,6 +52,14 @@
 #define PAGE_HUGE                   (1UL << 7)
 #define PAGE_GLOBAL                 (1UL << 8)
 #define PAGE_NO_EXECUTE             (1UL << 63)
+#define PAGE_ADDR_MASK              0x000FFFFFFFFFF000UL
+
+/* Page fault error code bits */
+#define PF_PRESENT                  (1 << 0)
+#define PF_WRITE                    (1 << 1)
+#define PF_USER                     (1 << 2)
+#define PF_RESERVED                 (1 << 3)
+#define PF_INSTR                    (1 << 4)
 
 /* Memory region types */
 #define MEMORY_TYPE_AVAILABLE       1
@@ -44,6 +73,51 @@
 #define ALLOC_DMA                   (1 << 1)
 #define ALLOC_ATOMIC                (1 << 2)
 
+/* Buddy allocator geometry: blocks of 2^0 .. 2^(PMEM_MAX_ORDER-1) pages */
+#define PMEM_MAX_ORDER              11
+
+/*
+ * Deferred frame initialisation: RAM below PMEM_EAGER_LIMIT is usable when
+ * memory_manager_init returns; the rest is added by background workers in
+ * chunks that are a multiple of the largest buddy block.
+ */
+#define PMEM_EAGER_LIMIT            (256UL << 20)
+#define PMEM_DEFERRED_CHUNK         (32UL << (PMEM_MAX_ORDER - 1))  /* 128MB of pages */
+
+/* Per-node pool of pages zeroed by the idle task for ALLOC_ZERO */
+#define ZERO_POOL_TARGET            256     /* Pages kept per node */
+#define ZERO_POOL_BATCH             16      /* Pages zeroed between idle checks */
+#define ZERO_POOL_RESERVE           1024    /* Free pages of the node the pool leaves alone */
+
+/* Page frame flags */
+#define PG_RESERVED                 (1 << 0)  /* Never handed to the allocator */
+#define PG_BUDDY                    (1 << 1)  /* Head of a free buddy block */
+#define PG_SLAB                     (1 << 2)  /* Owned by a kmalloc size class */
+#define PG_CACHE                    (1 << 3)  /* Member of the page cache */
+#define PG_UPTODATE                 (1 << 4)  /* Contents valid */
+#define PG_DIRTY                    (1 << 5)  /* Modified through a mapping */
+#define PG_ANON                     (1 << 6)  /* Anonymous process memory */
+#define PG_WRITEBACK                (1 << 7)  /* Being written to its backing store */
+
+/*
+ * Page frame descriptor - one per physical page, indexed by PFN in mem_map.
+ * The refcount counts every user of the frame: page cache membership,
+ * each page table entry mapping it and transient kernel references.
+ */
+struct page {
+    uint32_t flags;
+    atomic_t refcount;
+    uint32_t order;             /* Buddy order, or kmalloc class for PG_SLAB */
+    uint32_t node;              /* NUMA node of the frame */
+    struct inode *mapping;      /* Owning inode for PG_CACHE pages */
+    uint64_t index;             /* Page index within mapping */
+    struct page *hash_next;     /* Page cache hash chain */
+    struct list_head list;      /* Buddy free list linkage */
+};
+
+extern struct page *mem_map;
+extern uint64_t max_pfn;
+
 /* Function prototypes */
 int memory_manager_init(void);
 void early_memory_init(void *mb_info);
@@ -56,11 +130,26 @@ void pmem_free_pages(void *pages, size_t count);
 uint64_t pmem_get_total_memory(void);
 uint64_t pmem_get_available_memory(void);
 
+/* Page frame interface */
+struct page *page_alloc(uint32_t order, uint32_t flags);
+void page_free(struct page *page, uint32_t order);
+void page_put(struct page *page);
+uint32_t pmem_order_for(size_t count);
+uint64_t pmem_early_alloc(size_t size);
+void pmem_set_early_limit(uint64_t limit);
+void pmem_free_init_memory(void);
+int pmem_deferred_init(void);
+bool zero_pool_refill(void);
+
 /* Virtual memory management */
 void *vmem_map_page(uint64_t vaddr, uint64_t paddr, uint64_t flags);
 void vmem_unmap_page(uint64_t vaddr);
 uint64_t vmem_get_physical_addr(uint64_t vaddr);
 bool vmem_is_mapped(uint64_t vaddr);
+int vmem_init(uint64_t phys_limit);
+void *vmem_map_phys(uint64_t paddr, uint64_t size, uint64_t flags);
+void *ioremap(uint64_t paddr, uint64_t size);
+bool vmem_direct_mapped(uint64_t paddr, uint64_t size);
 
 /* Kernel heap management */
 void *kmalloc(size_t size);
@@ -68,6 +157,89 @@ void *kzalloc(size_t size);
 void *krealloc(void *ptr, size_t size);
 void kfree(void *ptr);
 
+/* Kernel heap size classes: 16 bytes .. 2KB in power-of-two steps */
+#define KMALLOC_MIN_SHIFT           4
+#define KMALLOC_MAX_SHIFT           11
+#define KMALLOC_CLASSES             (KMALLOC_MAX_SHIFT - KMALLOC_MIN_SHIFT + 1)
+
+/* mmap protection and flags (POSIX values) */
+#define PROT_NONE                   0x0
+#define PROT_READ                   0x1
+#define PROT_WRITE                  0x2
+#define PROT_EXEC                   0x4
+
+#define MAP_SHARED                  0x01
+#define MAP_PRIVATE                 0x02
+#define MAP_FIXED                   0x10
+#define MAP_ANONYMOUS               0x20
+#define MAP_POPULATE                0x8000
+
+/* Virtual memory area flags */
+#define VMA_READ                    (1 << 0)
+#define VMA_WRITE                   (1 << 1)
+#define VMA_EXEC                    (1 << 2)
+#define VMA_SHARED                  (1 << 3)
+#define VMA_ANON                    (1 << 4)
+
+/* Pages mapped around a file-backed fault when already cached */
+#define FAULT_AROUND_PAGES          16
+
+/*
+ * Virtual memory area - a contiguous range of user addresses with uniform
+ * protection and backing. Areas are kept sorted by start address.
+ */
+struct vm_area {
+    uint64_t start;
+    uint64_t end;               /* Exclusive */
+    uint32_t flags;
+    struct inode *inode;        /* Backing file, NULL for anonymous memory */
+    uint64_t pgoff;             /* File offset of start, in pages */
+    struct vm_space *space;
+    struct vm_area *next;
+};
+
+/*
+ * Address space - one page table hierarchy plus the areas describing it.
+ * Nothing is populated at mmap time; page frames appear on first touch.
+ */
+struct vm_space {
+    uint64_t pml4;              /* Physical address of the top-level table */
+    struct vm_area *areas;
+    struct vm_area *area_cache; /* Last area returned by vma_find */
+    atomic_t users;
+    uint64_t resident_pages;
+};
+
+/* Address space that the page fault handler resolves against */
+extern struct vm_space *current_vm_space;
+
+/* Address spaces */
+struct vm_space *vm_space_create(void);
+void vm_space_destroy(struct vm_space *space);
+void vm_space_activate(struct vm_space *space);
+struct vm_area *vma_find(struct vm_space *space, uint64_t addr);
+void vma_insert(struct vm_space *space, struct vm_area *vma);
+void vma_free(struct vm_area *vma);
+int vm_map_user_page(struct vm_space *space, uint64_t vaddr, struct page *page, uint32_t vma_flags, bool writable);
+void vm_unmap_range(struct vm_space *space, uint64_t start, uint64_t end);
+uint64_t *vm_lookup_pte(struct vm_space *space, uint64_t vaddr, bool create);
+uint64_t vm_protection_bits(uint32_t vma_flags, bool writable);
+void vm_flush_page(struct vm_space *space, uint64_t vaddr);
+
+/* Memory mappings */
+int64_t vm_mmap(struct vm_space *space, uint64_t addr, uint64_t length,
+                int prot, int flags, struct inode *inode, uint64_t offset);
+int vm_munmap(struct vm_space *space, uint64_t addr, uint64_t length);
+int vm_handle_fault(struct vm_space *space, uint64_t addr, uint32_t error);
+
+/* User memory access */
+bool user_range_ok(uint64_t addr, size_t length, bool write);
+int copy_from_user(void *dest, const void *user_src, size_t length);
+int copy_to_user(void *user_dest, const void *src, size_t length);
+int64_t strncpy_from_user(char *dest, const char *user_src, size_t max);
+int vm_copy_to_space(struct vm_space *space, uint64_t uaddr, const void *src, size_t length);
+int vm_clear_space(struct vm_space *space, uint64_t uaddr, size_t length);
+
 /* Memory utility functions */
 void *memset(void *dest, int c, size_t n);
 void *memcpy(void *dest, const void *src, size_t n);
@@ -84,6 +256,41 @@ static inline uint64_t phys_to_virt(uint64_t paddr)
     return paddr + KERNEL_VIRTUAL_BASE;
 }
 
+static inline void *phys_to_direct(uint64_t paddr)
+{
+    return (void *)(paddr + DIRECT_MAP_BASE);
+}
+
+static inline uint64_t direct_to_phys(const void *vaddr)
+{
+    return (uint64_t)vaddr - DIRECT_MAP_BASE;
+}
+
+static inline struct page *phys_to_page(uint64_t paddr)
+{
+    return &mem_map[paddr >> 12];
+}
+
+static inline uint64_t page_to_phys(const struct page *page)
+{
+    return (uint64_t)(page - mem_map) << 12;
+}
+
+static inline void *page_address(const struct page *page)
+{
+    return phys_to_direct(page_to_phys(page));
+}
+
+static inline struct page *virt_to_page(const void *vaddr)
+{
+    return phys_to_page(direct_to_phys(vaddr));
+}
+
+static inline void page_get(struct page *page)
+{
+    atomic_inc(&page->refcount);
+}
+
 static inline uint64_t page_align_down(uint64_t addr)
 {
     return addr & ~PAGE_MASK;
@@ -7,6 +7,7 @@
 #define _MULTIBOOT2_H
 
 #include "stdint.h"
+#include "stddef.h"
 
 /* Multiboot2 magic values */
 #define MULTIBOOT2_BOOTLOADER_MAGIC     0x36d76289
@@ -32,6 +33,13 @@
 #define MULTIBOOT_TAG_TYPE_NETWORK              16
 #define MULTIBOOT_TAG_TYPE_EFI_MMAP             17
 #define MULTIBOOT_TAG_TYPE_EFI_BS               18
+#define MULTIBOOT_TAG_TYPE_EFI32_IH             19
+#define MULTIBOOT_TAG_TYPE_EFI64_IH             20
+#define MULTIBOOT_TAG_TYPE_LOAD_BASE_ADDR       21
+#define MULTIBOOT_TAG_TYPE_COUNT                22
+
+/* Tags the index holds; later ones are still found, just not indexed */
+#define MULTIBOOT_TAG_INDEX_MAX                 64
 
 /* Legacy tag type aliases for compatibility */
 #define MULTIBOOT_TAG_TYPE_MEMORY       MULTIBOOT_TAG_TYPE_MMAP
@@ -99,9 +107,20 @@ struct multiboot_tag_mmap {
     struct multiboot_mmap_entry entries[0];
 };
 
+/*
+ * Tag index built by one walk of the tag list, grouped by type so that
+ * lookups are an array access instead of another walk.
+ */
+struct multiboot_tag_index {
+    struct multiboot_info *info;
+    struct multiboot_tag *tags[MULTIBOOT_TAG_INDEX_MAX];
+    uint8_t first[MULTIBOOT_TAG_TYPE_COUNT];    /* Into tags[] */
+    uint8_t count[MULTIBOOT_TAG_TYPE_COUNT];
+};
+
 /* Function prototypes */
 int multiboot2_parse_info(struct multiboot_info *info);
 struct multiboot_tag *multiboot2_find_tag(struct multiboot_info *info, uint32_t type);
-void multiboot2_print_info(struct multiboot_info *info);
+struct multiboot_tag *const *multiboot2_find_tags(uint32_t type, size_t *count);
 
 #endif /* _MULTIBOOT2_H */
@@ -0,0 +1,63 @@
+/*
+ * Power1 OS - NUMA Topology
+ * Memory nodes from the ACPI SRAT/SLIT and allocation policies
+ */
+
+#ifndef _NUMA_H
+#define _NUMA_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+
+#define NUMA_MAX_NODES          8
+#define NUMA_MAX_RANGES         32      /* SRAT memory affinity entries kept */
+
+#define NUMA_LOCAL_DISTANCE     10      /* SLIT value of a node to itself */
+#define NUMA_REMOTE_DISTANCE    20      /* Assumed without a SLIT */
+
+/* Memory policy modes (set_mempolicy numbering) */
+#define MPOL_DEFAULT            0       /* Local node first, then nearest */
+#define MPOL_PREFERRED          1       /* One node first, then nearest to it */
+#define MPOL_BIND               2       /* Only the given nodes */
+#define MPOL_INTERLEAVE         3       /* Round-robin over the given nodes */
+
+/* Per-task policy; zero-initialised tasks get MPOL_DEFAULT */
+struct mempolicy {
+    uint32_t mode;
+    uint32_t nodes;             /* Node mask for every mode but DEFAULT */
+    uint32_t interleave_next;   /* Last node interleave used */
+};
+
+/* Allocation counters of one node */
+struct numa_node_stats {
+    uint64_t local;             /* Wanted here by a CPU of this node */
+    uint64_t remote;            /* Wanted here by a CPU of another node */
+    uint64_t interleave;        /* Placed here by an interleave policy */
+    uint64_t miss;              /* Served here because the wanted node was full */
+};
+
+struct numa_node_info {
+    uint64_t total_pages;
+    uint64_t free_pages;
+    struct numa_node_stats stats;
+};
+
+extern unsigned int numa_node_count;
+
+/* Topology */
+int numa_init(void);
+uint32_t numa_node_of_phys(uint64_t paddr);
+uint32_t numa_cpu_node(unsigned int cpu);
+uint8_t numa_distance(uint32_t from, uint32_t to);
+const uint8_t *numa_fallback_order(uint32_t node);
+
+/* Policies */
+int mempolicy_set(struct mempolicy *policy, uint32_t mode, uint32_t nodes);
+uint32_t mempolicy_first_node(struct mempolicy *policy, uint32_t local);
+
+/* Statistics */
+int numa_node_info(uint32_t node, struct numa_node_info *info);
+void numa_report(void);
+
+#endif /* _NUMA_H */
@@ -0,0 +1,127 @@
+/*
+ * Power1 OS - NVMe Definitions
+ * Controller registers, submission and completion queue entries
+ */
+
+#ifndef _NVME_H
+#define _NVME_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+#include "spinlock.h"
+#include "devices.h"
+#include "pci.h"
+
+#define NVME_PCI_CLASS          0x01    /* Mass storage */
+#define NVME_PCI_SUBCLASS       0x08    /* Non-volatile memory */
+
+/* Controller registers */
+#define NVME_REG_CAP            0x00
+#define NVME_REG_VS             0x08
+#define NVME_REG_INTMS          0x0C
+#define NVME_REG_INTMC          0x10
+#define NVME_REG_CC             0x14
+#define NVME_REG_CSTS           0x1C
+#define NVME_REG_AQA            0x24
+#define NVME_REG_ASQ            0x28
+#define NVME_REG_ACQ            0x30
+#define NVME_REG_DOORBELL       0x1000
+
+#define NVME_CAP_MQES(cap)      ((uint32_t)((cap) & 0xFFFF) + 1)
+#define NVME_CAP_TIMEOUT(cap)   ((uint32_t)(((cap) >> 24) & 0xFF))     /* 500ms units */
+#define NVME_CAP_DSTRD(cap)     ((uint32_t)(((cap) >> 32) & 0xF))
+#define NVME_CAP_MPSMIN(cap)    ((uint32_t)(((cap) >> 48) & 0xF))
+
+#define NVME_CC_ENABLE          (1 << 0)
+#define NVME_CC_IOSQES          (6 << 16)   /* 64-byte submission entries */
+#define NVME_CC_IOCQES          (4 << 20)   /* 16-byte completion entries */
+#define NVME_CSTS_RDY           (1 << 0)
+#define NVME_CSTS_CFS           (1 << 1)
+
+/* Admin opcodes */
+#define NVME_ADMIN_CREATE_SQ    0x01
+#define NVME_ADMIN_CREATE_CQ    0x05
+#define NVME_ADMIN_IDENTIFY     0x06
+#define NVME_ADMIN_SET_FEATURES 0x09
+
+/* I/O opcodes */
+#define NVME_CMD_FLUSH          0x00
+#define NVME_CMD_WRITE          0x01
+#define NVME_CMD_READ           0x02
+
+/* Identify CNS values */
+#define NVME_ID_NAMESPACE       0x00
+#define NVME_ID_CONTROLLER      0x01
+
+/* Feature identifiers */
+#define NVME_FEAT_NUM_QUEUES    0x07
+#define NVME_FEAT_IRQ_COALESCE  0x08
+#define NVME_FEAT_IRQ_CONFIG    0x09
+
+/* Queue creation flags (CDW11) */
+#define NVME_QUEUE_CONTIGUOUS   (1 << 0)
+#define NVME_CQ_IRQ_ENABLED     (1 << 1)
+
+/* Command flags: PSDT selects PRPs or SGLs for the data pointer */
+#define NVME_CMD_PSDT_SGL       (1 << 6)
+
+/* SGL descriptor types (upper nibble of the identifier byte) */
+#define NVME_SGL_DATA_BLOCK     0x00
+#define NVME_SGL_LAST_SEGMENT   0x30
+
+/* Submission queue entry */
+struct nvme_command {
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t command_id;
+    uint32_t nsid;
+    uint64_t reserved;
+    uint64_t metadata;
+    uint64_t prp1;              /* Or the first half of an SGL descriptor */
+    uint64_t prp2;
+    uint32_t cdw10;
+    uint32_t cdw11;
+    uint32_t cdw12;
+    uint32_t cdw13;
+    uint32_t cdw14;
+    uint32_t cdw15;
+};
+
+/* Completion queue entry */
+struct nvme_completion {
+    uint32_t result;
+    uint32_t reserved;
+    uint16_t sq_head;
+    uint16_t sq_id;
+    uint16_t command_id;
+    uint16_t status;            /* Bit 0 is the phase tag */
+};
+
+struct nvme_sgl_desc {
+    uint64_t addr;
+    uint32_t length;
+    uint8_t reserved[3];
+    uint8_t type;
+};
+
+/* Identify data offsets */
+#define NVME_ID_CTRL_MDTS       77
+#define NVME_ID_CTRL_NN         516
+#define NVME_ID_CTRL_SGLS       536
+#define NVME_ID_NS_NSZE         0
+#define NVME_ID_NS_FLBAS        26
+#define NVME_ID_NS_LBAF         128
+
+/* ioctl commands */
+#define NVME_IOCTL_SET_COALESCING   0x4E01
+
+/* Interrupt coalescing: a threshold of 0 completions turns it off */
+struct nvme_coalescing {
+    uint8_t threshold;          /* Completions per interrupt */
+    uint8_t time;               /* Longest delay, 100us units */
+};
+
+int nvme_init(void);
+
+#endif /* _NVME_H */
@@ -0,0 +1,140 @@
+/*
+ * Power1 OS - PCI Definitions
+ * PCI/PCIe configuration space, enumeration and driver binding
+ */
+
+#ifndef _PCI_H
+#define _PCI_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+#include "list.h"
+#include "devices.h"
+#include "interrupts.h"
+
+#define PCI_ANY_ID              0xFFFF
+#define PCI_ANY_CLASS           0xFF
+#define PCI_MAX_BARS            6
+#define PCI_MAX_BUSES           256
+#define PCI_MAX_SLOTS           32
+#define PCI_MAX_FUNCTIONS       8
+#define PCI_CONFIG_SIZE         4096    /* Extended (PCIe) config space */
+
+/* Type 0 configuration header */
+#define PCI_VENDOR_ID           0x00
+#define PCI_DEVICE_ID           0x02
+#define PCI_COMMAND             0x04
+#define PCI_STATUS              0x06
+#define PCI_REVISION_ID         0x08
+#define PCI_PROG_IF             0x09
+#define PCI_SUBCLASS            0x0A
+#define PCI_CLASS_CODE          0x0B
+#define PCI_HEADER_TYPE         0x0E
+#define PCI_BAR0                0x10
+#define PCI_SECONDARY_BUS       0x19    /* Type 1 (bridge) header */
+#define PCI_CAPABILITY_LIST     0x34
+#define PCI_INTERRUPT_LINE      0x3C
+
+#define PCI_COMMAND_IO          (1 << 0)
+#define PCI_COMMAND_MEMORY      (1 << 1)
+#define PCI_COMMAND_MASTER      (1 << 2)
+#define PCI_COMMAND_INTX_DISABLE (1 << 10)
+#define PCI_STATUS_CAP_LIST     (1 << 4)
+
+#define PCI_HEADER_TYPE_MASK    0x7F
+#define PCI_HEADER_MULTIFUNC    0x80
+#define PCI_HEADER_BRIDGE       0x01
+
+#define PCI_CLASS_BRIDGE        0x06
+#define PCI_SUBCLASS_PCI_BRIDGE 0x04
+
+/* BAR encoding */
+#define PCI_BAR_IO              0x01
+#define PCI_BAR_MEM_TYPE_64     0x04
+#define PCI_BAR_PREFETCH        0x08
+
+/* Capabilities */
+#define PCI_CAP_ID_VENDOR       0x09
+#define PCI_CAP_ID_MSIX         0x11
+
+/* MSI-X capability and table layout */
+#define PCI_MSIX_CONTROL        0x02
+#define PCI_MSIX_TABLE          0x04
+#define PCI_MSIX_CONTROL_ENABLE (1 << 15)
+#define PCI_MSIX_CONTROL_MASK   (1 << 14)
+#define PCI_MSIX_TABLE_SIZE     0x07FF
+#define PCI_MSIX_BIR_MASK       0x7
+#define PCI_MSIX_ENTRY_SIZE     16
+#define PCI_MSIX_ENTRY_ADDR_LO  0x0
+#define PCI_MSIX_ENTRY_ADDR_HI  0x4
+#define PCI_MSIX_ENTRY_DATA     0x8
+#define PCI_MSIX_ENTRY_CTRL     0xC
+#define PCI_MSIX_ENTRY_MASKED   (1 << 0)
+#define PCI_MSI_ADDRESS_BASE    0xFEE00000
+
+struct pci_driver;
+
+/* One PCI function */
+struct pci_device {
+    struct device dev;                  /* Registered once a driver binds */
+    struct list_head list;
+    uint16_t segment;
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t function;
+    uint8_t header_type;
+    uint16_t vendor_id;
+    uint16_t device_id;
+    uint8_t class_code;
+    uint8_t subclass;
+    uint8_t prog_if;
+    uint8_t revision;
+    volatile uint8_t *config;           /* ECAM window, NULL for port I/O */
+    uint64_t bar_base[PCI_MAX_BARS];
+    uint64_t bar_size[PCI_MAX_BARS];
+    uint8_t bar_flags[PCI_MAX_BARS];
+    volatile uint8_t *msix_table;
+    uint16_t msix_count;                /* Entries enabled */
+    uint8_t msix_cap;
+    int *msix_vectors;                  /* CPU vector per entry, 0 if unbound */
+    struct pci_driver *driver;
+};
+
+/* Driver match entry; a zero vendor terminates the table */
+struct pci_device_id {
+    uint16_t vendor;
+    uint16_t device;
+    uint8_t class_code;
+    uint8_t subclass;
+};
+
+struct pci_driver {
+    const char *name;
+    const struct pci_device_id *id_table;
+    int (*probe)(struct pci_device *pdev, const struct pci_device_id *id);
+    struct pci_driver *next;
+};
+
+/* Function prototypes */
+int pci_init(void);
+int pci_register_driver(struct pci_driver *driver);
+struct pci_device *pci_find_device(uint16_t vendor, uint16_t device, struct pci_device *from);
+
+uint8_t pci_config_read8(struct pci_device *pdev, uint16_t offset);
+uint16_t pci_config_read16(struct pci_device *pdev, uint16_t offset);
+uint32_t pci_config_read32(struct pci_device *pdev, uint16_t offset);
+void pci_config_write8(struct pci_device *pdev, uint16_t offset, uint8_t value);
+void pci_config_write16(struct pci_device *pdev, uint16_t offset, uint16_t value);
+void pci_config_write32(struct pci_device *pdev, uint16_t offset, uint32_t value);
+
+int pci_enable_device(struct pci_device *pdev);
+void *pci_map_bar(struct pci_device *pdev, int bar);
+uint8_t pci_find_capability(struct pci_device *pdev, uint8_t cap_id, uint8_t start);
+
+int pci_enable_msix(struct pci_device *pdev, unsigned int count);
+int pci_msix_bind(struct pci_device *pdev, unsigned int entry, irq_handler_t handler,
+                  void *data, unsigned int cpu);
+void pci_msix_mask(struct pci_device *pdev, unsigned int entry, bool masked);
+
+#endif /* _PCI_H */
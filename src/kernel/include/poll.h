@@ -0,0 +1,95 @@
+/*
+ * Power1 OS - Readiness Notification
+ * poll() events, the file poll hook and the epoll interface
+ *
+ * A file's poll operation reports its current readiness and, when given a
+ * poll table, registers the wait queues whose wakes may change it. poll()
+ * registers once per call; epoll registers once per interest and keeps a
+ * ready list that the wait queue callbacks fill, so epoll_wait only looks
+ * at descriptors that have had a wake since they were last reported.
+ */
+
+#ifndef _POLL_H
+#define _POLL_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+
+/* Events (Linux values; EPOLL* equal the POLL* of the same name) */
+#define POLLIN          0x0001
+#define POLLPRI         0x0002
+#define POLLOUT         0x0004
+#define POLLERR         0x0008
+#define POLLHUP         0x0010
+#define POLLNVAL        0x0020
+#define POLLRDNORM      0x0040
+#define POLLWRNORM      0x0100
+
+/* Reported whether asked for or not */
+#define POLL_ALWAYS     (POLLERR | POLLHUP | POLLNVAL)
+
+/* Readiness of files without a poll operation */
+#define DEFAULT_POLLMASK    (POLLIN | POLLOUT | POLLRDNORM | POLLWRNORM)
+
+#define EPOLLIN         POLLIN
+#define EPOLLPRI        POLLPRI
+#define EPOLLOUT        POLLOUT
+#define EPOLLERR        POLLERR
+#define EPOLLHUP        POLLHUP
+#define EPOLLRDNORM     POLLRDNORM
+#define EPOLLWRNORM     POLLWRNORM
+#define EPOLLONESHOT    (1U << 30)  /* Disarm after one report */
+#define EPOLLET         (1U << 31)  /* Report only on a new wake */
+
+#define EPOLL_CTL_ADD   1
+#define EPOLL_CTL_DEL   2
+#define EPOLL_CTL_MOD   3
+
+#define POLL_FDS_MAX    1024        /* Largest poll() set */
+#define EPOLL_EVENTS_MAX    1024    /* Most events one epoll_wait returns */
+
+struct pollfd {
+    int fd;
+    int16_t events;
+    int16_t revents;
+};
+
+/* Packed, as on Linux x86_64 */
+struct epoll_event {
+    uint32_t events;
+    uint64_t data;
+} __attribute__((packed));
+
+struct wait_queue;
+struct file_descriptor;
+
+/*
+ * Passed to a poll operation that should register for wakes; NULL when
+ * the caller only wants the current mask.
+ */
+struct poll_table {
+    void (*queue)(struct poll_table *pt, struct wait_queue *wq);
+};
+
+/**
+ * poll_wait - Register @wq with the caller of a poll operation
+ */
+static inline void poll_wait(struct wait_queue *wq, struct poll_table *pt)
+{
+    if (pt && pt->queue) {
+        pt->queue(pt, wq);
+    }
+}
+
+uint32_t vfs_poll(struct file_descriptor *file, struct poll_table *pt);
+int64_t do_poll(struct pollfd *fds, uint32_t nfds, int64_t timeout_ms);
+
+/* epoll */
+int eventpoll_create(struct file_descriptor **file);
+int eventpoll_ctl(struct file_descriptor *epfile, int op, int fd, const struct epoll_event *event);
+int64_t eventpoll_wait(struct file_descriptor *epfile, struct epoll_event *events,
+                       int maxevents, int64_t timeout_ms);
+void eventpoll_release(struct file_descriptor *file);
+
+#endif /* _POLL_H */
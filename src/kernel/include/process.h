@@ -0,0 +1,149 @@
+/*
+ * Power1 OS - Process Management Definitions
+ * Tasks, scheduling, wait queues and process creation
+ */
+
+#ifndef _PROCESS_H
+#define _PROCESS_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+#include "list.h"
+#include "atomic.h"
+#include "numa.h"
+
+struct vm_space;
+struct fd_table;
+struct inode;
+struct syscall_frame;
+struct blk_plug;
+struct worker;
+
+/* Task states */
+#define TASK_RUNNING            0   /* On the CPU */
+#define TASK_READY              1   /* On the run queue */
+#define TASK_BLOCKED            2   /* On a wait queue */
+#define TASK_ZOMBIE             3   /* Exited, waiting to be reaped */
+
+/* Task flags */
+#define TASK_KTHREAD            (1 << 0)    /* Kernel thread, no user context */
+#define TASK_VFORK              (1 << 1)    /* Borrowing its parent's address space */
+
+/* waitpid options */
+#define WNOHANG                 1
+
+/* Wait status encoding (POSIX layout) */
+#define TASK_WSTATUS_EXIT(code) (((code) & 0xFF) << 8)
+#define TASK_WSTATUS_SEGV       11          /* Killed by SIGSEGV */
+
+#define TASK_NAME_LEN           16
+#define EXEC_ARG_MAX            64          /* argv/envp entries */
+#define EXEC_AUXV_MAX           8           /* Format-supplied auxv pairs */
+
+/* Wait queue - tasks blocked until an event is signalled */
+struct wait_queue {
+    struct list_head waiters;
+    struct list_head callbacks;     /* struct wait_callback, run on every wake */
+};
+
+#define WAIT_QUEUE_INIT(name)   { LIST_HEAD_INIT((name).waiters), LIST_HEAD_INIT((name).callbacks) }
+
+/*
+ * Callback entry on a wait queue. Instead of sleeping, a waiter such as
+ * poll or epoll is told about every wake and decides itself what to do.
+ */
+struct wait_callback {
+    struct list_head entry;
+    void (*func)(struct wait_callback *cb);
+};
+
+/* Task control block */
+struct task {
+    uint32_t pid;
+    uint32_t state;
+    uint32_t flags;
+    int exit_code;
+    uint64_t context_rsp;               /* Saved by switch_context */
+    void *kernel_stack;                 /* KERNEL_STACK_SIZE bytes */
+    struct syscall_frame *user_frame;   /* Frame of the syscall in progress */
+    struct vm_space *vm;
+    struct fd_table *files;
+    struct task *parent;
+    struct list_head children;
+    struct list_head sibling;
+    struct list_head run_list;          /* Run queue or wait queue linkage */
+    struct list_head all_list;
+    struct wait_queue child_exit;       /* Parent sleeps here in waitpid */
+    struct wait_queue vfork_done;       /* vfork parent sleeps here */
+    struct blk_plug *plug;              /* Active block I/O plug */
+    struct mempolicy mempolicy;         /* Node placement of page allocations */
+    struct worker *worker;              /* Set for workqueue workers */
+    void *fpu_area;                     /* Saved FPU state, from first use */
+    char name[TASK_NAME_LEN];
+};
+
+/*
+ * Program image under construction for execve/spawn. The binary format
+ * loader maps the program into space and sets entry and any auxiliary
+ * vector entries; exec then builds the initial stack.
+ */
+struct exec_params {
+    struct inode *inode;
+    const char *path;
+    char **argv;                        /* Kernel copies */
+    char **envp;
+    int argc;
+    int envc;
+    struct vm_space *space;
+    uint64_t entry;
+    uint64_t stack_pointer;
+    uint64_t auxv[2 * EXEC_AUXV_MAX];   /* Type/value pairs from the format */
+    int auxc;
+};
+
+/* Executable format handler */
+struct binary_format {
+    const char *name;
+    int (*load)(struct exec_params *params);
+    struct binary_format *next;
+};
+
+extern struct task *current_task;
+
+/* Task lifecycle */
+int process_manager_init(void);
+struct task *task_alloc(const char *name);
+void task_free(struct task *task);
+struct task *task_find(uint32_t pid);
+struct task *kthread_create(const char *name, int (*fn)(void *), void *arg);
+void task_prepare_user_return(struct task *task, const struct syscall_frame *frame);
+void task_exit(int code) __attribute__((noreturn));
+void task_release_vfork(struct task *task);
+
+/* Scheduling */
+void schedule(void);
+void schedule_next_task(void);
+void scheduler_loop(void);
+void task_enqueue(struct task *task);
+void wait_queue_init(struct wait_queue *wq);
+void wait_queue_sleep(struct wait_queue *wq);
+bool wait_queue_sleep_timeout(struct wait_queue *wq, uint64_t deadline);
+void wait_queue_wake_all(struct wait_queue *wq);
+bool wait_queue_wake_one(struct wait_queue *wq);
+void wait_queue_add_callback(struct wait_queue *wq, struct wait_callback *cb);
+void wait_queue_remove_callback(struct wait_callback *cb);
+
+/* Process creation */
+int64_t process_fork(bool share_vm);
+struct vm_space *vm_space_fork(struct vm_space *parent);
+int64_t process_spawn(const char *path, char **argv, char **envp);
+int process_exec(const char *path, char **argv, char **envp);
+int64_t process_wait(int64_t pid, int *status, int options);
+int binfmt_register(struct binary_format *format);
+
+/* Low-level context switching (switch.asm) */
+void switch_context(uint64_t *prev_rsp, uint64_t next_rsp);
+extern void kthread_trampoline(void);
+
+#endif /* _PROCESS_H */
@@ -0,0 +1,67 @@
+/*
+ * Power1 OS - Red-Black Trees
+ * Intrusive balanced binary search trees
+ *
+ * Like the lists, a tree node is embedded in the object it orders and the
+ * caller does the searching: walk down comparing keys, then link the new
+ * node at the empty child found and let rb_insert_color rebalance.
+ *
+ *     struct rb_node **link = &root->node, *parent = NULL;
+ *     while (*link) {
+ *         parent = *link;
+ *         link = key < rb_entry(parent, struct item, node)->key ?
+ *                &parent->left : &parent->right;
+ *     }
+ *     rb_link_node(&item->node, parent, link);
+ *     rb_insert_color(&item->node, root);
+ */
+
+#ifndef _RBTREE_H
+#define _RBTREE_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+#include "list.h"
+
+#define RB_RED      0
+#define RB_BLACK    1
+
+struct rb_node {
+    struct rb_node *parent;
+    struct rb_node *left;
+    struct rb_node *right;
+    int color;
+};
+
+struct rb_root {
+    struct rb_node *node;
+};
+
+#define RB_ROOT                 { NULL }
+#define rb_entry(ptr, type, member)     container_of(ptr, type, member)
+
+static inline bool rb_empty(const struct rb_root *root)
+{
+    return root->node == NULL;
+}
+
+/**
+ * rb_link_node - Attach @node as a red leaf at @link below @parent
+ */
+static inline void rb_link_node(struct rb_node *node, struct rb_node *parent,
+                                struct rb_node **link)
+{
+    node->parent = parent;
+    node->left = NULL;
+    node->right = NULL;
+    node->color = RB_RED;
+    *link = node;
+}
+
+void rb_insert_color(struct rb_node *node, struct rb_root *root);
+void rb_erase(struct rb_node *node, struct rb_root *root);
+struct rb_node *rb_first(const struct rb_root *root);
+struct rb_node *rb_next(const struct rb_node *node);
+
+#endif /* _RBTREE_H */
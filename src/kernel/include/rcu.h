@@ -0,0 +1,68 @@
+/*
+ * Power1 OS - Read-Copy-Update
+ * Lock-free read-side access to pointer-linked data
+ *
+ * Readers bracket their accesses with rcu_read_lock/rcu_read_unlock and
+ * load shared pointers with rcu_dereference. Updaters publish fully
+ * initialised objects with rcu_assign_pointer, then either wait in
+ * synchronize_rcu or hand the old object to call_rcu/kfree_rcu before
+ * freeing anything a reader might still hold.
+ *
+ * The kernel is not preemptible, so a CPU cannot be inside a read-side
+ * section when it switches tasks or sits in the idle loop. Those points
+ * are its quiescent states: read-side sections are compiler barriers with
+ * no stores, and a grace period ends once every online CPU has passed
+ * through one. Callbacks queued while a grace period runs are batched
+ * behind the next one.
+ */
+
+#ifndef _RCU_H
+#define _RCU_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+#include "atomic.h"
+
+struct rcu_head;
+typedef void (*rcu_callback_t)(struct rcu_head *head);
+
+/* Embedded in objects freed through call_rcu */
+struct rcu_head {
+    struct rcu_head *next;
+    rcu_callback_t func;
+};
+
+/* kfree_rcu stores the rcu_head offset in func; real callbacks lie above */
+#define RCU_KFREE_OFFSET_MAX        4096
+
+static inline void rcu_read_lock(void)
+{
+    barrier();
+}
+
+static inline void rcu_read_unlock(void)
+{
+    barrier();
+}
+
+/* Load a pointer published with rcu_assign_pointer */
+#define rcu_dereference(p)          __atomic_load_n(&(p), __ATOMIC_CONSUME)
+
+/* Publish @v after its initialisation is visible */
+#define rcu_assign_pointer(p, v)    __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+/* kfree @ptr after a grace period; @field is its struct rcu_head member */
+#define kfree_rcu(ptr, field) \
+    call_rcu(&(ptr)->field, (rcu_callback_t)(uintptr_t)offsetof(__typeof__(*(ptr)), field))
+
+int rcu_init(void);
+void rcu_cpu_online(unsigned int cpu);
+void call_rcu(struct rcu_head *head, rcu_callback_t func);
+void synchronize_rcu(void);
+
+/* Quiescent state reporting from the scheduler and idle loop */
+void rcu_note_context_switch(void);
+bool rcu_idle(void);
+
+#endif /* _RCU_H */
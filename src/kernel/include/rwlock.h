@@ -0,0 +1,45 @@
+/*
+ * Power1 OS - Reader-Writer Locks
+ * Shared readers, exclusive writers, readers favoured
+ *
+ * Readers only wait while a writer actually holds the lock; a waiting
+ * writer does not hold new readers back. That suits the read-mostly
+ * tables this lock is meant for (routes, mounts, device lists) where
+ * updates are rare and may wait, but it can starve writers under a
+ * continuous stream of readers. Use a seqlock when readers can retry
+ * instead.
+ */
+
+#ifndef _RWLOCK_H
+#define _RWLOCK_H
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "atomic.h"
+#include "lockstat.h"
+
+#define RW_WRITER               0x80000000u     /* Held for writing */
+#define RW_READER               1u              /* One reader */
+
+typedef struct {
+    uint32_t value;             /* RW_WRITER | reader count */
+#ifdef LOCK_STAT
+    struct lock_stat stat;
+#endif
+} rwlock_t;
+
+#define RWLOCK_INIT             { 0 LOCK_STAT_INIT }
+
+static inline void rwlock_init(rwlock_t *lock)
+{
+    *lock = (rwlock_t)RWLOCK_INIT;
+}
+
+void read_lock(rwlock_t *lock);
+bool read_trylock(rwlock_t *lock);
+void read_unlock(rwlock_t *lock);
+void write_lock(rwlock_t *lock);
+bool write_trylock(rwlock_t *lock);
+void write_unlock(rwlock_t *lock);
+
+#endif /* _RWLOCK_H */
@@ -0,0 +1,55 @@
+/*
+ * Power1 OS - Self-Tests
+ * Kernel tests run once boot has finished
+ *
+ * Built only with -DSELFTEST (make selftest-build). Each test registers
+ * with selftest() in the .selftest section and returns KERNEL_SUCCESS or
+ * a negative error; SELFTEST_EXPECT records a failed condition and lets
+ * the test go on to clean up. selftest_run calls them in link order after
+ * the initcalls, from the boot context with the scheduler running, and
+ * prints one line per test on serial. A test may sleep, start threads
+ * and switch address spaces, but must leave things as it found them.
+ * Without SELFTEST nothing is registered and selftest_run is empty.
+ */
+
+#ifndef _SELFTEST_H
+#define _SELFTEST_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+#ifdef SELFTEST
+
+struct selftest {
+    const char *name;
+    int (*fn)(void);
+};
+
+/*
+ * selftest - Register @fn to run after boot
+ */
+#define selftest(fn)                                                        \
+    static const struct selftest __selftest_##fn                            \
+        __attribute__((used, section(".selftest"), aligned(8))) = {         \
+        #fn, fn                                                             \
+    }
+
+/* Fail the running test if @cond is false; evaluates to @cond */
+#define SELFTEST_EXPECT(cond)   selftest_expect((cond), #cond, __FILE__, __LINE__)
+
+/* Linker provided bounds */
+extern const struct selftest __selftest_start[];
+extern const struct selftest __selftest_end[];
+
+bool selftest_expect(bool ok, const char *expr, const char *file, int line);
+void selftest_run(void);
+
+#else /* !SELFTEST */
+
+static inline void selftest_run(void)
+{
+}
+
+#endif /* SELFTEST */
+
+#endif /* _SELFTEST_H */
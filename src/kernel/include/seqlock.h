@@ -0,0 +1,76 @@
+/*
+ * Power1 OS - Sequence Locks
+ * Writer-side lock, retry-based lockless readers
+ *
+ * Readers never write to the lock, so any number of them run in parallel
+ * without sharing a dirty cache line; they read a sequence number, copy
+ * the data and retry if a writer was active meanwhile. Writers serialise
+ * on a ticket spinlock and make the sequence odd while updating. Suits
+ * small, frequently read values such as clocks and statistics. Readers
+ * must not follow pointers read inside the section, since the data may
+ * change underneath them.
+ *
+ *     do {
+ *         seq = read_seqbegin(&lock);
+ *         copy = shared;
+ *     } while (read_seqretry(&lock, seq));
+ */
+
+#ifndef _SEQLOCK_H
+#define _SEQLOCK_H
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "atomic.h"
+#include "spinlock.h"
+
+typedef struct {
+    uint32_t sequence;          /* Odd while a writer is inside */
+    spinlock_t lock;
+} seqlock_t;
+
+#define SEQLOCK_INIT            { 0, SPINLOCK_INIT }
+
+static inline void seqlock_init(seqlock_t *sl)
+{
+    sl->sequence = 0;
+    spin_lock_init(&sl->lock);
+}
+
+/**
+ * read_seqbegin - Start a read section, waiting out an active writer
+ */
+static inline uint32_t read_seqbegin(const seqlock_t *sl)
+{
+    uint32_t seq;
+
+    while ((seq = __atomic_load_n(&sl->sequence, __ATOMIC_ACQUIRE)) & 1) {
+        cpu_relax();
+    }
+    return seq;
+}
+
+/**
+ * read_seqretry - True if a writer ran since read_seqbegin returned @start
+ */
+static inline bool read_seqretry(const seqlock_t *sl, uint32_t start)
+{
+    smp_rmb();
+    return __atomic_load_n(&sl->sequence, __ATOMIC_RELAXED) != start;
+}
+
+static inline void write_seqlock(seqlock_t *sl)
+{
+    spin_lock(&sl->lock);
+    __atomic_store_n(&sl->sequence, sl->sequence + 1, __ATOMIC_RELAXED);
+    smp_wmb();
+}
+
+static inline void write_sequnlock(seqlock_t *sl)
+{
+    smp_wmb();
+    __atomic_store_n(&sl->sequence, sl->sequence + 1, __ATOMIC_RELEASE);
+    spin_unlock(&sl->lock);
+}
+
+#endif /* _SEQLOCK_H */
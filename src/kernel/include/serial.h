@@ -0,0 +1,38 @@
+/*
+ * Power1 OS - Serial Port
+ * 16550 UART on COM1 for boot diagnostics
+ */
+
+#ifndef _SERIAL_H
+#define _SERIAL_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+
+#define SERIAL_COM1             0x3F8
+
+/* Register offsets from the port base */
+#define SERIAL_DATA             0       /* DLL while DLAB is set */
+#define SERIAL_IER              1       /* DLM while DLAB is set */
+#define SERIAL_FCR              2
+#define SERIAL_LCR              3
+#define SERIAL_MCR              4
+#define SERIAL_LSR              5
+
+#define SERIAL_LCR_8N1          0x03
+#define SERIAL_LCR_DLAB         0x80
+#define SERIAL_FCR_ENABLE       0xC7    /* Enable and clear, 14-byte threshold */
+#define SERIAL_MCR_LOOPBACK     0x1E
+#define SERIAL_MCR_NORMAL       0x0B    /* DTR, RTS, OUT2 */
+#define SERIAL_LSR_THRE         0x20
+
+#define SERIAL_BAUD_DIVISOR     1       /* 115200 baud */
+
+int serial_init(void);
+bool serial_present(void);
+void serial_putc(char c);
+void serial_write(const char *str);
+void serial_write_u64(uint64_t value, int width);
+
+#endif /* _SERIAL_H */
@@ -0,0 +1,65 @@
+/*
+ * Power1 OS - Softirqs and Tasklets
+ * Per-CPU deferred work run after hard interrupt handlers
+ *
+ * A hard interrupt handler acknowledges its device, queues what it found
+ * and raises a softirq; the softirq handlers then run once the outermost
+ * handler has returned, on the same CPU and in batches. Interrupts only
+ * arrive in user mode or while a CPU idles, so that point is as safe for
+ * kernel code as a syscall. Softirq handling at interrupt exit is capped;
+ * whatever is still pending then, and softirqs raised outside interrupt
+ * context, are left to the CPU's ksoftirqd thread.
+ *
+ * Tasklets are dynamically registered bottom halves multiplexed on
+ * TASKLET_SOFTIRQ. A tasklet runs on the CPU that scheduled it, never
+ * concurrently with itself, and once however often it was scheduled
+ * before it got to run.
+ */
+
+#ifndef _SOFTIRQ_H
+#define _SOFTIRQ_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+
+/* Softirqs, highest priority first */
+#define HI_SOFTIRQ              0
+#define BLOCK_SOFTIRQ           1
+#define TASKLET_SOFTIRQ         2
+#define NR_SOFTIRQS             3
+
+#define SOFTIRQ_MAX_RESTART     10      /* Rounds at interrupt exit before deferring */
+
+typedef void (*softirq_action_t)(void);
+
+/* Tasklet state bits */
+#define TASKLET_STATE_SCHED     (1 << 0)    /* Queued to run */
+#define TASKLET_STATE_RUN       (1 << 1)    /* Running */
+
+struct tasklet {
+    struct tasklet *next;
+    uint32_t state;
+    void (*func)(void *data);
+    void *data;
+};
+
+#define TASKLET_INIT(fn, arg)   { NULL, 0, (fn), (arg) }
+
+int softirq_init(void);
+void open_softirq(unsigned int nr, softirq_action_t action);
+void raise_softirq(unsigned int nr);
+
+/* Interrupt context tracking, around device interrupt handlers */
+void irq_enter(void);
+void irq_exit(void);
+bool in_hardirq(void);
+bool in_softirq(void);
+
+/* Tasklets */
+void tasklet_init(struct tasklet *t, void (*func)(void *data), void *data);
+void tasklet_schedule(struct tasklet *t);
+void tasklet_hi_schedule(struct tasklet *t);
+void tasklet_kill(struct tasklet *t);
+
+#endif /* _SOFTIRQ_H */
@@ -0,0 +1,117 @@
+/*
+ * Power1 OS - Spinlocks
+ * Busy-wait mutual exclusion for short critical sections
+ *
+ * Ticket locks: each locker takes the next ticket and waits for the owner
+ * field to reach it, so the lock is granted in FIFO order and no CPU can
+ * be starved by luckier neighbours. Waiters back off in proportion to
+ * their place in line, which keeps the cache line quiet enough that the
+ * handoff to the next ticket is not delayed by everyone further back.
+ * Locks that see heavy contention from many CPUs should use mcs_lock_t,
+ * where each waiter spins on its own line.
+ */
+
+#ifndef _SPINLOCK_H
+#define _SPINLOCK_H
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "atomic.h"
+#include "lockstat.h"
+
+typedef struct {
+    union {
+        uint32_t value;
+        struct {
+            uint16_t owner;     /* Ticket being served */
+            uint16_t next;      /* Next ticket to hand out */
+        } tickets;
+    };
+#ifdef LOCK_STAT
+    struct lock_stat stat;
+#endif
+} spinlock_t;
+
+#define SPINLOCK_INIT           { { 0 } LOCK_STAT_INIT }
+
+static inline void spin_lock_init(spinlock_t *lock)
+{
+    *lock = (spinlock_t)SPINLOCK_INIT;
+}
+
+static inline void spin_lock(spinlock_t *lock)
+{
+#ifdef LOCK_STAT
+    uint64_t start = lock_stat_now();
+#endif
+    uint16_t ticket = __atomic_fetch_add(&lock->tickets.next, 1, __ATOMIC_RELAXED);
+    uint16_t owner = __atomic_load_n(&lock->tickets.owner, __ATOMIC_ACQUIRE);
+#ifdef LOCK_STAT
+    bool contended = owner != ticket;
+#endif
+
+    while (owner != ticket) {
+        for (uint16_t ahead = (uint16_t)(ticket - owner); ahead; ahead--) {
+            cpu_relax();
+        }
+        owner = __atomic_load_n(&lock->tickets.owner, __ATOMIC_ACQUIRE);
+    }
+
+#ifdef LOCK_STAT
+    lock_stat_acquired(&lock->stat, &lock_class_spinlock, start, contended, true);
+#endif
+}
+
+/**
+ * spin_trylock - Take the lock only if nobody holds or waits for it
+ */
+static inline bool spin_trylock(spinlock_t *lock)
+{
+    uint32_t old = __atomic_load_n(&lock->value, __ATOMIC_RELAXED);
+
+    if ((old & 0xFFFF) != (old >> 16)) {
+        return false;
+    }
+    if (!__atomic_compare_exchange_n(&lock->value, &old, old + (1u << 16), false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return false;
+    }
+
+#ifdef LOCK_STAT
+    lock_stat_acquired(&lock->stat, &lock_class_spinlock, lock_stat_now(), false, true);
+#endif
+    return true;
+}
+
+static inline void spin_unlock(spinlock_t *lock)
+{
+#ifdef LOCK_STAT
+    lock_stat_released(&lock->stat);
+#endif
+    /* Only the holder writes owner, so a plain increment is enough */
+    __atomic_store_n(&lock->tickets.owner, (uint16_t)(lock->tickets.owner + 1),
+                     __ATOMIC_RELEASE);
+}
+
+static inline bool spin_is_locked(spinlock_t *lock)
+{
+    uint32_t value = __atomic_load_n(&lock->value, __ATOMIC_RELAXED);
+    return (value & 0xFFFF) != (value >> 16);
+}
+
+/* Variants for locks also taken from interrupt handlers */
+static inline uint64_t spin_lock_irqsave(spinlock_t *lock)
+{
+    uint64_t flags;
+    __asm__ volatile ("pushfq; pop %0; cli" : "=r" (flags) :: "memory");
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *lock, uint64_t flags)
+{
+    spin_unlock(lock);
+    __asm__ volatile ("push %0; popfq" :: "r" (flags) : "memory", "cc");
+}
+
+#endif /* _SPINLOCK_H */
@@ -27,6 +27,23 @@
 #define SYS_CHMOD       15
 #define SYS_LSEEK       19
 #define SYS_GETPID      20
+#define SYS_PIPE        42
+#define SYS_MMAP        90
+#define SYS_MUNMAP      91
+#define SYS_POLL        168
+#define SYS_SENDFILE    187
+#define SYS_VFORK       190
+#define SYS_FUTEX       240
+#define SYS_EPOLL_CREATE 254
+#define SYS_EPOLL_CTL   255
+#define SYS_EPOLL_WAIT  256
+#define SYS_SET_MEMPOLICY 276
+#define SYS_SPLICE      313
+#define SYS_SPAWN       400     /* Power1 extension: posix_spawn */
+#define SYS_CHANNEL_CREATE 401  /* Power1 extension: shared-memory channel */
+
+/* Size of the dispatch table */
+#define SYSCALL_MAX     512
 
 /* System call handler */
 struct syscall_frame {
@@ -42,11 +59,34 @@ int syscall_interface_init(void);
 uint64_t syscall_handler(struct syscall_frame *frame);
 
 /* Individual system call handlers */
-uint64_t sys_exit(int status);
+uint64_t sys_exit(int status) __attribute__((noreturn));
 uint64_t sys_fork(void);
+uint64_t sys_vfork(void);
+uint64_t sys_execve(const char *pathname, char *const argv[], char *const envp[]);
+uint64_t sys_spawn(const char *pathname, char *const argv[], char *const envp[]);
+uint64_t sys_waitpid(int64_t pid, int *status, int options);
+uint64_t sys_getpid(void);
 uint64_t sys_read(int fd, void *buf, size_t count);
 uint64_t sys_write(int fd, const void *buf, size_t count);
 uint64_t sys_open(const char *pathname, int flags, int mode);
 uint64_t sys_close(int fd);
+uint64_t sys_pipe(int *fds);
+uint64_t sys_splice(int fd_in, int64_t *off_in, int fd_out, int64_t *off_out,
+                    size_t len, unsigned int flags);
+uint64_t sys_sendfile(int out_fd, int in_fd, int64_t *offset, size_t count);
+uint64_t sys_mmap(void *addr, size_t length, int prot, int flags, int fd, uint64_t offset);
+uint64_t sys_munmap(void *addr, size_t length);
+struct timespec;
+uint64_t sys_futex(uint32_t *uaddr, int op, uint32_t val, const struct timespec *timeout,
+                   uint32_t *uaddr2, uint32_t val3);
+struct pollfd;
+struct epoll_event;
+uint64_t sys_poll(struct pollfd *fds, uint32_t nfds, int timeout);
+uint64_t sys_epoll_create(int size);
+uint64_t sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+uint64_t sys_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout);
+uint64_t sys_channel_create(const char *name, uint32_t payload_size, uint32_t slot_count,
+                            uint32_t flags);
+uint64_t sys_set_mempolicy(int mode, const unsigned long *nodemask, unsigned long maxnode);
 
 #endif /* _SYSCALL_H */
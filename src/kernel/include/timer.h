@@ -0,0 +1,61 @@
+/*
+ * Power1 OS - Timers
+ * Monotonic clock and one-shot kernel timers
+ */
+
+#ifndef _TIMER_H
+#define _TIMER_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+#include "list.h"
+
+#define NSEC_PER_USEC           1000ULL
+#define NSEC_PER_MSEC           1000000ULL
+#define NSEC_PER_SEC            1000000000ULL
+
+/* PIT channel 2, used to measure the TSC when CPUID does not report it */
+#define PIT_FREQUENCY           1193182
+#define PIT_CHANNEL2            0x42
+#define PIT_COMMAND             0x43
+#define PIT_GATE_PORT           0x61
+
+struct timer;
+typedef void (*timer_fn_t)(struct timer *timer);
+
+/*
+ * One-shot timer. The callback runs from the timer interrupt with
+ * interrupts disabled, so it may wake tasks but not sleep.
+ */
+struct timer {
+    struct list_head entry;     /* Pending list, sorted by expiry */
+    uint64_t expires;           /* clock_ns() deadline */
+    timer_fn_t fn;
+    void *data;
+    unsigned int cpu;           /* Base holding the timer while pending */
+};
+
+/* POSIX timespec, as passed by user space */
+struct timespec {
+    int64_t tv_sec;
+    int64_t tv_nsec;
+};
+
+/* Clock */
+uint64_t clock_ns(void);
+uint64_t clock_tsc_khz(void);
+
+/* Timers */
+int timer_subsystem_init(void);
+void timer_init(struct timer *timer, timer_fn_t fn, void *data);
+void timer_add(struct timer *timer, uint64_t expires);
+bool timer_del(struct timer *timer);
+uint64_t timer_next_expiry(void);
+
+static inline bool timer_pending(const struct timer *timer)
+{
+    return !list_empty(&timer->entry);
+}
+
+#endif /* _TIMER_H */
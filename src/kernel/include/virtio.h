@@ -0,0 +1,160 @@
+/*
+ * Power1 OS - Virtio Definitions
+ * Virtio 1.x PCI transport and split virtqueues
+ */
+
+#ifndef _VIRTIO_H
+#define _VIRTIO_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+#include "spinlock.h"
+#include "pci.h"
+
+#define VIRTIO_PCI_VENDOR               0x1AF4
+
+/* Device status bits */
+#define VIRTIO_STATUS_ACKNOWLEDGE       1
+#define VIRTIO_STATUS_DRIVER            2
+#define VIRTIO_STATUS_DRIVER_OK         4
+#define VIRTIO_STATUS_FEATURES_OK       8
+#define VIRTIO_STATUS_FAILED            128
+
+/* Transport feature bits */
+#define VIRTIO_F_RING_INDIRECT_DESC     28
+#define VIRTIO_F_RING_EVENT_IDX         29
+#define VIRTIO_F_VERSION_1              32
+
+/* Virtio PCI vendor capability types */
+#define VIRTIO_PCI_CAP_COMMON_CFG       1
+#define VIRTIO_PCI_CAP_NOTIFY_CFG       2
+#define VIRTIO_PCI_CAP_ISR_CFG          3
+#define VIRTIO_PCI_CAP_DEVICE_CFG       4
+
+#define VIRTIO_MSI_NO_VECTOR            0xFFFF
+
+struct virtio_pci_cap {
+    uint8_t cap_vndr;
+    uint8_t cap_next;
+    uint8_t cap_len;
+    uint8_t cfg_type;
+    uint8_t bar;
+    uint8_t id;
+    uint8_t padding[2];
+    uint32_t offset;
+    uint32_t length;
+} __attribute__((packed));
+
+/* Naturally aligned, so no packing is needed */
+struct virtio_pci_common_cfg {
+    uint32_t device_feature_select;
+    uint32_t device_feature;
+    uint32_t driver_feature_select;
+    uint32_t driver_feature;
+    uint16_t msix_config;
+    uint16_t num_queues;
+    uint8_t device_status;
+    uint8_t config_generation;
+    uint16_t queue_select;
+    uint16_t queue_size;
+    uint16_t queue_msix_vector;
+    uint16_t queue_enable;
+    uint16_t queue_notify_off;
+    uint64_t queue_desc;
+    uint64_t queue_driver;
+    uint64_t queue_device;
+};
+
+/* Split ring layout */
+#define VRING_DESC_F_NEXT               1
+#define VRING_DESC_F_WRITE              2
+#define VRING_DESC_F_INDIRECT           4
+
+#define VRING_AVAIL_F_NO_INTERRUPT      1
+
+struct vring_desc {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+};
+
+struct vring_avail {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];            /* Followed by used_event */
+};
+
+struct vring_used_elem {
+    uint32_t id;
+    uint32_t len;
+};
+
+struct vring_used {
+    uint16_t flags;
+    uint16_t idx;
+    struct vring_used_elem ring[];  /* Followed by avail_event */
+};
+
+/* Transport state of one virtio PCI function */
+struct virtio_device {
+    struct pci_device *pdev;
+    volatile struct virtio_pci_common_cfg *common;
+    volatile uint8_t *notify_base;
+    uint32_t notify_multiplier;
+    volatile uint8_t *isr;
+    volatile uint8_t *device_cfg;
+    uint64_t features;          /* Negotiated */
+};
+
+/*
+ * One split virtqueue. A buffer chain handed to virtqueue_add occupies a
+ * single ring descriptor when it is an indirect table, so with
+ * VIRTIO_F_RING_INDIRECT_DESC the ring holds as many requests as it has
+ * entries regardless of their segment count.
+ */
+struct virtqueue {
+    struct virtio_device *vdev;
+    uint16_t index;
+    uint16_t size;
+    uint16_t free_head;
+    uint16_t num_free;
+    uint16_t avail_idx;         /* Shadow of avail->idx */
+    uint16_t last_used_idx;
+    uint16_t kicked_idx;        /* avail_idx at the last notification */
+    bool event_idx;
+    bool indirect;
+    struct vring_desc *desc;
+    struct vring_avail *avail;
+    struct vring_used *used;
+    volatile uint16_t *notify;
+    void **tokens;              /* Caller cookie per head descriptor */
+    spinlock_t lock;
+};
+
+/* Transport */
+int virtio_pci_init(struct virtio_device *vdev, struct pci_device *pdev);
+int virtio_negotiate(struct virtio_device *vdev, uint64_t wanted);
+void virtio_driver_ok(struct virtio_device *vdev);
+void virtio_fail(struct virtio_device *vdev);
+
+static inline bool virtio_has_feature(struct virtio_device *vdev, unsigned int bit)
+{
+    return vdev->features & (1ULL << bit);
+}
+
+/* Virtqueues */
+struct virtqueue *virtqueue_create(struct virtio_device *vdev, uint16_t index,
+                                   uint16_t max_size, uint16_t msix_entry);
+int virtqueue_add(struct virtqueue *vq, struct vring_desc *chain, uint16_t count, void *token);
+bool virtqueue_kick_prepare(struct virtqueue *vq);
+void virtqueue_notify(struct virtqueue *vq);
+void *virtqueue_get_buf(struct virtqueue *vq, uint32_t *length);
+bool virtqueue_enable_cb(struct virtqueue *vq);
+void virtqueue_disable_cb(struct virtqueue *vq);
+
+/* Drivers */
+int virtio_blk_init(void);
+
+#endif /* _VIRTIO_H */
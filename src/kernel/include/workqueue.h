@@ -0,0 +1,72 @@
+/*
+ * Power1 OS - Workqueues
+ * Deferred work run in process context by per-CPU worker pools
+ *
+ * Work items queued on a CPU are run by that CPU's pool of kernel
+ * threads. The pool keeps exactly one worker running while it has work:
+ * when the running worker blocks inside a work function, the scheduler
+ * tells the pool and an idle worker takes over, and workers that find
+ * another one already running go back to idle. Items calling the same
+ * function are taken together and run back to back.
+ *
+ * Work functions may sleep. queue_work may be called from any context,
+ * including interrupt handlers and softirqs.
+ */
+
+#ifndef _WORKQUEUE_H
+#define _WORKQUEUE_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+#include "atomic.h"
+#include "list.h"
+#include "process.h"
+
+#define WQ_MAX_WORKERS          16      /* Workers one pool may grow to */
+#define WQ_IDLE_MAX             2       /* Idle workers kept, the rest exit */
+#define WQ_BATCH_MAX            16      /* Same-function items run together */
+#define WQ_BATCH_SCAN           32      /* Queue entries examined for a batch */
+
+/* Work item flags */
+#define WORK_PENDING            (1 << 0)    /* Queued, not yet started */
+
+struct work_struct;
+typedef void (*work_func_t)(struct work_struct *work);
+
+struct work_struct {
+    struct list_head entry;
+    work_func_t func;
+    struct workqueue *wq;
+    uint32_t flags;
+};
+
+/* Groups work items for flushing */
+struct workqueue {
+    const char *name;
+    atomic_t nr_pending;        /* Queued or running items */
+    struct wait_queue flush_wait;
+};
+
+extern struct workqueue *system_wq;
+
+int workqueue_init(void);
+struct workqueue *alloc_workqueue(const char *name);
+void destroy_workqueue(struct workqueue *wq);
+
+void work_init(struct work_struct *work, work_func_t func);
+bool queue_work(struct workqueue *wq, struct work_struct *work);
+bool queue_work_on(unsigned int cpu, struct workqueue *wq, struct work_struct *work);
+void flush_workqueue(struct workqueue *wq);
+void flush_work(struct work_struct *work);
+
+static inline bool schedule_work(struct work_struct *work)
+{
+    return queue_work(system_wq, work);
+}
+
+/* Scheduler hooks for workers */
+void wq_worker_sleeping(struct task *task);
+void wq_worker_waking(struct task *task);
+
+#endif /* _WORKQUEUE_H */
@@ -0,0 +1,64 @@
+/*
+ * Power1 OS - Non-Temporal Page Clearing
+ * movnti from general registers, or the SIMD kernels inside one FPU region
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/memory.h"
+#include "../include/cpu.h"
+#include "../include/fpu.h"
+#include "../include/alternative.h"
+#include "../include/clear_page.h"
+
+/**
+ * clear_pages_movnti - Four 8-byte movnti stores per iteration
+ */
+static void clear_pages_movnti(void *const *pages, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        uint64_t *p = pages[i];
+        uint64_t *end = p + PAGE_SIZE / sizeof(uint64_t);
+
+        for (; p < end; p += 4) {
+            __asm__ volatile ("movnti %1, 0(%0)\n\t"
+                              "movnti %1, 8(%0)\n\t"
+                              "movnti %1, 16(%0)\n\t"
+                              "movnti %1, 24(%0)"
+                              :: "r" (p), "r" (0UL) : "memory");
+        }
+    }
+}
+
+static void clear_pages_sse_fpu(void *const *pages, size_t count)
+{
+    kernel_fpu_begin();
+    for (size_t i = 0; i < count; i++) {
+        clear_page_nt_sse(pages[i]);
+    }
+    kernel_fpu_end();
+}
+
+static void clear_pages_avx2_fpu(void *const *pages, size_t count)
+{
+    kernel_fpu_begin();
+    for (size_t i = 0; i < count; i++) {
+        clear_page_nt_avx2(pages[i]);
+    }
+    kernel_fpu_end();
+}
+
+static void (*clear_pages_impl)(void *const *pages, size_t count) = clear_pages_movnti;
+alternative(clear_pages_impl, clear_pages_sse_fpu, X86_FEATURE_SSE4_2, 1);
+alternative(clear_pages_impl, clear_pages_avx2_fpu, X86_FEATURE_AVX2, 2);
+
+/**
+ * clear_pages_nt - Zero the @count pages at @pages with non-temporal stores
+ *
+ * The caller fences with sfence before the pages are used.
+ */
+void clear_pages_nt(void *const *pages, size_t count)
+{
+    clear_pages_impl(pages, count);
+}
@@ -0,0 +1,123 @@
+/*
+ * Power1 OS - Lock Statistics
+ * Per-class counters behind the LOCK_STAT build option
+ *
+ * Counters are updated with relaxed atomics and no lock of their own, so
+ * accounting never adds a serialisation point to the lock it measures.
+ * Classes link themselves into the report list on first use.
+ */
+
+#ifdef LOCK_STAT
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/lockstat.h"
+#include "../include/serial.h"
+
+DEFINE_LOCK_CLASS(lock_class_spinlock, "spinlock");
+DEFINE_LOCK_CLASS(lock_class_mcs, "mcs");
+DEFINE_LOCK_CLASS(lock_class_rwlock, "rwlock");
+
+static struct lock_class *lock_classes = NULL;
+
+/**
+ * lock_class_register - Add @class to the report list once
+ */
+static void lock_class_register(struct lock_class *class)
+{
+    if (__atomic_load_n(&class->registered, __ATOMIC_RELAXED) ||
+        __atomic_exchange_n(&class->registered, true, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+
+    struct lock_class *head = __atomic_load_n(&lock_classes, __ATOMIC_RELAXED);
+    do {
+        class->next = head;
+    } while (!__atomic_compare_exchange_n(&lock_classes, &head, class, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/**
+ * lock_stat_max - Raise *max to @value if it is larger
+ */
+static void lock_stat_max(uint64_t *max, uint64_t value)
+{
+    uint64_t old = __atomic_load_n(max, __ATOMIC_RELAXED);
+
+    while (value > old &&
+           !__atomic_compare_exchange_n(max, &old, value, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/**
+ * lock_stat_acquired - Account one acquisition
+ * @fallback: Class of locks that were never given one
+ * @wait_start: TSC when the caller started trying
+ * @exclusive: Record the start of a hold for lock_stat_released
+ */
+void lock_stat_acquired(struct lock_stat *stat, struct lock_class *fallback,
+                        uint64_t wait_start, bool contended, bool exclusive)
+{
+    uint64_t now = cpu_read_tsc();
+
+    if (!stat->class) {
+        stat->class = fallback;
+    }
+    struct lock_class *class = stat->class;
+
+    lock_class_register(class);
+    __atomic_add_fetch(&class->acquisitions, 1, __ATOMIC_RELAXED);
+    if (contended) {
+        __atomic_add_fetch(&class->contentions, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&class->wait_cycles, now - wait_start, __ATOMIC_RELAXED);
+        lock_stat_max(&class->max_wait, now - wait_start);
+    }
+    if (exclusive) {
+        stat->acquired_at = now;
+    }
+}
+
+/**
+ * lock_stat_released - Account the hold that ends now
+ */
+void lock_stat_released(struct lock_stat *stat)
+{
+    struct lock_class *class = stat->class;
+    uint64_t held = cpu_read_tsc() - stat->acquired_at;
+
+    if (!class) {
+        return;
+    }
+    __atomic_add_fetch(&class->holds, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&class->hold_cycles, held, __ATOMIC_RELAXED);
+    lock_stat_max(&class->max_hold, held);
+}
+
+/**
+ * lock_stat_report - Print every class that has been used over serial
+ */
+void lock_stat_report(void)
+{
+    serial_write("\nLock statistics (TSC cycles)\n"
+                 "    acquired  contended   avg wait   max wait   avg hold   max hold  class\n");
+
+    for (struct lock_class *class = __atomic_load_n(&lock_classes, __ATOMIC_ACQUIRE);
+         class; class = class->next) {
+        uint64_t acquired = class->acquisitions;
+        uint64_t contended = class->contentions;
+
+        serial_write_u64(acquired, 12);
+        serial_write_u64(contended, 11);
+        serial_write_u64(contended ? class->wait_cycles / contended : 0, 11);
+        serial_write_u64(class->max_wait, 11);
+        serial_write_u64(class->holds ? class->hold_cycles / class->holds : 0, 11);
+        serial_write_u64(class->max_hold, 11);
+        serial_write("  ");
+        serial_write(class->name);
+        serial_write("\n");
+    }
+}
+
+#endif /* LOCK_STAT */
@@ -0,0 +1,83 @@
+/*
+ * Power1 OS - MCS Queued Locks
+ * Queue insertion and handoff for mcs_lock_t
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/mcs_lock.h"
+
+/**
+ * mcs_lock - Join the queue and spin on @node until the lock is handed over
+ * @node: Caller storage, valid until mcs_unlock
+ */
+void mcs_lock(mcs_lock_t *lock, struct mcs_node *node)
+{
+#ifdef LOCK_STAT
+    uint64_t start = lock_stat_now();
+#endif
+    node->next = NULL;
+    node->locked = false;
+
+    struct mcs_node *prev = __atomic_exchange_n(&lock->tail, node, __ATOMIC_ACQ_REL);
+    if (prev) {
+        /* Publish ourselves to the predecessor, then wait on our own line */
+        __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+        while (!__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE)) {
+            cpu_relax();
+        }
+    }
+
+#ifdef LOCK_STAT
+    lock_stat_acquired(&lock->stat, &lock_class_mcs, start, prev != NULL, true);
+#endif
+}
+
+/**
+ * mcs_trylock - Take the lock only if it is free
+ */
+bool mcs_trylock(mcs_lock_t *lock, struct mcs_node *node)
+{
+    struct mcs_node *expected = NULL;
+
+    node->next = NULL;
+    node->locked = false;
+
+    if (!__atomic_compare_exchange_n(&lock->tail, &expected, node, false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return false;
+    }
+
+#ifdef LOCK_STAT
+    lock_stat_acquired(&lock->stat, &lock_class_mcs, lock_stat_now(), false, true);
+#endif
+    return true;
+}
+
+/**
+ * mcs_unlock - Release the lock, handing it straight to the next waiter
+ */
+void mcs_unlock(mcs_lock_t *lock, struct mcs_node *node)
+{
+#ifdef LOCK_STAT
+    lock_stat_released(&lock->stat);
+#endif
+
+    struct mcs_node *next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+    if (!next) {
+        /* No known successor: try to mark the queue empty */
+        struct mcs_node *expected = node;
+        if (__atomic_compare_exchange_n(&lock->tail, &expected, NULL, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            return;
+        }
+
+        /* A waiter swapped itself in but has not linked to us yet */
+        while (!(next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE))) {
+            cpu_relax();
+        }
+    }
+
+    __atomic_store_n(&next->locked, true, __ATOMIC_RELEASE);
+}
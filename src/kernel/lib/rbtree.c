@@ -0,0 +1,258 @@
+/*
+ * Power1 OS - Red-Black Trees
+ * Rebalancing after insertion and removal
+ *
+ * Leaves are NULL and count as black. Every operation is O(log n) and
+ * performs at most three rotations.
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/rbtree.h"
+
+static inline bool rb_is_red(const struct rb_node *node)
+{
+    return node && node->color == RB_RED;
+}
+
+/**
+ * rb_replace_child - Make @parent point at @new_child where it had @old
+ */
+static void rb_replace_child(struct rb_root *root, struct rb_node *parent,
+                             struct rb_node *old, struct rb_node *new_child)
+{
+    if (!parent) {
+        root->node = new_child;
+    } else if (parent->left == old) {
+        parent->left = new_child;
+    } else {
+        parent->right = new_child;
+    }
+}
+
+static void rb_rotate_left(struct rb_root *root, struct rb_node *node)
+{
+    struct rb_node *pivot = node->right;
+
+    node->right = pivot->left;
+    if (pivot->left) {
+        pivot->left->parent = node;
+    }
+    pivot->parent = node->parent;
+    rb_replace_child(root, node->parent, node, pivot);
+    pivot->left = node;
+    node->parent = pivot;
+}
+
+static void rb_rotate_right(struct rb_root *root, struct rb_node *node)
+{
+    struct rb_node *pivot = node->left;
+
+    node->left = pivot->right;
+    if (pivot->right) {
+        pivot->right->parent = node;
+    }
+    pivot->parent = node->parent;
+    rb_replace_child(root, node->parent, node, pivot);
+    pivot->right = node;
+    node->parent = pivot;
+}
+
+/**
+ * rb_insert_color - Restore the tree invariants after rb_link_node
+ */
+void rb_insert_color(struct rb_node *node, struct rb_root *root)
+{
+    struct rb_node *parent;
+
+    while ((parent = node->parent) && parent->color == RB_RED) {
+        struct rb_node *grandparent = parent->parent;
+
+        if (parent == grandparent->left) {
+            struct rb_node *uncle = grandparent->right;
+            if (rb_is_red(uncle)) {
+                uncle->color = RB_BLACK;
+                parent->color = RB_BLACK;
+                grandparent->color = RB_RED;
+                node = grandparent;
+                continue;
+            }
+            if (node == parent->right) {
+                rb_rotate_left(root, parent);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->color = RB_BLACK;
+            grandparent->color = RB_RED;
+            rb_rotate_right(root, grandparent);
+        } else {
+            struct rb_node *uncle = grandparent->left;
+            if (rb_is_red(uncle)) {
+                uncle->color = RB_BLACK;
+                parent->color = RB_BLACK;
+                grandparent->color = RB_RED;
+                node = grandparent;
+                continue;
+            }
+            if (node == parent->left) {
+                rb_rotate_right(root, parent);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->color = RB_BLACK;
+            grandparent->color = RB_RED;
+            rb_rotate_left(root, grandparent);
+        }
+    }
+    root->node->color = RB_BLACK;
+}
+
+/**
+ * rb_erase_color - Rebalance after removing a black node
+ * @node: Child that took the removed node's place, possibly NULL
+ * @parent: Its parent
+ */
+static void rb_erase_color(struct rb_node *node, struct rb_node *parent, struct rb_root *root)
+{
+    while (node != root->node && !rb_is_red(node)) {
+        if (node == parent->left) {
+            struct rb_node *sibling = parent->right;
+            if (rb_is_red(sibling)) {
+                sibling->color = RB_BLACK;
+                parent->color = RB_RED;
+                rb_rotate_left(root, parent);
+                sibling = parent->right;
+            }
+            if (!rb_is_red(sibling->left) && !rb_is_red(sibling->right)) {
+                sibling->color = RB_RED;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+            if (!rb_is_red(sibling->right)) {
+                sibling->left->color = RB_BLACK;
+                sibling->color = RB_RED;
+                rb_rotate_right(root, sibling);
+                sibling = parent->right;
+            }
+            sibling->color = parent->color;
+            parent->color = RB_BLACK;
+            sibling->right->color = RB_BLACK;
+            rb_rotate_left(root, parent);
+        } else {
+            struct rb_node *sibling = parent->left;
+            if (rb_is_red(sibling)) {
+                sibling->color = RB_BLACK;
+                parent->color = RB_RED;
+                rb_rotate_right(root, parent);
+                sibling = parent->left;
+            }
+            if (!rb_is_red(sibling->left) && !rb_is_red(sibling->right)) {
+                sibling->color = RB_RED;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+            if (!rb_is_red(sibling->left)) {
+                sibling->right->color = RB_BLACK;
+                sibling->color = RB_RED;
+                rb_rotate_left(root, sibling);
+                sibling = parent->left;
+            }
+            sibling->color = parent->color;
+            parent->color = RB_BLACK;
+            sibling->left->color = RB_BLACK;
+            rb_rotate_right(root, parent);
+        }
+        node = root->node;
+        break;
+    }
+    if (node) {
+        node->color = RB_BLACK;
+    }
+}
+
+/**
+ * rb_erase - Unlink @node from @root
+ */
+void rb_erase(struct rb_node *node, struct rb_root *root)
+{
+    struct rb_node *child;
+    struct rb_node *parent;
+    int color;
+
+    if (node->left && node->right) {
+        /* Put the in-order successor where @node was */
+        struct rb_node *next = node->right;
+        while (next->left) {
+            next = next->left;
+        }
+
+        child = next->right;
+        parent = next->parent;
+        color = next->color;
+
+        if (parent == node) {
+            parent = next;
+        } else {
+            if (child) {
+                child->parent = parent;
+            }
+            parent->left = child;
+            next->right = node->right;
+            node->right->parent = next;
+        }
+
+        next->parent = node->parent;
+        next->color = node->color;
+        next->left = node->left;
+        node->left->parent = next;
+        rb_replace_child(root, node->parent, node, next);
+    } else {
+        child = node->left ? node->left : node->right;
+        parent = node->parent;
+        color = node->color;
+
+        if (child) {
+            child->parent = parent;
+        }
+        rb_replace_child(root, parent, node, child);
+    }
+
+    if (color == RB_BLACK) {
+        rb_erase_color(child, parent, root);
+    }
+}
+
+/**
+ * rb_first - Leftmost (smallest) node, or NULL for an empty tree
+ */
+struct rb_node *rb_first(const struct rb_root *root)
+{
+    struct rb_node *node = root->node;
+
+    while (node && node->left) {
+        node = node->left;
+    }
+    return node;
+}
+
+/**
+ * rb_next - In-order successor of @node, or NULL after the last
+ */
+struct rb_node *rb_next(const struct rb_node *node)
+{
+    if (node->right) {
+        node = node->right;
+        while (node->left) {
+            node = node->left;
+        }
+        return (struct rb_node *)node;
+    }
+
+    while (node->parent && node == node->parent->right) {
+        node = node->parent;
+    }
+    return node->parent;
+}
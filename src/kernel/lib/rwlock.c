@@ -0,0 +1,125 @@
+/*
+ * Power1 OS - Reader-Writer Locks
+ * Reader-preferring rwlock_t on a single word
+ */
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/rwlock.h"
+
+/**
+ * read_trylock - Join the readers unless a writer holds the lock
+ *
+ * The reader count is raised first and backed out on failure, so readers
+ * never contend with each other on a compare-and-swap.
+ */
+bool read_trylock(rwlock_t *lock)
+{
+    uint32_t old = __atomic_fetch_add(&lock->value, RW_READER, __ATOMIC_ACQUIRE);
+
+    if (old & RW_WRITER) {
+        __atomic_fetch_sub(&lock->value, RW_READER, __ATOMIC_RELAXED);
+        return false;
+    }
+
+#ifdef LOCK_STAT
+    lock_stat_acquired(&lock->stat, &lock_class_rwlock, lock_stat_now(), false, false);
+#endif
+    return true;
+}
+
+/**
+ * read_lock - Take the lock shared, waiting only for a current writer
+ */
+void read_lock(rwlock_t *lock)
+{
+#ifdef LOCK_STAT
+    uint64_t start = lock_stat_now();
+    bool contended = false;
+#endif
+
+    for (;;) {
+        uint32_t old = __atomic_fetch_add(&lock->value, RW_READER, __ATOMIC_ACQUIRE);
+        if (!(old & RW_WRITER)) {
+            break;
+        }
+        __atomic_fetch_sub(&lock->value, RW_READER, __ATOMIC_RELAXED);
+
+#ifdef LOCK_STAT
+        contended = true;
+#endif
+        while (__atomic_load_n(&lock->value, __ATOMIC_RELAXED) & RW_WRITER) {
+            cpu_relax();
+        }
+    }
+
+#ifdef LOCK_STAT
+    lock_stat_acquired(&lock->stat, &lock_class_rwlock, start, contended, false);
+#endif
+}
+
+void read_unlock(rwlock_t *lock)
+{
+    __atomic_fetch_sub(&lock->value, RW_READER, __ATOMIC_RELEASE);
+}
+
+/**
+ * write_trylock - Take the lock exclusive if nobody holds it at all
+ */
+bool write_trylock(rwlock_t *lock)
+{
+    uint32_t expected = 0;
+
+    if (!__atomic_compare_exchange_n(&lock->value, &expected, RW_WRITER, false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return false;
+    }
+
+#ifdef LOCK_STAT
+    lock_stat_acquired(&lock->stat, &lock_class_rwlock, lock_stat_now(), false, true);
+#endif
+    return true;
+}
+
+/**
+ * write_lock - Take the lock exclusive once readers and writers are gone
+ *
+ * Waiting is read-only, so a writer spinning here does not slow down the
+ * readers it is waiting for.
+ */
+void write_lock(rwlock_t *lock)
+{
+#ifdef LOCK_STAT
+    uint64_t start = lock_stat_now();
+    bool contended = false;
+#endif
+
+    for (;;) {
+        uint32_t expected = 0;
+        if (__atomic_compare_exchange_n(&lock->value, &expected, RW_WRITER, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+
+#ifdef LOCK_STAT
+        contended = true;
+#endif
+        while (__atomic_load_n(&lock->value, __ATOMIC_RELAXED)) {
+            cpu_relax();
+        }
+    }
+
+#ifdef LOCK_STAT
+    lock_stat_acquired(&lock->stat, &lock_class_rwlock, start, contended, true);
+#endif
+}
+
+void write_unlock(rwlock_t *lock)
+{
+#ifdef LOCK_STAT
+    lock_stat_released(&lock->stat);
+#endif
+    /* Readers backing out may have the count briefly raised, so subtract */
+    __atomic_fetch_sub(&lock->value, RW_WRITER, __ATOMIC_RELEASE);
+}
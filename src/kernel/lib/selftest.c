@@ -0,0 +1,65 @@
+/*
+ * Power1 OS - Self-Tests
+ * Runner for the tests behind the SELFTEST build option
+ *
+ * Tests live under tests/, one file per subsystem, and find their way
+ * here through the .selftest section. A failed expectation is printed
+ * where it happens; the summary line counts the tests that failed.
+ */
+
+#ifdef SELFTEST
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/selftest.h"
+#include "../include/serial.h"
+
+static bool selftest_failed;
+
+/**
+ * selftest_expect - Record the outcome of one SELFTEST_EXPECT
+ */
+bool selftest_expect(bool ok, const char *expr, const char *file, int line)
+{
+    if (!ok) {
+        serial_write("    expected ");
+        serial_write(expr);
+        serial_write(" at ");
+        serial_write(file);
+        serial_write(":");
+        serial_write_u64((uint64_t)line, 0);
+        serial_write("\n");
+        selftest_failed = true;
+    }
+    return ok;
+}
+
+/**
+ * selftest_run - Run every registered test and print the results over serial
+ */
+void selftest_run(void)
+{
+    uint64_t failures = 0;
+
+    serial_write("\nSelf-tests\n");
+    for (const struct selftest *test = __selftest_start; test < __selftest_end; test++) {
+        selftest_failed = false;
+        if (test->fn() != KERNEL_SUCCESS) {
+            selftest_failed = true;
+        }
+        failures += selftest_failed;
+
+        serial_write(selftest_failed ? "  FAIL  " : "  ok    ");
+        serial_write(test->name);
+        serial_write("\n");
+    }
+
+    serial_write_u64(failures, 0);
+    serial_write(" of ");
+    serial_write_u64((uint64_t)(__selftest_end - __selftest_start), 0);
+    serial_write(" self-tests failed\n");
+}
+
+#endif /* SELFTEST */
@@ -0,0 +1,22 @@
+/*
+ * Power1 OS - Non-Temporal Page Clearing, AVX2
+ * Two 32-byte vmovntdq stores per 64-byte line
+ */
+
+#include "../../include/stdint.h"
+#include "../../include/stddef.h"
+#include "../../include/memory.h"
+#include "../../include/clear_page.h"
+
+typedef long long clear_vec_t __attribute__((vector_size(32)));
+
+void clear_page_nt_avx2(void *addr)
+{
+    const clear_vec_t zero = { 0 };
+    clear_vec_t *p = addr;
+
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(clear_vec_t); i += 2) {
+        __builtin_ia32_movntdq256(&p[i + 0], zero);
+        __builtin_ia32_movntdq256(&p[i + 1], zero);
+    }
+}
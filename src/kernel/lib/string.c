@@ -3,6 +3,11 @@
  * Basic string and memory functions for kernel
  */
 
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/cpu.h"
+#include "../include/alternative.h"
 #include "../include/string.h"
 
 /**
@@ -17,17 +22,40 @@ void *memset(void *dest, int c, size_t n)
     return dest;
 }
 
+/**
+ * memcpy_movsq - Copy quadwords with REP MOVSQ, then the tail bytewise
+ */
+static void *memcpy_movsq(void *dest, const void *src, size_t n)
+{
+    void *ret = dest;
+    size_t quads = n >> 3;
+    size_t tail = n & 7;
+
+    __asm__ volatile ("rep movsq" : "+D" (dest), "+S" (src), "+c" (quads) :: "memory");
+    __asm__ volatile ("rep movsb" : "+D" (dest), "+S" (src), "+c" (tail) :: "memory");
+    return ret;
+}
+
+/**
+ * memcpy_erms - One REP MOVSB, which ERMS microcode runs in full lines
+ */
+static void *memcpy_erms(void *dest, const void *src, size_t n)
+{
+    void *ret = dest;
+
+    __asm__ volatile ("rep movsb" : "+D" (dest), "+S" (src), "+c" (n) :: "memory");
+    return ret;
+}
+
+static void *(*memcpy_impl)(void *dest, const void *src, size_t n) = memcpy_movsq;
+alternative(memcpy_impl, memcpy_erms, X86_FEATURE_ERMS, 1);
+
 /**
  * memcpy - Copy memory area
  */
 void *memcpy(void *dest, const void *src, size_t n)
 {
-    unsigned char *d = (unsigned char *)dest;
-    const unsigned char *s = (const unsigned char *)src;
-    while (n--) {
-        *d++ = *s++;
-    }
-    return dest;
+    return memcpy_impl(dest, src, n);
 }
 
 /**
@@ -103,3 +131,34 @@ int strcmp(const char *s1, const char *s2)
     }
     return *(unsigned char *)s1 - *(unsigned char *)s2;
 }
+
+/**
+ * strncpy - Copy at most n bytes of a string, padding with NULs
+ */
+char *strncpy(char *dest, const char *src, size_t n)
+{
+    size_t i = 0;
+    for (; i < n && src[i]; i++) {
+        dest[i] = src[i];
+    }
+    for (; i < n; i++) {
+        dest[i] = '\0';
+    }
+    return dest;
+}
+
+/**
+ * strncmp - Compare at most n bytes of two strings
+ */
+int strncmp(const char *s1, const char *s2, size_t n)
+{
+    while (n && *s1 && (*s1 == *s2)) {
+        s1++;
+        s2++;
+        n--;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    return *(unsigned char *)s1 - *(unsigned char *)s2;
+}
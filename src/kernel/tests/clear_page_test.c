@@ -0,0 +1,68 @@
+/*
+ * Power1 OS - Page Clearing Self-Tests
+ * The version alternatives chose for this CPU, vector or not
+ */
+
+#ifdef SELFTEST
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/string.h"
+#include "../include/cpu.h"
+#include "../include/clear_page.h"
+#include "../include/selftest.h"
+
+#define CLEAR_TEST_FILL         0xA5
+
+/**
+ * clear_page_filled - True if all @bytes at @addr equal @value
+ */
+static bool clear_page_filled(const void *addr, size_t bytes, uint8_t value)
+{
+    const uint8_t *p = addr;
+
+    for (size_t i = 0; i < bytes; i++) {
+        if (p[i] != value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * clear_pages_nt_test - Clear the middle two of four pages, out of order
+ *
+ * The pages on either side must keep their contents, and a vector
+ * version must not leave the FPU open to the next user if it was closed.
+ */
+static int clear_pages_nt_test(void)
+{
+    struct page *block = page_alloc(2, 0);
+
+    if (!block) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    uint8_t *base = page_address(block);
+    void *pages[] = { base + 2 * PAGE_SIZE, base + PAGE_SIZE };
+
+    bool fpu_closed = cpu_read_cr0() & CR0_TS;
+
+    memset(base, CLEAR_TEST_FILL, 4 * PAGE_SIZE);
+    clear_pages_nt(pages, 2);
+    __asm__ volatile ("sfence" ::: "memory");
+
+    SELFTEST_EXPECT(clear_page_filled(base, PAGE_SIZE, CLEAR_TEST_FILL));
+    SELFTEST_EXPECT(clear_page_filled(base + PAGE_SIZE, 2 * PAGE_SIZE, 0));
+    SELFTEST_EXPECT(clear_page_filled(base + 3 * PAGE_SIZE, PAGE_SIZE, CLEAR_TEST_FILL));
+    SELFTEST_EXPECT(!fpu_closed || (cpu_read_cr0() & CR0_TS));
+
+    page_free(block, 2);
+    return KERNEL_SUCCESS;
+}
+selftest(clear_pages_nt_test);
+
+#endif /* SELFTEST */
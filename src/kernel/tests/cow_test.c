@@ -0,0 +1,138 @@
+/*
+ * Power1 OS - Copy-on-Write Self-Tests
+ * Kernel stores into user memory must not write through shared frames
+ *
+ * Both tests make the kernel write to a read-only user PTE the way a
+ * system call does, through the live mapping of the active space, and
+ * then look at the frames through the direct map.
+ */
+
+#ifdef SELFTEST
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/memory.h"
+#include "../include/fs.h"
+#include "../include/string.h"
+#include "../include/process.h"
+#include "../include/selftest.h"
+
+static const char cow_parent_data[] = "parent data";
+static const char cow_child_data[] = "child";
+
+/**
+ * cow_frame - Direct-map alias of the frame behind @uaddr in @space, or NULL
+ */
+static const char *cow_frame(struct vm_space *space, uint64_t uaddr)
+{
+    uint64_t *pte = vm_lookup_pte(space, uaddr, false);
+
+    if (!pte || !(*pte & PAGE_PRESENT)) {
+        return NULL;
+    }
+    return phys_to_direct(*pte & PAGE_ADDR_MASK);
+}
+
+/**
+ * cow_fork_read_test - read() from a pipe into a COW page in a forked child
+ */
+static int cow_fork_read_test(void)
+{
+    struct vm_space *saved = current_vm_space;
+    struct file_descriptor *ends[2];
+    struct vm_space *parent = vm_space_create();
+    struct vm_space *child = NULL;
+    int ret = KERNEL_ERROR_NOMEM;
+
+    if (!parent) {
+        return ret;
+    }
+
+    int64_t addr = vm_mmap(parent, 0, PAGE_SIZE, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, NULL, 0);
+    if (addr < 0 || vm_copy_to_space(parent, (uint64_t)addr, cow_parent_data,
+                                     sizeof(cow_parent_data)) != KERNEL_SUCCESS) {
+        goto out;
+    }
+    child = vm_space_fork(parent);
+    if (!child || pipe_create(ends, 0) != KERNEL_SUCCESS) {
+        goto out;
+    }
+
+    SELFTEST_EXPECT(vfs_write(ends[1], cow_child_data, sizeof(cow_child_data)) ==
+                    (ssize_t)sizeof(cow_child_data));
+
+    /* As sys_read in the child: pipe_read stores straight through the PTE */
+    vm_space_activate(child);
+    ssize_t got = vfs_read(ends[0], (void *)addr, sizeof(cow_child_data));
+    vm_space_activate(saved);
+
+    const char *mine = cow_frame(parent, (uint64_t)addr);
+    const char *theirs = cow_frame(child, (uint64_t)addr);
+
+    SELFTEST_EXPECT(got == (ssize_t)sizeof(cow_child_data));
+    SELFTEST_EXPECT(mine && theirs && mine != theirs);
+    if (mine && theirs) {
+        SELFTEST_EXPECT(!memcmp(mine, cow_parent_data, sizeof(cow_parent_data)));
+        SELFTEST_EXPECT(!memcmp(theirs, cow_child_data, sizeof(cow_child_data)));
+    }
+
+    file_put(ends[0]);
+    file_put(ends[1]);
+    ret = KERNEL_SUCCESS;
+out:
+    vm_space_destroy(child);
+    vm_space_destroy(parent);
+    return ret;
+}
+selftest(cow_fork_read_test);
+
+/**
+ * cow_private_file_test - copy_to_user into a MAP_PRIVATE file page
+ */
+static int cow_private_file_test(void)
+{
+    struct vm_space *saved = current_vm_space;
+    struct inode *inode = shmem_inode_create(PAGE_SIZE);
+    struct vm_space *space = vm_space_create();
+    int ret = KERNEL_ERROR_NOMEM;
+
+    if (!inode || !space) {
+        goto out;
+    }
+
+    struct page *cached = page_cache_get(inode, 0);
+    if (!cached) {
+        goto out;
+    }
+    memcpy(page_address(cached), cow_parent_data, sizeof(cow_parent_data));
+
+    int64_t addr = vm_mmap(space, 0, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE, inode, 0);
+    if (addr >= 0 && vm_handle_fault(space, (uint64_t)addr, PF_USER) == KERNEL_SUCCESS) {
+        /* The read fault maps the cache page itself, read-only */
+        SELFTEST_EXPECT(cow_frame(space, (uint64_t)addr) == page_address(cached));
+
+        vm_space_activate(space);
+        SELFTEST_EXPECT(copy_to_user((void *)addr, cow_child_data,
+                                     sizeof(cow_child_data)) == KERNEL_SUCCESS);
+        vm_space_activate(saved);
+
+        const char *private = cow_frame(space, (uint64_t)addr);
+        SELFTEST_EXPECT(private && private != (const char *)page_address(cached));
+        SELFTEST_EXPECT(!memcmp(page_address(cached), cow_parent_data, sizeof(cow_parent_data)));
+        if (private) {
+            SELFTEST_EXPECT(!memcmp(private, cow_child_data, sizeof(cow_child_data)));
+        }
+        ret = KERNEL_SUCCESS;
+    }
+    page_put(cached);
+out:
+    vm_space_destroy(space);
+    inode_put(inode);
+    return ret;
+}
+selftest(cow_private_file_test);
+
+#endif /* SELFTEST */
@@ -0,0 +1,72 @@
+/*
+ * Power1 OS - Workqueue Self-Tests
+ * Requeueing items that a worker has taken as one batch
+ */
+
+#ifdef SELFTEST
+
+#include "../include/stdint.h"
+#include "../include/stddef.h"
+#include "../include/stdbool.h"
+#include "../include/kernel.h"
+#include "../include/workqueue.h"
+#include "../include/selftest.h"
+
+struct wq_test_item {
+    struct work_struct work;
+    struct workqueue *wq;
+    struct wq_test_item *sibling;   /* Queued once from this item's first run */
+    bool requeued;                  /* What queue_work said about the sibling */
+    unsigned int runs;
+};
+
+static void wq_test_func(struct work_struct *work)
+{
+    struct wq_test_item *item = container_of(work, struct wq_test_item, work);
+
+    item->runs++;
+    if (item->sibling) {
+        item->requeued = queue_work(item->wq, &item->sibling->work);
+        item->sibling = NULL;
+    }
+}
+
+/**
+ * wq_requeue_sibling_test - A work function requeues items of its own batch
+ *
+ * Both items share a function, so one worker takes them together. The
+ * first asks for the second while it still waits on the batch, which
+ * must be refused; the second asks for the first, which has started and
+ * must run again.
+ */
+static int wq_requeue_sibling_test(void)
+{
+    struct workqueue *wq = alloc_workqueue("selftest");
+    struct wq_test_item first = { .wq = wq };
+    struct wq_test_item second = { .wq = wq };
+
+    if (!wq) {
+        return KERNEL_ERROR_NOMEM;
+    }
+
+    work_init(&first.work, wq_test_func);
+    work_init(&second.work, wq_test_func);
+    first.sibling = &second;
+    second.sibling = &first;
+
+    SELFTEST_EXPECT(queue_work(wq, &first.work));
+    SELFTEST_EXPECT(queue_work(wq, &second.work));
+    flush_workqueue(wq);
+
+    SELFTEST_EXPECT(!first.requeued);
+    SELFTEST_EXPECT(second.requeued);
+    SELFTEST_EXPECT(first.runs == 2);
+    SELFTEST_EXPECT(second.runs == 1);
+    SELFTEST_EXPECT(atomic_read(&wq->nr_pending) == 0);
+
+    destroy_workqueue(wq);
+    return KERNEL_SUCCESS;
+}
+selftest(wq_requeue_sibling_test);
+
+#endif /* SELFTEST */